@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "esphome/core/log.h"
+#include "frames.h"
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Topics of every (type, node, object_id) a bridge publishes for, built once on
+        // first sight into a string arena so later packets publish straight from it.
+        // Also remembers what went into the entity's discovery config, so that is only
+        // published again when it changes (or every DISCOVERY_REFRESH_MS, in case the
+        // broker lost its retained copy). The least recently used entity is evicted
+        // when either the slots or the arena run out; the arena is compacted then. An
+        // evicted entity's config hash is kept, so an entity that comes back unchanged
+        // doesn't publish its config again.
+        //
+        // Slots and arena are allocated by begin(), or at the default size by the first
+        // add(). Pointers into the arena are only good until the next add().
+        class EntityTable
+        {
+        public:
+            // 300 nodes with a sensor each, and their rssi
+            static const uint16_t DEFAULT_ENTITIES = 600;
+            static const uint16_t MIN_ENTITIES = 16;
+            // arena per slot: a state and a config topic with names of about 16 characters
+            static const size_t ARENA_PER_ENTITY = 96;
+            static const uint32_t DISCOVERY_REFRESH_MS = 3600000;
+
+            struct Entity
+            {
+                uint32_t hash;           // of type, node and object_id
+                uint32_t discovery_hash; // of the last published config, 0 = none yet
+                uint32_t announced;      // millis() of that config
+                uint32_t used;           // LRU clock
+                uint32_t offset;         // state topic, then config topic, in the arena
+                uint16_t size;
+                uint16_t config;         // config topic, relative to offset
+                uint8_t node_len;
+                uint8_t type_len;
+                bool active;
+            };
+
+            // Allocates max_entities slots and their arena, half as many at a time while
+            // memory is short. Returns the slots allocated, 0 if not even MIN_ENTITIES fit.
+            uint16_t begin(uint16_t max_entities = DEFAULT_ENTITIES)
+            {
+                this->entities_.reset();
+                this->retired_.reset();
+                this->arena_.reset();
+                for (; max_entities >= MIN_ENTITIES; max_entities /= 2)
+                {
+                    this->entities_.reset(new (std::nothrow) Entity[max_entities]());
+                    this->retired_.reset(new (std::nothrow) Retired[max_entities]());
+                    this->arena_.reset(new (std::nothrow) char[max_entities * ARENA_PER_ENTITY]);
+                    if (this->entities_ != nullptr && this->retired_ != nullptr && this->arena_ != nullptr)
+                        break;
+                    this->entities_.reset();
+                    this->retired_.reset();
+                    this->arena_.reset();
+                }
+                if (max_entities < MIN_ENTITIES)
+                    max_entities = 0;
+                this->max_entities_ = max_entities;
+                this->arena_size_ = max_entities * ARENA_PER_ENTITY;
+                this->arena_used_ = 0;
+                this->count_ = 0;
+                this->retired_next_ = 0;
+                this->allocated_ = true;
+                return max_entities;
+            }
+
+            Entity *find(const char *type, const char *node, const char *object_id)
+            {
+                uint32_t hash = key_hash(type, node, object_id);
+                for (uint16_t i = 0; i < this->max_entities_; i++)
+                {
+                    Entity &entity = this->entities_[i];
+                    if (entity.active && entity.hash == hash && this->matches_(entity, type, node, object_id))
+                    {
+                        entity.used = ++this->clock_;
+                        this->hits_++;
+                        return &entity;
+                    }
+                }
+                return nullptr;
+            }
+
+            // Interns an entity that find() didn't return. nullptr if its topics could
+            // never fit the arena.
+            Entity *add(const char *type, const char *node, const char *object_id, const char *prefix)
+            {
+                if (!this->allocated_)
+                    this->begin();
+                size_t node_len = strlen(node), type_len = strlen(type), object_len = strlen(object_id);
+                // node/type/object_id/state and prefix/type/node/object_id/config
+                size_t state_len = node_len + type_len + object_len + 9;
+                size_t size = state_len + strlen(prefix) + type_len + node_len + object_len + 12;
+                if (size > this->arena_size_ || size > 0xFFFF || node_len > 0xFF || type_len > 0xFF)
+                    return nullptr;
+                this->misses_++;
+
+                Entity *slot = nullptr;
+                for (uint16_t i = 0; i < this->max_entities_; i++)
+                {
+                    if (!this->entities_[i].active)
+                    {
+                        slot = &this->entities_[i];
+                        break;
+                    }
+                }
+                while (slot == nullptr || this->arena_used_ + size > this->arena_size_)
+                {
+                    Entity *victim = this->evict_();
+                    if (slot == nullptr)
+                        slot = victim;
+                }
+
+                char *block = this->arena_.get() + this->arena_used_;
+                snprintf(block, state_len + 1, "%s/%s/%s/state", node, type, object_id);
+                snprintf(block + state_len + 1, size - state_len - 1, "%s/%s/%s/%s/config", prefix, type, node, object_id);
+                slot->hash = key_hash(type, node, object_id);
+                slot->discovery_hash = 0;
+                slot->announced = 0;
+                this->restore_(slot);
+                slot->used = ++this->clock_;
+                slot->offset = this->arena_used_;
+                slot->size = size;
+                slot->config = state_len + 1;
+                slot->node_len = node_len;
+                slot->type_len = type_len;
+                slot->active = true;
+                this->arena_used_ += size;
+                this->count_++;
+                return slot;
+            }
+
+            const char *state_topic(const Entity *entity) const { return this->arena_.get() + entity->offset; }
+            const char *config_topic(const Entity *entity) const { return this->arena_.get() + entity->offset + entity->config; }
+
+            // True when the discovery config has to go out (and marks it as sent): first
+            // sight, a different config than last time, or the refresh is due.
+            bool needs_discovery(Entity *entity, uint32_t discovery_hash, uint32_t now)
+            {
+                if (discovery_hash == 0)
+                    discovery_hash = 1;
+                if (entity->discovery_hash == discovery_hash && now - entity->announced < DISCOVERY_REFRESH_MS)
+                    return false;
+                entity->discovery_hash = discovery_hash;
+                entity->announced = now;
+                return true;
+            }
+
+            // the config didn't make it out: try again with the next packet
+            void discovery_failed(Entity *entity) { entity->discovery_hash = 0; }
+
+            void log_stats(const char *tag) const
+            {
+                ESP_LOGD(tag, "Entity table: %u/%u entities, arena %u/%u bytes, hits=%lu, misses=%lu, evictions=%lu, restored=%lu",
+                         (unsigned)this->count_, (unsigned)this->max_entities_, (unsigned)this->arena_used_, (unsigned)this->arena_size_,
+                         (unsigned long)this->hits_, (unsigned long)this->misses_, (unsigned long)this->evictions_,
+                         (unsigned long)this->restored_);
+            }
+            uint16_t size() const { return this->count_; }
+            uint16_t capacity() const { return this->max_entities_; }
+            size_t arena_used() const { return this->arena_used_; }
+
+            static uint32_t key_hash(const char *type, const char *node, const char *object_id)
+            {
+                return fnv1a(object_id, fnv1a(node, fnv1a(type)));
+            }
+
+        protected:
+            // what an evicted entity's config was, by its key hash
+            struct Retired
+            {
+                uint32_t hash;
+                uint32_t discovery_hash; // 0 = unused
+                uint32_t announced;
+            };
+
+            // compares against the pieces of the stored state topic
+            bool matches_(const Entity &entity, const char *type, const char *node, const char *object_id) const
+            {
+                const char *topic = this->arena_.get() + entity.offset;
+                if (strncmp(topic, node, entity.node_len) != 0 || node[entity.node_len] != 0)
+                    return false;
+                topic += entity.node_len + 1;
+                if (strncmp(topic, type, entity.type_len) != 0 || type[entity.type_len] != 0)
+                    return false;
+                topic += entity.type_len + 1;
+                size_t object_len = strlen(object_id);
+                return strncmp(topic, object_id, object_len) == 0 && strcmp(topic + object_len, "/state") == 0;
+            }
+
+            // drops the least recently used entity and closes its gap in the arena
+            Entity *evict_()
+            {
+                Entity *victim = nullptr;
+                for (uint16_t i = 0; i < this->max_entities_; i++)
+                {
+                    Entity &entity = this->entities_[i];
+                    if (entity.active && (victim == nullptr || entity.used < victim->used))
+                        victim = &entity;
+                }
+                uint32_t offset = victim->offset, size = victim->size;
+                char *arena = this->arena_.get();
+                memmove(arena + offset, arena + offset + size, this->arena_used_ - offset - size);
+                this->arena_used_ -= size;
+                for (uint16_t i = 0; i < this->max_entities_; i++)
+                {
+                    Entity &entity = this->entities_[i];
+                    if (entity.active && entity.offset > offset)
+                        entity.offset -= size;
+                }
+                if (victim->discovery_hash != 0)
+                {
+                    // the oldest retired entry gives way
+                    this->retired_[this->retired_next_] = {victim->hash, victim->discovery_hash, victim->announced};
+                    this->retired_next_ = (this->retired_next_ + 1) % this->max_entities_;
+                }
+                victim->active = false;
+                this->count_--;
+                this->evictions_++;
+                return victim;
+            }
+
+            // picks up the config hash of an entity evicted earlier
+            void restore_(Entity *slot)
+            {
+                for (uint16_t i = 0; i < this->max_entities_; i++)
+                {
+                    Retired &retired = this->retired_[i];
+                    if (retired.discovery_hash != 0 && retired.hash == slot->hash)
+                    {
+                        slot->discovery_hash = retired.discovery_hash;
+                        slot->announced = retired.announced;
+                        retired.discovery_hash = 0;
+                        this->restored_++;
+                        return;
+                    }
+                }
+            }
+
+            std::unique_ptr<Entity[]> entities_;
+            std::unique_ptr<Retired[]> retired_;
+            std::unique_ptr<char[]> arena_;
+            uint16_t max_entities_{0};
+            size_t arena_size_{0};
+            size_t arena_used_{0};
+            bool allocated_{false};
+            uint16_t count_{0};
+            uint16_t retired_next_{0};
+            uint32_t clock_{0};
+            uint32_t hits_{0};
+            uint32_t misses_{0};
+            uint32_t evictions_{0};
+            uint32_t restored_{0};
+        };
+    } // namespace frame_codec
+} // namespace esphome
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Firmware images are multicast as blocks of FUOTA_BLOCK source fragments. A
+        // block goes out as its source fragments (index < FUOTA_BLOCK) followed by repair
+        // fragments: each the XOR of the source fragments a pseudo-random mask of block
+        // and index picks. Any FUOTA_BLOCK independent fragments give back the block, so
+        // a receiver only needs enough of them, not particular ones. A random code over
+        // GF(2) needs about 1.6 fragments more than that on average once repair fragments
+        // stand in for lost ones.
+        static const uint8_t FUOTA_BLOCK = 32;
+
+        inline uint32_t fountain_mask(uint16_t block, uint8_t index)
+        {
+            if (index < FUOTA_BLOCK)
+                return 1UL << index;
+            // murmur3 finalizer over (block, index)
+            uint32_t x = ((uint32_t)block << 8 | index) * 0x9E3779B9UL;
+            x ^= x >> 16;
+            x *= 0x85EBCA6BUL;
+            x ^= x >> 13;
+            x *= 0xC2B2AE35UL;
+            x ^= x >> 16;
+            return x != 0 ? x : 1UL << (index % FUOTA_BLOCK);
+        }
+
+        // fragment index of a block of FUOTA_BLOCK * fragment_size bytes
+        inline void fountain_encode(const uint8_t *block, size_t fragment_size, uint16_t block_index, uint8_t index, uint8_t *out)
+        {
+            uint32_t mask = fountain_mask(block_index, index);
+            memset(out, 0, fragment_size);
+            for (uint8_t source = 0; source < FUOTA_BLOCK; source++)
+            {
+                if (!(mask & (1UL << source)))
+                    continue;
+                const uint8_t *in = block + source * fragment_size;
+                for (size_t i = 0; i < fragment_size; i++)
+                    out[i] ^= in[i];
+            }
+        }
+
+        // Gaussian elimination as the fragments of a block come in: each is reduced by
+        // the rows already held and kept, under its lowest remaining source, if anything
+        // is left. Back substitution once all FUOTA_BLOCK rows are there turns the rows
+        // into the source fragments. Needs FUOTA_BLOCK + 1 fragments of memory.
+        class FountainDecoder
+        {
+        public:
+            bool begin(size_t fragment_size)
+            {
+                this->rows_.reset(new (std::nothrow) uint8_t[(FUOTA_BLOCK + 1) * fragment_size]);
+                this->fragment_size_ = fragment_size;
+                this->reset(0);
+                return this->rows_ != nullptr;
+            }
+            void end() { this->rows_.reset(); }
+
+            void reset(uint16_t block)
+            {
+                this->block_ = block;
+                this->pivots_ = 0;
+                this->rank_ = 0;
+            }
+            uint16_t block() const { return this->block_; }
+            uint8_t rank() const { return this->rank_; }
+            bool complete() const { return this->rank_ == FUOTA_BLOCK; }
+
+            // true once the block is complete; fragments that add nothing are dropped
+            bool add(uint8_t index, const uint8_t *payload)
+            {
+                if (this->complete())
+                    return true;
+                uint8_t *scratch = this->row_(FUOTA_BLOCK);
+                uint32_t mask = fountain_mask(this->block_, index);
+                memcpy(scratch, payload, this->fragment_size_);
+                while (mask != 0)
+                {
+                    uint8_t pivot = __builtin_ctz(mask);
+                    if (!(this->pivots_ & (1UL << pivot)))
+                    {
+                        memcpy(this->row_(pivot), scratch, this->fragment_size_);
+                        this->masks_[pivot] = mask;
+                        this->pivots_ |= 1UL << pivot;
+                        if (++this->rank_ == FUOTA_BLOCK)
+                            this->solve_();
+                        return this->complete();
+                    }
+                    mask ^= this->masks_[pivot];
+                    this->xor_row_(scratch, pivot);
+                }
+                return false;
+            }
+
+            // the block's FUOTA_BLOCK * fragment_size bytes, once complete
+            const uint8_t *data() const { return this->rows_.get(); }
+
+        protected:
+            uint8_t *row_(uint8_t index) { return this->rows_.get() + index * this->fragment_size_; }
+            void xor_row_(uint8_t *out, uint8_t index)
+            {
+                const uint8_t *in = this->row_(index);
+                for (size_t i = 0; i < this->fragment_size_; i++)
+                    out[i] ^= in[i];
+            }
+
+            // every row only has its pivot and higher sources left; clear them from the top
+            void solve_()
+            {
+                for (int pivot = FUOTA_BLOCK - 1; pivot >= 0; pivot--)
+                {
+                    uint32_t higher = this->masks_[pivot] & ~(1UL << pivot);
+                    while (higher != 0)
+                    {
+                        uint8_t source = __builtin_ctz(higher);
+                        this->xor_row_(this->row_(pivot), source);
+                        higher &= higher - 1;
+                    }
+                    this->masks_[pivot] = 1UL << pivot;
+                }
+            }
+
+            std::unique_ptr<uint8_t[]> rows_;
+            size_t fragment_size_{0};
+            uint32_t masks_[FUOTA_BLOCK]{};
+            uint32_t pivots_{0};
+            uint8_t rank_{0};
+            uint16_t block_{0};
+        };
+    } // namespace frame_codec
+} // namespace esphome
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Raw frame capture, pcap-like. A stream is a header followed by records; streams
+        // may be concatenated (every MQTT chunk starts with its own header), a reader just
+        // picks up the header again. All fields are little endian.
+        //
+        //   header: magic "LCAP" version sf coding_rate reserved bandwidth_hz (u32)
+        //   record: time_s (u32) time_us (u32) rssi_dbm (i16) snr_quarter_db (i8) flags len frame
+        //
+        // time is unix time with CAPTURE_WALL_TIME set, uptime otherwise. FLRC and GFSK
+        // captures have sf 0 and the bit rate in place of the bandwidth; FLRC has its
+        // coding rate, GFSK 0.
+        static const uint8_t CAPTURE_MAGIC[4] = {'L', 'C', 'A', 'P'};
+        static const uint8_t CAPTURE_VERSION = 1;
+        static const size_t CAPTURE_HEADER_SIZE = 12;
+        static const size_t CAPTURE_RECORD_HEADER_SIZE = 13;
+
+        static const uint8_t CAPTURE_WALL_TIME = 0x01;
+        static const uint8_t CAPTURE_UNSEALED = 0x02; // arrived sealed, this is the opened frame
+        static const uint8_t CAPTURE_SEALED = 0x04;   // arrived sealed and could not be opened
+
+        struct CaptureHeader
+        {
+            uint8_t sf{0};
+            uint8_t coding{0};
+            uint32_t bandwidth{0};
+        };
+
+        struct CaptureRecord
+        {
+            uint32_t time_s{0};
+            uint32_t time_us{0};
+            int16_t rssi{0};
+            int8_t snr_quarter_db{0};
+            uint8_t flags{0};
+            uint8_t len{0};
+            const uint8_t *frame{nullptr};
+
+            float snr() const { return this->snr_quarter_db / 4.0f; }
+        };
+
+        inline void capture_put_u32(uint8_t *out, uint32_t value)
+        {
+            out[0] = value;
+            out[1] = value >> 8;
+            out[2] = value >> 16;
+            out[3] = value >> 24;
+        }
+
+        inline uint32_t capture_get_u32(const uint8_t *in) { return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24; }
+
+        inline size_t capture_put_header(uint8_t *out, const CaptureHeader &header)
+        {
+            memcpy(out, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+            out[4] = CAPTURE_VERSION;
+            out[5] = header.sf;
+            out[6] = header.coding;
+            out[7] = 0;
+            capture_put_u32(out + 8, header.bandwidth);
+            return CAPTURE_HEADER_SIZE;
+        }
+
+        // writes CAPTURE_RECORD_HEADER_SIZE + record.len bytes
+        inline size_t capture_put_record(uint8_t *out, const CaptureRecord &record)
+        {
+            capture_put_u32(out, record.time_s);
+            capture_put_u32(out + 4, record.time_us);
+            out[8] = (uint16_t)record.rssi;
+            out[9] = (uint16_t)record.rssi >> 8;
+            out[10] = (uint8_t)record.snr_quarter_db;
+            out[11] = record.flags;
+            out[12] = record.len;
+            memcpy(out + CAPTURE_RECORD_HEADER_SIZE, record.frame, record.len);
+            return CAPTURE_RECORD_HEADER_SIZE + record.len;
+        }
+
+        // Walks a capture in memory. The records point into the buffer.
+        class CaptureReader
+        {
+        public:
+            CaptureReader(const uint8_t *data, size_t len) : data_(data), len_(len) {}
+
+            // false at the end or on a truncated record (see truncated())
+            bool next(CaptureRecord *record)
+            {
+                while (this->pos_ + CAPTURE_HEADER_SIZE <= this->len_ &&
+                       memcmp(this->data_ + this->pos_, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0)
+                {
+                    const uint8_t *in = this->data_ + this->pos_;
+                    this->header_.sf = in[5];
+                    this->header_.coding = in[6];
+                    this->header_.bandwidth = capture_get_u32(in + 8);
+                    this->version_ = in[4];
+                    this->pos_ += CAPTURE_HEADER_SIZE;
+                }
+                if (this->pos_ == this->len_)
+                    return false;
+                if (this->version_ != CAPTURE_VERSION || this->pos_ + CAPTURE_RECORD_HEADER_SIZE > this->len_)
+                {
+                    this->truncated_ = true;
+                    return false;
+                }
+                const uint8_t *in = this->data_ + this->pos_;
+                if (this->pos_ + CAPTURE_RECORD_HEADER_SIZE + in[12] > this->len_)
+                {
+                    this->truncated_ = true;
+                    return false;
+                }
+                record->time_s = capture_get_u32(in);
+                record->time_us = capture_get_u32(in + 4);
+                record->rssi = (int16_t)(in[8] | in[9] << 8);
+                record->snr_quarter_db = (int8_t)in[10];
+                record->flags = in[11];
+                record->len = in[12];
+                record->frame = in + CAPTURE_RECORD_HEADER_SIZE;
+                this->pos_ += CAPTURE_RECORD_HEADER_SIZE + record->len;
+                return true;
+            }
+
+            const CaptureHeader &header() const { return this->header_; }
+            bool truncated() const { return this->truncated_; }
+
+        protected:
+            const uint8_t *data_;
+            size_t len_;
+            size_t pos_{0};
+            uint8_t version_{0};
+            CaptureHeader header_;
+            bool truncated_{false};
+        };
+    } // namespace frame_codec
+} // namespace esphome
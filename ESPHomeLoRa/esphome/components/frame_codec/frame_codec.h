@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <ArduinoJson.h>
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/version.h"
+#include "frames.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+
+#ifdef USE_TEXT_SENSOR
+#include "esphome/components/text_sensor/text_sensor.h"
+#endif
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Text frame shared by every node and bridge:
+        //   node:device_class:state_class:object_id:unit:value:icon:version:board:kind:[seq]
+        // icon is "mdi:name" and so spans two tokens (both empty without an icon), binary
+        // sensors carry "binary_sensor" as their state class, text sensors leave the class
+        // tokens empty. The optional trailing seq asks a LoRa bridge for an ACK.
+        static const int LINE_TOKENS = 11;
+        static const int MAX_LINE_TOKENS = 13;
+
+        // One decoded (or to be encoded) line. On decode every field points into the
+        // caller's buffer, which is modified in place.
+        struct SensorLine
+        {
+            const char *node{""};
+            const char *device_class{""};
+            const char *state_class{""};
+            const char *object_id{""};
+            const char *unit{""};
+            const char *value{""};
+            const char *icon{""};
+            const char *version{ESPHOME_VERSION};
+            const char *board{ESPHOME_BOARD};
+            const char *kind{""};
+            const char *stamp{nullptr}; // two timestamp characters after TIMESTAMP_MARK
+            const char *seq{nullptr};   // ACK request, two hex characters
+
+            bool is_binary() const { return strcmp(this->state_class, "binary_sensor") == 0; }
+            const char *type() const { return this->is_binary() ? "binary_sensor" : "sensor"; }
+        };
+
+        // Transports differ only in how long a line may get and which optional tokens
+        // their bridges understand; the codec is instantiated once per transport.
+        struct LoRaTransport
+        {
+            static const size_t MAX_LINE = 255;
+            static const bool TIMESTAMPS = true;
+            static const bool ACKS = true;
+        };
+
+        struct NowTransport
+        {
+            static const size_t MAX_LINE = NOW_MAX_MESSAGE;
+            static const bool TIMESTAMPS = false;
+            static const bool ACKS = false;
+        };
+
+        // in-place split on ':' that keeps empty tokens, returns the token count or -1 if
+        // there are more than max_tokens
+        inline int split_line(char *string, char **argv, int max_tokens)
+        {
+            int argc = 0;
+            do
+            {
+                if (argc == max_tokens)
+                    return -1;
+                argv[argc++] = string;
+                while (*string && *string != ':')
+                    string++;
+                if (*string)
+                    *string++ = 0;
+            } while (*string);
+            return argc;
+        }
+
+        inline void format_config_topic(char *buf, size_t len, const char *prefix, const char *type, const char *node, const char *object_id)
+        {
+            snprintf(buf, len, "%s/%s/%s/%s/config", prefix, type, node, object_id);
+        }
+
+        inline void format_state_topic(char *buf, size_t len, const char *type, const char *node, const char *object_id)
+        {
+            snprintf(buf, len, "%s/%s/%s/state", node, type, object_id);
+        }
+
+        template <typename Transport>
+        class LineCodec
+        {
+        public:
+            // Builds the line into out. Returns false if it is too long for the transport.
+            static bool encode(const SensorLine &line, std::string &out)
+            {
+                out.clear();
+                out.reserve(96);
+                out += line.node;
+                out += ':';
+                out += line.device_class;
+                out += ':';
+                out += line.state_class;
+                out += ':';
+                out += line.object_id;
+                out += ':';
+                out += line.unit;
+                out += ':';
+                out += line.value;
+                if (Transport::TIMESTAMPS && line.stamp != nullptr)
+                {
+                    out += TIMESTAMP_MARK;
+                    out += line.stamp;
+                }
+                out += ':';
+                out += line.icon[0] != 0 ? line.icon : ":";
+                out += ':';
+                out += line.version;
+                out += ':';
+                out += line.board;
+                out += ':';
+                out += line.kind;
+                out += ':';
+                if (Transport::ACKS && line.seq != nullptr)
+                    out += line.seq;
+                return out.size() <= Transport::MAX_LINE;
+            }
+
+#ifdef USE_SENSOR
+            static bool encode_sensor(const std::string &node, sensor::Sensor *obj, float state, const char *stamp, std::string &out)
+            {
+                std::string device_class = obj->get_device_class();
+                std::string object_id = str_snake_case(obj->get_name().c_str());
+                std::string unit = obj->get_unit_of_measurement();
+                std::string value = value_accuracy_to_string(state, obj->get_accuracy_decimals());
+                std::string icon = obj->get_icon();
+                SensorLine line;
+                line.node = node.c_str();
+                line.device_class = device_class.c_str();
+                line.state_class = LOG_STR_ARG(state_class_to_string(obj->get_state_class()));
+                line.object_id = object_id.c_str();
+                line.unit = unit.c_str();
+                line.value = value.c_str();
+                line.icon = icon.c_str();
+                line.kind = "sensor";
+                line.stamp = stamp;
+                return encode(line, out);
+            }
+#endif
+
+#ifdef USE_BINARY_SENSOR
+            static bool encode_binary_sensor(const std::string &node, binary_sensor::BinarySensor *obj, bool state, const char *stamp, std::string &out)
+            {
+                std::string device_class = obj->get_device_class();
+                std::string object_id = str_snake_case(obj->get_name().c_str());
+                std::string icon = obj->get_icon();
+                SensorLine line;
+                line.node = node.c_str();
+                line.device_class = device_class.c_str();
+                line.state_class = "binary_sensor";
+                line.object_id = object_id.c_str();
+                line.value = state ? "ON" : "OFF";
+                line.icon = icon.c_str();
+                line.stamp = stamp;
+                return encode(line, out);
+            }
+#endif
+
+#ifdef USE_TEXT_SENSOR
+            static bool encode_text_sensor(const std::string &node, text_sensor::TextSensor *obj, const std::string &state, std::string &out)
+            {
+                std::string object_id = str_snake_case(obj->get_name().c_str());
+                std::string icon = obj->get_icon();
+                SensorLine line;
+                line.node = node.c_str();
+                line.object_id = object_id.c_str();
+                line.value = state.c_str();
+                line.icon = icon.c_str();
+                return encode(line, out);
+            }
+#endif
+
+            // Parses a NUL terminated line in place. Returns false if it isn't one of ours.
+            static bool decode(char *buf, SensorLine *line)
+            {
+                char *tokens[MAX_LINE_TOKENS];
+                int argc = split_line(buf, tokens, MAX_LINE_TOKENS);
+                if (argc != LINE_TOKENS && !(Transport::ACKS && argc == LINE_TOKENS + 1))
+                    return false;
+
+                line->node = tokens[0];
+                line->device_class = tokens[1];
+                line->state_class = tokens[2];
+                line->object_id = tokens[3];
+                line->unit = tokens[4];
+                line->value = tokens[5];
+                line->version = tokens[8];
+                line->board = tokens[9];
+                line->kind = tokens[10];
+                line->seq = argc > LINE_TOKENS ? tokens[11] : nullptr;
+                line->stamp = nullptr;
+
+                // the icon was split at its own colon, put it back together
+                line->icon = tokens[6];
+                if (tokens[6][0] != 0)
+                    tokens[7][-1] = ':';
+
+                if (Transport::TIMESTAMPS)
+                {
+                    char *mark = strchr(tokens[5], TIMESTAMP_MARK);
+                    if (mark != nullptr)
+                    {
+                        *mark = 0;
+                        line->stamp = mark + 1;
+                    }
+                }
+                return true;
+            }
+
+            // Home Assistant discovery config for the entity on this line. device_id is
+            // what identifies the node to the bridge (its name on LoRa, its MAC on ESP-NOW).
+            static void build_discovery(const SensorLine &line, const char *device_id, bool attributes, JsonDocument &doc)
+            {
+                bool binary = line.is_binary();
+                if (!binary)
+                {
+                    if (line.device_class[0] != 0)
+                        doc["dev_cla"] = line.device_class;
+                    if (line.unit[0] != 0)
+                        doc["unit_of_meas"] = line.unit;
+                    if (line.state_class[0] != 0)
+                        doc["stat_cla"] = line.state_class;
+                }
+                if (line.object_id[0] != 0)
+                    doc["name"] = line.object_id;
+                if (!binary && line.icon[0] != 0)
+                    doc["icon"] = line.icon;
+                if (line.node[0] != 0)
+                {
+                    std::string topic = line.node;
+                    topic += '/';
+                    topic += line.type();
+                    topic += '/';
+                    topic += line.object_id;
+                    doc["stat_t"] = topic + "/state";
+                    if (attributes)
+                        doc["json_attr_t"] = topic + "/attributes";
+
+                    std::string uniq_id = device_id;
+                    uniq_id += '_';
+                    uniq_id += line.object_id;
+                    doc["uniq_id"] = uniq_id;
+                }
+                add_device(line, device_id, doc);
+            }
+
+            // everything build_discovery() reads, so a bridge can tell when a config changed
+            static uint32_t discovery_hash(const SensorLine &line, const char *device_id, bool attributes)
+            {
+                uint32_t hash = fnv1a(line.node, fnv1a(device_id, attributes ? 2166136261UL : 1));
+                for (const char *field : {line.device_class, line.state_class, line.object_id, line.unit, line.icon, line.version, line.board})
+                {
+                    hash = fnv1a(field, hash ^ ':');
+                }
+                return hash;
+            }
+
+            static uint32_t rssi_discovery_hash(const SensorLine &line, const char *device_id)
+            {
+                return fnv1a(line.board, fnv1a(line.version, fnv1a(line.node, fnv1a(device_id, fnv1a("rssi")))));
+            }
+
+            // the per-node signal strength sensor published next to every reading
+            static void build_rssi_discovery(const SensorLine &line, const char *device_id, JsonDocument &doc)
+            {
+                doc["name"] = "rssi";
+                doc["dev_cla"] = "SIGNAL_STRENGTH";
+                doc["unit_of_meas"] = "dBm";
+                doc["stat_cla"] = "measurement";
+                doc["icon"] = "mdi:wifi";
+
+                std::string stat_t = line.node;
+                stat_t += "/sensor/rssi/state";
+                doc["stat_t"] = stat_t;
+
+                std::string uniq_id = device_id;
+                uniq_id += "_rssi";
+                doc["uniq_id"] = uniq_id;
+                add_device(line, device_id, doc);
+            }
+
+        protected:
+            static void add_device(const SensorLine &line, const char *device_id, JsonDocument &doc)
+            {
+                JsonObject dev = doc["dev"].template to<JsonObject>();
+                dev["ids"] = device_id;
+                if (line.node[0] != 0)
+                    dev["name"] = line.node;
+                // frames without node metadata leave these empty rather than overwrite them
+                if (line.version[0] != 0)
+                    dev["sw"] = line.version;
+                if (line.board[0] != 0)
+                    dev["mdl"] = line.board;
+                dev["mf"] = "espressif";
+            }
+        };
+
+        using LoRaCodec = LineCodec<LoRaTransport>;
+        using NowCodec = LineCodec<NowTransport>;
+    } // namespace frame_codec
+} // namespace esphome
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "mbedtls/ccm.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // A sealed frame wraps any other frame (text line, catch-up, fragment payload):
+        //   (FRAME_SEALED | key_id) counter[3, LE] ciphertext MIC[4]
+        // AES-128-CCM with a 4 byte tag; the 4 header bytes are authenticated as associated
+        // data. Every node has its own key, so key_id names the node and the counter only
+        // has to be unique per key. mbedTLS uses the ESP32 AES peripheral underneath.
+        static const uint8_t FRAME_SEALED = 0xC0;
+        static const uint8_t SEALED_KEY_MASK = 0x0F;
+        static const size_t SEALED_HEADER = 4;
+        static const size_t SEALED_MIC = 4;
+        static const size_t SEALED_OVERHEAD = SEALED_HEADER + SEALED_MIC;
+        static const uint32_t SEALED_COUNTER_MAX = 0xFFFFFF;
+        static const size_t SEALED_KEY_SIZE = 16;
+        static const uint8_t SEALED_KEYS = 16;
+
+        inline bool is_sealed(const uint8_t *frame, size_t len) { return len > SEALED_OVERHEAD && (frame[0] & 0xF0) == FRAME_SEALED; }
+
+        class FrameCipher
+        {
+        public:
+            FrameCipher() { mbedtls_ccm_init(&this->ctx_); }
+            ~FrameCipher() { mbedtls_ccm_free(&this->ctx_); }
+            FrameCipher(const FrameCipher &) = delete;
+            FrameCipher &operator=(const FrameCipher &) = delete;
+
+            bool set_key(const uint8_t *key)
+            {
+                this->ready_ = mbedtls_ccm_setkey(&this->ctx_, MBEDTLS_CIPHER_ID_AES, key, SEALED_KEY_SIZE * 8) == 0;
+                return this->ready_;
+            }
+            bool ready() const { return this->ready_; }
+
+            // out must hold len + SEALED_OVERHEAD bytes
+            bool seal(uint8_t key_id, uint32_t counter, const uint8_t *in, size_t len, uint8_t *out)
+            {
+                uint8_t nonce[13];
+                out[0] = FRAME_SEALED | (key_id & SEALED_KEY_MASK);
+                out[1] = counter;
+                out[2] = counter >> 8;
+                out[3] = counter >> 16;
+                make_nonce(out, nonce);
+                return mbedtls_ccm_encrypt_and_tag(&this->ctx_, len, nonce, sizeof(nonce), out, SEALED_HEADER, in,
+                                                   out + SEALED_HEADER, out + SEALED_HEADER + len, SEALED_MIC) == 0;
+            }
+
+            // out must hold len - SEALED_OVERHEAD bytes; false if the MIC doesn't verify
+            bool open(const uint8_t *in, size_t len, uint8_t *out)
+            {
+                uint8_t nonce[13];
+                size_t plain = len - SEALED_OVERHEAD;
+                make_nonce(in, nonce);
+                return mbedtls_ccm_auth_decrypt(&this->ctx_, plain, nonce, sizeof(nonce), in, SEALED_HEADER, in + SEALED_HEADER,
+                                                out, in + SEALED_HEADER + plain, SEALED_MIC) == 0;
+            }
+
+            static uint32_t counter_of(const uint8_t *frame) { return frame[1] | (frame[2] << 8) | ((uint32_t)frame[3] << 16); }
+
+        protected:
+            // nonce = key_id, counter, zero padding
+            static void make_nonce(const uint8_t *header, uint8_t *nonce)
+            {
+                memset(nonce, 0, 13);
+                memcpy(nonce, header, SEALED_HEADER);
+            }
+
+            mbedtls_ccm_context ctx_;
+            bool ready_{false};
+        };
+
+        // per-frame crypto cost, logged by the owning component (tools/crypto_bench logs
+        // the same on a host)
+        struct CryptoStats
+        {
+            uint32_t frames{0};
+            uint32_t rejected{0};
+            uint32_t total_us{0};
+            uint32_t max_us{0};
+
+            void add(uint32_t us)
+            {
+                this->frames++;
+                this->total_us += us;
+                if (us > this->max_us)
+                    this->max_us = us;
+            }
+            void log(const char *tag, const char *what) const
+            {
+                ESP_LOGD(tag, "%s: %lu frame(s), %lu rejected, avg %lu us, max %lu us", what, (unsigned long)this->frames,
+                         (unsigned long)this->rejected, (unsigned long)(this->frames == 0 ? 0 : this->total_us / this->frames),
+                         (unsigned long)this->max_us);
+            }
+        };
+
+        // Node side: one key, and a counter that must never repeat under it. The counter
+        // is reserved in blocks of COUNTER_BLOCK that are persisted before use, so a reboot
+        // skips ahead to the next block instead of reusing a nonce.
+        class FrameSealer
+        {
+        public:
+            static const uint32_t COUNTER_BLOCK = 256;
+
+            void set_key(uint8_t key_id, const std::string &hex_key)
+            {
+                this->key_id_ = key_id & SEALED_KEY_MASK;
+                this->hex_key_ = hex_key;
+            }
+            bool configured() const { return !this->hex_key_.empty(); }
+            bool enabled() const { return this->cipher_.ready(); }
+
+            bool begin(uint32_t hash)
+            {
+                uint8_t key[SEALED_KEY_SIZE];
+                if (this->hex_key_.size() != SEALED_KEY_SIZE * 2 || !parse_hex(this->hex_key_, key, sizeof(key)) || !this->cipher_.set_key(key))
+                    return false;
+                this->pref_ = global_preferences->make_preference<uint32_t>(hash ^ this->key_id_);
+                uint32_t reserved = 0;
+                this->pref_.load(&reserved);
+                this->counter_ = reserved;
+                this->reserve_();
+                return true;
+            }
+
+            // out must hold len + SEALED_OVERHEAD bytes
+            bool seal(const uint8_t *in, size_t len, uint8_t *out)
+            {
+                if (this->counter_ > SEALED_COUNTER_MAX)
+                {
+                    // all nonces under this key are used up: a new key is needed
+                    this->stats_.rejected++;
+                    return false;
+                }
+                if (this->counter_ == this->reserved_)
+                    this->reserve_();
+                uint32_t start = micros();
+                bool ok = this->cipher_.seal(this->key_id_, this->counter_++, in, len, out);
+                this->stats_.add(micros() - start);
+                return ok;
+            }
+
+            uint32_t counter() const { return this->counter_; }
+            const CryptoStats &stats() const { return this->stats_; }
+
+        protected:
+            void reserve_()
+            {
+                this->reserved_ = this->counter_ + COUNTER_BLOCK;
+                this->pref_.save(&this->reserved_);
+                global_preferences->sync();
+            }
+
+            FrameCipher cipher_;
+            ESPPreferenceObject pref_;
+            std::string hex_key_;
+            uint8_t key_id_{0};
+            uint32_t counter_{0};
+            uint32_t reserved_{0};
+            CryptoStats stats_;
+        };
+
+        // Bridge side: a key per key_id and the highest counter accepted from each, so a
+        // recorded frame can't be played back. The counters are persisted once a minute,
+        // which bounds what could be replayed across a bridge reboot to that last minute.
+        class FrameOpener
+        {
+        public:
+            static const uint32_t PERSIST_INTERVAL_MS = 60000;
+
+            bool add_key(uint8_t key_id, const std::string &hex_key)
+            {
+                uint8_t key[SEALED_KEY_SIZE];
+                key_id &= SEALED_KEY_MASK;
+                if (hex_key.size() != SEALED_KEY_SIZE * 2 || !parse_hex(hex_key, key, sizeof(key)))
+                    return false;
+                return this->ciphers_[key_id].set_key(key);
+            }
+            void set_required(bool required) { this->required_ = required; }
+            bool required() const { return this->required_; }
+
+            void begin(uint32_t hash)
+            {
+                this->pref_ = global_preferences->make_preference<uint32_t[SEALED_KEYS]>(hash);
+                if (!this->pref_.load(&this->last_counter_))
+                    memset(this->last_counter_, 0, sizeof(this->last_counter_));
+            }
+
+            // Decrypts a sealed frame into out (len - SEALED_OVERHEAD bytes). False for an
+            // unknown key, a bad MIC or a replayed counter.
+            bool open(const uint8_t *in, size_t len, uint8_t *out)
+            {
+                uint8_t key_id = in[0] & SEALED_KEY_MASK;
+                FrameCipher &cipher = this->ciphers_[key_id];
+                uint32_t counter = FrameCipher::counter_of(in);
+                // last_counter_ holds counter + 1 so that 0 means nothing seen yet
+                if (!cipher.ready() || counter < this->last_counter_[key_id])
+                {
+                    this->stats_.rejected++;
+                    return false;
+                }
+                uint32_t start = micros();
+                bool ok = cipher.open(in, len, out);
+                this->stats_.add(micros() - start);
+                if (!ok)
+                {
+                    this->stats_.rejected++;
+                    return false;
+                }
+                this->last_counter_[key_id] = counter + 1;
+                this->dirty_ = true;
+                return true;
+            }
+
+            void loop(uint32_t now)
+            {
+                if (this->dirty_ && now - this->last_persist_ >= PERSIST_INTERVAL_MS)
+                {
+                    this->pref_.save(&this->last_counter_);
+                    this->last_persist_ = now;
+                    this->dirty_ = false;
+                }
+            }
+
+            const CryptoStats &stats() const { return this->stats_; }
+
+        protected:
+            FrameCipher ciphers_[SEALED_KEYS];
+            uint32_t last_counter_[SEALED_KEYS]{};
+            ESPPreferenceObject pref_;
+            bool required_{false};
+            bool dirty_{false};
+            uint32_t last_persist_{0};
+            CryptoStats stats_;
+        };
+    } // namespace frame_codec
+} // namespace esphome
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Binary frames share the channel with the colon separated text frames. Their
+        // first byte is never printable, which is how a receiver tells them apart.
+        // 0xAx frames are ESP-NOW only, 0xBx frames are LoRa only.
+        static const uint8_t NOW_FRAME_PROBE = 0xA0;       // node -> broadcast: looking for a bridge
+        static const uint8_t NOW_FRAME_PROBE_REPLY = 0xA1; // bridge -> broadcast: sender MAC is a bridge
+        static const uint8_t NOW_FRAME_FRAGMENT = 0xA2;    // node -> bridge: msg_id index count payload
+        static const uint8_t FRAME_BEACON = 0xB0;          // bridge -> all: unix_s (u32 LE) fraction (1/256 s)
+        static const uint8_t FRAME_ACK = 0xB1;             // bridge -> node: id_lo id_hi seq [correction]
+        static const uint8_t FRAME_CATCHUP = 0xB2;         // node -> bridge: uploaded backlog
+        static const uint8_t FRAME_TEXT = 0xB3;            // node -> bridge: dictionary coded text sensor state
+        static const uint8_t FRAME_FUOTA_SESSION = 0xB4;   // bridge -> all: firmware image announcement, sealed
+        static const uint8_t FRAME_FUOTA_FRAGMENT = 0xB5;  // bridge -> all: fountain-coded image fragment
+
+        // catch-up frame layout:
+        //   FRAME_CATCHUP seq name_len name
+        //   then per entity: flags obj_len object_id count samples
+        // samples are { varint age_s, float32 value } * count, or a packed series
+        // (see SeriesEncoder) when ENTITY_PACKED is set
+        static const uint8_t ENTITY_BINARY = 0x80;   // flags: binary_sensor rather than sensor
+        static const uint8_t ENTITY_PACKED = 0x40;   // flags: samples are a packed series
+        static const uint8_t ENTITY_ACCURACY = 0x0F; // flags: accuracy decimals of the values
+
+        // text frame layout:
+        //   FRAME_TEXT name_len name obj_len object_id op [len text]
+        // op is TEXT_CODE | code followed by text_check() of the text, TEXT_DEFINE | code
+        // followed by the text, or TEXT_LITERAL followed by the text (see
+        // TextDictionaryEncoder)
+        static const uint8_t TEXT_CODE = 0x00;
+        static const uint8_t TEXT_DEFINE = 0x40;
+        static const uint8_t TEXT_LITERAL = 0x80;
+        static const uint8_t TEXT_OP_MASK = 0xC0;
+        static const uint8_t TEXT_CODE_MASK = 0x3F;
+
+        static const size_t ACK_FRAME_SIZE = 4;
+        // An ACK may carry a frequency correction for the node: int16 LE, in Hz, by which
+        // the node moves its carrier down (see FrequencyTracker)
+        static const size_t ACK_CORRECTION_FRAME_SIZE = 6;
+        static const size_t BEACON_FRAME_SIZE = 6;
+
+        // With implicit_header the radios drop the LoRa PHY header and every frame goes
+        // out at that fixed length: a length byte, the frame and padding. Nothing on air
+        // says which mode a sender used, so node and bridge must be set alike, with room
+        // for the longest downlink. SF6 works in implicit header mode only.
+        static const size_t MIN_IMPLICIT_HEADER = 1 + BEACON_FRAME_SIZE;
+
+        inline bool valid_header_mode(long implicit_header, long sf)
+        {
+            if (implicit_header == 0)
+                return sf != 6;
+            return implicit_header >= (long)MIN_IMPLICIT_HEADER && implicit_header <= 255;
+        }
+
+        // firmware update frames, see fountain.h:
+        //   FRAME_FUOTA_SESSION sealed(image_size[4] fragment_size repair sha256[32])
+        //   FRAME_FUOTA_FRAGMENT session[2] block[2] index payload[fragment_size]
+        // The announcement is sealed with the fuota_key (key id 0), its counter is the
+        // session id; fragments carry the id's low 16 bits. Blocks have FUOTA_BLOCK source
+        // and `repair` repair fragments, the last one is zero padded.
+        static const size_t FUOTA_SESSION_SIZE = 38;
+        static const size_t FUOTA_SESSION_FRAME_SIZE = 1 + 4 + FUOTA_SESSION_SIZE + 4;
+        static const size_t FUOTA_FRAGMENT_HEADER = 6;
+
+        static const size_t NOW_PROBE_FRAME_SIZE = 1;
+        static const size_t NOW_MAX_FRAME = 250; // ESP-NOW payload limit
+
+        // ESP-NOW lines longer than one frame are split into fragments. Every fragment but
+        // the last carries a full NOW_FRAGMENT_PAYLOAD, so fragment i lands at offset
+        // i * NOW_FRAGMENT_PAYLOAD and the last one fixes the total length.
+        static const size_t NOW_FRAGMENT_HEADER = 4;
+        static const size_t NOW_FRAGMENT_PAYLOAD = NOW_MAX_FRAME - NOW_FRAGMENT_HEADER;
+        static const size_t NOW_MAX_MESSAGE = 1024;
+        static const uint8_t NOW_MAX_FRAGMENTS = (NOW_MAX_MESSAGE + NOW_FRAGMENT_PAYLOAD - 1) / NOW_FRAGMENT_PAYLOAD;
+
+        // Text frames from a node with network time carry "value@XY": the sample time in
+        // seconds modulo 4096 as two base64url characters. The receiver picks the most
+        // recent matching second, so a reading may be up to ~68 minutes old.
+        static const char TIMESTAMP_MARK = '@';
+        static const uint32_t TIMESTAMP_MODULO = 4096;
+
+        inline char timestamp_char(uint32_t value)
+        {
+            static const char *const ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+            return ALPHABET[value & 0x3F];
+        }
+
+        inline int timestamp_value(char c)
+        {
+            if (c >= 'A' && c <= 'Z')
+                return c - 'A';
+            if (c >= 'a' && c <= 'z')
+                return c - 'a' + 26;
+            if (c >= '0' && c <= '9')
+                return c - '0' + 52;
+            if (c == '-')
+                return 62;
+            if (c == '_')
+                return 63;
+            return -1;
+        }
+
+        inline uint16_t node_id_hash(uint32_t fnv1) { return (uint16_t)(fnv1 ^ (fnv1 >> 16)); }
+
+        inline uint32_t fnv1a(const char *str, uint32_t hash = 2166136261UL)
+        {
+            while (*str)
+            {
+                hash ^= (uint8_t)*str++;
+                hash *= 16777619UL;
+            }
+            return hash;
+        }
+
+        inline size_t put_varint(uint8_t *out, uint32_t value)
+        {
+            size_t n = 0;
+            while (value >= 0x80)
+            {
+                out[n++] = (uint8_t)(value | 0x80);
+                value >>= 7;
+            }
+            out[n++] = (uint8_t)value;
+            return n;
+        }
+
+        inline size_t get_varint(const uint8_t *in, size_t len, uint32_t *value)
+        {
+            uint32_t result = 0;
+            for (size_t n = 0; n < len && n < 5; n++)
+            {
+                result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+                if (!(in[n] & 0x80))
+                {
+                    *value = result;
+                    return n + 1;
+                }
+            }
+            return 0;
+        }
+
+        inline uint32_t zigzag_encode(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+        inline int32_t zigzag_decode(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+        // Readings are quantized to the sensor's accuracy_decimals, which is exactly what
+        // the text frame would have carried. Returns false if the value doesn't fit.
+        // Packed blocks with more decimals than MAX_ACCURACY are malformed.
+        static const uint8_t MAX_ACCURACY = 6;
+        static const double QUANTIZE_SCALE[MAX_ACCURACY + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+        inline bool quantize_value(float value, uint8_t accuracy, int32_t *quantized)
+        {
+            if (!std::isfinite(value) || accuracy > MAX_ACCURACY)
+                return false;
+            double scaled = std::round((double)value * QUANTIZE_SCALE[accuracy]);
+            if (scaled > 1e9 || scaled < -1e9)
+                return false;
+            *quantized = (int32_t)scaled;
+            return true;
+        }
+
+        // NAN for an accuracy no encoder produces; decoders reject those blocks before this
+        inline float dequantize_value(int32_t quantized, uint8_t accuracy)
+        {
+            return accuracy > MAX_ACCURACY ? NAN : (float)(quantized / QUANTIZE_SCALE[accuracy]);
+        }
+
+        // a packed sample's time is a negative age; INT32_MIN has no positive age
+        inline bool valid_sample_time(int32_t time) { return time <= 0 && time != INT32_MIN; }
+
+        // Gorilla-style packed series for catch-up uploads: the sample time (seconds,
+        // negative age) is sent as a zigzag varint delta-of-delta, the quantized value as
+        // a zigzag varint delta from the previous sample. A sensor on a fixed update
+        // interval costs 2 bytes per sample for small changes. Streamed one sample at a
+        // time, so it needs no buffering on either end.
+        struct SeriesEncoder
+        {
+            int32_t prev_time{0};
+            int32_t prev_delta{0};
+            int32_t prev_value{0};
+
+            // writes at most 10 bytes
+            size_t encode(uint8_t *out, int32_t time, int32_t value)
+            {
+                int32_t delta = time - this->prev_time;
+                size_t n = put_varint(out, zigzag_encode(delta - this->prev_delta));
+                n += put_varint(out + n, zigzag_encode(value - this->prev_value));
+                this->prev_time = time;
+                this->prev_delta = delta;
+                this->prev_value = value;
+                return n;
+            }
+        };
+
+        struct SeriesDecoder
+        {
+            int32_t prev_time{0};
+            int32_t prev_delta{0};
+            int32_t prev_value{0};
+
+            // Returns the bytes consumed, 0 on a truncated sample. The sums wrap rather than
+            // overflow on a malformed series.
+            size_t decode(const uint8_t *in, size_t len, int32_t *time, int32_t *value)
+            {
+                uint32_t dod, dv;
+                size_t n = get_varint(in, len, &dod);
+                if (n == 0)
+                    return 0;
+                size_t m = get_varint(in + n, len - n, &dv);
+                if (m == 0)
+                    return 0;
+                this->prev_delta = (int32_t)((uint32_t)this->prev_delta + (uint32_t)zigzag_decode(dod));
+                this->prev_time = (int32_t)((uint32_t)this->prev_time + (uint32_t)this->prev_delta);
+                this->prev_value = (int32_t)((uint32_t)this->prev_value + (uint32_t)zigzag_decode(dv));
+                *time = this->prev_time;
+                *value = this->prev_value;
+                return n + m;
+            }
+        };
+    } // namespace frame_codec
+} // namespace esphome
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esphome/core/log.h"
+#include "frames.h"
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Carrier offset of every node the bridge hears, from the frequency error the
+        // radio measures on each LoRa packet (positive: the node transmits high). Modules
+        // without a TCXO are 10-20 ppm off and drift with temperature, which at SF11/12
+        // on 125 kHz is enough for the demodulator to miss packets.
+        //
+        // Errors are averaged over WINDOW packets. A mean beyond the deadband is a
+        // correction: the bridge hands it to the node in its next ACK, or retunes its
+        // own receiver by the mean over all nodes. Either way the packets after it come
+        // in on the new frequency, so the window starts over.
+        //
+        // Each node's sequence numbers give its decode success rate, counted apart
+        // before and after the first correction.
+        class FrequencyTracker
+        {
+        public:
+            static const uint8_t MAX_NODES = 64;
+            static const uint8_t WINDOW = 4;
+
+            struct Window
+            {
+                int32_t sum_hz;
+                uint8_t samples;
+                uint32_t corrections;
+            };
+
+            struct Node
+            {
+                uint16_t id;
+                bool active;
+                bool has_seq;
+                uint8_t last_seq;
+                int32_t offset_hz; // mean of the last full window
+                uint32_t used;     // LRU clock
+                Window window;
+                // [0] before the first correction, [1] after it
+                uint32_t received[2];
+                uint32_t missed[2];
+            };
+
+            void set_deadband(int32_t hz) { this->deadband_hz_ = hz; }
+
+            Node *find(uint16_t node_id)
+            {
+                for (auto &node : this->nodes_)
+                {
+                    if (node.active && node.id == node_id)
+                        return &node;
+                }
+                return nullptr;
+            }
+
+            // One packet from node_id with its measured frequency error. seq is the
+            // node's sequence number, -1 if the frame has none.
+            Node *add(uint16_t node_id, long error_hz, int seq)
+            {
+                Node *node = this->find(node_id);
+                if (node == nullptr)
+                    node = this->add_(node_id);
+                node->used = ++this->clock_;
+                int phase = node->window.corrections != 0 || this->receiver_.corrections != 0 ? 1 : 0;
+                if (seq >= 0)
+                {
+                    // a jump of half the sequence space is a reboot, not a loss
+                    uint8_t gap = (uint8_t)(seq - node->last_seq - 1);
+                    if (node->has_seq && gap < 128)
+                        node->missed[phase] += gap;
+                    node->has_seq = true;
+                    node->last_seq = seq;
+                }
+                node->received[phase]++;
+                if (this->sample_(&node->window, error_hz))
+                    node->offset_hz = node->window.sum_hz / WINDOW;
+                this->sample_(&this->receiver_, error_hz);
+                return node;
+            }
+
+            // The correction due for a node, 0 if none; restarts its window when there is
+            // one. The node moves its carrier down by the value.
+            int32_t take_correction(Node *node) { return this->take_(&node->window); }
+            // The correction due for the bridge's receiver, over every node: it moves up
+            // by the value.
+            int32_t take_receiver_correction() { return this->take_(&this->receiver_); }
+
+            // packets received and missed per phase, summed over all nodes
+            void totals(uint32_t *received, uint32_t *missed) const
+            {
+                received[0] = received[1] = missed[0] = missed[1] = 0;
+                for (auto &node : this->nodes_)
+                {
+                    if (!node.active)
+                        continue;
+                    for (int phase = 0; phase < 2; phase++)
+                    {
+                        received[phase] += node.received[phase];
+                        missed[phase] += node.missed[phase];
+                    }
+                }
+            }
+
+            int32_t max_offset_hz() const
+            {
+                int32_t max = 0;
+                for (auto &node : this->nodes_)
+                {
+                    int32_t offset = node.offset_hz < 0 ? -node.offset_hz : node.offset_hz;
+                    if (node.active && offset > max)
+                        max = offset;
+                }
+                return max;
+            }
+
+            void log_stats(const char *tag) const
+            {
+                uint32_t received[2], missed[2];
+                this->totals(received, missed);
+                ESP_LOGD(tag, "Frequency: %u node(s), largest offset %ld Hz, %lu correction(s) to nodes, %lu to the receiver",
+                         (unsigned)this->count_, (long)this->max_offset_hz(), (unsigned long)this->node_corrections_,
+                         (unsigned long)this->receiver_.corrections);
+                ESP_LOGD(tag, "Decode success: %.1f%% of %lu before correction, %.1f%% of %lu after",
+                         success_percent(received[0], missed[0]), (unsigned long)(received[0] + missed[0]),
+                         success_percent(received[1], missed[1]), (unsigned long)(received[1] + missed[1]));
+            }
+            uint8_t size() const { return this->count_; }
+            uint32_t node_corrections() const { return this->node_corrections_; }
+            uint32_t receiver_corrections() const { return this->receiver_.corrections; }
+
+            static float success_percent(uint32_t received, uint32_t missed)
+            {
+                return received + missed == 0 ? 0.0f : 100.0f * received / (received + missed);
+            }
+
+        protected:
+            // true when the sample completed a window
+            bool sample_(Window *window, long error_hz)
+            {
+                if (window->samples == WINDOW)
+                {
+                    window->sum_hz = 0;
+                    window->samples = 0;
+                }
+                window->sum_hz += error_hz;
+                return ++window->samples == WINDOW;
+            }
+
+            int32_t take_(Window *window)
+            {
+                if (window->samples != WINDOW)
+                    return 0;
+                int32_t mean = window->sum_hz / WINDOW;
+                if (mean <= this->deadband_hz_ && mean >= -this->deadband_hz_)
+                    return 0;
+                window->sum_hz = 0;
+                window->samples = 0;
+                window->corrections++;
+                if (window != &this->receiver_)
+                    this->node_corrections_++;
+                return mean;
+            }
+
+            // a free slot, or the least recently heard node's
+            Node *add_(uint16_t node_id)
+            {
+                Node *slot = nullptr;
+                for (auto &node : this->nodes_)
+                {
+                    if (!node.active)
+                    {
+                        slot = &node;
+                        break;
+                    }
+                    if (slot == nullptr || node.used < slot->used)
+                        slot = &node;
+                }
+                if (!slot->active)
+                    this->count_++;
+                *slot = Node{};
+                slot->id = node_id;
+                slot->active = true;
+                return slot;
+            }
+
+            Node nodes_[MAX_NODES]{};
+            Window receiver_{};
+            int32_t deadband_hz_{0};
+            uint8_t count_{0};
+            uint32_t clock_{0};
+            uint32_t node_corrections_{0};
+        };
+    } // namespace frame_codec
+} // namespace esphome
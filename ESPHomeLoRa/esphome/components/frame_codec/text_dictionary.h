@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include "esphome/core/log.h"
+#include "frames.h"
+
+namespace esphome
+{
+    namespace frame_codec
+    {
+        // Text sensor states in a FRAME_TEXT frame are dictionary coded per sensor. A
+        // state goes out as a literal the first time, is given a code the second time
+        // (DEFINE carries code and text) and is sent as a bare code after that.
+        // Defines are repeated a few times and refreshed now and then, so a lost frame
+        // or a rebooted bridge only costs the states until the next define.
+        //
+        // A code is followed by a check byte of its text. When an entry is evicted its code
+        // goes to the new text, and a bridge that missed every define of that would still
+        // hold the old one: the check tells, and the code is refused instead of
+        // decoded as the old text.
+        static const uint8_t TEXT_DICT_SIZE = 16;
+        static const uint8_t TEXT_DEFINE_REPEATS = 2;
+        static const uint32_t TEXT_DEFINE_REFRESH_MS = 600000;
+
+        inline uint8_t text_check(const std::string &value)
+        {
+            uint32_t hash = 2166136261UL;
+            for (char c : value)
+            {
+                hash ^= (uint8_t)c;
+                hash *= 16777619UL;
+            }
+            return (uint8_t)(hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24));
+        }
+
+        struct TextDictionaryEncoder
+        {
+            struct Entry
+            {
+                std::string value;
+                uint8_t uses{0};
+                uint32_t used{0};
+                uint32_t defined{0};
+            };
+            Entry entries[TEXT_DICT_SIZE];
+            uint32_t literals{0};
+            uint32_t defines{0};
+            uint32_t codes{0};
+
+            // Writes op and payload to out. Returns the bytes written, 0 if they don't fit.
+            size_t encode(const std::string &value, uint32_t now, uint8_t *out, size_t max)
+            {
+                Entry *entry = this->find_(value);
+                if (entry == nullptr)
+                {
+                    // least recently used entry gives way; its code is reused on the next define
+                    entry = &this->entries[0];
+                    for (auto &candidate : this->entries)
+                    {
+                        if (candidate.uses == 0)
+                        {
+                            entry = &candidate;
+                            break;
+                        }
+                        if (candidate.used - entry->used > 0x80000000u)
+                            entry = &candidate;
+                    }
+                    entry->value = value;
+                    entry->uses = 0;
+                }
+                if (entry->uses < 0xFF)
+                    entry->uses++;
+                entry->used = now;
+                uint8_t code = entry - this->entries;
+
+                if (entry->uses == 1)
+                {
+                    if (value.size() > 0xFF || 2 + value.size() > max)
+                        return 0;
+                    out[0] = TEXT_LITERAL;
+                    out[1] = value.size();
+                    memcpy(out + 2, value.data(), value.size());
+                    this->literals++;
+                    return 2 + value.size();
+                }
+                if (entry->uses <= 1 + TEXT_DEFINE_REPEATS || now - entry->defined >= TEXT_DEFINE_REFRESH_MS)
+                {
+                    if (value.size() > 0xFF || 2 + value.size() > max)
+                        return 0;
+                    out[0] = TEXT_DEFINE | code;
+                    out[1] = value.size();
+                    memcpy(out + 2, value.data(), value.size());
+                    entry->defined = now;
+                    this->defines++;
+                    return 2 + value.size();
+                }
+                if (max < 2)
+                    return 0;
+                out[0] = TEXT_CODE | code;
+                out[1] = text_check(value);
+                this->codes++;
+                return 2;
+            }
+
+        protected:
+            Entry *find_(const std::string &value)
+            {
+                for (auto &entry : this->entries)
+                {
+                    if (entry.uses != 0 && entry.value == value)
+                        return &entry;
+                }
+                return nullptr;
+            }
+        };
+
+        struct TextDictionaryDecoder
+        {
+            std::string entries[TEXT_DICT_SIZE];
+            uint8_t checks[TEXT_DICT_SIZE]{};
+            bool known[TEXT_DICT_SIZE]{};
+
+            // Expands op and payload into value. Returns the bytes consumed, 0 if the
+            // frame is truncated or names a code that was never defined here or was
+            // defined for another text since.
+            size_t decode(const uint8_t *in, size_t len, std::string &value, bool *carries_text)
+            {
+                if (len < 1)
+                    return 0;
+                uint8_t op = in[0] & TEXT_OP_MASK;
+                uint8_t code = in[0] & TEXT_CODE_MASK;
+                if (code >= TEXT_DICT_SIZE)
+                    return 0;
+                if (op == TEXT_CODE)
+                {
+                    if (len < 2 || !this->known[code] || this->checks[code] != in[1])
+                        return 0;
+                    value = this->entries[code];
+                    *carries_text = false;
+                    return 2;
+                }
+                if (len < 2 || 2u + in[1] > len)
+                    return 0;
+                value.assign(reinterpret_cast<const char *>(in + 2), in[1]);
+                *carries_text = true;
+                if (op == TEXT_DEFINE)
+                {
+                    this->entries[code] = value;
+                    this->checks[code] = text_check(value);
+                    this->known[code] = true;
+                }
+                else if (op != TEXT_LITERAL)
+                    return 0;
+                return 2 + in[1];
+            }
+        };
+
+        // A bridge's decoders, one per text sensor ("node/object_id"), for at most
+        // MAX_TEXT_SENSORS sensors: the least recently heard one gives way to a new one.
+        // Its codes are refused until its next define then, as after a reboot.
+        class TextDictionaryTable
+        {
+        public:
+            static const uint8_t MAX_TEXT_SENSORS = 32;
+
+            TextDictionaryDecoder &get(const std::string &key)
+            {
+                auto it = this->decoders_.find(key);
+                if (it == this->decoders_.end())
+                {
+                    if (this->decoders_.size() >= MAX_TEXT_SENSORS)
+                        this->evict_();
+                    it = this->decoders_.emplace(key, Slot()).first;
+                }
+                it->second.used = ++this->clock_;
+                return it->second.decoder;
+            }
+
+            void log_stats(const char *tag) const
+            {
+                ESP_LOGD(tag, "Text dictionaries: %u/%u sensors, evictions=%lu", (unsigned)this->decoders_.size(),
+                         (unsigned)MAX_TEXT_SENSORS, (unsigned long)this->evictions_);
+            }
+            size_t size() const { return this->decoders_.size(); }
+
+        protected:
+            struct Slot
+            {
+                TextDictionaryDecoder decoder;
+                uint32_t used{0}; // LRU clock
+            };
+
+            void evict_()
+            {
+                auto victim = this->decoders_.begin();
+                for (auto it = this->decoders_.begin(); it != this->decoders_.end(); ++it)
+                {
+                    if (it->second.used < victim->second.used)
+                        victim = it;
+                }
+                this->decoders_.erase(victim);
+                this->evictions_++;
+            }
+
+            std::map<std::string, Slot> decoders_;
+            uint32_t clock_{0};
+            uint32_t evictions_{0};
+        };
+    } // namespace frame_codec
+} // namespace esphome
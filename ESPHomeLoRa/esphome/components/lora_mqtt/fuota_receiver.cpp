@@ -0,0 +1,223 @@
+#include "fuota_receiver.h"
+#include "esphome/core/log.h"
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace esphome
+{
+    namespace lora_mqtt
+    {
+        using namespace frame_codec;
+
+        static const char *const TAG = "lora_mqtt.fuota";
+        static const uint32_t FLASH_SECTOR = 4096;
+
+        bool FuotaReceiver::begin(const std::string &hex_key, uint32_t hash)
+        {
+            uint8_t key[SEALED_KEY_SIZE];
+            if (hex_key.size() != SEALED_KEY_SIZE * 2 || !parse_hex(hex_key, key, sizeof(key)) || !this->cipher_.set_key(key))
+                return false;
+            this->pref_ = global_preferences->make_preference<uint32_t>(hash);
+            if (!this->pref_.load(&this->min_session_))
+                this->min_session_ = 0;
+            return true;
+        }
+
+        bool FuotaReceiver::on_frame(const uint8_t *frame, size_t len, uint32_t now)
+        {
+            if (!this->enabled())
+                return false;
+            if (frame[0] == FRAME_FUOTA_SESSION)
+                return this->on_session_(frame, len, now);
+            return this->on_fragment_(frame, len, now);
+        }
+
+        void FuotaReceiver::loop(uint32_t now)
+        {
+            if (this->active_ && now - this->last_frame_ >= IDLE_TIMEOUT_MS)
+                this->abort_("nothing heard from the bridge for an hour");
+        }
+
+        void FuotaReceiver::log_stats(const char *tag) const
+        {
+            if (!this->active_)
+                return;
+            ESP_LOGD(tag, "Firmware update %06lx: %u of %u blocks, %lu fragment(s), %lu block(s) left for a later pass",
+                     (unsigned long)this->session_, this->blocks_ - this->remaining_, this->blocks_,
+                     (unsigned long)this->fragments_, (unsigned long)this->blocks_missed_);
+        }
+
+        bool FuotaReceiver::on_session_(const uint8_t *frame, size_t len, uint32_t now)
+        {
+            const uint8_t *sealed = frame + 1;
+            uint8_t session[FUOTA_SESSION_SIZE];
+            if (len != FUOTA_SESSION_FRAME_SIZE || sealed[0] != FRAME_SEALED || !this->cipher_.open(sealed, len - 1, session))
+            {
+                ESP_LOGW(TAG, "Firmware update announcement that doesn't verify with the fuota_key, ignored");
+                return false;
+            }
+            uint32_t id = FrameCipher::counter_of(sealed);
+            if (this->has_session_ && id == this->session_)
+            {
+                // repeated at the start of every pass
+                this->last_frame_ = now;
+                return false;
+            }
+            if (id < this->min_session_)
+            {
+                ESP_LOGW(TAG, "Firmware update %06lx is older than the last one (%06lx), ignored", (unsigned long)id,
+                         (unsigned long)this->min_session_);
+                return false;
+            }
+            if (this->active_)
+                this->abort_("a new image was announced");
+
+            this->has_session_ = true;
+            this->session_ = id;
+            this->image_size_ = session[0] | (session[1] << 8) | (session[2] << 16) | ((uint32_t)session[3] << 24);
+            this->fragment_size_ = session[4];
+            memcpy(this->sha256_, session + 6, sizeof(this->sha256_));
+            uint32_t block_size = FUOTA_BLOCK * this->fragment_size_;
+            uint32_t blocks = block_size == 0 ? 0 : (this->image_size_ + block_size - 1) / block_size;
+            this->partition_ = esp_ota_get_next_update_partition(nullptr);
+            if (blocks == 0 || blocks > 0xFFFF || this->partition_ == nullptr || this->image_size_ > this->partition_->size)
+            {
+                ESP_LOGE(TAG, "Firmware update %06lx: a %lu byte image doesn't fit the OTA partition", (unsigned long)id,
+                         (unsigned long)this->image_size_);
+                return false;
+            }
+            if (!this->decoder_.begin(this->fragment_size_))
+            {
+                ESP_LOGE(TAG, "Firmware update %06lx: no memory for a %lu byte block", (unsigned long)id, (unsigned long)block_size);
+                return false;
+            }
+            this->set_min_session_(id);
+            this->blocks_ = blocks;
+            this->remaining_ = blocks;
+            this->written_.assign(blocks, false);
+            this->erased_ = 0;
+            this->decoder_.reset(0);
+            this->fragments_ = 0;
+            this->blocks_missed_ = 0;
+            this->last_frame_ = now;
+            this->active_ = true;
+            ESP_LOGI(TAG, "Firmware update %06lx: receiving a %lu byte image in %u blocks", (unsigned long)id,
+                     (unsigned long)this->image_size_, this->blocks_);
+            return false;
+        }
+
+        bool FuotaReceiver::on_fragment_(const uint8_t *frame, size_t len, uint32_t now)
+        {
+            if (!this->active_ || len != FUOTA_FRAGMENT_HEADER + this->fragment_size_ ||
+                (uint16_t)(frame[1] | (frame[2] << 8)) != (uint16_t)this->session_)
+                return false;
+            uint16_t block = frame[3] | (frame[4] << 8);
+            this->fragments_++;
+            this->last_frame_ = now;
+            if (block >= this->blocks_ || this->written_[block])
+                return false;
+            if (block != this->decoder_.block())
+            {
+                // blocks go out one after the other, so the one being decoded is over for this pass
+                if (this->decoder_.rank() != 0)
+                {
+                    ESP_LOGD(TAG, "Firmware update: block %u incomplete (%u of %u), left for the next pass", this->decoder_.block(),
+                             this->decoder_.rank(), (unsigned)FUOTA_BLOCK);
+                    this->blocks_missed_++;
+                }
+                this->decoder_.reset(block);
+            }
+            if (!this->decoder_.add(frame[5], frame + FUOTA_FRAGMENT_HEADER) || !this->write_block_(block))
+                return false;
+            this->decoder_.reset(block + 1 < this->blocks_ ? block + 1 : 0);
+            return --this->remaining_ == 0 && this->finish_();
+        }
+
+        bool FuotaReceiver::write_block_(uint16_t block)
+        {
+            uint32_t block_size = FUOTA_BLOCK * this->fragment_size_;
+            uint32_t offset = (uint32_t)block * block_size;
+            // the last block is zero padded
+            size_t len = this->image_size_ - offset < block_size ? this->image_size_ - offset : block_size;
+            // Blocks share flash sectors, so only sectors past everything written so far
+            // may be erased: skipped blocks land in sectors erased on the way.
+            uint32_t end = (offset + len + FLASH_SECTOR - 1) / FLASH_SECTOR * FLASH_SECTOR;
+            if (end > this->erased_)
+            {
+                if (esp_partition_erase_range(this->partition_, this->erased_, end - this->erased_) != ESP_OK)
+                {
+                    this->abort_("erasing the OTA partition failed");
+                    return false;
+                }
+                this->erased_ = end;
+            }
+            if (esp_partition_write(this->partition_, offset, this->decoder_.data(), len) != ESP_OK)
+            {
+                this->abort_("writing the OTA partition failed");
+                return false;
+            }
+            this->written_[block] = true;
+            return true;
+        }
+
+        bool FuotaReceiver::finish_()
+        {
+            this->decoder_.end();
+            this->written_.clear();
+            this->active_ = false;
+            // whatever comes of it, this session's announcements are done with
+            this->set_min_session_(this->session_ + 1);
+            // the hash is over what actually landed in flash
+            static const size_t CHUNK = 4096;
+            std::unique_ptr<uint8_t[]> buf(new (std::nothrow) uint8_t[CHUNK]);
+            bool read = buf != nullptr;
+            mbedtls_sha256_context sha;
+            uint8_t digest[32];
+            mbedtls_sha256_init(&sha);
+            mbedtls_sha256_starts(&sha, 0);
+            for (uint32_t offset = 0; read && offset < this->image_size_; offset += CHUNK)
+            {
+                size_t len = this->image_size_ - offset < CHUNK ? this->image_size_ - offset : CHUNK;
+                read = esp_partition_read(this->partition_, offset, buf.get(), len) == ESP_OK;
+                mbedtls_sha256_update(&sha, buf.get(), len);
+                App.feed_wdt();
+            }
+            mbedtls_sha256_finish(&sha, digest);
+            mbedtls_sha256_free(&sha);
+            if (!read || memcmp(digest, this->sha256_, sizeof(digest)) != 0)
+            {
+                ESP_LOGE(TAG, "Firmware update %06lx: the image doesn't match its SHA-256", (unsigned long)this->session_);
+                return false;
+            }
+            // which checks the image itself before it may boot
+            if (esp_ota_set_boot_partition(this->partition_) != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Firmware update %06lx: the image was received but is not bootable", (unsigned long)this->session_);
+                return false;
+            }
+            ESP_LOGI(TAG, "Firmware update %06lx: %lu byte image verified from %lu fragment(s), restarting into it",
+                     (unsigned long)this->session_, (unsigned long)this->image_size_, (unsigned long)this->fragments_);
+            return true;
+        }
+
+        void FuotaReceiver::set_min_session_(uint32_t session)
+        {
+            if (session == this->min_session_)
+                return;
+            this->min_session_ = session;
+            this->pref_.save(&this->min_session_);
+            global_preferences->sync();
+        }
+
+        void FuotaReceiver::abort_(const char *reason)
+        {
+            ESP_LOGW(TAG, "Firmware update %06lx aborted: %s", (unsigned long)this->session_, reason);
+            this->decoder_.end();
+            this->written_.clear();
+            this->active_ = false;
+        }
+    } // namespace lora_mqtt
+} // namespace esphome
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include "mbedtls/sha256.h"
+#include "esphome/core/preferences.h"
+#include "esphome/components/frame_codec/frames.h"
+#include "esphome/components/frame_codec/frame_crypto.h"
+#include "esphome/components/frame_codec/fountain.h"
+
+namespace esphome
+{
+    namespace lora_mqtt
+    {
+        // Node end of the bridge's multicast firmware update (see the bridge's
+        // FuotaSender). A sealed announcement names the image's size and SHA-256; the
+        // node then decodes the blocks as they go by and writes each one straight to
+        // its place in the next OTA partition. Blocks it couldn't complete are filled
+        // in from the bridge's next pass. The image only becomes the boot partition
+        // once the partition's SHA-256 matches the announcement. Session ids only go up:
+        // the lowest one still acceptable is persisted, so a recorded older announcement
+        // can't abort an update or bring back an older image.
+        class FuotaReceiver
+        {
+        public:
+            // a session that hears nothing for this long is given up
+            static const uint32_t IDLE_TIMEOUT_MS = 3600000;
+
+            bool begin(const std::string &hex_key, uint32_t hash);
+            bool enabled() const { return this->cipher_.ready(); }
+            bool active() const { return this->active_; }
+
+            // a FRAME_FUOTA_SESSION or FRAME_FUOTA_FRAGMENT frame; true once the image is
+            // complete and set to boot, so the caller restarts into it
+            bool on_frame(const uint8_t *frame, size_t len, uint32_t now);
+            void loop(uint32_t now);
+            void log_stats(const char *tag) const;
+
+        protected:
+            bool on_session_(const uint8_t *frame, size_t len, uint32_t now);
+            bool on_fragment_(const uint8_t *frame, size_t len, uint32_t now);
+            bool write_block_(uint16_t block);
+            bool finish_();
+            void abort_(const char *reason);
+            void set_min_session_(uint32_t session);
+
+            frame_codec::FrameCipher cipher_;
+            frame_codec::FountainDecoder decoder_;
+            ESPPreferenceObject pref_;
+            // sessions below this are rejected: the one in progress stays acceptable after a
+            // reboot, a finished one does not
+            uint32_t min_session_{0};
+            bool active_{false};
+            uint32_t session_{0};
+            bool has_session_{false};
+            uint32_t image_size_{0};
+            size_t fragment_size_{0};
+            uint8_t sha256_[32];
+            uint16_t blocks_{0};
+            std::vector<bool> written_; // per block
+            uint16_t remaining_{0};
+            uint32_t erased_{0}; // the partition is erased up to here
+            uint32_t last_frame_{0};
+            const esp_partition_t *partition_{nullptr};
+
+            uint32_t fragments_{0};
+            uint32_t blocks_missed_{0};
+        };
+    } // namespace lora_mqtt
+} // namespace esphome
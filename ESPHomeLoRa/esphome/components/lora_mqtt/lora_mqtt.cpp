@@ -5,12 +5,20 @@
 #include <esphome/core/helpers.h>
 #include "esphome/core/version.h"
 #include <SPI.h>
-#include "LoRa.h"
+#include <ctime>
+#include <esp_timer.h>
+#include "esphome/components/lora_radio/LoRa.h"
+
+volatile bool esphome::lora_mqtt::Lora_MQTTComponent::receivedLoRaP = false;
+volatile int esphome::lora_mqtt::Lora_MQTTComponent::_packet_size = 0;
+volatile int64_t esphome::lora_mqtt::Lora_MQTTComponent::_rx_time_us = 0;
 
 namespace esphome
 {
     namespace lora_mqtt
     {
+        using namespace frame_codec;
+
         static const char *const TAG = "lora_mqtt.sensor";
         void Lora_MQTTComponent::setup()
         {
@@ -32,153 +40,788 @@ namespace esphome
             // Set chip type before initialization
             LoRa.setChipType((LoRaChipType)_chip_type);
             LoRa.setPins(cs_pin, reset_pin, dio0_pin, dio1_pin);
-            if (!LoRa.begin(_frequency))
+            if (!LoRa.setModulation((LoRaModulation)_modulation) || !LoRa.begin(_frequency))
             {
                 this->mark_failed();
                 ESP_LOGE(TAG, "Error initializing LoRa");
                 return;
             }
             LoRa.setSyncWord(_sync);
-            LoRa.setCodingRate4(_coding);
-            LoRa.setSpreadingFactor(_spread);
-            LoRa.setSignalBandwidth(_bandwidth);
+            bool modem_ok;
+            if (_modulation == MODULATION_LORA)
+            {
+                LoRa.setCodingRate4(_coding);
+                modem_ok = LoRa.setSpreadingFactor(_spread) && LoRa.setSignalBandwidth(_bandwidth);
+            }
+            else
+            {
+                modem_ok = _bit_rate == 0 || LoRa.setBitRate(_bit_rate);
+                if (_modulation == MODULATION_FLRC)
+                    modem_ok = modem_ok && LoRa.setFlrcCodingRate(_flrc_coding);
+                else if (_deviation != 0)
+                    modem_ok = modem_ok && LoRa.setFrequencyDeviation(_deviation);
+            }
+            if (!modem_ok)
+            {
+                this->mark_failed();
+                ESP_LOGE(TAG, "Modem settings not supported by the radio");
+                return;
+            }
+            if (!valid_header_mode(_implicit_header, _spread) || !LoRa.setImplicitHeader(_implicit_header))
+            {
+                this->mark_failed();
+                ESP_LOGE(TAG, "Invalid header mode: implicit_header must be 0 or %u..255 bytes, and SF6 needs it",
+                         (unsigned)MIN_IMPLICIT_HEADER);
+                return;
+            }
+            _node_name = str_snake_case(App.get_name());
+            if (!_encryption_key.empty())
+            {
+                _sealer.set_key(_key_id, _encryption_key);
+                if (!_sealer.begin(fnv1_hash("lora_mqtt.seal")))
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "Invalid encryption key, expected 32 hex characters");
+                    return;
+                }
+                ESP_LOGI(TAG, "Encryption enabled: key id %d, counter %lu", _key_id, (unsigned long)_sealer.counter());
+            }
+            if (_implicit_header != 0)
+            {
+                // what is left once sealed has to hold at least one reading of a one-character entity
+                size_t min_frame = CATCHUP_HEADER + _node_name.size() + CATCHUP_BLOCK_HEADER + 1 + MAX_SAMPLE;
+                if (this->max_frame() < min_frame)
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "implicit_header of %ld leaves %u bytes of data%s, at least %u are needed", _implicit_header,
+                             (unsigned)this->max_frame(), _sealer.enabled() ? " after sealing" : "", (unsigned)min_frame);
+                    return;
+                }
+                ESP_LOGI(TAG, "Implicit header: %ld byte frames, %u bytes of data", _implicit_header, (unsigned)this->max_frame());
+            }
+            if (!_fuota_key.empty())
+            {
+                if (!_fuota.begin(_fuota_key, fnv1_hash("lora_mqtt.fuota")))
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "Invalid fuota_key, expected 32 hex characters");
+                    return;
+                }
+                ESP_LOGI(TAG, "Firmware updates over LoRa enabled");
+            }
+            if (_backlog_enabled)
+            {
+                _node_id = node_id_hash(fnv1_hash(_node_name));
+                _backlog.begin(_backlog_size, fnv1_hash(App.get_compilation_time()));
+                // the bridge answers from its loop, so allow for that on top of the ACK airtime
+                _ack_timeout = 2 * LoRa.timeOnAir(ACK_FRAME_SIZE) / 1000 + 1000;
+                _airtime_budget_max_us = (int64_t)(3600e6 * _duty_cycle / 100.0f);
+                _airtime_budget_us = _airtime_budget_max_us;
+                _airtime_refill = millis();
+                ESP_LOGI(TAG, "Backlog enabled: %u reading(s) max, duty cycle %.1f%%, ACK timeout %lu ms",
+                         (unsigned)(_backlog_size > NodeBacklog::CAPACITY ? NodeBacklog::CAPACITY : _backlog_size),
+                         _duty_cycle, (unsigned long)_ack_timeout);
+            }
+            if (this->listening())
+            {
+                LoRa.onReceive(Lora_MQTTComponent::call_on_data_recv_callback);
+                LoRa.receive();
+            }
+
+            uint16_t index = 0;
             for (auto *obj : App.get_sensors())
             {
-                obj->add_on_state_callback([this, obj](float state)
-                                           { this->on_sensor_update(obj, state); });
+                obj->add_on_state_callback([this, obj, index](float state)
+                                           { this->on_sensor_update(obj, index, state); });
+                _sensor_priorities.push_back(this->priority_of(obj, PRIORITY_NORMAL));
+                index++;
             }
 
 #ifdef USE_BINARY_SENSOR
+            index = 0;
             for (auto *obj : App.get_binary_sensors())
             {
-                obj->add_on_state_callback([this, obj](float state)
-                                           { this->on_binary_sensor_update(obj, state); });
+                obj->add_on_state_callback([this, obj, index](float state)
+                                           { this->on_binary_sensor_update(obj, index, state); });
+                _binary_sensor_priorities.push_back(this->priority_of(obj, PRIORITY_CRITICAL));
+                index++;
+            }
+#endif
+
+#ifdef USE_TEXT_SENSOR
+            index = 0;
+            _text_dictionaries.resize(App.get_text_sensors().size());
+            for (auto *obj : App.get_text_sensors())
+            {
+                obj->add_on_state_callback([this, obj, index](std::string state)
+                                           { this->on_text_sensor_update(obj, index, state); });
+                index++;
             }
 #endif
         }
 
-#ifdef USE_BINARY_SENSOR
-        void Lora_MQTTComponent::on_binary_sensor_update(binary_sensor::BinarySensor *obj, float state)
+        void Lora_MQTTComponent::loop()
         {
-            if (!obj->has_state())
+            if (millis() - _last_link_stats >= STATS_INTERVAL_MS)
+            {
+                _last_link_stats = millis();
+                if (_sealer.enabled())
+                    _sealer.stats().log(TAG, "Encryption");
+                _fuota.log_stats(TAG);
+#ifdef USE_TEXT_SENSOR
+                uint32_t literals = 0, defines = 0, codes = 0;
+                for (auto &dictionary : _text_dictionaries)
+                {
+                    literals += dictionary.literals;
+                    defines += dictionary.defines;
+                    codes += dictionary.codes;
+                }
+                if (literals + defines + codes != 0)
+                    ESP_LOGD(TAG, "Text states: %lu coded, %lu defined, %lu literal", (unsigned long)codes,
+                             (unsigned long)defines, (unsigned long)literals);
+#endif
+            }
+            if (!this->listening())
+                return;
+
+            if (receivedLoRaP)
+            {
+                receivedLoRaP = false;
+                this->handle_downlink();
+            }
+            uint32_t now = millis();
+            _fuota.loop(now);
+            if (!_backlog_enabled)
+                return;
+
+            // refill the duty-cycle budget
+            _airtime_budget_us += (int64_t)(now - _airtime_refill) * 10 * _duty_cycle;
+            if (_airtime_budget_us > _airtime_budget_max_us)
+                _airtime_budget_us = _airtime_budget_max_us;
+            _airtime_refill = now;
+
+            if (_ack_pending && now - _ack_sent >= _ack_timeout)
+            {
+                this->on_ack_timeout();
+            }
+
+            // a critical event doesn't sit out the ACK wait of a lower priority frame
+            if (_ack_pending && _in_flight_priority != PRIORITY_CRITICAL && _queues[PRIORITY_CRITICAL].count != 0)
+            {
+                this->preempt_in_flight();
+            }
+
+            if (!_ack_pending)
+            {
+                uint8_t priority = 0;
+                while (priority < PRIORITY_CLASSES && _queues[priority].count == 0)
+                    priority++;
+                if (priority < PRIORITY_CLASSES)
+                {
+                    TxQueue &queue = _queues[priority];
+                    QueuedReading &reading = queue.front();
+                    // critical readings always try, which doubles as a probe
+                    bool probe = !_link_up && (priority == PRIORITY_CRITICAL || now - _last_probe >= PROBE_INTERVAL_MS);
+                    if (!_link_up && !probe)
+                    {
+                        // no bridge in reach: park it until the link comes back
+                        _backlog.push(reading.record);
+                        queue.pop();
+                    }
+                    else
+                    {
+                        _in_flight_reading = reading;
+                        _in_flight_priority = priority;
+                        if (this->send_reading(reading.record))
+                        {
+                            if (probe)
+                                _last_probe = now;
+                            queue.pop();
+                        }
+                    }
+                }
+                else if (_link_up && !_backlog.empty())
+                {
+                    this->send_catchup();
+                }
+            }
+
+            if (now - _last_stats >= STATS_INTERVAL_MS)
+            {
+                this->publish_backlog_stats(now);
+            }
+        }
+
+        uint8_t Lora_MQTTComponent::priority_of(EntityBase *entity, uint8_t fallback) const
+        {
+            for (auto &entry : _entity_priorities)
+            {
+                if (entry.first == entity)
+                    return entry.second < PRIORITY_CLASSES ? entry.second : fallback;
+            }
+            return fallback;
+        }
+
+        void Lora_MQTTComponent::queue_reading(uint16_t entity, uint8_t flags, float value, uint8_t priority)
+        {
+            QueuedReading reading;
+            reading.record.time = this->node_time();
+            reading.record.value = value;
+            reading.record.entity = entity;
+            reading.record.flags = flags;
+            reading.record.reserved = 0;
+            reading.queued_ms = millis();
+            reading.attempts = 0;
+
+            TxQueue &queue = _queues[priority];
+            if (queue.count == QUEUE_SIZE)
+            {
+                // sending can't keep up (duty cycle): the oldest reading waits in the backlog
+                _backlog.push(queue.front().record);
+                queue.pop();
+            }
+            queue.entries[(queue.head + queue.count) % QUEUE_SIZE] = reading;
+            queue.count++;
+        }
+
+        void Lora_MQTTComponent::requeue_front(const QueuedReading &reading, uint8_t priority)
+        {
+            TxQueue &queue = _queues[priority];
+            if (queue.count == QUEUE_SIZE)
+            {
+                _backlog.push(reading.record);
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+            }
+            queue.head = (queue.head + QUEUE_SIZE - 1) % QUEUE_SIZE;
+            queue.entries[queue.head] = reading;
+            queue.count++;
+        }
+
+        void Lora_MQTTComponent::preempt_in_flight()
+        {
+            // stop waiting for the ACK; a late one no longer matches the sequence number.
+            // A catch-up frame stays in the backlog, a live reading goes back to the head
+            // of its queue (the bridge may then publish it twice)
+            _ack_pending = false;
+            if (_in_flight_catchup == 0)
+                this->requeue_front(_in_flight_reading, _in_flight_priority);
+            _in_flight_catchup = 0;
+            _preempted++;
+        }
+
+        bool Lora_MQTTComponent::send_reading(const BacklogRecord &reading)
+        {
             std::string line;
-            const char *state_s = state ? "ON" : "OFF";
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            line += obj->get_device_class().c_str();
-            line += ":";
-            line += "binary_sensor";
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += ":";
-            line += state_s;
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
+#ifdef USE_BINARY_SENSOR
+            if (reading.flags & ENTITY_BINARY)
+            {
+                line = this->build_binary_sensor_line(App.get_binary_sensors()[reading.entity], reading.value, reading.time);
             }
             else
+#endif
             {
-                line += ":";
+                line = this->build_sensor_line(App.get_sensors()[reading.entity], reading.value, reading.time);
             }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += "::";
 
+            // the trailing token asks the bridge to acknowledge this sequence number
+            char seq[3];
+            snprintf(seq, sizeof(seq), "%02x", _seq);
+            line += seq;
+
+            // too long for the fixed frame length: it goes out in a catch-up frame instead,
+            // right away so that a probe still reaches the bridge
+            if (line.size() > this->max_frame())
+            {
+                _backlog.push(reading);
+                this->send_catchup();
+                return true;
+            }
+            if (!this->airtime_available(line.size(), _in_flight_priority))
+                return false;
             ESP_LOGI(TAG, "LoRa-MQTT Publish:  %s", line.c_str());
+            _in_flight_catchup = 0;
+            return this->transmit(reinterpret_cast<const uint8_t *>(line.c_str()), line.size(), true);
+        }
+
+        bool Lora_MQTTComponent::send_catchup()
+        {
+            size_t len = CATCHUP_HEADER + _node_name.size();
+            size_t limit = this->max_frame();
+            if (!this->airtime_available(len + 16, PRIORITY_BULK))
+                return false;
+
+            // Take the oldest readings in order (so an ACK pops a prefix of the backlog) and
+            // sort them into one block per entity, which is what makes the packed series pay off.
+            uint32_t start = micros();
+            uint32_t now = this->node_time();
+            uint8_t blocks = 0;
+            uint16_t taken = 0;
+            while (taken < _backlog.size())
+            {
+                const BacklogRecord &record = _backlog.at(taken);
+                CatchupBlock *block = nullptr;
+                for (uint8_t i = 0; i < blocks; i++)
+                {
+                    if (_blocks[i].entity == record.entity && (_blocks[i].flags & ENTITY_BINARY) == (record.flags & ENTITY_BINARY))
+                        block = &_blocks[i];
+                }
+
+                int32_t age = now >= record.time ? now - record.time : 0;
+                int32_t quantized = 0;
+                if (block == nullptr)
+                {
+                    if (blocks == MAX_CATCHUP_BLOCKS)
+                        break;
+                    block = &_blocks[blocks];
+                    uint8_t accuracy = 0;
+#ifdef USE_BINARY_SENSOR
+                    if (record.flags & ENTITY_BINARY)
+                    {
+                        block->object_id = str_snake_case(App.get_binary_sensors()[record.entity]->get_name().c_str());
+                    }
+                    else
+#endif
+                    {
+                        sensor::Sensor *obj = App.get_sensors()[record.entity];
+                        block->object_id = str_snake_case(obj->get_name().c_str());
+                        accuracy = obj->get_accuracy_decimals() & ENTITY_ACCURACY;
+                    }
+                    if (block->object_id.size() > 64 || len + CATCHUP_BLOCK_HEADER + block->object_id.size() + MAX_SAMPLE > limit)
+                    {
+                        if (blocks != 0)
+                            break;
+                        // not even a frame to itself holds it: left in place it would hold up
+                        // the whole backlog
+                        ESP_LOGW(TAG, "No catch-up frame fits a reading of %s, dropped", block->object_id.c_str());
+                        _backlog.pop(1);
+                        _catchup_unsendable++;
+                        continue;
+                    }
+                    block->entity = record.entity;
+                    block->flags = (record.flags & ENTITY_BINARY) | accuracy;
+                    // the first sample decides: pack unless the value can't be quantized
+                    if (quantize_value(record.value, accuracy, &quantized))
+                        block->flags |= ENTITY_PACKED;
+                    block->count = 0;
+                    block->len = 0;
+                    block->encoder = SeriesEncoder();
+                    len += CATCHUP_BLOCK_HEADER + block->object_id.size();
+                    blocks++;
+                }
+                if (block->count == 255)
+                    break;
+
+                uint8_t sample[MAX_SAMPLE];
+                size_t sample_len;
+                if (block->flags & ENTITY_PACKED)
+                {
+                    if (!quantize_value(record.value, block->flags & ENTITY_ACCURACY, &quantized))
+                        break;
+                    sample_len = block->encoder.encode(sample, -age, quantized);
+                }
+                else
+                {
+                    sample_len = put_varint(sample, age);
+                    memcpy(sample + sample_len, &record.value, sizeof(float));
+                    sample_len += sizeof(float);
+                }
+                if (len + sample_len > limit)
+                    break;
+                memcpy(block->data + block->len, sample, sample_len);
+                block->len += sample_len;
+                block->count++;
+                len += sample_len;
+                taken++;
+            }
+            if (taken == 0 || !this->airtime_available(len, PRIORITY_BULK))
+                return false;
+
+            uint8_t frame[MAX_CATCHUP_FRAME];
+            size_t pos = 0;
+            frame[pos++] = FRAME_CATCHUP;
+            frame[pos++] = _seq;
+            frame[pos++] = _node_name.size();
+            memcpy(frame + pos, _node_name.c_str(), _node_name.size());
+            pos += _node_name.size();
+            for (uint8_t i = 0; i < blocks; i++)
+            {
+                frame[pos++] = _blocks[i].flags;
+                frame[pos++] = _blocks[i].object_id.size();
+                memcpy(frame + pos, _blocks[i].object_id.c_str(), _blocks[i].object_id.size());
+                pos += _blocks[i].object_id.size();
+                frame[pos++] = _blocks[i].count;
+                memcpy(frame + pos, _blocks[i].data, _blocks[i].len);
+                pos += _blocks[i].len;
+            }
+            _catchup_encode_us += micros() - start;
+
+            ESP_LOGD(TAG, "Catch-up frame: %u reading(s) of %u sensor(s) in %u bytes, %u left", taken, blocks, (unsigned)pos,
+                     _backlog.size() - taken);
+            _in_flight_catchup = taken;
+            _in_flight_priority = PRIORITY_BULK;
+            _in_flight_bytes = pos;
+            return this->transmit(frame, pos, true);
+        }
+
+        bool Lora_MQTTComponent::transmit(const uint8_t *data, size_t len, bool want_ack)
+        {
+            uint8_t sealed[MAX_CATCHUP_FRAME];
+            if (_sealer.enabled())
+            {
+                if (len + SEALED_OVERHEAD > sizeof(sealed) || !_sealer.seal(data, len, sealed))
+                {
+                    ESP_LOGW(TAG, "Could not seal a %u byte frame, not sent", (unsigned)len);
+                    return false;
+                }
+                data = sealed;
+                len += SEALED_OVERHEAD;
+            }
+            if (len > LoRa.maxPacketLength())
+            {
+                ESP_LOGW(TAG, "A %u byte frame doesn't fit implicit_header, not sent", (unsigned)len);
+                return false;
+            }
+
+            // TX done is signalled on the same IRQ line as RX done, so stop listening first
+            if (this->listening())
+                LoRa.onReceive(NULL);
             LoRa.beginPacket();
-            LoRa.print(line.c_str());
-            LoRa.endPacket();
+            LoRa.write(data, len);
+            bool sent = LoRa.endPacket();
+            if (_backlog_enabled)
+                _airtime_budget_us -= LoRa.timeOnAir(len);
+            if (this->listening())
+            {
+                LoRa.onReceive(Lora_MQTTComponent::call_on_data_recv_callback);
+                LoRa.receive();
+            }
+            if (want_ack)
+            {
+                _ack_pending = true;
+                _ack_seq = _seq++;
+                _ack_sent = millis();
+            }
+            return sent;
+        }
+
+        void Lora_MQTTComponent::handle_downlink()
+        {
+            uint8_t frame[256];
+            int len = 0;
+            while (LoRa.available())
+            {
+                int c = LoRa.read();
+                if (len < (int)sizeof(frame))
+                    frame[len] = c;
+                len++;
+            }
+            if (len == 0 || len > (int)sizeof(frame))
+                return;
+            if (frame[0] == FRAME_FUOTA_SESSION || frame[0] == FRAME_FUOTA_FRAGMENT)
+            {
+                if (_fuota.on_frame(frame, len, millis()))
+                    App.safe_reboot();
+                return;
+            }
+            if (len == BEACON_FRAME_SIZE && frame[0] == FRAME_BEACON)
+            {
+                if (_time_sync)
+                    this->on_beacon(frame);
+                return;
+            }
+            if ((len != ACK_FRAME_SIZE && len != ACK_CORRECTION_FRAME_SIZE) || frame[0] != FRAME_ACK)
+                return;
+            if ((frame[1] | (frame[2] << 8)) != _node_id || !_ack_pending || frame[3] != _ack_seq)
+                return;
+            this->on_ack();
+            if (len == ACK_CORRECTION_FRAME_SIZE)
+                this->correct_frequency((int16_t)(frame[4] | (frame[5] << 8)));
+        }
+
+        void Lora_MQTTComponent::correct_frequency(int16_t hz)
+        {
+            // the bridge measured our carrier hz above where it should be; move it, and
+            // the receiver with it, a step at a time and no further than a crystal can be off
+            int32_t step_limit = (int64_t)_frequency * MAX_CORRECTION_STEP_PPM / 1000000;
+            int32_t limit = (int64_t)_frequency * MAX_CORRECTION_PPM / 1000000;
+            int32_t step = -hz;
+            step = step > step_limit ? step_limit : step < -step_limit ? -step_limit : step;
+            _frequency_correction += step;
+            _frequency_correction = _frequency_correction > limit ? limit : _frequency_correction < -limit ? -limit : _frequency_correction;
+            LoRa.setFrequency(_frequency + _frequency_correction);
+            LoRa.receive();
+            ESP_LOGI(TAG, "Frequency corrected by %ld Hz, now %ld Hz from %lu", (long)step, (long)_frequency_correction,
+                     (unsigned long)_frequency);
+        }
+
+        void Lora_MQTTComponent::reset_frequency_correction()
+        {
+            if (_frequency_correction == 0)
+                return;
+            ESP_LOGW(TAG, "Dropping the %ld Hz frequency correction until the bridge answers again", (long)_frequency_correction);
+            _frequency_correction = 0;
+            LoRa.setFrequency(_frequency);
+            LoRa.receive();
+        }
+
+        void Lora_MQTTComponent::on_beacon(const uint8_t *frame)
+        {
+            // the beacon is stamped when the bridge starts transmitting it; it lands here
+            // one airtime later (the IRQ time is taken in the receive callback)
+            uint32_t seconds = frame[1] | (frame[2] << 8) | (frame[3] << 16) | ((uint32_t)frame[4] << 24);
+            int64_t network_ms = (int64_t)seconds * 1000 + frame[5] * 1000 / 256 + LoRa.timeOnAir(BEACON_FRAME_SIZE) / 1000;
+            int64_t offset = network_ms - _rx_time_us / 1000;
+            int64_t error = offset - _network_offset_ms;
+
+            if (!_time_synced || error > 2000 || error < -2000)
+            {
+                // first beacon, or the bridge clock stepped: jump straight to it
+                _network_offset_ms = offset;
+                if (!_time_synced)
+                    ESP_LOGI(TAG, "Network time acquired from bridge beacon: %lu", (unsigned long)seconds);
+                _time_synced = true;
+            }
+            else
+            {
+                // slew by a quarter of the error to smooth out RX latency jitter
+                _network_offset_ms += error / 4;
+            }
+            _beacons++;
+            ESP_LOGD(TAG, "Beacon %lu: offset error %lld ms", (unsigned long)_beacons, (long long)error);
+        }
+
+        uint32_t Lora_MQTTComponent::network_time(uint32_t local_time)
+        {
+            // readings are stamped with the node clock; shift by how long ago that was
+            int64_t network_now_ms = esp_timer_get_time() / 1000 + _network_offset_ms;
+            uint32_t local_now = this->node_time();
+            uint32_t age = local_now >= local_time ? local_now - local_time : 0;
+            return (uint32_t)(network_now_ms / 1000) - age;
+        }
+
+        const char *Lora_MQTTComponent::timestamp(uint32_t local_time, char *buf)
+        {
+            if (!_time_synced)
+                return nullptr;
+            uint32_t stamp = this->network_time(local_time) % TIMESTAMP_MODULO;
+            buf[0] = timestamp_char(stamp >> 6);
+            buf[1] = timestamp_char(stamp);
+            buf[2] = 0;
+            return buf;
+        }
+
+        void Lora_MQTTComponent::on_ack()
+        {
+            _ack_pending = false;
+            _missed_acks = 0;
+            if (!_link_up)
+            {
+                ESP_LOGI(TAG, "Bridge reachable again, %u reading(s) to catch up", _backlog.size());
+                _link_up = true;
+            }
+            if (_in_flight_catchup != 0)
+            {
+                _backlog.pop(_in_flight_catchup);
+                _catchup_frames++;
+                _catchup_records += _in_flight_catchup;
+                _catchup_records_window += _in_flight_catchup;
+                _catchup_bytes += _in_flight_bytes;
+                _in_flight_catchup = 0;
+            }
+            else
+            {
+                LatencyStats &latency = _latency[_in_flight_priority];
+                uint32_t ms = millis() - _in_flight_reading.queued_ms;
+                latency.count++;
+                latency.total_ms += ms;
+                if (ms > latency.max_ms)
+                    latency.max_ms = ms;
+            }
+        }
+
+        void Lora_MQTTComponent::on_ack_timeout()
+        {
+            _ack_pending = false;
+            if (_in_flight_catchup == 0)
+            {
+                if (_in_flight_priority == PRIORITY_CRITICAL && ++_in_flight_reading.attempts < CRITICAL_ATTEMPTS)
+                {
+                    // retry right away rather than wait for the catch-up upload
+                    this->requeue_front(_in_flight_reading, PRIORITY_CRITICAL);
+                }
+                else
+                {
+                    // the live reading may be lost: keep it for the catch-up upload
+                    _backlog.push(_in_flight_reading.record);
+                }
+            }
+            _in_flight_catchup = 0;
+            if (_link_up && ++_missed_acks >= LINK_DOWN_MISSES)
+            {
+                ESP_LOGW(TAG, "No ACK from a bridge for %u frames, buffering readings", _missed_acks);
+                _link_up = false;
+                _last_probe = millis();
+                // a bad correction may be why: the bridge corrects us again once it hears us
+                this->reset_frequency_correction();
+            }
+        }
+
+        size_t Lora_MQTTComponent::max_frame()
+        {
+            size_t radio = LoRa.maxPacketLength();
+            if (radio > MAX_CATCHUP_FRAME)
+                radio = MAX_CATCHUP_FRAME;
+            // setup() refuses an implicit_header this leaves too short, but never wrap
+            return radio > this->frame_overhead() ? radio - this->frame_overhead() : 0;
+        }
+
+        bool Lora_MQTTComponent::airtime_available(size_t len, uint8_t priority)
+        {
+            int64_t reserve = priority == PRIORITY_CRITICAL ? 0 : _airtime_budget_max_us * CRITICAL_RESERVE_PERCENT / 100;
+            return _airtime_budget_us - reserve >= (int64_t)LoRa.timeOnAir(len + this->frame_overhead());
+        }
+
+        void Lora_MQTTComponent::publish_backlog_stats(uint32_t now)
+        {
+            uint32_t elapsed = now - _last_stats;
+            float rate = elapsed == 0 ? 0.0f : _catchup_records_window * 60000.0f / elapsed;
+            _last_stats = now;
+            _catchup_records_window = 0;
+
+            ESP_LOGI(TAG, "Backlog: depth=%u, dropped=%lu, unsendable=%lu, link=%s, catch-up=%lu reading(s) in %lu frame(s), %.1f readings/min, airtime budget=%lld ms",
+                     _backlog.size(), (unsigned long)_backlog.dropped(), (unsigned long)_catchup_unsendable, _link_up ? "up" : "down",
+                     (unsigned long)_catchup_records, (unsigned long)_catchup_frames, rate,
+                     (long long)(_airtime_budget_us / 1000));
+            if (_catchup_records != 0)
+            {
+                ESP_LOGI(TAG, "Catch-up encoding: %.1f bytes/reading, %.1f us/reading",
+                         (float)_catchup_bytes / _catchup_records, (float)_catchup_encode_us / _catchup_records);
+            }
+
+            static const char *const PRIORITY_NAMES[PRIORITY_CLASSES] = {"critical", "normal", "bulk"};
+            for (uint8_t priority = 0; priority < PRIORITY_CLASSES; priority++)
+            {
+                const LatencyStats &latency = _latency[priority];
+                if (latency.count != 0)
+                    ESP_LOGI(TAG, "Latency %s: %lu reading(s), avg %lu ms, max %lu ms, queued %u", PRIORITY_NAMES[priority],
+                             (unsigned long)latency.count, (unsigned long)(latency.total_ms / latency.count),
+                             (unsigned long)latency.max_ms, (unsigned)_queues[priority].count);
+            }
+            if (_preempted != 0)
+                ESP_LOGI(TAG, "ACK waits preempted by critical readings: %lu", (unsigned long)_preempted);
+            if (_critical_latency_sensor != nullptr && _latency[PRIORITY_CRITICAL].count != 0)
+                _critical_latency_sensor->publish_state(_latency[PRIORITY_CRITICAL].total_ms / _latency[PRIORITY_CRITICAL].count);
+            for (auto &latency : _latency)
+                latency = LatencyStats{};
+
+            if (_backlog_depth_sensor != nullptr)
+                _backlog_depth_sensor->publish_state(_backlog.size());
+            if (_catchup_rate_sensor != nullptr)
+                _catchup_rate_sensor->publish_state(rate);
+        }
+
+        uint32_t Lora_MQTTComponent::node_time()
+        {
+            // system time keeps counting across deep sleep and software resets on ESP32,
+            // unlike millis(), so backlog ages stay meaningful after a reboot
+            return (uint32_t)::time(nullptr);
+        }
+
+        void Lora_MQTTComponent::call_on_data_recv_callback(int packetSize)
+        {
+            _rx_time_us = esp_timer_get_time();
+            _packet_size = packetSize;
+            receivedLoRaP = true;
+        }
+
+#ifdef USE_BINARY_SENSOR
+        void Lora_MQTTComponent::on_binary_sensor_update(binary_sensor::BinarySensor *obj, uint16_t index, float state)
+        {
+            if (!obj->has_state())
+                return;
+            if (_backlog_enabled)
+            {
+                this->queue_reading(index, ENTITY_BINARY, state, _binary_sensor_priorities[index]);
+                this->callback_.call(state);
+                return;
+            }
+            std::string line = this->build_binary_sensor_line(obj, state, this->node_time());
+
+            ESP_LOGI(TAG, "LoRa-MQTT Publish:  %s", line.c_str());
+            this->transmit(reinterpret_cast<const uint8_t *>(line.c_str()), line.size(), false);
             this->callback_.call(state);
         }
+
+        std::string Lora_MQTTComponent::build_binary_sensor_line(binary_sensor::BinarySensor *obj, float state, uint32_t time)
+        {
+            char stamp[3];
+            std::string line;
+            if (!LoRaCodec::encode_binary_sensor(_node_name, obj, state, this->timestamp(time, stamp), line))
+                ESP_LOGW(TAG, "Line for %s is too long for one LoRa frame", obj->get_name().c_str());
+            return line;
+        }
 #endif
 
 #ifdef USE_TEXT_SENSOR
-        void Lora_MQTTComponent::on_text_sensor_update(text_sensor::TextSensor *obj, std::string state)
+        void Lora_MQTTComponent::on_text_sensor_update(text_sensor::TextSensor *obj, uint16_t index, std::string state)
         {
             if (!obj->has_state())
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-            std::string line;
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            // line += obj->get_device_class().c_str();
-            line += ":";
-            // line += "sensor";
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += ":";
-            line += state;
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
+            // FRAME_TEXT name_len name obj_len object_id, then the dictionary coded state
+            std::string object_id = str_snake_case(obj->get_name().c_str());
+            if (_node_name.size() > 64 || object_id.size() > 64)
+            {
+                ESP_LOGW(TAG, "Name of %s is too long for a text frame, dropped", obj->get_name().c_str());
+                return;
             }
-            else
+            uint8_t frame[MAX_CATCHUP_FRAME];
+            size_t pos = 0;
+            frame[pos++] = FRAME_TEXT;
+            frame[pos++] = _node_name.size();
+            memcpy(frame + pos, _node_name.data(), _node_name.size());
+            pos += _node_name.size();
+            frame[pos++] = object_id.size();
+            memcpy(frame + pos, object_id.data(), object_id.size());
+            pos += object_id.size();
+            size_t room = this->max_frame() > pos ? this->max_frame() - pos : 0;
+            size_t n = _text_dictionaries[index].encode(state, millis(), frame + pos, room);
+            if (n == 0)
             {
-                line += ":";
+                ESP_LOGW(TAG, "State of %s is too long for one LoRa frame, dropped", obj->get_name().c_str());
+                return;
             }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += "::";
+            pos += n;
 
-            ESP_LOGI(TAG, "LoRa-MQTT Publish:  %s", line.c_str());
-            LoRa.beginPacket();
-            LoRa.print(line.c_str());
-            LoRa.endPacket();
+            ESP_LOGI(TAG, "LoRa-MQTT Publish:  %s = '%s' (%u bytes)", object_id.c_str(), state.c_str(), (unsigned)pos);
+            this->transmit(frame, pos, false);
             this->callback_text_.call(state);
         }
 #endif
 
-        void Lora_MQTTComponent::on_sensor_update(sensor::Sensor *obj, float state)
+        void Lora_MQTTComponent::on_sensor_update(sensor::Sensor *obj, uint16_t index, float state)
         {
             if (!obj->has_state())
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-            std::string line;
-            int8_t accuracy = obj->get_accuracy_decimals();
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            line += obj->get_device_class().c_str();
-            line += ":";
-            line += LOG_STR_ARG(state_class_to_string(obj->get_state_class()));
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += obj->get_unit_of_measurement().c_str();
-            line += ":";
-            line += value_accuracy_to_string(state, accuracy);
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
-            }
-            else
+            if (_backlog_enabled)
             {
-                line += ":";
+                this->queue_reading(index, 0, state, _sensor_priorities[index]);
+                this->callback_.call(state);
+                return;
             }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += ":sensor:";
+            std::string line = this->build_sensor_line(obj, state, this->node_time());
 
             ESP_LOGI(TAG, "LoRa-MQTT Publish:  %s", line.c_str());
-            LoRa.beginPacket();
-            LoRa.print(line.c_str());
-            LoRa.endPacket();
+            this->transmit(reinterpret_cast<const uint8_t *>(line.c_str()), line.size(), false);
             this->callback_.call(state);
         }
+
+        std::string Lora_MQTTComponent::build_sensor_line(sensor::Sensor *obj, float state, uint32_t time)
+        {
+            char stamp[3];
+            std::string line;
+            if (!LoRaCodec::encode_sensor(_node_name, obj, state, this->timestamp(time, stamp), line))
+                ESP_LOGW(TAG, "Line for %s is too long for one LoRa frame", obj->get_name().c_str());
+            return line;
+        }
     } // namespace lora_mqtt
 } // namespace esphome
@@ -4,6 +4,11 @@
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/core/automation.h"
 #include "esphome/core/hal.h"
+#include "node_backlog.h"
+#include "fuota_receiver.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/frame_crypto.h"
+#include "esphome/components/frame_codec/text_dictionary.h"
 
 #ifdef USE_BINARY_SENSOR
 #include "esphome/components/binary_sensor/binary_sensor.h"
@@ -17,42 +22,228 @@ namespace esphome
 {
     namespace lora_mqtt
     {
+        // TX priority classes, highest first. Binary sensors default to critical,
+        // sensors to normal; both can be overridden per entity.
+        enum TxPriority : uint8_t
+        {
+            PRIORITY_CRITICAL = 0,
+            PRIORITY_NORMAL = 1,
+            PRIORITY_BULK = 2,
+        };
+        static const uint8_t PRIORITY_CLASSES = 3;
+
         class Lora_MQTTComponent : public Component
         {
         public:
             void setup() override;
+            void loop() override;
             void add_on_state_callback(std::function<void(float)> &&callback) { this->callback_.add(std::move(callback)); }
             void set_cs_constant(GPIOPin *constant) { this->_cs = constant; }
             void set_reset_constant(GPIOPin *constant) { this->_reset = constant; }
             void set_dio0_constant(GPIOPin *constant) { this->_dio0 = constant; }
             void set_dio1_constant(GPIOPin *constant) { this->_dio1 = constant; }
             void set_chip_type_constant(int constant) { this->_chip_type = constant; }
-            void set_frequency_constant(long constant) { this->_frequency = constant; }
+            void set_modulation_constant(int constant) { this->_modulation = constant; }
+            void set_frequency_constant(uint32_t constant) { this->_frequency = constant; }
             void set_bandwidth_constant(long constant) { this->_bandwidth = constant; }
             void set_spread_constant(long constant) { this->_spread = constant; }
             void set_coding_constant(long constant) { this->_coding = constant; }
+            void set_bit_rate_constant(long constant) { this->_bit_rate = constant; }
+            void set_flrc_coding_constant(long constant) { this->_flrc_coding = constant; }
+            void set_deviation_constant(long constant) { this->_deviation = constant; }
             void set_sync_constant(long constant) { this->_sync = constant; }
+            void set_implicit_header_constant(long constant) { this->_implicit_header = constant; }
+            void set_backlog_constant(bool constant) { this->_backlog_enabled = constant; }
+            void set_backlog_size_constant(long constant) { this->_backlog_size = constant; }
+            void set_duty_cycle_constant(float constant) { this->_duty_cycle = constant; }
+            void set_backlog_depth_sensor(sensor::Sensor *sensor) { this->_backlog_depth_sensor = sensor; }
+            void set_catchup_rate_sensor(sensor::Sensor *sensor) { this->_catchup_rate_sensor = sensor; }
+            void set_critical_latency_sensor(sensor::Sensor *sensor) { this->_critical_latency_sensor = sensor; }
+            void set_entity_priority_constant(EntityBase *entity, int priority) { this->_entity_priorities.push_back({entity, (uint8_t)priority}); }
+            void set_time_sync_constant(bool constant) { this->_time_sync = constant; }
+            void set_encryption_key_constant(const std::string &constant) { this->_encryption_key = constant; }
+            void set_key_id_constant(int constant) { this->_key_id = constant; }
+            void set_fuota_key_constant(const std::string &constant) { this->_fuota_key = constant; }
+            static volatile bool receivedLoRaP;
 
         private:
             CallbackManager<void(float)> callback_;
             CallbackManager<void(std::string)> callback_text_;
-            void on_sensor_update(sensor::Sensor *obj, float state);
+            void on_sensor_update(sensor::Sensor *obj, uint16_t index, float state);
+            std::string build_sensor_line(sensor::Sensor *obj, float state, uint32_t time);
 #ifdef USE_BINARY_SENSOR
-            void on_binary_sensor_update(binary_sensor::BinarySensor *obj, float state);
+            void on_binary_sensor_update(binary_sensor::BinarySensor *obj, uint16_t index, float state);
+            std::string build_binary_sensor_line(binary_sensor::BinarySensor *obj, float state, uint32_t time);
 #endif
 #ifdef USE_TEXT_SENSOR
-            void on_text_sensor_update(text_sensor::TextSensor *obj, std::string state);
+            void on_text_sensor_update(text_sensor::TextSensor *obj, uint16_t index, std::string state);
+            std::vector<frame_codec::TextDictionaryEncoder> _text_dictionaries;
 #endif
             GPIOPin *_cs{0};
             GPIOPin *_reset{0};
             GPIOPin *_dio0{0};
             GPIOPin *_dio1{0};
             int _chip_type{0};
-            long _frequency{0};
+            int _modulation{0};
+            uint32_t _frequency{0};
             long _bandwidth{0};
             long _spread{0};
             long _coding{0};
+            long _bit_rate{0}; // 0 keeps the driver's default for the modulation
+            long _flrc_coding{3};
+            long _deviation{0}; // 0 for a quarter of the bit rate
             long _sync{0};
+            long _implicit_header{0};
+
+            // backlog / acknowledged delivery, only used when backlog is enabled
+            static const uint8_t QUEUE_SIZE = 16;
+            static const uint8_t LINK_DOWN_MISSES = 3;
+            static const uint32_t PROBE_INTERVAL_MS = 60000;
+            static const uint32_t STATS_INTERVAL_MS = 60000;
+
+            // one FIFO per priority class; a critical reading that isn't acknowledged is
+            // retried straight away a few times before it falls back to the backlog
+            static const uint8_t CRITICAL_ATTEMPTS = 3;
+            // share of the airtime budget only critical frames may dip into
+            static const uint8_t CRITICAL_RESERVE_PERCENT = 10;
+            struct QueuedReading
+            {
+                BacklogRecord record;
+                uint32_t queued_ms;
+                uint8_t attempts;
+            };
+            struct TxQueue
+            {
+                QueuedReading entries[QUEUE_SIZE];
+                uint8_t head{0};
+                uint8_t count{0};
+
+                QueuedReading &front() { return this->entries[this->head]; }
+                void pop()
+                {
+                    this->head = (this->head + 1) % QUEUE_SIZE;
+                    this->count--;
+                }
+            };
+            // event to ACK, which the bridge sends as it publishes the reading
+            struct LatencyStats
+            {
+                uint32_t count{0};
+                uint32_t total_ms{0};
+                uint32_t max_ms{0};
+            };
+
+            uint8_t priority_of(EntityBase *entity, uint8_t fallback) const;
+            void queue_reading(uint16_t entity, uint8_t flags, float value, uint8_t priority);
+            void requeue_front(const QueuedReading &reading, uint8_t priority);
+            void preempt_in_flight();
+            bool send_reading(const BacklogRecord &reading);
+            bool send_catchup();
+            bool transmit(const uint8_t *data, size_t len, bool want_ack);
+            void handle_downlink();
+            void on_ack();
+            void on_ack_timeout();
+            // Carrier correction from the bridge's ACKs, in Hz from _frequency. ACKs aren't
+            // authenticated, so one moves the carrier at most MAX_CORRECTION_STEP_PPM, the
+            // total stays within what a crystal without TCXO is off (MAX_CORRECTION_PPM),
+            // and it is dropped when the link goes down.
+            static const uint32_t MAX_CORRECTION_PPM = 20;
+            static const uint32_t MAX_CORRECTION_STEP_PPM = 4;
+            void correct_frequency(int16_t hz);
+            void reset_frequency_correction();
+            int32_t _frequency_correction{0};
+            bool airtime_available(size_t len, uint8_t priority);
+            void publish_backlog_stats(uint32_t now);
+            uint32_t node_time();
+            static void call_on_data_recv_callback(int packetSize);
+            static volatile int _packet_size;
+            static volatile int64_t _rx_time_us;
+
+            // network time from bridge beacons
+            bool listening() const { return _backlog_enabled || _time_sync || _fuota.enabled(); }
+            void on_beacon(const uint8_t *frame);
+            uint32_t network_time(uint32_t local_time);
+            const char *timestamp(uint32_t local_time, char *buf);
+            bool _time_sync{false};
+            bool _time_synced{false};
+            int64_t _network_offset_ms{0};
+            uint32_t _beacons{0};
+
+            // authenticated encryption of everything the node sends
+            std::string _encryption_key;
+            int _key_id{0};
+            frame_codec::FrameSealer _sealer;
+            uint32_t _last_link_stats{0};
+            size_t frame_overhead() const { return _sealer.enabled() ? frame_codec::SEALED_OVERHEAD : 0; }
+            // the most a frame can carry before sealing, less in implicit header mode
+            size_t max_frame();
+
+            // firmware updates multicast by the bridge
+            std::string _fuota_key;
+            FuotaReceiver _fuota;
+
+            bool _backlog_enabled{false};
+            long _backlog_size{NodeBacklog::CAPACITY};
+            float _duty_cycle{1.0f};
+            sensor::Sensor *_backlog_depth_sensor{nullptr};
+            sensor::Sensor *_catchup_rate_sensor{nullptr};
+            NodeBacklog _backlog;
+
+            TxQueue _queues[PRIORITY_CLASSES];
+            std::vector<std::pair<EntityBase *, uint8_t>> _entity_priorities;
+            std::vector<uint8_t> _sensor_priorities;
+            std::vector<uint8_t> _binary_sensor_priorities;
+            LatencyStats _latency[PRIORITY_CLASSES];
+            uint32_t _preempted{0};
+            sensor::Sensor *_critical_latency_sensor{nullptr};
+
+            std::string _node_name;
+            uint16_t _node_id{0};
+            uint8_t _seq{0};
+            bool _ack_pending{false};
+            uint8_t _ack_seq{0};
+            uint32_t _ack_sent{0};
+            uint32_t _ack_timeout{0};
+            uint16_t _in_flight_catchup{0};
+            QueuedReading _in_flight_reading;
+            uint8_t _in_flight_priority{PRIORITY_NORMAL};
+            bool _link_up{true};
+            uint8_t _missed_acks{0};
+            uint32_t _last_probe{0};
+
+            int64_t _airtime_budget_us{0};
+            int64_t _airtime_budget_max_us{0};
+            uint32_t _airtime_refill{0};
+
+            uint32_t _catchup_frames{0};
+            uint32_t _catchup_records{0};
+            uint32_t _catchup_records_window{0};
+            uint32_t _catchup_bytes{0};
+            uint32_t _catchup_encode_us{0};
+            // readings whose entity can't fit even an empty catch-up frame
+            uint32_t _catchup_unsendable{0};
+            uint16_t _in_flight_bytes{0};
+
+            // per-entity sample blocks while a catch-up frame is assembled
+            static const size_t MAX_CATCHUP_FRAME = 255;
+            static const uint8_t MAX_CATCHUP_BLOCKS = 6;
+            // a catch-up frame's header and name, then one block: flags, id length, count,
+            // the object_id and a sample of at most 10 bytes
+            static const size_t CATCHUP_HEADER = 3;
+            static const size_t CATCHUP_BLOCK_HEADER = 3;
+            static const size_t MAX_SAMPLE = 10;
+            struct CatchupBlock
+            {
+                uint16_t entity;
+                uint8_t flags;
+                uint8_t count;
+                uint8_t len;
+                frame_codec::SeriesEncoder encoder;
+                std::string object_id;
+                uint8_t data[MAX_CATCHUP_FRAME];
+            };
+            CatchupBlock _blocks[MAX_CATCHUP_BLOCKS];
+            uint32_t _last_stats{0};
         };
 
         class ESPLoraSendTrigger : public Trigger<float>
@@ -0,0 +1,75 @@
+#include "node_backlog.h"
+#include "esphome/core/log.h"
+#include <Arduino.h>
+
+namespace esphome
+{
+    namespace lora_mqtt
+    {
+        static const char *const TAG = "lora_mqtt.backlog";
+        static const uint32_t BACKLOG_MAGIC = 0x4C424B31;
+
+        struct BacklogStore
+        {
+            uint32_t magic;
+            uint32_t build_hash;
+            uint16_t head;
+            uint16_t count;
+            uint32_t dropped;
+            BacklogRecord records[NodeBacklog::CAPACITY];
+        };
+
+        // ~3 KB of RTC slow memory, not cleared on reset or wake from deep sleep
+        static RTC_NOINIT_ATTR BacklogStore rtc_backlog;
+
+        void NodeBacklog::begin(uint16_t limit, uint32_t build_hash)
+        {
+            this->limit_ = (limit == 0 || limit > CAPACITY) ? CAPACITY : limit;
+            if (rtc_backlog.magic != BACKLOG_MAGIC || rtc_backlog.build_hash != build_hash ||
+                rtc_backlog.head >= CAPACITY || rtc_backlog.count > CAPACITY)
+            {
+                // power-on reset or new firmware: the entity indexes can't be trusted
+                rtc_backlog.magic = BACKLOG_MAGIC;
+                rtc_backlog.build_hash = build_hash;
+                rtc_backlog.head = 0;
+                rtc_backlog.count = 0;
+                rtc_backlog.dropped = 0;
+                return;
+            }
+            while (rtc_backlog.count > this->limit_)
+                this->pop(1);
+            if (rtc_backlog.count != 0)
+                ESP_LOGI(TAG, "Recovered %u backlog reading(s) from RTC memory", rtc_backlog.count);
+        }
+
+        void NodeBacklog::push(const BacklogRecord &record)
+        {
+            if (rtc_backlog.count >= this->limit_)
+            {
+                // keep the newest readings
+                this->pop(1);
+                rtc_backlog.dropped++;
+            }
+            uint16_t tail = (rtc_backlog.head + rtc_backlog.count) % CAPACITY;
+            rtc_backlog.records[tail] = record;
+            rtc_backlog.count++;
+        }
+
+        void NodeBacklog::pop(uint16_t count)
+        {
+            if (count > rtc_backlog.count)
+                count = rtc_backlog.count;
+            rtc_backlog.head = (rtc_backlog.head + count) % CAPACITY;
+            rtc_backlog.count -= count;
+        }
+
+        const BacklogRecord &NodeBacklog::at(uint16_t index) const
+        {
+            return rtc_backlog.records[(rtc_backlog.head + index) % CAPACITY];
+        }
+
+        uint16_t NodeBacklog::size() const { return rtc_backlog.count; }
+
+        uint32_t NodeBacklog::dropped() const { return rtc_backlog.dropped; }
+    } // namespace lora_mqtt
+} // namespace esphome
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome
+{
+    namespace lora_mqtt
+    {
+        struct BacklogRecord
+        {
+            uint32_t time;   // node clock, seconds
+            float value;
+            uint16_t entity; // index into App.get_sensors() / App.get_binary_sensors()
+            uint8_t flags;   // ENTITY_BINARY for binary sensors
+            uint8_t reserved;
+        };
+
+        // Bounded ring of readings that could not be delivered. It lives in RTC memory,
+        // so it survives deep sleep and software resets (but not a power cycle).
+        class NodeBacklog
+        {
+        public:
+            static const uint16_t CAPACITY = 256;
+
+            // Adopts the RTC copy if it is intact and belongs to this firmware build.
+            void begin(uint16_t limit, uint32_t build_hash);
+
+            void push(const BacklogRecord &record);
+            void pop(uint16_t count);
+            const BacklogRecord &at(uint16_t index) const;
+            uint16_t size() const;
+            bool empty() const { return this->size() == 0; }
+            uint32_t dropped() const;
+
+        protected:
+            uint16_t limit_{CAPACITY};
+        };
+    } // namespace lora_mqtt
+} // namespace esphome
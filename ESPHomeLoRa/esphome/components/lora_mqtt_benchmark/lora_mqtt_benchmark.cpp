@@ -0,0 +1,328 @@
+#include "lora_mqtt_benchmark.h"
+#include "esphome/core/log.h"
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "esphome/components/lora_radio/LoRa.h"
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+#ifdef USE_ESP32
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+// set CONFIG_HEAP_TRACING_STANDALONE in sdkconfig_options to count allocations
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+#include <esp_heap_trace.h>
+#define BENCH_HEAP_TRACE
+#endif
+#endif
+
+#ifdef USE_ESP8266
+#include <Esp.h>
+#include <cont.h>
+#endif
+
+namespace esphome
+{
+    namespace lora_mqtt_benchmark
+    {
+        using namespace frame_codec;
+
+        static const char *const TAG = "lora_mqtt_benchmark";
+        static const char *const DISCOVERY_PREFIX = "homeassistant";
+        static const float BENCH_STATE = 21.375f;
+
+#ifdef USE_ESP32
+        // every batch runs on a fresh stack of this size, so its high-water mark is the
+        // batch's own
+        static const uint32_t BATCH_STACK = 8192;
+
+        struct Batch
+        {
+            Lora_MQTT_BenchmarkComponent *self;
+            BenchmarkOperation operation;
+            uint8_t size;
+            TaskHandle_t caller;
+        };
+#endif
+
+#ifdef BENCH_HEAP_TRACE
+        // HEAP_TRACE_ALL keeps freed allocations too: room for everything one call does
+        static heap_trace_record_t trace_records[64];
+#endif
+
+        static size_t free_heap()
+        {
+#ifdef USE_ESP32
+            return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+#elif defined(USE_ESP8266)
+            return ESP.getFreeHeap();
+#else
+            return 0;
+#endif
+        }
+
+        const char *Lora_MQTT_BenchmarkComponent::operation_name(BenchmarkOperation operation)
+        {
+            switch (operation)
+            {
+            case BENCH_ENCODE:
+                return "encode";
+            case BENCH_DECODE:
+                return "decode";
+            case BENCH_DISCOVERY:
+                return "discovery";
+            case BENCH_TOPICS:
+                return "topics";
+            case BENCH_SPI_READ:
+                return "spi_read";
+            default:
+                return "";
+            }
+        }
+
+        float Lora_MQTT_BenchmarkComponent::get_setup_priority() const { return setup_priority::LATE; }
+
+        void Lora_MQTT_BenchmarkComponent::setup()
+        {
+            ESP_LOGI(TAG, "Benchmarking %ld iteration(s) per operation and size at %lu MHz...", _iterations,
+                     (unsigned long)(arch_get_cpu_freq_hz() / 1000000));
+            if (_iterations < 1)
+                _iterations = 1;
+            size_t heap_before = free_heap();
+            _samples.resize(_iterations);
+            _entities.reset(new (std::nothrow) EntityTable());
+            // small enough to fill up, so topics is timed with evictions
+            if (_entities != nullptr)
+                _entities->begin(64);
+#ifdef BENCH_HEAP_TRACE
+            heap_trace_init_standalone(trace_records, sizeof(trace_records) / sizeof(trace_records[0]));
+#endif
+#ifdef USE_SENSOR
+            _sensor.set_device_class("temperature");
+            _sensor.set_unit_of_measurement("°C");
+            _sensor.set_state_class(sensor::STATE_CLASS_MEASUREMENT);
+            _sensor.set_accuracy_decimals(2);
+#endif
+            // a packet arriving during the SPI reads would have its readout collide with them
+            int receiving = LoRa.isReceiving();
+            LoRa.idle();
+
+            for (uint8_t size = 0; size < BENCH_SIZES; size++)
+            {
+                if (!this->prepare(size))
+                    continue;
+                for (uint8_t operation = 0; operation < BENCH_OPERATIONS; operation++)
+                {
+#ifdef USE_ESP32
+                    Batch batch{this, (BenchmarkOperation)operation, size, xTaskGetCurrentTaskHandle()};
+                    // on this core: the cycle counter is per core
+                    if (xTaskCreatePinnedToCore(Lora_MQTT_BenchmarkComponent::batch_task, "benchmark", BATCH_STACK, &batch,
+                                                uxTaskPriorityGet(nullptr), nullptr, xPortGetCoreID()) == pdPASS)
+                        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                    else
+                        this->run_batch((BenchmarkOperation)operation, size);
+#else
+#ifdef USE_ESP8266
+                    ESP.resetFreeContStack();
+#endif
+                    this->run_batch((BenchmarkOperation)operation, size);
+#ifdef USE_ESP8266
+                    // the depth of the whole loop stack, setup() included
+                    if (_results[operation][size].size != 0)
+                        _results[operation][size].stack = CONT_STACKSIZE - ESP.getFreeContStack();
+#endif
+#endif
+                    App.feed_wdt();
+                }
+            }
+
+            if (receiving != 0)
+                LoRa.receive(LoRa.implicitHeaderLength());
+            _entities.reset();
+            _samples.clear();
+            _samples.shrink_to_fit();
+            this->log_results();
+            ESP_LOGI(TAG, "Free heap: %u bytes before the benchmark, %u after", (unsigned)heap_before, (unsigned)free_heap());
+#ifdef USE_SENSOR
+            this->publish_results();
+#endif
+        }
+
+#ifdef USE_ESP32
+        void Lora_MQTT_BenchmarkComponent::batch_task(void *arg)
+        {
+            Batch *batch = (Batch *)arg;
+            batch->self->run_batch(batch->operation, batch->size);
+            BenchmarkResult &result = batch->self->_results[batch->operation][batch->size];
+            // ESP-IDF counts stack in bytes
+            if (result.size != 0)
+                result.stack = BATCH_STACK - uxTaskGetStackHighWaterMark(nullptr);
+            xTaskNotifyGive(batch->caller);
+            vTaskDelete(nullptr);
+        }
+#endif
+
+        void Lora_MQTT_BenchmarkComponent::run_batch(BenchmarkOperation operation, uint8_t size)
+        {
+            BenchmarkResult &result = _results[operation][size];
+            // the first call warms the caches and shows whether the operation runs here at all
+            if (!this->call(operation))
+                return;
+            for (long i = 0; i < _iterations; i++)
+            {
+                uint32_t start = arch_get_cpu_cycle_count();
+                this->call(operation);
+                _samples[i] = arch_get_cpu_cycle_count() - start;
+            }
+            // the median: an interrupt during a few calls doesn't move it
+            std::nth_element(_samples.begin(), _samples.begin() + _iterations / 2, _samples.end());
+            result.cycles = _samples[_iterations / 2];
+            result.size = operation == BENCH_SPI_READ ? BENCH_SIZE[size] : _line.size();
+#ifdef BENCH_HEAP_TRACE
+            // traced apart from the timing, which tracing would slow down; whatever other
+            // tasks allocate meanwhile counts too
+            if (heap_trace_start(HEAP_TRACE_ALL) == ESP_OK)
+            {
+                this->call(operation);
+                heap_trace_stop();
+                result.allocations = heap_trace_get_count();
+            }
+#endif
+        }
+
+        // Builds a line of (about) the size: the sensor's name is padded to get there,
+        // and so are its object id, topics and discovery config
+        bool Lora_MQTT_BenchmarkComponent::prepare(uint8_t size)
+        {
+            _name = "Benchmark";
+            std::string node = App.get_name();
+            SensorLine line;
+            line.node = node.c_str();
+            line.device_class = "temperature";
+            line.state_class = "measurement";
+            line.unit = "°C";
+            line.value = "21.38";
+            line.kind = "sensor";
+            line.object_id = "benchmark";
+            LoRaCodec::encode(line, _line);
+            if (_line.size() > BENCH_SIZE[size])
+            {
+                // too long already: only run the sizes above it, from the shortest
+                if (size + 1 < BENCH_SIZES && _line.size() > BENCH_SIZE[size + 1])
+                    return false;
+            }
+            else
+            {
+                _name.append(BENCH_SIZE[size] - _line.size(), 'x');
+            }
+            std::string object_id = str_snake_case(_name.c_str());
+            line.object_id = object_id.c_str();
+            if (!LoRaCodec::encode(line, _line))
+                return false;
+
+            _spi_size = BENCH_SIZE[size];
+            memcpy(_decoded_buf, _line.c_str(), _line.size() + 1);
+            LoRaCodec::decode(_decoded_buf, &_decoded);
+#ifdef USE_SENSOR
+            _sensor.set_name(_name.c_str());
+#endif
+            return true;
+        }
+
+        bool Lora_MQTT_BenchmarkComponent::call(BenchmarkOperation operation)
+        {
+            switch (operation)
+            {
+            case BENCH_ENCODE:
+            {
+#ifdef USE_SENSOR
+                // as build_sensor_line() does
+                std::string line;
+                return LoRaCodec::encode_sensor(App.get_name(), &_sensor, BENCH_STATE, nullptr, line);
+#else
+                return false;
+#endif
+            }
+            case BENCH_DECODE:
+            {
+                char buf[LoRaTransport::MAX_LINE + 1];
+                memcpy(buf, _line.c_str(), _line.size() + 1);
+                SensorLine line;
+                return LoRaCodec::decode(buf, &line);
+            }
+            case BENCH_DISCOVERY:
+            {
+                // as handle_packet() does
+                StaticJsonDocument<500> doc;
+                std::string json;
+                LoRaCodec::build_discovery(_decoded, _decoded.node, false, doc);
+                serializeJson(doc, json);
+                return !json.empty();
+            }
+            case BENCH_TOPICS:
+                // first sight of an entity; once the table is full every add() evicts
+                return _entities != nullptr && _entities->add(_decoded.type(), _decoded.node, _decoded.object_id, DISCOVERY_PREFIX) != nullptr;
+            case BENCH_SPI_READ:
+                return LoRa.readBuffer(_spi, _spi_size) == (int)_spi_size;
+            default:
+                return false;
+            }
+        }
+
+        void Lora_MQTT_BenchmarkComponent::log_results()
+        {
+            float cycles_per_us = arch_get_cpu_freq_hz() / 1e6f;
+            ESP_LOGI(TAG, "operation   bytes    cycles        us  allocations  stack");
+            for (uint8_t operation = 0; operation < BENCH_OPERATIONS; operation++)
+            {
+                bool run = false;
+                for (uint8_t size = 0; size < BENCH_SIZES; size++)
+                {
+                    const BenchmarkResult &result = _results[operation][size];
+                    if (result.size == 0)
+                        continue;
+                    run = true;
+                    char allocations[12] = "-", stack[12] = "-";
+                    if (result.allocations >= 0)
+                        snprintf(allocations, sizeof(allocations), "%ld", (long)result.allocations);
+                    if (result.stack >= 0)
+                        snprintf(stack, sizeof(stack), "%ld", (long)result.stack);
+                    ESP_LOGI(TAG, "%-9s %7u %9lu %9.1f %12s %6s", operation_name((BenchmarkOperation)operation), (unsigned)result.size,
+                             (unsigned long)result.cycles, result.cycles / cycles_per_us, allocations, stack);
+                }
+                if (!run)
+                    ESP_LOGI(TAG, "%-9s not run here", operation_name((BenchmarkOperation)operation));
+            }
+        }
+
+#ifdef USE_SENSOR
+        void Lora_MQTT_BenchmarkComponent::publish_results()
+        {
+            for (auto &entry : _result_sensors)
+            {
+                float value = NAN;
+                for (uint8_t operation = 0; operation < BENCH_OPERATIONS; operation++)
+                {
+                    if (entry.operation != operation_name((BenchmarkOperation)operation))
+                        continue;
+                    for (uint8_t size = 0; size < BENCH_SIZES; size++)
+                    {
+                        const BenchmarkResult &result = _results[operation][size];
+                        if (BENCH_SIZE[size] != (size_t)entry.size || result.size == 0)
+                            continue;
+                        if (entry.figure == "cycles")
+                            value = result.cycles;
+                        else if (entry.figure == "allocations" && result.allocations >= 0)
+                            value = result.allocations;
+                        else if (entry.figure == "stack" && result.stack >= 0)
+                            value = result.stack;
+                    }
+                }
+                entry.sensor->publish_state(value);
+            }
+        }
+#endif
+    } // namespace lora_mqtt_benchmark
+} // namespace esphome
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/entity_table.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+namespace esphome
+{
+    namespace lora_mqtt_benchmark
+    {
+        // the hot paths timed, each at every payload size
+        enum BenchmarkOperation : uint8_t
+        {
+            BENCH_ENCODE,    // the node's on_sensor_update(): a sensor state to a line
+            BENCH_DECODE,    // the bridge's LoRaCodec::decode() of that line
+            BENCH_DISCOVERY, // the bridge's build_discovery() and serializeJson()
+            BENCH_TOPICS,    // the bridge's EntityTable building an entity's topics
+            BENCH_SPI_READ,  // readData() of a packet that size out of the radio
+            BENCH_OPERATIONS,
+        };
+
+        // Line lengths, and bytes read over SPI. A board whose shortest line (node name,
+        // version and board all count) is longer than the first starts there.
+        static const uint8_t BENCH_SIZES = 4;
+        static const size_t BENCH_SIZE[BENCH_SIZES] = {64, 128, 192, 255};
+
+        struct BenchmarkResult
+        {
+            size_t size{0};         // bytes handled, 0 when not run
+            uint32_t cycles{0};     // median per call
+            int32_t allocations{-1}; // heap allocations per call, -1 without heap tracing
+            int32_t stack{-1};       // deepest stack use in bytes, -1 where not measured
+        };
+
+        // Times the encode, decode, discovery, topic and SPI paths once at boot on the
+        // board itself, for a per-release baseline. Results go to the log and to the
+        // sensors configured for them. Runs after the radio is set up, and blocks the
+        // loop for as long as it takes (well under a second at the default iterations).
+        class Lora_MQTT_BenchmarkComponent : public Component
+        {
+        public:
+            void setup() override;
+            float get_setup_priority() const override;
+            void set_iterations_constant(long constant) { this->_iterations = constant; }
+#ifdef USE_SENSOR
+            // operation: encode, decode, discovery, topics or spi_read; figure: cycles,
+            // allocations or stack; size: one of BENCH_SIZE
+            void add_result_sensor(const std::string &operation, const std::string &figure, long size, sensor::Sensor *sensor)
+            {
+                this->_result_sensors.push_back({operation, figure, size, sensor});
+            }
+#endif
+            const BenchmarkResult &result(BenchmarkOperation operation, uint8_t size) const { return _results[operation][size]; }
+
+            static const char *operation_name(BenchmarkOperation operation);
+
+        private:
+#ifdef USE_ESP32
+            static void batch_task(void *arg);
+#endif
+            void run_batch(BenchmarkOperation operation, uint8_t size);
+            bool prepare(uint8_t size);
+            bool call(BenchmarkOperation operation);
+            void log_results();
+#ifdef USE_SENSOR
+            void publish_results();
+#endif
+
+            long _iterations{50};
+            BenchmarkResult _results[BENCH_OPERATIONS][BENCH_SIZES];
+            std::vector<uint32_t> _samples;
+
+            // the payload of the current size
+            std::string _name;
+            std::string _line;
+            char _decoded_buf[frame_codec::LoRaTransport::MAX_LINE + 1];
+            frame_codec::SensorLine _decoded;
+            uint8_t _spi[256];
+            size_t _spi_size{0};
+            std::unique_ptr<frame_codec::EntityTable> _entities;
+#ifdef USE_SENSOR
+            sensor::Sensor _sensor;
+
+            struct ResultSensor
+            {
+                std::string operation;
+                std::string figure;
+                long size;
+                sensor::Sensor *sensor;
+            };
+            std::vector<ResultSensor> _result_sensors;
+#endif
+        };
+    } // namespace lora_mqtt_benchmark
+} // namespace esphome
@@ -0,0 +1,218 @@
+#include "capture_sink.h"
+#include "esphome/core/log.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include <LittleFS.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        using namespace frame_codec;
+
+        static const char *const TAG = "lora_mqtt_bridge.capture";
+        static const char *const CAPTURE_DIR = "/capture";
+
+        bool CaptureSink::begin(CaptureMode mode, const CaptureHeader &header, size_t max_bytes, PublishFn &&publish)
+        {
+            this->header_ = header;
+            this->publish_ = std::move(publish);
+            // MQTT chunks carry their own header, files get one when they are created
+            this->chunk_len_ = CAPTURE_HEADER_SIZE;
+            capture_put_header(this->chunk_, header);
+
+            if (mode == CAPTURE_FILE)
+            {
+                if (!LittleFS.begin(true))
+                {
+                    ESP_LOGE(TAG, "Could not mount LittleFS - capture disabled");
+                    return false;
+                }
+                if (!LittleFS.exists(CAPTURE_DIR))
+                    LittleFS.mkdir(CAPTURE_DIR);
+                // files left over from the last boot are uploaded, this boot starts after them
+                char path[32];
+                for (uint8_t index = 0; index < 2; index++)
+                {
+                    this->file_path_(false, index, path, sizeof(path));
+                    if (!LittleFS.exists(path))
+                        continue;
+                    char previous[32];
+                    this->file_path_(true, index, previous, sizeof(previous));
+                    if (LittleFS.exists(previous))
+                        LittleFS.remove(previous);
+                    LittleFS.rename(path, previous);
+                    this->upload_pending_ = true;
+                }
+                this->file_max_ = max_bytes / 2;
+                if (this->file_max_ < CHUNK_SIZE)
+                    this->file_max_ = CHUNK_SIZE;
+            }
+            this->mode_ = mode;
+            ESP_LOGI(TAG, "Capturing frames to %s%s", mode == CAPTURE_LOG ? "the log" : mode == CAPTURE_MQTT ? "MQTT" : "flash",
+                     this->upload_pending_ ? ", uploading the previous boot's capture" : "");
+            return true;
+        }
+
+        void CaptureSink::record(const CaptureRecord &record)
+        {
+            if (this->mode_ == CAPTURE_OFF)
+                return;
+            this->records_++;
+            this->bytes_ += CAPTURE_RECORD_HEADER_SIZE + record.len;
+            if (this->mode_ == CAPTURE_LOG)
+            {
+                this->log_record_(record);
+                return;
+            }
+            if (this->chunk_len_ + CAPTURE_RECORD_HEADER_SIZE + record.len > CHUNK_SIZE)
+                this->flush_();
+            if (this->chunk_records_ == 0)
+                this->chunk_since_ = millis();
+            this->chunk_len_ += capture_put_record(this->chunk_ + this->chunk_len_, record);
+            this->chunk_records_++;
+        }
+
+        void CaptureSink::loop(uint32_t now)
+        {
+            if (this->chunk_records_ != 0 && now - this->chunk_since_ >= FLUSH_INTERVAL_MS)
+                this->flush_();
+            if (this->upload_pending_)
+                this->upload_();
+        }
+
+        void CaptureSink::log_record_(const CaptureRecord &record)
+        {
+            uint8_t buf[CAPTURE_RECORD_HEADER_SIZE + 255];
+            size_t len = capture_put_record(buf, record);
+            ESP_LOGI(TAG, "CAP:%s", base64_encode(buf, len).c_str());
+        }
+
+        void CaptureSink::flush_()
+        {
+            if (this->chunk_records_ == 0)
+                return;
+            bool ok = this->mode_ == CAPTURE_FILE ? this->write_file_() : this->publish_(this->chunk_, this->chunk_len_);
+            if (!ok)
+                this->dropped_ += this->chunk_records_;
+            this->chunk_len_ = CAPTURE_HEADER_SIZE;
+            this->chunk_records_ = 0;
+        }
+
+        bool CaptureSink::write_file_()
+        {
+            size_t len = this->chunk_len_ - CAPTURE_HEADER_SIZE;
+            if (this->file_size_ != 0 && this->file_size_ + len > this->file_max_)
+            {
+                // the other file of the ring starts over
+                this->file_index_ ^= 1;
+                this->file_size_ = 0;
+            }
+            char path[32];
+            this->file_path_(false, this->file_index_, path, sizeof(path));
+            File file = LittleFS.open(path, this->file_size_ == 0 ? "w" : "a");
+            if (!file)
+            {
+                ESP_LOGE(TAG, "Could not open %s", path);
+                return false;
+            }
+            size_t expected = len;
+            size_t written = 0;
+            if (this->file_size_ == 0)
+            {
+                expected += CAPTURE_HEADER_SIZE;
+                written += file.write(this->chunk_, CAPTURE_HEADER_SIZE);
+            }
+            written += file.write(this->chunk_ + CAPTURE_HEADER_SIZE, len);
+            file.close();
+            this->file_size_ += written;
+            return written == expected;
+        }
+
+        void CaptureSink::upload_()
+        {
+            // records carry their own time, so the order of the two files doesn't matter
+            char path[32];
+            this->file_path_(true, this->upload_index_, path, sizeof(path));
+            File file;
+            if (LittleFS.exists(path))
+                file = LittleFS.open(path, "r");
+            if (!file)
+            {
+                if (++this->upload_index_ == 2)
+                    this->upload_pending_ = false;
+                this->upload_offset_ = 0;
+                return;
+            }
+
+            // one self-contained chunk per call, cut at record boundaries
+            uint8_t chunk[CHUNK_SIZE];
+            size_t len = 0;
+            if (this->upload_offset_ == 0)
+            {
+                if (file.read(chunk, CAPTURE_HEADER_SIZE) != CAPTURE_HEADER_SIZE || memcmp(chunk, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+                {
+                    file.close();
+                    LittleFS.remove(path);
+                    return;
+                }
+                this->upload_offset_ = CAPTURE_HEADER_SIZE;
+            }
+            else
+            {
+                file.seek(0);
+                file.read(chunk, CAPTURE_HEADER_SIZE);
+            }
+            len = CAPTURE_HEADER_SIZE;
+            size_t offset = this->upload_offset_;
+            file.seek(offset);
+            uint32_t records = 0;
+            while (len + CAPTURE_RECORD_HEADER_SIZE <= CHUNK_SIZE)
+            {
+                if (file.read(chunk + len, CAPTURE_RECORD_HEADER_SIZE) != CAPTURE_RECORD_HEADER_SIZE)
+                    break;
+                size_t frame_len = chunk[len + CAPTURE_RECORD_HEADER_SIZE - 1];
+                if (len + CAPTURE_RECORD_HEADER_SIZE + frame_len > CHUNK_SIZE ||
+                    file.read(chunk + len + CAPTURE_RECORD_HEADER_SIZE, frame_len) != frame_len)
+                    break;
+                len += CAPTURE_RECORD_HEADER_SIZE + frame_len;
+                offset += CAPTURE_RECORD_HEADER_SIZE + frame_len;
+                records++;
+            }
+            bool done = offset >= file.size();
+            file.close();
+
+            if (records != 0)
+            {
+                // try again next loop while the broker is away
+                if (!this->publish_(chunk, len))
+                    return;
+                this->uploaded_ += records;
+            }
+            this->upload_offset_ = offset;
+            if (done || records == 0)
+            {
+                LittleFS.remove(path);
+                this->upload_offset_ = 0;
+                if (++this->upload_index_ == 2)
+                {
+                    this->upload_pending_ = false;
+                    ESP_LOGI(TAG, "Previous boot's capture uploaded: %lu record(s)", (unsigned long)this->uploaded_);
+                }
+            }
+        }
+
+        void CaptureSink::file_path_(bool previous, uint8_t index, char *buf, size_t len) const
+        {
+            snprintf(buf, len, "%s/%s%u.bin", CAPTURE_DIR, previous ? "prev" : "", (unsigned)index);
+        }
+
+        void CaptureSink::log_stats(const char *tag) const
+        {
+            ESP_LOGI(tag, "Capture: %lu frame(s), %lu B, %lu dropped, %lu uploaded from the previous boot", (unsigned long)this->records_,
+                     (unsigned long)this->bytes_, (unsigned long)this->dropped_, (unsigned long)this->uploaded_);
+        }
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "esphome/components/frame_codec/frame_capture.h"
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        enum CaptureMode : uint8_t
+        {
+            CAPTURE_OFF = 0,
+            CAPTURE_LOG = 1,  // one base64 "CAP:" line per frame in the serial log
+            CAPTURE_MQTT = 2, // chunks of records published to the capture topic
+            CAPTURE_FILE = 3, // a ring of two files on LittleFS, uploaded after a reboot
+        };
+
+        // Streams every received frame, with RSSI, SNR and time, in the frame_capture
+        // format for replay on a host (tools/lora_replay).
+        //
+        // MQTT chunks are self-contained (header plus whole records), published once
+        // CHUNK_SIZE fills up or the oldest record is FLUSH_INTERVAL_MS old. In file mode
+        // the same chunks are appended to the current file instead. The files of the
+        // previous boot, which is usually what a crash report needs, are published to
+        // the capture topic chunk by chunk once the broker is reachable, then deleted.
+        class CaptureSink
+        {
+        public:
+            static const size_t CHUNK_SIZE = 1024;
+            static const uint32_t FLUSH_INTERVAL_MS = 5000;
+
+            using PublishFn = std::function<bool(const uint8_t *data, size_t len)>;
+
+            bool begin(CaptureMode mode, const frame_codec::CaptureHeader &header, size_t max_bytes, PublishFn &&publish);
+            bool enabled() const { return this->mode_ != CAPTURE_OFF; }
+
+            void record(const frame_codec::CaptureRecord &record);
+            // flushes a chunk that is due and uploads the previous boot's capture
+            void loop(uint32_t now);
+            void log_stats(const char *tag) const;
+
+        protected:
+            void log_record_(const frame_codec::CaptureRecord &record);
+            void flush_();
+            bool write_file_();
+            void upload_();
+            void file_path_(bool previous, uint8_t index, char *buf, size_t len) const;
+
+            CaptureMode mode_{CAPTURE_OFF};
+            frame_codec::CaptureHeader header_;
+            PublishFn publish_;
+
+            uint8_t chunk_[CHUNK_SIZE];
+            size_t chunk_len_{0};
+            uint32_t chunk_records_{0};
+            uint32_t chunk_since_{0};
+
+            // file mode: the current file of the ring and its size
+            size_t file_max_{0};
+            uint8_t file_index_{0};
+            size_t file_size_{0};
+            // previous boot: next file to upload and where in it
+            uint8_t upload_index_{0};
+            size_t upload_offset_{0};
+            bool upload_pending_{false};
+
+            uint32_t records_{0};
+            uint32_t bytes_{0};
+            uint32_t dropped_{0};
+            uint32_t uploaded_{0};
+        };
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -0,0 +1,223 @@
+#include "fuota_sender.h"
+#include "esphome/core/log.h"
+#include "esphome/core/helpers.h"
+#include <LittleFS.h>
+#include <cstring>
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        using namespace frame_codec;
+
+        static const char *const TAG = "lora_mqtt_bridge.fuota";
+        static const char *const IMAGE_PATH = "/fuota.bin";
+
+        bool FuotaSender::begin(const std::string &hex_key, uint32_t hash)
+        {
+            uint8_t key[SEALED_KEY_SIZE];
+            if (hex_key.size() != SEALED_KEY_SIZE * 2 || !parse_hex(hex_key, key, sizeof(key)) || !this->cipher_.set_key(key))
+                return false;
+            this->pref_ = global_preferences->make_preference<uint32_t>(hash);
+            if (!this->pref_.load(&this->last_session_))
+                this->last_session_ = 0;
+            if (!LittleFS.begin(true))
+            {
+                ESP_LOGE(TAG, "Could not mount LittleFS - firmware updates disabled");
+                return false;
+            }
+            // an image staged before a reboot would need its hash again; start over
+            if (LittleFS.exists(IMAGE_PATH))
+                LittleFS.remove(IMAGE_PATH);
+            return true;
+        }
+
+        bool FuotaSender::stage(uint32_t size, const uint8_t *sha256)
+        {
+            this->cancel();
+            if (this->staging_)
+                mbedtls_sha256_free(&this->sha_);
+            this->staging_ = this->staged_ = false;
+            if (size == 0)
+                return false;
+            if (LittleFS.totalBytes() - LittleFS.usedBytes() < size)
+            {
+                ESP_LOGE(TAG, "A %lu byte image doesn't fit LittleFS (%u bytes free)", (unsigned long)size,
+                         (unsigned)(LittleFS.totalBytes() - LittleFS.usedBytes()));
+                return false;
+            }
+            File file = LittleFS.open(IMAGE_PATH, "w");
+            if (!file)
+            {
+                ESP_LOGE(TAG, "Could not create %s", IMAGE_PATH);
+                return false;
+            }
+            file.close();
+            memcpy(this->sha256_, sha256, sizeof(this->sha256_));
+            this->size_ = size;
+            this->written_ = 0;
+            mbedtls_sha256_init(&this->sha_);
+            mbedtls_sha256_starts(&this->sha_, 0);
+            this->staging_ = true;
+            ESP_LOGI(TAG, "Staging a %lu byte image", (unsigned long)size);
+            return true;
+        }
+
+        bool FuotaSender::append(const uint8_t *data, size_t len)
+        {
+            if (!this->staging_)
+                return false;
+            bool ok = this->written_ + len <= this->size_;
+            if (ok)
+            {
+                File file = LittleFS.open(IMAGE_PATH, "a");
+                ok = file && file.write(data, len) == len;
+                file.close();
+            }
+            if (!ok)
+            {
+                ESP_LOGE(TAG, "Image data beyond its size or not written at %lu, dropped", (unsigned long)this->written_);
+                mbedtls_sha256_free(&this->sha_);
+                this->staging_ = false;
+                LittleFS.remove(IMAGE_PATH);
+                return false;
+            }
+            mbedtls_sha256_update(&this->sha_, data, len);
+            this->written_ += len;
+            if (this->written_ < this->size_)
+                return true;
+
+            uint8_t digest[32];
+            mbedtls_sha256_finish(&this->sha_, digest);
+            mbedtls_sha256_free(&this->sha_);
+            this->staging_ = false;
+            if (memcmp(digest, this->sha256_, sizeof(digest)) != 0)
+            {
+                ESP_LOGE(TAG, "Image SHA-256 mismatch, dropped");
+                LittleFS.remove(IMAGE_PATH);
+                return false;
+            }
+            this->staged_ = true;
+            ESP_LOGI(TAG, "Image staged and verified: %lu bytes", (unsigned long)this->size_);
+            return true;
+        }
+
+        bool FuotaSender::start(size_t fragment_size, uint8_t repair, uint8_t passes)
+        {
+            uint32_t blocks = fragment_size == 0 ? 0 : (this->size_ + FUOTA_BLOCK * fragment_size - 1) / (FUOTA_BLOCK * fragment_size);
+            if (!this->staged_ || !this->enabled() || blocks == 0 || blocks > 0xFFFF || passes == 0 || FUOTA_BLOCK + repair > 0xFF)
+                return false;
+            if (this->last_session_ >= SEALED_COUNTER_MAX)
+            {
+                ESP_LOGE(TAG, "Session ids are used up - set a new fuota_key");
+                return false;
+            }
+            this->block_data_.reset(new (std::nothrow) uint8_t[FUOTA_BLOCK * fragment_size]);
+            if (this->block_data_ == nullptr)
+            {
+                ESP_LOGE(TAG, "No memory for a %u byte block", (unsigned)(FUOTA_BLOCK * fragment_size));
+                return false;
+            }
+            this->fragment_size_ = fragment_size;
+            this->repair_ = repair;
+            this->passes_ = passes;
+            this->blocks_ = blocks;
+            // the session id is the announcement's nonce counter, one up on the last
+            // session's; saved before anything goes out so a reboot can't reuse it
+            this->session_ = ++this->last_session_;
+            this->pref_.save(&this->last_session_);
+            global_preferences->sync();
+            this->pass_ = 0;
+            this->announced_ = 0;
+            this->block_ = 0;
+            this->index_ = 0;
+            this->block_done_ = false;
+            this->active_ = true;
+            return true;
+        }
+
+        void FuotaSender::cancel()
+        {
+            this->active_ = false;
+            this->block_data_.reset();
+        }
+
+        size_t FuotaSender::next_frame(uint8_t *out)
+        {
+            this->block_done_ = false;
+            if (!this->active_)
+                return 0;
+            if (this->announced_ < ANNOUNCE_FRAMES)
+            {
+                this->announced_++;
+                size_t len = this->announcement_(out);
+                if (len == 0)
+                    this->cancel();
+                return len;
+            }
+            if (this->index_ == 0 && !this->load_block_())
+            {
+                this->cancel();
+                return 0;
+            }
+
+            out[0] = FRAME_FUOTA_FRAGMENT;
+            out[1] = this->session_;
+            out[2] = this->session_ >> 8;
+            out[3] = this->block_;
+            out[4] = this->block_ >> 8;
+            out[5] = this->index_;
+            if (this->index_ < FUOTA_BLOCK)
+                memcpy(out + FUOTA_FRAGMENT_HEADER, this->block_data_.get() + this->index_ * this->fragment_size_, this->fragment_size_);
+            else
+                fountain_encode(this->block_data_.get(), this->fragment_size_, this->block_, this->index_, out + FUOTA_FRAGMENT_HEADER);
+
+            if (++this->index_ == FUOTA_BLOCK + this->repair_)
+            {
+                this->index_ = 0;
+                this->block_done_ = true;
+                if (++this->block_ == this->blocks_)
+                {
+                    this->block_ = 0;
+                    this->announced_ = 0;
+                    if (++this->pass_ == this->passes_)
+                        this->cancel();
+                }
+            }
+            return FUOTA_FRAGMENT_HEADER + this->fragment_size_;
+        }
+
+        size_t FuotaSender::announcement_(uint8_t *out)
+        {
+            uint8_t session[FUOTA_SESSION_SIZE];
+            session[0] = this->size_;
+            session[1] = this->size_ >> 8;
+            session[2] = this->size_ >> 16;
+            session[3] = this->size_ >> 24;
+            session[4] = this->fragment_size_;
+            session[5] = this->repair_;
+            memcpy(session + 6, this->sha256_, sizeof(this->sha256_));
+            out[0] = FRAME_FUOTA_SESSION;
+            if (!this->cipher_.seal(0, this->session_, session, sizeof(session), out + 1))
+                return 0;
+            return FUOTA_SESSION_FRAME_SIZE;
+        }
+
+        bool FuotaSender::load_block_()
+        {
+            size_t block_size = FUOTA_BLOCK * this->fragment_size_;
+            uint32_t offset = (uint32_t)this->block_ * block_size;
+            size_t len = this->size_ - offset < block_size ? this->size_ - offset : block_size;
+            File file = LittleFS.open(IMAGE_PATH, "r");
+            bool ok = file && file.seek(offset) && file.read(this->block_data_.get(), len) == len;
+            file.close();
+            if (!ok)
+            {
+                ESP_LOGE(TAG, "Could not read block %u of the image", this->block_);
+                return false;
+            }
+            memset(this->block_data_.get() + len, 0, block_size - len);
+            return true;
+        }
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "mbedtls/sha256.h"
+#include "esphome/core/preferences.h"
+#include "esphome/components/frame_codec/frames.h"
+#include "esphome/components/frame_codec/frame_crypto.h"
+#include "esphome/components/frame_codec/fountain.h"
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        // Multicast firmware update: an image staged on LittleFS goes out to every node
+        // at once as fountain-coded fragments (see frame_codec/fountain.h), so no node
+        // needs fragments of its own.
+        //
+        // A session is a number of passes over the image. Each pass starts with
+        // ANNOUNCE_FRAMES sealed announcements, then sends every block as its source
+        // fragments and `repair` repair fragments. Nodes write each block where it goes
+        // as soon as they have it: a block one missed too much of is filled in by the
+        // next pass, and a node that missed the first pass's announcements can start in
+        // a later one.
+        //
+        // Session ids count up and the last one is persisted: nodes reject an
+        // announcement whose id is below the last one they took, so a recorded older
+        // session can't be replayed to them.
+        class FuotaSender
+        {
+        public:
+            static const uint8_t ANNOUNCE_FRAMES = 3;
+
+            bool begin(const std::string &hex_key, uint32_t hash);
+            bool enabled() const { return this->cipher_.ready(); }
+
+            // The image arrives over MQTT: its size and SHA-256 first, then its bytes in
+            // order. Returns false, and drops the image, when it doesn't add up.
+            bool stage(uint32_t size, const uint8_t *sha256);
+            bool append(const uint8_t *data, size_t len);
+            bool staging() const { return this->staging_; }
+            bool staged() const { return this->staged_; }
+            uint32_t staged_bytes() const { return this->written_; }
+
+            // fragment_size: what a frame has room for after FUOTA_FRAGMENT_HEADER
+            bool start(size_t fragment_size, uint8_t repair, uint8_t passes);
+            void cancel();
+            bool active() const { return this->active_; }
+            // the next frame of the session into out (room for the largest frame),
+            // 0 once the session is over
+            size_t next_frame(uint8_t *out);
+
+            uint32_t session() const { return this->session_; }
+            uint32_t image_size() const { return this->size_; }
+            uint8_t pass() const { return this->pass_; }
+            uint8_t passes() const { return this->passes_; }
+            uint16_t block() const { return this->block_; }
+            uint16_t blocks() const { return this->blocks_; }
+            // whether the last frame finished a block, for progress reports
+            bool block_done() const { return this->block_done_; }
+            uint32_t frames_per_pass() const { return ANNOUNCE_FRAMES + (uint32_t)this->blocks_ * (frame_codec::FUOTA_BLOCK + this->repair_); }
+            size_t fragment_frame_size() const { return frame_codec::FUOTA_FRAGMENT_HEADER + this->fragment_size_; }
+
+        protected:
+            size_t announcement_(uint8_t *out);
+            bool load_block_();
+
+            frame_codec::FrameCipher cipher_;
+            ESPPreferenceObject pref_;
+            uint32_t last_session_{0};
+            mbedtls_sha256_context sha_;
+            uint8_t sha256_[32];
+            uint32_t size_{0};
+            uint32_t written_{0};
+            bool staging_{false};
+            bool staged_{false};
+
+            bool active_{false};
+            uint32_t session_{0};
+            size_t fragment_size_{0};
+            uint8_t repair_{0};
+            uint8_t passes_{0};
+            uint16_t blocks_{0};
+            uint8_t pass_{0};
+            uint8_t announced_{0};
+            uint16_t block_{0};
+            uint8_t index_{0};
+            bool block_done_{false};
+            std::unique_ptr<uint8_t[]> block_data_;
+        };
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -4,228 +4,315 @@
 #include <esp_now.h>
 #include <esp_wifi.h>
 #include "esphome/components/mqtt/mqtt_client.h"
-#include "LoRa.h"
+#include "esphome/components/lora_radio/LoRa.h"
 #include <iostream>
 #include <sstream>
+#include <sys/time.h>
+#include <esp_timer.h>
+#include <cmath>
+#include <algorithm>
 volatile bool esphome::lora_mqtt_bridge::Lora_MQTT_BridgeComponent::receivedLoRaP = false;
 volatile int esphome::lora_mqtt_bridge::Lora_MQTT_BridgeComponent::_packet_size = 0;
 
-// External debug counters from LoRa.cpp (declared in global namespace)
-extern volatile uint32_t g_lora_irq_count;
-extern volatile uint32_t g_lora_packet_count;
-extern volatile int g_lora_last_parse_result;
-
 namespace esphome
 {
     namespace lora_mqtt_bridge
     {
+        using namespace frame_codec;
+
         static const char *const TAG = "lora_mqtt_bridge.sensor";
 
         static uint32_t last_debug_time = 0;
         static uint32_t last_irq_count = 0;
 
+        // parser: what arrived and why frames were dropped
+        static metrics::Counter metric_lines("rx_lines");
+        static metrics::Counter metric_catchups("rx_catchup");
+        static metrics::Counter metric_texts("rx_text");
+        static metrics::Counter metric_bad_seal("drop_seal");
+        static metrics::Counter metric_unsealed("drop_unsealed");
+        static metrics::Counter metric_bad_line("drop_line");
+        static metrics::Counter metric_bad_catchup("drop_catchup");
+        static metrics::Counter metric_bad_text("drop_text");
+        static metrics::Gauge metric_rssi("rssi");
+        static metrics::Gauge metric_freq_offset("freq_offset_max");
+        static metrics::Counter metric_freq_corrections("freq_corrections");
+        // receive watchdog
+        static metrics::Counter metric_rx_rearms("rx_rearm");
+        static metrics::Counter metric_radio_resets("radio_reset");
+        static metrics::Counter metric_deaf_ms("deaf_ms");
+        // firmware updates
+        static metrics::Counter metric_fuota_frames("fuota_frames");
+        static metrics::Counter metric_fuota_airtime_ms("fuota_airtime_ms");
+        static metrics::Histogram metric_process_us("rx_process_us", metrics::DURATION_US_BOUNDS);
+        // publisher
+        static metrics::Counter metric_published("mqtt_pub");
+        static metrics::Counter metric_publish_failed("mqtt_fail");
+        static metrics::Counter metric_journaled("journaled");
+        static metrics::Gauge metric_journal_depth("journal_depth");
+        static metrics::Gauge metric_entities("entities");
+        static metrics::Gauge metric_entity_bytes("entity_bytes");
+        // per-packet latency by stage, see record_trace()
+        static metrics::LatencyHistogram trace_readout("lat_readout_us");
+        static metrics::LatencyHistogram trace_pickup("lat_pickup_us");
+        static metrics::LatencyHistogram trace_decode("lat_decode_us");
+        static metrics::LatencyHistogram trace_publish("lat_publish_us");
+        static metrics::LatencyHistogram trace_total("lat_total_us");
+
         void Lora_MQTT_BridgeComponent::loop()
         {
             // Print debug status every 30 seconds
             uint32_t now = millis();
             if (now - last_debug_time >= 30000) {
                 last_debug_time = now;
-                ESP_LOGI(TAG, "LoRa status: IRQ count=%lu, packets=%lu, last_parse=%d, flag=%d",
-                         (unsigned long)g_lora_irq_count, (unsigned long)g_lora_packet_count,
-                         g_lora_last_parse_result, (int)receivedLoRaP);
-                if (g_lora_irq_count == last_irq_count) {
+                uint32_t irqs = g_lora_irqs.get();
+                ESP_LOGI(TAG, "LoRa status: IRQ count=%lu, packets=%lu, CRC errors=%lu, flag=%d",
+                         (unsigned long)irqs, (unsigned long)g_lora_packets.get(),
+                         (unsigned long)g_lora_crc_errors.get(), (int)receivedLoRaP);
+                if (irqs == last_irq_count) {
                     ESP_LOGW(TAG, "No IRQs received in last 30s - check DIO1/IRQ wiring!");
                 }
-                last_irq_count = g_lora_irq_count;
+                last_irq_count = irqs;
+                if (_journal_enabled && _journal.is_ready())
+                {
+                    _journal.log_stats(TAG);
+                }
+                if (!_keys.empty())
+                {
+                    _opener.stats().log(TAG, "Decryption");
+                }
+                _entities.log_stats(TAG);
+                _text_dictionaries.log_stats(TAG);
+                if (_modulation == MODULATION_LORA)
+                {
+                    _frequencies.log_stats(TAG);
+                }
+                if (_capture.enabled())
+                {
+                    _capture.log_stats(TAG);
+                }
+            }
+            _opener.loop(now);
+            if (_rx_watchdog > 0)
+            {
+                this->check_receiver(now);
+            }
+            if (_capture.enabled())
+            {
+                _capture.loop(now);
             }
 
-            if (receivedLoRaP)
+            if (_stats_interval > 0 && now - _last_stats_export >= (uint32_t)_stats_interval)
             {
-                receivedLoRaP = false;
-                ESP_LOGI(TAG, "*** LoRa packet received! Size: %d bytes ***", _packet_size);
+                _last_stats_export = now;
+                this->export_metrics();
+            }
 
-                char received_string[251];
-                char config_topic[] = "%s/sensor/%s/%s/config";
-                char sensor_topic[] = "%s/sensor/%s/state";
-                char binary_config_topic[] = "%s/binary_sensor/%s/%s/config";
-                char binary_sensor_topic[] = "%s/binary_sensor/%s/state";
+            if (_beacon_interval > 0 && now - _last_beacon >= (uint32_t)_beacon_interval)
+            {
+                _last_beacon = now;
+                this->send_beacon();
+            }
 
-                char topic[250];
-                char macStr[18];
-                StaticJsonDocument<500> doc;
-                JsonObject dev;
-                std::string json;
-                std::string message_type;
-                mqtt::MQTTDiscoveryInfo discovery_info;
+            // drain anything journaled during a broker outage (or before a reboot)
+            // ahead of live traffic
+            if (_journal_enabled && _journal.is_ready())
+            {
+                _journal.loop(now);
+                if (!_journal.empty() && mqtt::global_mqtt_client->is_connected())
+                {
+                    size_t replayed = _journal.replay([this](const char *topic, const char *payload, size_t len, bool retain)
+                                                      { return this->publish(topic, payload, len, retain); },
+                                                      8);
+                    if (replayed != 0 && _journal.empty())
+                    {
+                        ESP_LOGI(TAG, "Journal replay complete");
+                    }
+                }
+            }
 
-                // received data
-                memset(&received_string, 0, sizeof(received_string));
-                for (int i = 0; i < _packet_size; i++)
+            if (receivedLoRaP)
+            {
+                receivedLoRaP = false;
+                _trace = PacketTrace{};
+                _trace.pickup = arch_get_cpu_cycle_count();
+                _trace.irq = LoRa.packetIrqCycles();
+                _trace.readout = LoRa.packetReadoutCycles();
+                uint32_t start = micros();
+                this->handle_packet();
+                metric_process_us.record(micros() - start);
+                if (_trace.published != 0)
                 {
-                    received_string[i] = (char)LoRa.read();
+                    this->record_trace();
                 }
+            }
+
+            // after the receive path, and never faster than the duty cycle allows
+            if (_fuota.active() && millis() - _fuota_last_frame >= _fuota_wait_ms)
+            {
+                this->send_fuota_frame();
+            }
+        }
 
-                ESP_LOGI(TAG, "Raw received data: '%s'", received_string);
-                ESP_LOGI(TAG, "RSSI: %d dBm", LoRa.packetRssi());
+        void Lora_MQTT_BridgeComponent::handle_packet()
+        {
+            ESP_LOGI(TAG, "*** LoRa packet received! Size: %d bytes ***", _packet_size);
 
-                // tokenize the received string
-                char *tokens[13];
-                int argc;
-                this->split(tokens, &argc, received_string, ':', 1);
+            char received_string[257];
+            StaticJsonDocument<500> doc;
+            std::string json;
+
+            // received data
+            int received_len = 0;
+            while (LoRa.available() && received_len < (int)sizeof(received_string) - 1)
+            {
+                received_string[received_len++] = (char)LoRa.read();
+            }
+            received_string[received_len] = 0;
 
-                ESP_LOGI(TAG, "Parsed %d tokens (expecting 11)", argc);
+            ESP_LOGI(TAG, "RSSI: %d dBm", LoRa.packetRssi());
+            metric_rssi.set(LoRa.packetRssi());
 
-                // if we didn't get 11 elements, this wasn't a message from our sensors
-                if (argc != 11)
+            // sealed frames are opened in place and then handled like any other
+            if (is_sealed((const uint8_t *)received_string, received_len))
+            {
+                uint8_t plain[sizeof(received_string)];
+                if (!_opener.open((const uint8_t *)received_string, received_len, plain))
                 {
-                    ESP_LOGW(TAG, "Invalid packet format - expected 11 tokens, got %d. Ignoring.", argc);
+                    this->capture_frame((const uint8_t *)received_string, received_len, CAPTURE_SEALED);
+                    metric_bad_seal.inc();
+                    ESP_LOGW(TAG, "Sealed frame from key %d failed to open (unknown key, bad MIC or replay). Ignoring.",
+                             received_string[0] & SEALED_KEY_MASK);
                     return;
                 }
+                received_len -= SEALED_OVERHEAD;
+                memcpy(received_string, plain, received_len);
+                received_string[received_len] = 0;
+                this->capture_frame(plain, received_len, CAPTURE_UNSEALED);
+            }
+            else
+            {
+                this->capture_frame((const uint8_t *)received_string, received_len, 0);
+                if (_opener.required())
+                {
+                    ESP_LOGW(TAG, "Unsealed frame while encryption is required. Ignoring.");
+                    metric_unsealed.inc();
+                    return;
+                }
+            }
 
-                ESP_LOGI(TAG, "Valid packet: %s:%s:%s:%s:%s:%s:%s:%s:%s:%s:%s", tokens[0], tokens[1], tokens[2], tokens[3], tokens[4], tokens[5], tokens[6], tokens[7], tokens[8], tokens[9], tokens[10]);
-
-                // check for binary_sensor or sensor
-                message_type = tokens[2];
-                if (message_type.compare("binary_sensor") == 0)
+            // dictionary coded text sensor state
+            if ((uint8_t)received_string[0] == FRAME_TEXT)
+            {
+                metric_texts.inc();
+                if (!this->process_text((const uint8_t *)received_string, received_len))
                 {
-                    if (strlen(tokens[3]) != 0)
-                    {
-                        doc["name"] = tokens[3];
-                    }
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        std::string stat_t = tokens[0];
-                        stat_t += "/binary_sensor/";
-                        stat_t += tokens[3];
-                        stat_t += "/state";
-                        doc["stat_t"] = stat_t;
-                    }
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        std::string uniq_id = tokens[0];
-                        uniq_id += "_";
-                        uniq_id += tokens[3];
-                        doc["uniq_id"] = uniq_id;
-                    }
-                    dev = doc.createNestedObject("dev");
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        dev["ids"] = tokens[0];
-                        dev["name"] = tokens[0];
-                    }
-                    dev["sw"] = tokens[8];
-                    dev["mdl"] = tokens[9];
-                    dev["mf"] = "espressif";
-                    serializeJson(doc, json);
-
-                    // make and send the config topic
-                    discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-                    memset(&topic, 0, sizeof(topic));
-                    snprintf(topic, sizeof(topic), binary_config_topic, discovery_info.prefix.c_str(), tokens[0], tokens[3]);
-                    mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
-
-                    // make and send the state topic
-                    memset(&topic, 0, sizeof(topic));
-                    snprintf(topic, sizeof(topic), binary_sensor_topic, tokens[0], tokens[3]);
-                    mqtt::global_mqtt_client->publish(topic, tokens[5], strlen(tokens[5]), 2, true);
+                    metric_bad_text.inc();
+                    ESP_LOGW(TAG, "Malformed text frame or unknown code (%d bytes). Ignoring.", received_len);
                 }
-                else
+                return;
+            }
+
+            // binary backlog upload from a node that was out of range
+            if ((uint8_t)received_string[0] == FRAME_CATCHUP)
+            {
+                const uint8_t *frame = (const uint8_t *)received_string;
+                metric_catchups.inc();
+                if (!this->process_catchup(frame, received_len, false))
                 {
-                    if (strlen(tokens[1]) != 0)
-                    {
-                        doc["dev_cla"] = tokens[1];
-                    }
-                    if (strlen(tokens[4]) != 0)
-                    {
-                        doc["unit_of_meas"] = tokens[4];
-                    }
-                    if (strlen(tokens[2]) != 0)
-                    {
-                        doc["stat_cla"] = tokens[2];
-                    }
-                    if (strlen(tokens[3]) != 0)
-                    {
-                        doc["name"] = tokens[3];
-                    }
-                    if (strlen(tokens[6]) != 0)
-                    {
-                        std::string icon = tokens[6];
-                        icon += ":";
-                        icon += tokens[7];
-                        doc["icon"] = icon;
-                    }
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        std::string stat_t = tokens[0];
-                        stat_t += "/sensor/";
-                        stat_t += tokens[3];
-                        stat_t += "/state";
-                        doc["stat_t"] = stat_t;
-                    }
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        std::string uniq_id = tokens[0];
-                        uniq_id += "_";
-                        uniq_id += tokens[3];
-                        doc["uniq_id"] = uniq_id;
-                    }
-                    dev = doc.createNestedObject("dev");
-                    if (strlen(tokens[0]) != 0)
-                    {
-                        dev["ids"] = tokens[0];
-                        dev["name"] = tokens[0];
-                    }
-                    dev["sw"] = tokens[8];
-                    dev["mdl"] = tokens[9];
-                    dev["mf"] = "espressif";
-                    serializeJson(doc, json);
-
-                    // make and send the config topic
-                    discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-                    memset(&topic, 0, sizeof(topic));
-                    snprintf(topic, sizeof(topic), config_topic, discovery_info.prefix.c_str(), tokens[0], tokens[3]);
-                    mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
-
-                    // make and send the state topic
-                    memset(&topic, 0, sizeof(topic));
-                    snprintf(topic, sizeof(topic), sensor_topic, tokens[0], tokens[3]);
-                    mqtt::global_mqtt_client->publish(topic, tokens[5], strlen(tokens[5]), 2, true);
+                    metric_bad_catchup.inc();
+                    ESP_LOGW(TAG, "Malformed catch-up frame (%d bytes). Ignoring.", received_len);
+                    return;
                 }
+                char node[65];
+                memcpy(node, frame + 3, frame[2]);
+                node[frame[2]] = 0;
+                this->track_frequency(node, frame[1]);
+                this->send_ack(node, frame[1]);
+                this->trace_mark(&_trace.decoded);
+                this->process_catchup(frame, received_len, true);
+                this->trace_mark(&_trace.published);
+                return;
+            }
 
-                // create RSSI message
-                json = "";
-                doc["name"] = "rssi";
-                doc["dev_cla"] = "SIGNAL_STRENGTH";
-                doc["unit_of_meas"] = "dBm";
-                doc["stat_cla"] = "measurement";
-                doc["icon"] = "mdi:wifi";
-
-                std::string stat_t = tokens[0];
-                stat_t += "/sensor/";
-                stat_t += "rssi";
-                stat_t += "/state";
-                doc["stat_t"] = stat_t;
-
-                std::string uniq_id = tokens[0];
-                ;
-                uniq_id += "_";
-                uniq_id += "rssi";
-                doc["uniq_id"] = uniq_id;
+            ESP_LOGI(TAG, "Raw received data: '%s'", received_string);
+
+            SensorLine line;
+            metric_lines.inc();
+            if (!LoRaCodec::decode(received_string, &line))
+            {
+                metric_bad_line.inc();
+                ESP_LOGW(TAG, "Invalid packet format - expected %d tokens. Ignoring.", LINE_TOKENS);
+                return;
+            }
+            // a node that wants an ACK sends its sequence number as a 12th token
+            int seq = line.seq != nullptr ? (int)(strtoul(line.seq, nullptr, 16) & 0xFF) : -1;
+            this->track_frequency(line.node, seq);
+            if (seq >= 0)
+            {
+                this->send_ack(line.node, seq);
+            }
+
+            // "value@XY" carries the time the node took the reading
+            uint32_t sample_time = 0;
+            if (line.stamp != nullptr)
+            {
+                sample_time = this->resolve_timestamp(line.stamp);
+            }
+
+            ESP_LOGI(TAG, "Valid packet: %s:%s:%s:%s:%s:%s:%s:%s:%s:%s", line.node, line.device_class, line.state_class, line.object_id,
+                     line.unit, line.value, line.icon, line.version, line.board, line.kind);
+
+            this->trace_mark(&_trace.decoded);
+            uint32_t now = millis();
 
+            // config topic, only when the entity is new or its config changed
+            EntityTable::Entity *entity = this->intern(line.type(), line.node, line.object_id);
+            if (entity == nullptr)
+            {
+                ESP_LOGW(TAG, "Topics for %s/%s are too long. Ignoring.", line.node, line.object_id);
+                return;
+            }
+            if (_entities.needs_discovery(entity, LoRaCodec::discovery_hash(line, line.node, sample_time != 0), now))
+            {
+                LoRaCodec::build_discovery(line, line.node, sample_time != 0, doc);
                 serializeJson(doc, json);
+                if (!this->publish_config(_entities.config_topic(entity), json))
+                    _entities.discovery_failed(entity);
+            }
 
-                // make and send the rssi config topic
-                discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), config_topic, discovery_info.prefix.c_str(), tokens[0], "rssi");
-                mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
+            // state topic
+            this->publish_state(_entities.state_topic(entity), line.value, strlen(line.value));
+            this->trace_mark(&_trace.published);
+            if (sample_time != 0)
+            {
+                this->publish_sample_time(line.node, line.type(), line.object_id, sample_time);
+            }
 
-                // make and send the rssi state topic
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), sensor_topic, tokens[0], "rssi");
-                std::string last_rssi_str = std::to_string(LoRa.packetRssi());
-                mqtt::global_mqtt_client->publish(topic, last_rssi_str.c_str(), last_rssi_str.length(), 2, true);
+            // rssi config and state topics
+            entity = this->intern("sensor", line.node, "rssi");
+            if (entity == nullptr)
+                return;
+            if (_entities.needs_discovery(entity, LoRaCodec::rssi_discovery_hash(line, line.node), now))
+            {
+                json = "";
+                doc.clear();
+                LoRaCodec::build_rssi_discovery(line, line.node, doc);
+                serializeJson(doc, json);
+                if (!this->publish_config(_entities.config_topic(entity), json))
+                    _entities.discovery_failed(entity);
             }
+            char rssi[8];
+            int rssi_len = snprintf(rssi, sizeof(rssi), "%d", LoRa.packetRssi());
+            this->publish_state(_entities.state_topic(entity), rssi, rssi_len);
+        }
+
+        EntityTable::Entity *Lora_MQTT_BridgeComponent::intern(const char *type, const char *node, const char *object_id)
+        {
+            EntityTable::Entity *entity = _entities.find(type, node, object_id);
+            if (entity != nullptr)
+                return entity;
+            return _entities.add(type, node, object_id, mqtt::global_mqtt_client->get_discovery_info().prefix.c_str());
         }
 
         float Lora_MQTT_BridgeComponent::get_setup_priority() const { return setup_priority::AFTER_CONNECTION; }
@@ -248,60 +335,700 @@ namespace esphome
             }
 
             ESP_LOGI(TAG, "LoRa pins: CS=%d, RST=%d, DIO0/IRQ=%d, DIO1/BUSY=%d", cs_pin, reset_pin, dio0_pin, dio1_pin);
-            ESP_LOGI(TAG, "LoRa config: chip_type=%d, freq=%ld, bw=%ld, sf=%ld, cr=%ld, sync=0x%02lX",
-                     _chip_type, _frequency, _bandwidth, _spread, _coding, _sync);
+            if (_modulation == MODULATION_FLRC)
+                ESP_LOGI(TAG, "LoRa config: chip_type=%d, freq=%lu, FLRC bit_rate=%ld, flrc_coding=%ld, sync=0x%02lX", _chip_type,
+                         (unsigned long)_frequency, _bit_rate, _flrc_coding, _sync);
+            else if (_modulation == MODULATION_GFSK)
+                ESP_LOGI(TAG, "LoRa config: chip_type=%d, freq=%lu, GFSK bit_rate=%ld, deviation=%ld, sync=0x%02lX", _chip_type,
+                         (unsigned long)_frequency, _bit_rate, _deviation, _sync);
+            else
+                ESP_LOGI(TAG, "LoRa config: chip_type=%d, freq=%lu, bw=%ld, sf=%ld, cr=%ld, sync=0x%02lX, implicit_header=%ld",
+                         _chip_type, (unsigned long)_frequency, _bandwidth, _spread, _coding, _sync, _implicit_header);
 
             // Set chip type before initialization
             LoRa.setChipType((LoRaChipType)_chip_type);
             LoRa.setPins(cs_pin, reset_pin, dio0_pin, dio1_pin);
-            if (!LoRa.begin(_frequency))
+            if (!this->begin_radio())
             {
                 this->mark_failed();
-                ESP_LOGE(TAG, "Error initializing LoRa - check wiring and pins!");
                 return;
             }
             ESP_LOGI(TAG, "LoRa radio initialized successfully");
-            LoRa.setSyncWord(_sync);
-            LoRa.setCodingRate4(_coding);
-            LoRa.setSpreadingFactor(_spread);
-            LoRa.setSignalBandwidth(_bandwidth);
+            if (_implicit_header != 0)
+            {
+                ESP_LOGI(TAG, "Implicit header: %ld byte frames, nodes must use the same implicit_header", _implicit_header);
+            }
+            // the frequency error estimate is good to about 1% of the bandwidth
+            _frequencies.set_deadband(_bandwidth / 100);
+            if (_frequency_correction != FREQUENCY_CORRECTION_OFF && _modulation != MODULATION_LORA)
+            {
+                ESP_LOGW(TAG, "frequency_correction needs LoRa modulation, turned off");
+                _frequency_correction = FREQUENCY_CORRECTION_OFF;
+            }
+            uint16_t entities = _entities.begin(std::max<long>(std::min<long>(_max_entities, 0xFFFF), EntityTable::MIN_ENTITIES));
+            if (entities < _max_entities)
+            {
+                ESP_LOGW(TAG, "Memory for %u entities only, max_entities is %ld", entities, _max_entities);
+            }
+            if (_journal_enabled && !_journal.begin(_journal_size))
+            {
+                ESP_LOGW(TAG, "Uplink journal unavailable - states will be lost during broker outages");
+            }
+            for (auto &key : _keys)
+            {
+                if (!_opener.add_key(key.first, key.second))
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "Invalid encryption key for key id %d, expected 32 hex characters", key.first);
+                    return;
+                }
+            }
+            if (!_keys.empty())
+            {
+                _opener.begin(fnv1_hash("lora_mqtt_bridge.replay"));
+                ESP_LOGI(TAG, "Encryption: %u key(s), unsealed frames %s", (unsigned)_keys.size(),
+                         _opener.required() ? "rejected" : "accepted");
+            }
+            if (_capture_mode != CAPTURE_OFF)
+            {
+                CaptureHeader header;
+                if (_modulation == MODULATION_LORA)
+                {
+                    header.sf = _spread;
+                    header.coding = _coding;
+                    header.bandwidth = _bandwidth;
+                }
+                else
+                {
+                    header.coding = _modulation == MODULATION_FLRC ? _flrc_coding : 0;
+                    header.bandwidth = LoRa.bitRate();
+                }
+                _capture.begin(_capture_mode, header, _capture_size, [this](const uint8_t *data, size_t len)
+                               { return !_capture_topic.empty() && mqtt::global_mqtt_client->is_connected() &&
+                                        mqtt::global_mqtt_client->publish(_capture_topic.c_str(), (const char *)data, len, 0, false); });
+            }
+            this->setup_fuota();
             LoRa.onReceive(Lora_MQTT_BridgeComponent::call_on_data_recv_callback);
             LoRa.receive();
+            _last_heard = _last_status_check = millis();
             ESP_LOGI(TAG, "LoRa MQTT Bridge ready - listening for packets");
         }
 
-        void Lora_MQTT_BridgeComponent::receivecallback(int packetSize)
+        // Brings the radio up with the configured modem settings, at setup and when the
+        // receive watchdog resets it
+        bool Lora_MQTT_BridgeComponent::begin_radio()
         {
-            _packet_size = packetSize;
-            receivedLoRaP = true;
-            // Note: Can't use ESP_LOG in ISR, but this sets the flag for loop() to process
+            if (!LoRa.setModulation((LoRaModulation)_modulation) || !LoRa.begin(_frequency + _receiver_offset))
+            {
+                ESP_LOGE(TAG, "Error initializing LoRa - check wiring and pins!");
+                return false;
+            }
+            LoRa.setSyncWord(_sync);
+            bool modem_ok;
+            if (_modulation == MODULATION_LORA)
+            {
+                LoRa.setCodingRate4(_coding);
+                modem_ok = LoRa.setSpreadingFactor(_spread) && LoRa.setSignalBandwidth(_bandwidth);
+            }
+            else
+            {
+                modem_ok = _bit_rate == 0 || LoRa.setBitRate(_bit_rate);
+                if (_modulation == MODULATION_FLRC)
+                    modem_ok = modem_ok && LoRa.setFlrcCodingRate(_flrc_coding);
+                else if (_deviation != 0)
+                    modem_ok = modem_ok && LoRa.setFrequencyDeviation(_deviation);
+            }
+            if (!modem_ok)
+            {
+                ESP_LOGE(TAG, "Modem settings not supported by the radio");
+                return false;
+            }
+            if (!valid_header_mode(_implicit_header, _spread) || !LoRa.setImplicitHeader(_implicit_header))
+            {
+                ESP_LOGE(TAG, "Invalid header mode: implicit_header must be 0 or %u..255 bytes, and SF6 needs it",
+                         (unsigned)MIN_IMPLICIT_HEADER);
+                return false;
+            }
+            return true;
         }
 
-        void Lora_MQTT_BridgeComponent::call_on_data_recv_callback(int packetSize)
+        void Lora_MQTT_BridgeComponent::check_receiver(uint32_t now)
         {
-            Lora_MQTT_BridgeComponent().receivecallback(packetSize);
+            uint32_t heard = g_lora_packets.get() + g_lora_crc_errors.get() + g_lora_rx_errors.get();
+            if (heard != _heard_count)
+            {
+                // smoothed over about eight packets
+                uint32_t gap = now - _last_heard;
+                _mean_gap_ms = _mean_gap_ms == 0 ? gap : _mean_gap_ms + ((int32_t)(gap - _mean_gap_ms)) / 8;
+                _heard_count = heard;
+                _last_heard = now;
+                if (_recovery_level != 0)
+                {
+                    // the last recovery worked: the radio was deaf from the stall until then
+                    uint32_t deaf = _recovery_at - _stall_since;
+                    metric_deaf_ms.inc(deaf);
+                    _recovery_level = 0;
+                    ESP_LOGI(TAG, "Receiver back after %lu ms deaf", (unsigned long)deaf);
+                    this->publish_watchdog_event("recovered", nullptr, deaf);
+                }
+            }
+
+            // a radio that left RX, e.g. after an SPI glitch, is re-armed, then reset if it
+            // still isn't receiving at the next check; a packet arriving during the status
+            // read is read out right after it
+            if (now - _last_status_check >= STATUS_CHECK_MS)
+            {
+                if (LoRa.isReceiving() == 0)
+                {
+                    this->recover_receiver(_status_rearmed, "status", now, _last_status_check);
+                    _status_rearmed = !_status_rearmed;
+                }
+                else
+                {
+                    _status_rearmed = false;
+                }
+                _last_status_check = now;
+            }
+
+            // Silence for many times the usual gap between packets: re-arm first, reset
+            // after that, and back off while the network stays quiet. Nothing to go by
+            // until the bridge has heard from the network twice.
+            if (_mean_gap_ms == 0 || _heard_count < 2)
+                return;
+            uint32_t wait = _mean_gap_ms * SILENCE_GAPS;
+            wait = wait < MIN_SILENCE_MS ? MIN_SILENCE_MS : wait;
+            wait = wait > (uint32_t)_rx_watchdog ? (uint32_t)_rx_watchdog : wait;
+            for (uint8_t level = 2; level < _recovery_level && wait < MAX_SILENCE_BACKOFF_MS; level++)
+                wait *= 2;
+            if (now - (_recovery_level == 0 ? _last_heard : _recovery_at) >= wait)
+                this->recover_receiver(_recovery_level != 0, "silence", now, _last_heard);
+        }
+
+        void Lora_MQTT_BridgeComponent::recover_receiver(bool reset, const char *reason, uint32_t now, uint32_t stall_since)
+        {
+            if (_recovery_level == 0)
+                _stall_since = stall_since;
+            if (_recovery_level < 0xFF)
+                _recovery_level++;
+            _recovery_at = now;
+            // after a failed reset the radio is down: nothing to disarm or end, begin again
+            bool down = !LoRa.isInitialized();
+            if (!down)
+                LoRa.onReceive(NULL);
+            if (reset || down)
+            {
+                ESP_LOGW(TAG, "Receiver stalled (%s), resetting the radio", reason);
+                metric_radio_resets.inc();
+                if (!down)
+                    LoRa.end();
+                if (!this->begin_radio())
+                {
+                    ESP_LOGE(TAG, "Radio reset failed, trying again at the next check");
+                    this->publish_watchdog_event("reset_failed", reason, 0);
+                    return;
+                }
+            }
+            else
+            {
+                ESP_LOGW(TAG, "Receiver stalled (%s), re-arming RX", reason);
+                metric_rx_rearms.inc();
+            }
+            LoRa.onReceive(Lora_MQTT_BridgeComponent::call_on_data_recv_callback);
+            LoRa.receive();
+            this->publish_watchdog_event(reset ? "reset" : "rearm", reason, 0);
         }
 
-        // Static counter for periodic status
-        static uint32_t last_status_time = 0;
+        void Lora_MQTT_BridgeComponent::publish_watchdog_event(const char *action, const char *reason, uint32_t deaf_ms)
+        {
+            if (_stats_topic.empty() || !mqtt::global_mqtt_client->is_connected())
+                return;
+            std::string topic = _stats_topic + "/watchdog";
+            char payload[160];
+            int len = snprintf(payload, sizeof(payload),
+                               "{\"action\":\"%s\",\"reason\":\"%s\",\"deaf_ms\":%lu,\"rearms\":%lu,\"resets\":%lu,\"deaf_total_ms\":%lu}",
+                               action, reason != nullptr ? reason : "", (unsigned long)deaf_ms, (unsigned long)metric_rx_rearms.get(),
+                               (unsigned long)metric_radio_resets.get(), (unsigned long)metric_deaf_ms.get());
+            mqtt::global_mqtt_client->publish(topic.c_str(), payload, len, 0, false);
+        }
 
-        void Lora_MQTT_BridgeComponent::split(char **argv, int *argc, char *string, const char delimiter, int allowempty)
+        bool Lora_MQTT_BridgeComponent::publish_state(const char *topic, const char *payload, size_t len, bool retain)
         {
-            *argc = 0;
-            do
+            if (!_journal_enabled || !_journal.is_ready())
+            {
+                return this->publish(topic, payload, len, retain);
+            }
+            // while a backlog exists, live states queue behind it to keep ordering
+            if (_journal.empty() && mqtt::global_mqtt_client->is_connected() &&
+                this->publish(topic, payload, len, retain))
             {
-                if (*string && (*string != delimiter || allowempty))
+                return true;
+            }
+            metric_journaled.inc();
+            return _journal.append(topic, payload, len, retain);
+        }
+
+        bool Lora_MQTT_BridgeComponent::publish_config(const char *topic, const std::string &json)
+        {
+            return this->publish(topic, json.c_str(), json.length(), true);
+        }
+
+        bool Lora_MQTT_BridgeComponent::publish(const char *topic, const char *payload, size_t len, bool retain)
+        {
+            bool ok = mqtt::global_mqtt_client->publish(topic, payload, len, 2, retain);
+            (ok ? metric_published : metric_publish_failed).inc();
+            return ok;
+        }
+
+        void Lora_MQTT_BridgeComponent::trace_mark(uint32_t *stage)
+        {
+            // a stamp of exactly 0 is taken as 1, 0 means the stage wasn't reached
+            uint32_t cycles = arch_get_cpu_cycle_count();
+            *stage = cycles != 0 ? cycles : 1;
+        }
+
+        void Lora_MQTT_BridgeComponent::record_trace()
+        {
+            // cycle deltas wrap cleanly; at 240 MHz a stage may take up to ~17 s
+            uint32_t cycles_per_us = arch_get_cpu_freq_hz() / 1000000;
+            if (_trace.irq == 0 || _trace.decoded == 0 || cycles_per_us == 0)
+                return;
+            trace_readout.record((_trace.readout - _trace.irq) / cycles_per_us);
+            trace_pickup.record((_trace.pickup - _trace.readout) / cycles_per_us);
+            trace_decode.record((_trace.decoded - _trace.pickup) / cycles_per_us);
+            trace_publish.record((_trace.published - _trace.decoded) / cycles_per_us);
+            trace_total.record((_trace.published - _trace.irq) / cycles_per_us);
+        }
+
+        void Lora_MQTT_BridgeComponent::log_trace_summary()
+        {
+            if (trace_total.count() == 0)
+                return;
+            ESP_LOGI(TAG, "Latency p50/p95/p99 us over %lu packet(s): readout %lu/%lu/%lu, pickup %lu/%lu/%lu, decode %lu/%lu/%lu, publish %lu/%lu/%lu, total %lu/%lu/%lu",
+                     (unsigned long)trace_total.count(),
+                     (unsigned long)trace_readout.percentile(50), (unsigned long)trace_readout.percentile(95), (unsigned long)trace_readout.percentile(99),
+                     (unsigned long)trace_pickup.percentile(50), (unsigned long)trace_pickup.percentile(95), (unsigned long)trace_pickup.percentile(99),
+                     (unsigned long)trace_decode.percentile(50), (unsigned long)trace_decode.percentile(95), (unsigned long)trace_decode.percentile(99),
+                     (unsigned long)trace_publish.percentile(50), (unsigned long)trace_publish.percentile(95), (unsigned long)trace_publish.percentile(99),
+                     (unsigned long)trace_total.percentile(50), (unsigned long)trace_total.percentile(95), (unsigned long)trace_total.percentile(99));
+        }
+
+        void Lora_MQTT_BridgeComponent::export_metrics()
+        {
+            this->log_trace_summary();
+            if (_journal_enabled && _journal.is_ready())
+                metric_journal_depth.set(_journal.pending());
+            metric_entities.set(_entities.size());
+            metric_entity_bytes.set(_entities.arena_used());
+#ifdef USE_SENSOR
+            for (auto &entry : _metric_sensors)
+            {
+                metrics::Metric *metric = metrics::MetricsRegistry::find(entry.first.c_str());
+                if (metric != nullptr)
+                    entry.second->publish_state(metric->value());
+            }
+#endif
+            if (_stats_topic.empty() || !mqtt::global_mqtt_client->is_connected())
+                return;
+            std::string json;
+            json.reserve(640);
+            metrics::MetricsRegistry::to_json(json);
+            // straight to the broker: stats are not worth journaling
+            mqtt::global_mqtt_client->publish(_stats_topic, json, 0, false);
+        }
+
+        bool Lora_MQTT_BridgeComponent::process_catchup(const uint8_t *frame, size_t len, bool publish)
+        {
+            // walked once to validate (so the ACK only confirms a usable frame) and
+            // once more to publish
+            if (len < 4 || frame[2] == 0 || frame[2] > 64 || 3u + frame[2] > len)
+                return false;
+            char node[65];
+            memcpy(node, frame + 3, frame[2]);
+            node[frame[2]] = 0;
+            size_t pos = 3 + frame[2];
+
+            uint32_t now = this->wall_time();
+            uint32_t samples = 0;
+            while (pos < len)
+            {
+                if (pos + 2 > len)
+                    return false;
+                uint8_t flags = frame[pos++];
+                if ((flags & ENTITY_PACKED) && (flags & ENTITY_ACCURACY) > MAX_ACCURACY)
+                    return false;
+                uint8_t object_len = frame[pos++];
+                if (object_len == 0 || object_len > 64 || pos + object_len + 1 > len)
+                    return false;
+                char object_id[65];
+                memcpy(object_id, frame + pos, object_len);
+                object_id[object_len] = 0;
+                pos += object_len;
+                uint8_t count = frame[pos++];
+
+                char topic[250];
+                snprintf(topic, sizeof(topic), (flags & ENTITY_BINARY) ? "%s/binary_sensor/%s/history" : "%s/sensor/%s/history",
+                         node, object_id);
+                SeriesDecoder decoder;
+                for (uint8_t i = 0; i < count; i++)
                 {
-                    argv[(*argc)++] = string;
+                    uint32_t age;
+                    float value;
+                    if (flags & ENTITY_PACKED)
+                    {
+                        int32_t time, quantized;
+                        size_t n = decoder.decode(frame + pos, len - pos, &time, &quantized);
+                        if (n == 0 || !valid_sample_time(time))
+                            return false;
+                        pos += n;
+                        age = -time;
+                        value = dequantize_value(quantized, flags & ENTITY_ACCURACY);
+                    }
+                    else
+                    {
+                        size_t n = get_varint(frame + pos, len - pos, &age);
+                        if (n == 0 || pos + n + sizeof(float) > len)
+                            return false;
+                        pos += n;
+                        memcpy(&value, frame + pos, sizeof(float));
+                        pos += sizeof(float);
+                    }
+                    samples++;
+                    if (!publish)
+                        continue;
+
+                    std::string value_s = (flags & ENTITY_BINARY) ? (value != 0.0f ? "ON" : "OFF")
+                                                                   : value_accuracy_to_string(value, flags & ENTITY_ACCURACY);
+                    char payload[96];
+                    int payload_len;
+                    if (now != 0)
+                        payload_len = snprintf(payload, sizeof(payload), "{\"ts\":%lu,\"value\":\"%s\"}",
+                                               (unsigned long)(now - age), value_s.c_str());
+                    else
+                        payload_len = snprintf(payload, sizeof(payload), "{\"age\":%lu,\"value\":\"%s\"}",
+                                               (unsigned long)age, value_s.c_str());
+                    this->publish_state(topic, payload, payload_len, false);
                 }
-                while (*string && *string != delimiter)
-                    string++;
-                if (*string)
-                    *string++ = 0;
-                if (!allowempty)
-                    while (*string && *string == delimiter)
-                        string++;
-            } while (*string);
+            }
+            if (publish)
+                ESP_LOGI(TAG, "Catch-up from %s: %lu reading(s)", node, (unsigned long)samples);
+            return samples != 0;
+        }
+
+        bool Lora_MQTT_BridgeComponent::process_text(const uint8_t *frame, size_t len)
+        {
+            size_t pos = 1;
+            char node[65];
+            char object_id[65];
+            for (char *name : {node, object_id})
+            {
+                if (pos >= len || frame[pos] == 0 || frame[pos] > 64 || pos + 1 + frame[pos] > len)
+                    return false;
+                memcpy(name, frame + pos + 1, frame[pos]);
+                name[frame[pos]] = 0;
+                pos += 1 + frame[pos];
+            }
+
+            std::string key = node;
+            key += '/';
+            key += object_id;
+            std::string value;
+            bool carries_text;
+            if (_text_dictionaries.get(key).decode(frame + pos, len - pos, value, &carries_text) == 0)
+                return false;
+            this->trace_mark(&_trace.decoded);
+            this->track_frequency(node, -1);
+            ESP_LOGI(TAG, "Text from %s: %s = '%s'%s", node, object_id, value.c_str(), carries_text ? "" : " (coded)");
+
+            SensorLine line;
+            line.node = node;
+            line.object_id = object_id;
+            line.value = value.c_str();
+            line.version = "";
+            line.board = "";
+            EntityTable::Entity *entity = this->intern(line.type(), line.node, line.object_id);
+            if (entity == nullptr)
+                return false;
+            if (_entities.needs_discovery(entity, LoRaCodec::discovery_hash(line, line.node, false), millis()))
+            {
+                StaticJsonDocument<500> doc;
+                std::string json;
+                LoRaCodec::build_discovery(line, line.node, false, doc);
+                serializeJson(doc, json);
+                if (!this->publish_config(_entities.config_topic(entity), json))
+                    _entities.discovery_failed(entity);
+            }
+            this->publish_state(_entities.state_topic(entity), line.value, strlen(line.value));
+            this->trace_mark(&_trace.published);
+            return true;
+        }
+
+        void Lora_MQTT_BridgeComponent::send_ack(const char *node, uint8_t seq)
+        {
+            uint16_t node_id = node_id_hash(fnv1_hash(node));
+            uint8_t frame[ACK_CORRECTION_FRAME_SIZE] = {FRAME_ACK, (uint8_t)(node_id & 0xFF), (uint8_t)(node_id >> 8), seq};
+            size_t len = ACK_FRAME_SIZE;
+            FrequencyTracker::Node *tracked = _frequencies.find(node_id);
+            if (_frequency_correction == FREQUENCY_CORRECTION_NODES && tracked != nullptr)
+            {
+                int32_t correction = _frequencies.take_correction(tracked);
+                if (correction != 0)
+                {
+                    int16_t hz = correction > INT16_MAX ? INT16_MAX : correction < INT16_MIN ? INT16_MIN : correction;
+                    frame[4] = (uint8_t)hz;
+                    frame[5] = (uint8_t)((uint16_t)hz >> 8);
+                    len = ACK_CORRECTION_FRAME_SIZE;
+                    metric_freq_corrections.inc();
+                    ESP_LOGI(TAG, "Frequency correction for %s: %d Hz", node, hz);
+                }
+            }
+            this->transmit_frame(frame, len);
+        }
+
+        void Lora_MQTT_BridgeComponent::track_frequency(const char *node, int seq)
+        {
+            // the radio only measures the offset on LoRa packets
+            if (_modulation != MODULATION_LORA)
+                return;
+            _frequencies.add(node_id_hash(fnv1_hash(node)), LoRa.packetFrequencyError(), seq);
+            metric_freq_offset.set(_frequencies.max_offset_hz());
+            if (_frequency_correction != FREQUENCY_CORRECTION_RECEIVER)
+                return;
+            int32_t correction = _frequencies.take_receiver_correction();
+            if (correction == 0)
+                return;
+            // no further than a cheap crystal can be off
+            int32_t limit = _frequency / 10000;
+            _receiver_offset += correction;
+            _receiver_offset = _receiver_offset > limit ? limit : _receiver_offset < -limit ? -limit : _receiver_offset;
+            // as in transmit_frame(): no packet readout from the DIO interrupt in the middle
+            // of the retune's SPI transfers
+            LoRa.onReceive(NULL);
+            LoRa.setFrequency(_frequency + _receiver_offset);
+            LoRa.onReceive(Lora_MQTT_BridgeComponent::call_on_data_recv_callback);
+            LoRa.receive();
+            metric_freq_corrections.inc();
+            ESP_LOGI(TAG, "Receiver retuned by %ld Hz, now %ld Hz from %lu", (long)correction, (long)_receiver_offset,
+                     (unsigned long)_frequency);
+        }
+
+        void Lora_MQTT_BridgeComponent::send_beacon()
+        {
+            if (this->wall_time() == 0)
+                return;
+            // SNTP disciplines the system clock, which gives us the sub-second part
+            struct timeval tv;
+            gettimeofday(&tv, nullptr);
+            uint32_t seconds = tv.tv_sec;
+            uint8_t frame[BEACON_FRAME_SIZE] = {FRAME_BEACON, (uint8_t)seconds, (uint8_t)(seconds >> 8), (uint8_t)(seconds >> 16),
+                                                (uint8_t)(seconds >> 24), (uint8_t)(tv.tv_usec * 256 / 1000000)};
+            this->transmit_frame(frame, sizeof(frame));
+            ESP_LOGD(TAG, "Time beacon sent: %lu", (unsigned long)seconds);
+        }
+
+        void Lora_MQTT_BridgeComponent::transmit_frame(const uint8_t *frame, size_t len)
+        {
+            // a radio that failed to reset stays down until the watchdog's next attempt
+            if (!LoRa.isInitialized())
+                return;
+            // TX done is signalled on the same IRQ line as RX done, so stop listening first
+            LoRa.onReceive(NULL);
+            LoRa.beginPacket();
+            LoRa.write(frame, len);
+            LoRa.endPacket();
+            LoRa.onReceive(Lora_MQTT_BridgeComponent::call_on_data_recv_callback);
+            LoRa.receive();
+        }
+
+        void Lora_MQTT_BridgeComponent::setup_fuota()
+        {
+            if (_fuota_topic.empty())
+                return;
+            if (LoRa.maxPacketLength() < FUOTA_SESSION_FRAME_SIZE)
+            {
+                ESP_LOGE(TAG, "Firmware updates need frames of %u bytes, implicit_header is too short - disabled",
+                         (unsigned)FUOTA_SESSION_FRAME_SIZE);
+                return;
+            }
+            if (!_fuota.begin(_fuota_key, fnv1_hash("lora_mqtt_bridge.fuota")))
+            {
+                ESP_LOGE(TAG, "Firmware updates need a fuota_key of 32 hex characters and LittleFS - disabled");
+                return;
+            }
+            mqtt::global_mqtt_client->subscribe(_fuota_topic + "/start", [this](const std::string &topic, const std::string &payload)
+                                                { this->on_fuota_start(payload); }, 1);
+            mqtt::global_mqtt_client->subscribe(_fuota_topic + "/data", [this](const std::string &topic, const std::string &payload)
+                                                { this->on_fuota_data(payload); }, 1);
+            ESP_LOGI(TAG, "Firmware updates: images on %s/start and %s/data, %ld%% repair fragments, %ld pass(es), %.1f%% duty cycle",
+                     _fuota_topic.c_str(), _fuota_topic.c_str(), _fuota_redundancy, _fuota_passes, _fuota_duty_cycle);
+        }
+
+        void Lora_MQTT_BridgeComponent::on_fuota_start(const std::string &payload)
+        {
+            // {"size": bytes, "sha256": "hex"}; a new image replaces a session in progress
+            StaticJsonDocument<256> doc;
+            uint8_t sha256[32];
+            if (deserializeJson(doc, payload) || !parse_hex(doc["sha256"].as<std::string>(), sha256, sizeof(sha256)) ||
+                !_fuota.stage(doc["size"].as<uint32_t>(), sha256))
+            {
+                ESP_LOGE(TAG, "Invalid firmware update start, expected {\"size\": bytes, \"sha256\": \"hex\"}");
+                this->publish_fuota_status("failed");
+                return;
+            }
+            this->publish_fuota_status("staging");
+        }
+
+        void Lora_MQTT_BridgeComponent::on_fuota_data(const std::string &payload)
+        {
+            if (!_fuota.staging())
+                return;
+            if (!_fuota.append((const uint8_t *)payload.data(), payload.size()))
+                this->publish_fuota_status("failed");
+            else if (_fuota.staged())
+                this->start_fuota();
+        }
+
+        void Lora_MQTT_BridgeComponent::start_fuota()
+        {
+            size_t radio = LoRa.maxPacketLength();
+            size_t fragment_size = (radio < 255 ? radio : 255) - FUOTA_FRAGMENT_HEADER;
+            long repair = (FUOTA_BLOCK * _fuota_redundancy + 99) / 100;
+            repair = repair < 0 ? 0 : repair > 255 - FUOTA_BLOCK ? 255 - FUOTA_BLOCK : repair;
+            if (!_fuota.start(fragment_size, repair, _fuota_passes))
+            {
+                ESP_LOGE(TAG, "Could not start the firmware update");
+                this->publish_fuota_status("failed");
+                return;
+            }
+            uint32_t fragments = _fuota.frames_per_pass() - FuotaSender::ANNOUNCE_FRAMES;
+            _fuota_pass_airtime_us = (uint64_t)FuotaSender::ANNOUNCE_FRAMES * LoRa.timeOnAir(FUOTA_SESSION_FRAME_SIZE) +
+                                     (uint64_t)fragments * LoRa.timeOnAir(_fuota.fragment_frame_size());
+            _fuota_airtime_us = 0;
+            _fuota_wait_ms = 0;
+            ESP_LOGI(TAG, "Firmware update %06lx: %lu bytes in %u blocks of %u+%ld fragments of %u bytes", (unsigned long)_fuota.session(),
+                     (unsigned long)_fuota.image_size(), _fuota.blocks(), (unsigned)FUOTA_BLOCK, repair, (unsigned)fragment_size);
+            ESP_LOGI(TAG, "Per pass: %lu frames, %.0f s airtime, %.1f h at %.1f%% duty cycle; %u pass(es)",
+                     (unsigned long)_fuota.frames_per_pass(), _fuota_pass_airtime_us / 1e6,
+                     _fuota_pass_airtime_us / 36e6 / _fuota_duty_cycle, _fuota_duty_cycle, _fuota.passes());
+            this->publish_fuota_status("sending");
+        }
+
+        void Lora_MQTT_BridgeComponent::send_fuota_frame()
+        {
+            uint8_t frame[256];
+            size_t len = _fuota.next_frame(frame);
+            if (len == 0)
+            {
+                this->publish_fuota_status("failed");
+                return;
+            }
+            this->transmit_frame(frame, len);
+            uint32_t airtime_us = LoRa.timeOnAir(len);
+            _fuota_airtime_us += airtime_us;
+            metric_fuota_frames.inc();
+            metric_fuota_airtime_ms.inc(airtime_us / 1000);
+            // off air for the rest of the duty cycle; at most half the time on air, so
+            // uplinks and their ACKs get through in between
+            float duty = _fuota_duty_cycle > 50.0f ? 50.0f : _fuota_duty_cycle;
+            _fuota_wait_ms = airtime_us / 1000 * (100.0f - duty) / duty;
+            _fuota_last_frame = millis();
+
+            if (!_fuota.active())
+            {
+                ESP_LOGI(TAG, "Firmware update %06lx sent: %.0f s airtime", (unsigned long)_fuota.session(), _fuota_airtime_us / 1e6);
+                this->publish_fuota_status("done");
+            }
+            else if (_fuota.block_done())
+            {
+                // block() and pass() have moved on to the next one already
+                bool pass_done = _fuota.block() == 0;
+                ESP_LOGD(TAG, "Firmware update: %u of %u blocks sent in pass %u", pass_done ? _fuota.blocks() : _fuota.block(),
+                         _fuota.blocks(), pass_done ? _fuota.pass() : _fuota.pass() + 1);
+                this->publish_fuota_status("sending");
+            }
+        }
+
+        void Lora_MQTT_BridgeComponent::publish_fuota_status(const char *state)
+        {
+            if (!mqtt::global_mqtt_client->is_connected())
+                return;
+            std::string topic = _fuota_topic + "/status";
+            char payload[256];
+            int len = snprintf(payload, sizeof(payload),
+                               "{\"state\":\"%s\",\"session\":\"%06lx\",\"size\":%lu,\"staged\":%lu,\"pass\":%u,\"passes\":%u,"
+                               "\"block\":%u,\"blocks\":%u,\"airtime_s\":%.1f,\"pass_airtime_s\":%.1f}",
+                               state, (unsigned long)_fuota.session(), (unsigned long)_fuota.image_size(),
+                               (unsigned long)_fuota.staged_bytes(), _fuota.pass(), _fuota.passes(), _fuota.block(), _fuota.blocks(),
+                               _fuota_airtime_us / 1e6, _fuota_pass_airtime_us / 1e6);
+            mqtt::global_mqtt_client->publish(topic.c_str(), payload, len, 0, false);
+        }
+
+        void Lora_MQTT_BridgeComponent::capture_frame(const uint8_t *frame, size_t len, uint8_t flags)
+        {
+            if (!_capture.enabled())
+                return;
+            CaptureRecord record;
+            if (this->wall_time() != 0)
+            {
+                struct timeval tv;
+                gettimeofday(&tv, nullptr);
+                record.time_s = tv.tv_sec;
+                record.time_us = tv.tv_usec;
+                flags |= CAPTURE_WALL_TIME;
+            }
+            else
+            {
+                uint64_t uptime = esp_timer_get_time();
+                record.time_s = uptime / 1000000;
+                record.time_us = uptime % 1000000;
+            }
+            float snr = LoRa.packetSnr() * 4;
+            record.rssi = LoRa.packetRssi();
+            record.snr_quarter_db = snr < -128 ? -128 : snr > 127 ? 127 : (int8_t)lroundf(snr);
+            record.flags = flags;
+            record.len = len;
+            record.frame = frame;
+            _capture.record(record);
+        }
+
+        uint32_t Lora_MQTT_BridgeComponent::wall_time()
+        {
+#ifdef USE_TIME
+            if (_time != nullptr && _time->now().is_valid())
+                return _time->now().timestamp;
+#endif
+            return 0;
+        }
+
+        uint32_t Lora_MQTT_BridgeComponent::resolve_timestamp(const char *stamp)
+        {
+            int high = timestamp_value(stamp[0]);
+            int low = high < 0 ? -1 : timestamp_value(stamp[1]);
+            uint32_t now = this->wall_time();
+            if (low < 0 || stamp[2] != 0 || now == 0)
+                return 0;
+            // most recent second with these low bits, allowing a little clock skew
+            uint32_t stamp_value = (high << 6) | low;
+            uint32_t sample_time = now - now % TIMESTAMP_MODULO + stamp_value;
+            if (sample_time > now + 60)
+                sample_time -= TIMESTAMP_MODULO;
+            return sample_time;
+        }
+
+        void Lora_MQTT_BridgeComponent::publish_sample_time(const char *node, const char *type, const char *name, uint32_t sample_time)
+        {
+            char topic[250];
+            char payload[64];
+            snprintf(topic, sizeof(topic), "%s/%s/%s/attributes", node, type, name);
+            int len = snprintf(payload, sizeof(payload), "{\"sample_time\":%lu,\"delay\":%ld}",
+                               (unsigned long)sample_time, (long)(this->wall_time() - sample_time));
+            this->publish_state(topic, payload, len);
+        }
+
+        // from the DIO interrupt: only hands the packet to loop()
+        void Lora_MQTT_BridgeComponent::call_on_data_recv_callback(int packetSize)
+        {
+            _packet_size = packetSize;
+            receivedLoRaP = true;
         }
     } // namespace lora_mqtt_bridge
 } // namespace esphome
@@ -4,28 +4,81 @@
 #include "esphome/components/mqtt/mqtt_client.h"
 #include "esphome/core/hal.h"
 #include "esp_wifi.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/frame_crypto.h"
+#include "esphome/components/frame_codec/text_dictionary.h"
+#include "esphome/components/frame_codec/entity_table.h"
+#include "esphome/components/frame_codec/frequency_tracker.h"
+#include "esphome/components/metrics/metrics.h"
+#include "uplink_journal.h"
+#include "capture_sink.h"
+#include "fuota_sender.h"
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
 
 namespace esphome
 {
     namespace lora_mqtt_bridge
     {
+        // what the bridge does with the carrier offsets it measures, see FrequencyTracker
+        enum FrequencyCorrection
+        {
+            FREQUENCY_CORRECTION_OFF,
+            FREQUENCY_CORRECTION_NODES,    // in the ACKs, to every node on its own
+            FREQUENCY_CORRECTION_RECEIVER, // retune the bridge, for a single-node link
+        };
+
         class Lora_MQTT_BridgeComponent : public Component
         {
         public:
             void setup() override;
             void loop() override;
-            void process_line();
             float get_setup_priority() const override;
             void set_cs_constant(GPIOPin *constant) { this->_cs = constant; }
             void set_reset_constant(GPIOPin *constant) { this->_reset = constant; }
             void set_dio0_constant(GPIOPin *constant) { this->_dio0 = constant; }
             void set_dio1_constant(GPIOPin *constant) { this->_dio1 = constant; }
             void set_chip_type_constant(int constant) { this->_chip_type = constant; }
-            void set_frequency_constant(long constant) { this->_frequency = constant; }
+            void set_modulation_constant(int constant) { this->_modulation = constant; }
+            void set_frequency_constant(uint32_t constant) { this->_frequency = constant; }
             void set_bandwidth_constant(long constant) { this->_bandwidth = constant; }
             void set_spread_constant(long constant) { this->_spread = constant; }
             void set_coding_constant(long constant) { this->_coding = constant; }
+            void set_bit_rate_constant(long constant) { this->_bit_rate = constant; }
+            void set_flrc_coding_constant(long constant) { this->_flrc_coding = constant; }
+            void set_deviation_constant(long constant) { this->_deviation = constant; }
             void set_sync_constant(long constant) { this->_sync = constant; }
+            void set_implicit_header_constant(long constant) { this->_implicit_header = constant; }
+            void set_frequency_correction_constant(int constant) { this->_frequency_correction = (FrequencyCorrection)constant; }
+            void set_rx_watchdog_constant(long constant) { this->_rx_watchdog = constant; }
+            void set_journal_constant(bool constant) { this->_journal_enabled = constant; }
+            void set_journal_size_constant(long constant) { this->_journal_size = constant; }
+#ifdef USE_TIME
+            void set_time_constant(time::RealTimeClock *constant) { this->_time = constant; }
+#endif
+            void set_beacon_interval_constant(long constant) { this->_beacon_interval = constant; }
+            void set_max_entities_constant(long constant) { this->_max_entities = constant; }
+            void set_stats_interval_constant(long constant) { this->_stats_interval = constant; }
+            void set_stats_topic_constant(const std::string &constant) { this->_stats_topic = constant; }
+#ifdef USE_SENSOR
+            void add_metric_sensor(const std::string &metric, sensor::Sensor *sensor) { this->_metric_sensors.push_back({metric, sensor}); }
+#endif
+            void add_key_constant(int key_id, const std::string &key) { this->_keys.push_back({key_id, key}); }
+            void set_require_encryption_constant(bool constant) { this->_opener.set_required(constant); }
+            void set_capture_constant(int constant) { this->_capture_mode = (CaptureMode)constant; }
+            void set_capture_topic_constant(const std::string &constant) { this->_capture_topic = constant; }
+            void set_capture_size_constant(long constant) { this->_capture_size = constant; }
+            void set_fuota_topic_constant(const std::string &constant) { this->_fuota_topic = constant; }
+            void set_fuota_key_constant(const std::string &constant) { this->_fuota_key = constant; }
+            void set_fuota_redundancy_constant(long constant) { this->_fuota_redundancy = constant; }
+            void set_fuota_passes_constant(long constant) { this->_fuota_passes = constant; }
+            void set_fuota_duty_cycle_constant(float constant) { this->_fuota_duty_cycle = constant; }
             static volatile bool receivedLoRaP;
         private:
             GPIOPin *_cs{0};
@@ -33,15 +86,122 @@ namespace esphome
             GPIOPin *_dio0{0};
             GPIOPin *_dio1{0};
             int _chip_type{0};
-            long _frequency{0};
+            int _modulation{0};
+            uint32_t _frequency{0};
             long _bandwidth{0};
             long _spread{0};
             long _coding{0};
+            long _bit_rate{0}; // 0 keeps the driver's default for the modulation
+            long _flrc_coding{3};
+            long _deviation{0}; // 0 for a quarter of the bit rate
             long _sync{0};
+            long _implicit_header{0};
+
+            // carrier offset per node, measured on every LoRa packet
+            FrequencyCorrection _frequency_correction{FREQUENCY_CORRECTION_OFF};
+            frame_codec::FrequencyTracker _frequencies;
+            int32_t _receiver_offset{0};
+            void track_frequency(const char *node, int seq);
+            bool begin_radio();
+
+            // receive watchdog: a radio that stops listening is re-armed, then reset and
+            // set up again, without rebooting
+            static const uint32_t STATUS_CHECK_MS = 5000;
+            static const uint32_t SILENCE_GAPS = 8;
+            static const uint32_t MIN_SILENCE_MS = 60000;
+            static const uint32_t MAX_SILENCE_BACKOFF_MS = 3600000;
+            long _rx_watchdog{900000}; // longest silence before recovery, 0 = off
+            uint32_t _heard_count{0};
+            uint32_t _last_heard{0};
+            uint32_t _mean_gap_ms{0};
+            uint32_t _last_status_check{0};
+            bool _status_rearmed{false};
+            uint8_t _recovery_level{0}; // recoveries since the last packet
+            uint32_t _recovery_at{0};
+            uint32_t _stall_since{0};
+            void check_receiver(uint32_t now);
+            void recover_receiver(bool reset, const char *reason, uint32_t now, uint32_t stall_since);
+            void publish_watchdog_event(const char *action, const char *reason, uint32_t deaf_ms);
+
+            bool _journal_enabled{false};
+            long _journal_size{131072};
+            UplinkJournal _journal;
+#ifdef USE_TIME
+            time::RealTimeClock *_time{nullptr};
+#endif
+            std::vector<std::pair<int, std::string>> _keys;
+            frame_codec::FrameOpener _opener;
+            long _beacon_interval{0};
+            uint32_t _last_beacon{0};
             static volatile int _packet_size;
-            void split(char **argv, int *argc, char *string, const char delimiter, int allowempty);
+            bool publish_state(const char *topic, const char *payload, size_t len, bool retain = true);
+            bool publish_config(const char *topic, const std::string &json);
+            bool publish(const char *topic, const char *payload, size_t len, bool retain);
+            void handle_packet();
+
+            // metrics registry export, as one JSON topic and/or sensors
+            long _stats_interval{60000};
+            std::string _stats_topic;
+            uint32_t _last_stats_export{0};
+#ifdef USE_SENSOR
+            std::vector<std::pair<std::string, sensor::Sensor *>> _metric_sensors;
+#endif
+            void export_metrics();
+
+            // raw frame capture for replay on a host, see capture_sink.h
+            CaptureMode _capture_mode{CAPTURE_OFF};
+            std::string _capture_topic;
+            long _capture_size{65536};
+            CaptureSink _capture;
+            void capture_frame(const uint8_t *frame, size_t len, uint8_t flags);
+
+            // multicast firmware updates, see fuota_sender.h; images come in on
+            // <fuota_topic>/start and /data, progress goes out on /status
+            std::string _fuota_topic;
+            std::string _fuota_key;
+            long _fuota_redundancy{40}; // repair fragments per block, percent of FUOTA_BLOCK
+            long _fuota_passes{2};
+            float _fuota_duty_cycle{1.0f};
+            FuotaSender _fuota;
+            uint32_t _fuota_last_frame{0};
+            uint32_t _fuota_wait_ms{0};
+            uint64_t _fuota_airtime_us{0};      // sent in this session
+            uint64_t _fuota_pass_airtime_us{0}; // planned per pass
+            void setup_fuota();
+            void on_fuota_start(const std::string &payload);
+            void on_fuota_data(const std::string &payload);
+            void start_fuota();
+            void send_fuota_frame();
+            void publish_fuota_status(const char *state);
+
+            // CPU cycle stamps of the packet being handled: DIO interrupt, read out of
+            // the radio, picked up by loop(), decoded, state published (0 = not reached)
+            struct PacketTrace
+            {
+                uint32_t irq;
+                uint32_t readout;
+                uint32_t pickup;
+                uint32_t decoded;
+                uint32_t published;
+            };
+            PacketTrace _trace{};
+            void trace_mark(uint32_t *stage);
+            void record_trace();
+            void log_trace_summary();
+            bool process_catchup(const uint8_t *frame, size_t len, bool publish);
+            bool process_text(const uint8_t *frame, size_t len);
+            frame_codec::EntityTable _entities;
+            long _max_entities{frame_codec::EntityTable::DEFAULT_ENTITIES};
+            frame_codec::EntityTable::Entity *intern(const char *type, const char *node, const char *object_id);
+            // per "node/object_id", rebuilt from defines after a reboot
+            frame_codec::TextDictionaryTable _text_dictionaries;
+            void send_ack(const char *node, uint8_t seq);
+            void send_beacon();
+            void transmit_frame(const uint8_t *frame, size_t len);
+            uint32_t wall_time();
+            uint32_t resolve_timestamp(const char *stamp);
+            void publish_sample_time(const char *node, const char *type, const char *name, uint32_t sample_time);
             
-            void receivecallback(int packetSize);
             static void call_on_data_recv_callback(int packetSize);
         };
     } // namespace lora_mqtt_bridge
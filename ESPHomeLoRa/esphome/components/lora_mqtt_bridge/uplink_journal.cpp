@@ -0,0 +1,335 @@
+#include "uplink_journal.h"
+#include "esphome/core/log.h"
+#include "esphome/core/hal.h"
+#include <LittleFS.h>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        static const char *const TAG = "lora_mqtt_bridge.journal";
+        static const char *const JOURNAL_DIR = "/journal";
+
+        bool UplinkJournal::begin(size_t max_bytes)
+        {
+            this->page_.reset(new (std::nothrow) uint8_t[PAGE_SIZE]);
+            if (this->page_ == nullptr)
+            {
+                ESP_LOGE(TAG, "No memory for a %u byte journal page - journal disabled", (unsigned)PAGE_SIZE);
+                return false;
+            }
+            if (!LittleFS.begin(true))
+            {
+                ESP_LOGE(TAG, "Could not mount LittleFS - journal disabled");
+                return false;
+            }
+            if (!LittleFS.exists(JOURNAL_DIR))
+                LittleFS.mkdir(JOURNAL_DIR);
+
+            this->max_segments_ = max_bytes / (PAGE_SIZE * SEGMENT_PAGES);
+            if (this->max_segments_ < 2)
+                this->max_segments_ = 2;
+
+            // find the range of segment files left over from the previous boot
+            bool found = false;
+            uint32_t lowest = 0, highest = 0;
+            File dir = LittleFS.open(JOURNAL_DIR);
+            if (dir && dir.isDirectory())
+            {
+                File entry = dir.openNextFile();
+                while (entry)
+                {
+                    const char *name = strrchr(entry.name(), '/');
+                    name = name ? name + 1 : entry.name();
+                    uint32_t index = strtoul(name, nullptr, 16);
+                    if (!found || index < lowest)
+                        lowest = index;
+                    if (!found || index > highest)
+                        highest = index;
+                    found = true;
+                    entry.close();
+                    entry = dir.openNextFile();
+                }
+                dir.close();
+            }
+
+            if (found)
+            {
+                uint32_t last_seq = 0;
+                for (uint32_t index = lowest; index <= highest; index++)
+                    this->pending_ += this->scan_segment_(index, 0, &last_seq);
+                this->next_seq_ = last_seq + 1;
+                this->read_segment_ = lowest;
+                // start a fresh segment so a torn tail from the last boot is never appended to
+                this->write_segment_ = highest + 1;
+            }
+            this->read_offset_ = 0;
+            this->write_segment_size_ = 0;
+            this->ready_ = true;
+
+            ESP_LOGI(TAG, "Journal ready: %lu record(s) pending replay, %lu segment(s) of %u bytes max",
+                     (unsigned long)this->pending_, (unsigned long)this->max_segments_,
+                     (unsigned)(PAGE_SIZE * SEGMENT_PAGES));
+            return true;
+        }
+
+        bool UplinkJournal::append(const char *topic, const char *payload, size_t len, bool retain)
+        {
+            if (!this->ready_)
+                return false;
+
+            size_t topic_len = strlen(topic);
+            if (topic_len > MAX_TOPIC || len > MAX_PAYLOAD)
+            {
+                this->dropped_++;
+                return false;
+            }
+
+            size_t record_len = sizeof(RecordHeader) + topic_len + len;
+            if (this->page_len_ + record_len > PAGE_SIZE)
+                this->write_page_();
+
+            RecordHeader header;
+            header.seq = this->next_seq_++;
+            header.topic_len = topic_len;
+            header.payload_len = len;
+            header.flags = retain ? FLAG_RETAIN : 0;
+            header.crc = crc8_((const uint8_t *)&header.seq, sizeof(header.seq), 0);
+            header.crc = crc8_((const uint8_t *)topic, topic_len, header.crc);
+            header.crc = crc8_((const uint8_t *)payload, len, header.crc);
+
+            if (this->page_len_ == 0)
+                this->page_since_ = millis();
+            uint8_t *record = this->page_.get() + this->page_len_;
+            memcpy(record, &header, sizeof(header));
+            memcpy(record + sizeof(header), topic, topic_len);
+            memcpy(record + sizeof(header) + topic_len, payload, len);
+            this->page_len_ += record_len;
+            this->pending_++;
+            return true;
+        }
+
+        void UplinkJournal::flush()
+        {
+            if (this->page_len_ != 0)
+                this->write_page_();
+        }
+
+        void UplinkJournal::loop(uint32_t now)
+        {
+            if (this->page_len_ != 0 && now - this->page_since_ >= FLUSH_INTERVAL_MS)
+                this->write_page_();
+        }
+
+        bool UplinkJournal::write_page_()
+        {
+            if (this->write_segment_size_ + this->page_len_ > PAGE_SIZE * SEGMENT_PAGES)
+            {
+                this->write_segment_++;
+                this->write_segment_size_ = 0;
+            }
+            // the ring is full: sacrifice the oldest unpublished segment
+            while (this->write_segment_ - this->read_segment_ >= this->max_segments_)
+                this->drop_oldest_segment_();
+
+            char path[32];
+            this->segment_path_(this->write_segment_, path, sizeof(path));
+            uint32_t start = micros();
+            File file = LittleFS.open(path, "a");
+            if (!file)
+            {
+                ESP_LOGE(TAG, "Could not open %s for append", path);
+                return false;
+            }
+            size_t written = file.write(this->page_.get(), this->page_len_);
+            file.close();
+            uint32_t elapsed = micros() - start;
+
+            this->pages_written_++;
+            this->bytes_written_ += written;
+            this->write_time_us_ += elapsed;
+            if (elapsed > this->max_write_time_us_)
+                this->max_write_time_us_ = elapsed;
+
+            this->write_segment_size_ += written;
+            bool ok = written == this->page_len_;
+            if (!ok)
+                ESP_LOGE(TAG, "Short journal write (%u of %u bytes)", (unsigned)written, (unsigned)this->page_len_);
+            this->page_len_ = 0;
+            return ok;
+        }
+
+        size_t UplinkJournal::replay(const PublishFn &publish, size_t max_records)
+        {
+            size_t published = 0;
+            if (this->pending_ == 0)
+                return 0;
+            char topic[MAX_TOPIC + 1];
+            char payload[MAX_PAYLOAD + 1];
+
+            while (published < max_records && this->pending_ != 0)
+            {
+                // records still staged in RAM are read back through the active segment
+                if (this->read_segment_ == this->write_segment_ && this->read_offset_ >= this->write_segment_size_)
+                {
+                    if (this->page_len_ == 0)
+                    {
+                        // nothing left on flash or in RAM
+                        this->pending_ = 0;
+                        break;
+                    }
+                    this->write_page_();
+                }
+
+                char path[32];
+                this->segment_path_(this->read_segment_, path, sizeof(path));
+                File file = LittleFS.open(path, "r");
+                bool advance = !file;
+                if (file)
+                {
+                    file.seek(this->read_offset_);
+                    while (published < max_records)
+                    {
+                        RecordHeader header;
+                        if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+                            file.read((uint8_t *)topic, header.topic_len) != header.topic_len ||
+                            file.read((uint8_t *)payload, header.payload_len) != header.payload_len)
+                        {
+                            advance = true;
+                            break;
+                        }
+                        uint8_t crc = crc8_((const uint8_t *)&header.seq, sizeof(header.seq), 0);
+                        crc = crc8_((const uint8_t *)topic, header.topic_len, crc);
+                        crc = crc8_((const uint8_t *)payload, header.payload_len, crc);
+                        if (crc != header.crc)
+                        {
+                            // torn write at the tail of a segment from a previous boot
+                            ESP_LOGW(TAG, "Corrupt journal record in %s at %lu, skipping rest of segment",
+                                     path, (unsigned long)this->read_offset_);
+                            advance = true;
+                            break;
+                        }
+                        topic[header.topic_len] = 0;
+                        payload[header.payload_len] = 0;
+
+                        if (!publish(topic, payload, header.payload_len, header.flags & FLAG_RETAIN))
+                        {
+                            file.close();
+                            return published;
+                        }
+                        this->read_offset_ += sizeof(header) + header.topic_len + header.payload_len;
+                        if (this->pending_ != 0)
+                            this->pending_--;
+                        published++;
+                    }
+                    file.close();
+                }
+
+                if (advance)
+                {
+                    if (this->read_segment_ == this->write_segment_)
+                    {
+                        // a corrupt or missing active segment can't hold anything else we can replay
+                        if (this->page_len_ == 0)
+                            this->pending_ = 0;
+                        else
+                            this->read_offset_ = this->write_segment_size_;
+                        continue;
+                    }
+                    this->retire_segment_(this->read_segment_);
+                    this->read_segment_++;
+                    this->read_offset_ = 0;
+                }
+            }
+
+            if (this->pending_ == 0)
+            {
+                // fully drained: drop the active segment too and start the next one empty
+                this->retire_segment_(this->read_segment_);
+                this->write_segment_++;
+                this->write_segment_size_ = 0;
+                this->read_segment_ = this->write_segment_;
+                this->read_offset_ = 0;
+            }
+            return published;
+        }
+
+        void UplinkJournal::retire_segment_(uint32_t index)
+        {
+            char path[32];
+            this->segment_path_(index, path, sizeof(path));
+            if (LittleFS.exists(path))
+                LittleFS.remove(path);
+        }
+
+        void UplinkJournal::drop_oldest_segment_()
+        {
+            // records before the replay cursor were already published
+            uint32_t last_seq = 0;
+            uint32_t lost = this->scan_segment_(this->read_segment_, this->read_offset_, &last_seq);
+            this->pending_ = this->pending_ > lost ? this->pending_ - lost : 0;
+            this->dropped_ += lost;
+            ESP_LOGW(TAG, "Journal full - dropped %lu unpublished record(s)", (unsigned long)lost);
+
+            this->retire_segment_(this->read_segment_);
+            this->read_segment_++;
+            this->read_offset_ = 0;
+        }
+
+        uint32_t UplinkJournal::scan_segment_(uint32_t index, uint32_t offset, uint32_t *last_seq)
+        {
+            char path[32];
+            this->segment_path_(index, path, sizeof(path));
+            File file = LittleFS.open(path, "r");
+            if (!file)
+                return 0;
+
+            uint32_t count = 0;
+            size_t size = file.size();
+            RecordHeader header;
+            while (offset + sizeof(header) <= size)
+            {
+                file.seek(offset);
+                if (file.read((uint8_t *)&header, sizeof(header)) != sizeof(header))
+                    break;
+                size_t record_len = sizeof(header) + header.topic_len + header.payload_len;
+                if (offset + record_len > size)
+                    break;
+                *last_seq = header.seq;
+                offset += record_len;
+                count++;
+            }
+            file.close();
+            return count;
+        }
+
+        void UplinkJournal::segment_path_(uint32_t index, char *buf, size_t len) const
+        {
+            snprintf(buf, len, "%s/%08lx", JOURNAL_DIR, (unsigned long)index);
+        }
+
+        uint8_t UplinkJournal::crc8_(const uint8_t *data, size_t len, uint8_t crc)
+        {
+            // CRC-8/ATM, only used to spot torn records after a power cut
+            while (len--)
+            {
+                crc ^= *data++;
+                for (uint8_t i = 0; i < 8; i++)
+                    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+            }
+            return crc;
+        }
+
+        void UplinkJournal::log_stats(const char *tag) const
+        {
+            // KiB/s = bytes / us * 1e6 / 1024
+            uint32_t kib_per_s = this->write_time_us_ == 0 ? 0 : (uint32_t)((uint64_t)this->bytes_written_ * 1000000ULL / 1024ULL / this->write_time_us_);
+            ESP_LOGI(tag, "Journal: pending=%lu, dropped=%lu, pages=%lu, written=%lu B, throughput=%lu KiB/s, worst page write=%lu us",
+                     (unsigned long)this->pending_, (unsigned long)this->dropped_, (unsigned long)this->pages_written_,
+                     (unsigned long)this->bytes_written_, (unsigned long)kib_per_s, (unsigned long)this->max_write_time_us_);
+        }
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace esphome
+{
+    namespace lora_mqtt_bridge
+    {
+        // Append-only journal of decoded state publishes, kept on LittleFS so that
+        // data buffered during a broker outage survives a bridge reboot.
+        //
+        // Records are staged in a RAM page and written out one flash page at a time,
+        // so each record costs at most one page program instead of a read-modify-write
+        // of the last block. Pages are appended to a ring of segment files; a segment
+        // is deleted as soon as every record in it has been published, which both
+        // truncates the journal and lets LittleFS rotate the erased blocks.
+        class UplinkJournal
+        {
+        public:
+            static const size_t PAGE_SIZE = 4096;
+            static const size_t SEGMENT_PAGES = 4;
+            static const size_t MAX_TOPIC = 127;
+            static const size_t MAX_PAYLOAD = 255;
+            static const uint32_t FLUSH_INTERVAL_MS = 15000;
+
+            using PublishFn = std::function<bool(const char *topic, const char *payload, size_t len, bool retain)>;
+
+            // Allocates the page, mounts the filesystem and scans for segments left over
+            // from the last boot.
+            bool begin(size_t max_bytes);
+            bool is_ready() const { return this->ready_; }
+
+            // Stages one publish. Returns false if the record could not be stored.
+            bool append(const char *topic, const char *payload, size_t len, bool retain);
+
+            // Publishes up to max_records in sequence order. Stops at the first failed
+            // publish so ordering is kept; returns the number published.
+            size_t replay(const PublishFn &publish, size_t max_records);
+
+            // Forces the staged page to flash (used before replay).
+            void flush();
+            // Flushes the staged page once it has been held for FLUSH_INTERVAL_MS, which
+            // bounds what a power cut can lose while keeping writes page-sized.
+            void loop(uint32_t now);
+
+            bool empty() const { return this->pending_ == 0; }
+            uint32_t pending() const { return this->pending_; }
+            uint32_t dropped() const { return this->dropped_; }
+            void log_stats(const char *tag) const;
+
+        protected:
+            struct RecordHeader
+            {
+                uint32_t seq;
+                uint8_t topic_len;
+                uint8_t payload_len;
+                uint8_t flags;
+                uint8_t crc;
+            };
+            static const uint8_t FLAG_RETAIN = 0x01;
+
+            void segment_path_(uint32_t index, char *buf, size_t len) const;
+            bool write_page_();
+            void retire_segment_(uint32_t index);
+            void drop_oldest_segment_();
+            uint32_t scan_segment_(uint32_t index, uint32_t offset, uint32_t *last_seq);
+            static uint8_t crc8_(const uint8_t *data, size_t len, uint8_t crc);
+
+            bool ready_{false};
+            uint32_t max_segments_{0};
+
+            // ring of segment files [read_segment_, write_segment_]; everything before
+            // the replay cursor has been published and deleted
+            uint32_t read_segment_{0};
+            uint32_t read_offset_{0};
+            uint32_t write_segment_{0};
+            uint32_t write_segment_size_{0};
+
+            // only allocated when the journal is enabled
+            std::unique_ptr<uint8_t[]> page_;
+            size_t page_len_{0};
+            uint32_t page_since_{0};
+
+            uint32_t next_seq_{1};
+            uint32_t pending_{0};
+            uint32_t dropped_{0};
+
+            // write throughput accounting
+            uint32_t pages_written_{0};
+            uint32_t bytes_written_{0};
+            uint32_t write_time_us_{0};
+            uint32_t max_write_time_us_{0};
+        };
+    } // namespace lora_mqtt_bridge
+} // namespace esphome
@@ -0,0 +1,1058 @@
+#include "LoRa.h"
+#include "esphome/core/log.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+
+static const char *const TAG = "LoRa";
+
+// SX1280 FLRC packets carry at most 127 bytes, SX127x GFSK packets the 64 of its FIFO
+static const size_t FLRC_MAX_PACKET = 127;
+static const size_t SX127X_GFSK_MAX_PACKET = 64;
+
+// Driver metrics
+esphome::metrics::Counter g_lora_irqs("lora_irq");
+esphome::metrics::Counter g_lora_packets("lora_rx");
+esphome::metrics::Counter g_lora_crc_errors("lora_crc_err");
+esphome::metrics::Counter g_lora_rx_errors("lora_rx_err");
+esphome::metrics::Histogram g_lora_irq_us("lora_irq_us", esphome::metrics::DURATION_US_BOUNDS);
+
+#if (ESP8266 || ESP32)
+    #define ISR_PREFIX ICACHE_RAM_ATTR
+#else
+    #define ISR_PREFIX
+#endif
+
+LoRaClass::LoRaClass() :
+  _spiSettings(LORA_DEFAULT_SPI_FREQUENCY, MSBFIRST, SPI_MODE0),
+  _spi(&LORA_DEFAULT_SPI),
+  _ss(LORA_DEFAULT_SS_PIN),
+  _reset(LORA_DEFAULT_RESET_PIN),
+  _dio0(LORA_DEFAULT_DIO0_PIN),
+  _dio1(LORA_DEFAULT_DIO1_PIN),
+  _frequency(0),
+  _packetIndex(0),
+  _implicitHeaderMode(0),
+  _implicitLength(0),
+  _onReceive(NULL),
+  _onCadDone(NULL),
+  _onTxDone(NULL),
+  _chipType(CHIP_SX1276),
+  _modulation(MODULATION_LORA),
+  _sx127x(NULL),
+  _sx1262(NULL),
+  _sx1280(NULL),
+  _rxBufferLen(0),
+  _txBufferLen(0),
+  _lastRssi(0),
+  _lastSnr(0),
+  _lastFreqError(0),
+  _currentSpreadingFactor(7),
+  _currentBandwidth(125000),
+  _bitRate(650000),
+  _flrcCodingRate(3),
+  _deviation(12500),
+  _initialized(false),
+  _mod(NULL),
+  _irqCycles(0),
+  _readoutCycles(0),
+  _spiBusy(false),
+  _dioPending(false),
+  _pendingIrqCycles(0)
+{
+  setTimeout(0);
+}
+
+void LoRaClass::setChipType(LoRaChipType type) {
+  _chipType = type;
+}
+
+int LoRaClass::setModulation(LoRaModulation modulation) {
+  if (_initialized) {
+    ESP_LOGE(TAG, "The modulation must be set before begin()");
+    return 0;
+  }
+  if (modulation == MODULATION_FLRC && _chipType != CHIP_SX1280) {
+    ESP_LOGE(TAG, "FLRC needs an SX1280");
+    return 0;
+  }
+  if (modulation == MODULATION_GFSK && _chipType == CHIP_SX1280) {
+    ESP_LOGE(TAG, "GFSK needs an SX126x or SX127x, the SX1280 has FLRC");
+    return 0;
+  }
+  _modulation = modulation;
+  // the defaults begin() starts the modulation with
+  if (modulation == MODULATION_FLRC) {
+    _bitRate = 650000;
+  } else if (modulation == MODULATION_GFSK) {
+    _bitRate = 50000;
+    _deviation = 12500;
+  }
+  return 1;
+}
+
+int LoRaClass::begin(uint32_t frequency) {
+  // Start SPI
+  _spi->begin();
+
+  // Create the appropriate radio module based on chip type
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _mod = new Module(_ss, _dio0, _reset, _dio1, *_spi, _spiSettings);
+    _sx1262 = new SX1262(_mod);
+
+    // Initialize SX1262
+    int state;
+    if (_modulation == MODULATION_GFSK) {
+      state = _sx1262->beginFSK(frequency / 1000000.0, _bitRate / 1000.0, _deviation / 1000.0, gfskRxBandwidth());
+    } else {
+      state = _sx1262->begin(frequency / 1000000.0);
+    }
+    if (state != RADIOLIB_ERR_NONE) {
+      delete _sx1262;
+      delete _mod;
+      _mod = NULL;
+      _sx1262 = NULL;
+      return 0;
+    }
+
+    // Configure TCXO for Wio-SX1262 module (1.8V, 5ms startup delay)
+    // This is required for the Seeedstudio Wio-SX1262 module which uses an external TCXO
+    state = _sx1262->setTCXO(1.8);
+    if (state != RADIOLIB_ERR_NONE) {
+      // TCXO setup failed, but continue anyway - some modules may not need it
+    }
+
+    // Enable DIO2 as RF switch control (for antenna switching)
+    state = _sx1262->setDio2AsRfSwitch(true);
+    if (state != RADIOLIB_ERR_NONE) {
+      // RF switch setup failed, but continue anyway
+    }
+
+    // Set default parameters
+    _sx1262->setOutputPower(17);
+    if (_modulation == MODULATION_GFSK) {
+      _sx1262->setDataShaping(RADIOLIB_SHAPING_0_5);
+    } else {
+      _sx1262->setSpreadingFactor(7);
+      _sx1262->setBandwidth(125.0);
+      _sx1262->setCodingRate(5);
+      _sx1262->setPreambleLength(8);
+    }
+
+  } else if (_chipType == CHIP_SX1280) {
+    // IRQ on DIO1 and a BUSY line, wired like the SX1262
+    _mod = new Module(_ss, _dio0, _reset, _dio1, *_spi, _spiSettings);
+    _sx1280 = new SX1280(_mod);
+
+    int state;
+    if (_modulation == MODULATION_FLRC) {
+      state = _sx1280->beginFLRC(frequency / 1000000.0, _bitRate / 1000, _flrcCodingRate);
+    } else {
+      state = _sx1280->begin(frequency / 1000000.0);
+    }
+    if (state != RADIOLIB_ERR_NONE) {
+      ESP_LOGE(TAG, "SX1280 init failed (%d), it needs a frequency of 2400..2500 MHz", state);
+      delete _sx1280;
+      delete _mod;
+      _mod = NULL;
+      _sx1280 = NULL;
+      return 0;
+    }
+
+    // Set default parameters; 13 dBm is the most the SX1280 puts out
+    _sx1280->setOutputPower(13);
+    if (_modulation == MODULATION_LORA) {
+      _sx1280->setSpreadingFactor(7);
+      _sx1280->setBandwidth(812.5);
+      _sx1280->setCodingRate(5);
+      _sx1280->setPreambleLength(8);
+      _currentBandwidth = 812500;
+    }
+
+  } else {
+    // SX127x series (SX1276, SX1277, SX1278, SX1279)
+    _mod = new Module(_ss, _dio0, _reset, _dio1, *_spi, _spiSettings);
+    _sx127x = new SX1276(_mod);
+
+    // Initialize SX127x
+    int state;
+    if (_modulation == MODULATION_GFSK) {
+      state = _sx127x->beginFSK(frequency / 1000000.0, _bitRate / 1000.0, _deviation / 1000.0, gfskRxBandwidth());
+    } else {
+      state = _sx127x->begin(frequency / 1000000.0);
+    }
+    if (state != RADIOLIB_ERR_NONE) {
+      delete _sx127x;
+      delete _mod;
+      _mod = NULL;
+      _sx127x = NULL;
+      return 0;
+    }
+
+    // Set default parameters
+    _sx127x->setOutputPower(17);
+    if (_modulation == MODULATION_GFSK) {
+      _sx127x->setDataShaping(RADIOLIB_SHAPING_0_5);
+    } else {
+      _sx127x->setSpreadingFactor(7);
+      _sx127x->setBandwidth(125.0);
+      _sx127x->setCodingRate(5);
+      _sx127x->setPreambleLength(8);
+    }
+  }
+
+  _frequency = frequency;
+  _initialized = true;
+  return 1;
+}
+
+void LoRaClass::end() {
+  if (_sx127x) {
+    delete _sx127x;
+    _sx127x = NULL;
+  }
+  if (_sx1262) {
+    delete _sx1262;
+    _sx1262 = NULL;
+  }
+  if (_sx1280) {
+    delete _sx1280;
+    _sx1280 = NULL;
+  }
+  if (_mod) {
+    delete _mod;
+    _mod = NULL;
+  }
+  _spi->end();
+  _initialized = false;
+}
+
+int LoRaClass::setImplicitHeader(size_t length) {
+  if (_modulation != MODULATION_LORA) {
+    if (length == 0) return 1;
+    ESP_LOGE(TAG, "Implicit header mode needs LoRa modulation");
+    return 0;
+  }
+  if (length == 0) {
+    // RadioLib puts the SX127x in implicit header mode for SF6, it can't do without
+    if (_currentSpreadingFactor == 6 && _chipType != CHIP_SX1262 && _chipType != CHIP_SX1268 && _chipType != CHIP_SX1280) {
+      ESP_LOGE(TAG, "SF6 needs implicit header mode");
+      return 0;
+    }
+    return explicitHeaderMode() ? 1 : 0;
+  }
+  if (length < 2 || length > TX_BUFFER_SIZE - 1) {
+    ESP_LOGE(TAG, "Implicit header length %u out of range (2..255)", (unsigned)length);
+    return 0;
+  }
+  return implicitHeaderMode(length) ? 1 : 0;
+}
+
+size_t LoRaClass::maxPacketLength() {
+  if (_modulation == MODULATION_FLRC) return FLRC_MAX_PACKET;
+  if (_modulation == MODULATION_GFSK && _chipType != CHIP_SX1262 && _chipType != CHIP_SX1268) return SX127X_GFSK_MAX_PACKET;
+  return _implicitHeaderMode ? _implicitLength - 1 : TX_BUFFER_SIZE - 1;
+}
+
+int LoRaClass::beginPacket(int implicitHeader) {
+  if (!_initialized) return 0;
+
+  // the header mode is a radio setting both ends share, not a per-packet choice
+  if ((implicitHeader != 0) != (_implicitHeaderMode != 0)) {
+    ESP_LOGW(TAG, "beginPacket(%s header) while the radio is in %s header mode", implicitHeader ? "implicit" : "explicit",
+             _implicitHeaderMode ? "implicit" : "explicit");
+    return 0;
+  }
+  _txBufferLen = 0;
+
+  return 1;
+}
+
+int LoRaClass::endPacket(bool async) {
+  if (!_initialized) return 0;
+
+  int state;
+  uint8_t *data = _txBuffer;
+  size_t len = _txBufferLen;
+
+  // fixed length on air: length byte, data, zero padding
+  uint8_t padded[TX_BUFFER_SIZE];
+  if (_implicitHeaderMode) {
+    padded[0] = _txBufferLen;
+    memcpy(padded + 1, _txBuffer, _txBufferLen);
+    memset(padded + 1 + _txBufferLen, 0, _implicitLength - 1 - _txBufferLen);
+    data = padded;
+    len = _implicitLength;
+  }
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    if (async) {
+      state = _sx1262->startTransmit(data, len);
+    } else {
+      state = _sx1262->transmit(data, len);
+    }
+  } else if (_chipType == CHIP_SX1280) {
+    if (async) {
+      state = _sx1280->startTransmit(data, len);
+    } else {
+      state = _sx1280->transmit(data, len);
+    }
+  } else {
+    if (async) {
+      state = _sx127x->startTransmit(data, len);
+    } else {
+      state = _sx127x->transmit(data, len);
+    }
+  }
+
+  _txBufferLen = 0;
+  return (state == RADIOLIB_ERR_NONE) ? 1 : 0;
+}
+
+bool LoRaClass::isTransmitting() {
+  if (!_initialized) return false;
+
+  // RadioLib doesn't have a direct isTransmitting check
+  // We'll return false as transmissions are handled by endPacket
+  return false;
+}
+
+int LoRaClass::parsePacket(int size) {
+  if (!_initialized) return 0;
+
+  _rxBufferLen = 0;
+  _packetIndex = 0;
+
+  int state;
+  size_t packetLen;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    // For RadioLib, getPacketLength() must be called BEFORE readData()
+    packetLen = _sx1262->getPacketLength();
+    if (packetLen == 0) {
+      return 0;
+    }
+    if (packetLen > RX_BUFFER_SIZE) {
+      g_lora_rx_errors.inc();
+      return 0;
+    }
+    state = _sx1262->readData(_rxBuffer, packetLen);
+    if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+      g_lora_crc_errors.inc();
+    } else if (state != RADIOLIB_ERR_NONE) {
+      g_lora_rx_errors.inc();
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+      _rxBufferLen = packetLen;
+      _lastRssi = _sx1262->getRSSI();
+      // SNR and frequency error are only measured on LoRa packets
+      bool lora = _modulation == MODULATION_LORA;
+      _lastSnr = lora ? _sx1262->getSNR() : 0;
+      _lastFreqError = lora ? _sx1262->getFrequencyError() : 0;
+    }
+  } else if (_chipType == CHIP_SX1280) {
+    // For RadioLib, getPacketLength() must be called BEFORE readData()
+    packetLen = _sx1280->getPacketLength();
+    if (packetLen == 0) {
+      return 0;
+    }
+    if (packetLen > RX_BUFFER_SIZE) {
+      g_lora_rx_errors.inc();
+      return 0;
+    }
+    state = _sx1280->readData(_rxBuffer, packetLen);
+    if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+      g_lora_crc_errors.inc();
+    } else if (state != RADIOLIB_ERR_NONE) {
+      g_lora_rx_errors.inc();
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+      _rxBufferLen = packetLen;
+      _lastRssi = _sx1280->getRSSI();
+      // SNR and frequency error are only measured on LoRa packets
+      bool lora = _modulation == MODULATION_LORA;
+      _lastSnr = lora ? _sx1280->getSNR() : 0;
+      _lastFreqError = lora ? _sx1280->getFrequencyError() : 0;
+    }
+  } else {
+    // For RadioLib, getPacketLength() must be called BEFORE readData()
+    packetLen = _sx127x->getPacketLength();
+    if (packetLen == 0) {
+      return 0;
+    }
+    if (packetLen > RX_BUFFER_SIZE) {
+      g_lora_rx_errors.inc();
+      return 0;
+    }
+    state = _sx127x->readData(_rxBuffer, packetLen);
+    if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+      g_lora_crc_errors.inc();
+    } else if (state != RADIOLIB_ERR_NONE) {
+      g_lora_rx_errors.inc();
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+      _rxBufferLen = packetLen;
+      bool lora = _modulation == MODULATION_LORA;
+      // in FSK mode RadioLib would otherwise leave receive mode to read it
+      _lastRssi = _sx127x->getRSSI(true, !lora);
+      _lastSnr = lora ? _sx127x->getSNR() : 0;
+      _lastFreqError = lora ? _sx127x->getFrequencyError() : 0;
+    }
+  }
+
+  // strip the length byte and padding of a fixed length packet
+  if (_implicitHeaderMode && _rxBufferLen > 0) {
+    int len = _rxBuffer[0];
+    if (len >= _rxBufferLen) {
+      g_lora_rx_errors.inc();
+      _rxBufferLen = 0;
+      return 0;
+    }
+    memmove(_rxBuffer, _rxBuffer + 1, len);
+    _rxBufferLen = len;
+  }
+
+  return _rxBufferLen;
+}
+
+int LoRaClass::packetRssi() {
+  return _lastRssi;
+}
+
+float LoRaClass::packetSnr() {
+  return _lastSnr;
+}
+
+long LoRaClass::packetFrequencyError() {
+  return _lastFreqError;
+}
+
+uint32_t LoRaClass::timeOnAir(size_t len) {
+  if (!_initialized) return 0;
+
+  if (_implicitHeaderMode) {
+    len = _implicitLength;
+  }
+
+  if (_modulation == MODULATION_GFSK) {
+    return gfskTimeOnAir(len);
+  }
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    return _sx1262->getTimeOnAir(len);
+  } else if (_chipType == CHIP_SX1280) {
+    return _modulation == MODULATION_FLRC ? flrcTimeOnAir(len) : _sx1280->getTimeOnAir(len);
+  } else {
+    return _sx127x->getTimeOnAir(len);
+  }
+}
+
+uint32_t LoRaClass::flrcTimeOnAir(size_t len) {
+  // RadioLib counts the payload bits only. From the SX1280 packet format: 16 bits of
+  // preamble and 32 of sync word, then header, payload, CRC and tail at the coding rate;
+  // the same as lora_sim's radio_model.h
+  static const float RATES[] = {0.5f, 0.75f, 1.0f};
+  float coded = (16 + 8 * len + 16 + 6) / RATES[_flrcCodingRate - 2];
+  return (uint32_t)((16 + 32 + ceilf(coded)) * 1000000.0f / _bitRate);
+}
+
+uint32_t LoRaClass::gfskTimeOnAir(size_t len) {
+  // RadioLib's SX126x figure is the payload alone: add 16 bits of preamble, the 32 bit
+  // sync word, the length byte and a 2 byte CRC
+  return (uint32_t)((16 + 32 + 8 * (1 + len + 2)) * 1000000.0f / _bitRate);
+}
+
+int LoRaClass::rssi() {
+  if (!_initialized) return 0;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    return _sx1262->getRSSI();
+  } else if (_chipType == CHIP_SX1280) {
+    return _sx1280->getRSSI();
+  } else {
+    return _sx127x->getRSSI();
+  }
+}
+
+int LoRaClass::isReceiving() {
+  if (!_initialized) return 0;
+
+  if (_chipType != CHIP_SX1262 && _chipType != CHIP_SX1268 && _chipType != CHIP_SX1280) return -1;
+
+  // The DIO interrupt reads packets out over the same bus, and one arriving mid
+  // transfer would interleave with the status command: it waits for the read instead
+  _spiBusy = true;
+  // chip mode field of the status byte: 2/3 standby, 4 FS, 5 RX, 6 TX
+  uint8_t mode;
+  if (_chipType == CHIP_SX1280) {
+    mode = (_sx1280->getStatus() >> 5) & 0x07;
+  } else {
+    mode = (_sx1262->getStatus() >> 4) & 0x07;
+  }
+  bool pending;
+  {
+    esphome::InterruptLock lock;
+    _spiBusy = false;
+    pending = _dioPending;
+    _dioPending = false;
+  }
+  if (pending) readPacket(_pendingIrqCycles);
+
+  if (mode == 5) return 1;
+  if (mode == 2 || mode == 3) return 0;
+  return -1;
+}
+
+int LoRaClass::readBuffer(uint8_t *buffer, size_t len) {
+  if (!_initialized) return 0;
+  if (len > 255) len = 255;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    return _sx1262->readBuffer(buffer, len) == RADIOLIB_ERR_NONE ? len : 0;
+  } else if (_chipType == CHIP_SX1280) {
+    return _sx1280->readBuffer(buffer, len) == RADIOLIB_ERR_NONE ? len : 0;
+  }
+  if (_modulation == MODULATION_GFSK) return 0;
+  // the burst moves the FIFO pointer the next packet's readout starts from
+  uint8_t pointer = _mod->SPIreadRegister(RADIOLIB_SX127X_REG_FIFO_ADDR_PTR);
+  _mod->SPIreadRegisterBurst(RADIOLIB_SX127X_REG_FIFO, len, buffer);
+  _mod->SPIwriteRegister(RADIOLIB_SX127X_REG_FIFO_ADDR_PTR, pointer);
+  return len;
+}
+
+size_t LoRaClass::write(uint8_t byte) {
+  return write(&byte, sizeof(byte));
+}
+
+size_t LoRaClass::write(const uint8_t *buffer, size_t size) {
+  size_t limit = maxPacketLength();
+  if (_txBufferLen + size > limit) {
+    size = limit - _txBufferLen;
+  }
+
+  memcpy(_txBuffer + _txBufferLen, buffer, size);
+  _txBufferLen += size;
+
+  return size;
+}
+
+int LoRaClass::available() {
+  return _rxBufferLen - _packetIndex;
+}
+
+int LoRaClass::read() {
+  if (!available()) {
+    return -1;
+  }
+
+  return _rxBuffer[_packetIndex++];
+}
+
+int LoRaClass::peek() {
+  if (!available()) {
+    return -1;
+  }
+
+  return _rxBuffer[_packetIndex];
+}
+
+void LoRaClass::flush() {
+  // Nothing to do for LoRa
+}
+
+void LoRaClass::onReceive(void(*callback)(int)) {
+  _onReceive = callback;
+  // no chip to arm or disarm while the radio is down
+  if (!_initialized) return;
+
+  if (callback) {
+    // Use setPacketReceivedAction - RadioLib's high-level API that handles all IRQ setup
+    if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+      _sx1262->setPacketReceivedAction(LoRaClass::onDio0Rise);
+    } else if (_chipType == CHIP_SX1280) {
+      _sx1280->setPacketReceivedAction(LoRaClass::onDio0Rise);
+    } else {
+      _sx127x->setPacketReceivedAction(LoRaClass::onDio0Rise);
+    }
+  } else {
+    if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+      _sx1262->clearPacketReceivedAction();
+    } else if (_chipType == CHIP_SX1280) {
+      _sx1280->clearPacketReceivedAction();
+    } else {
+      _sx127x->clearPacketReceivedAction();
+    }
+  }
+}
+
+void LoRaClass::onCadDone(void(*callback)(boolean)) {
+  _onCadDone = callback;
+  // CAD callbacks are handled through the same DIO interrupt as onReceive
+}
+
+void LoRaClass::onTxDone(void(*callback)()) {
+  _onTxDone = callback;
+  // TX done callbacks are handled through the same DIO interrupt as onReceive
+}
+
+void LoRaClass::receive(int size) {
+  if (!_initialized) return;
+
+  // as with beginPacket(), size only confirms the header mode (0 = explicit)
+  if (size != 0 && (size_t)size != implicitHeaderLength()) {
+    ESP_LOGW(TAG, "receive(%d) doesn't match the header mode, implicit length %u", size, (unsigned)implicitHeaderLength());
+  }
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    // For SX1262, we need to specify IRQ flags for interrupt-based receive
+    // RADIOLIB_SX126X_RX_TIMEOUT_INF = continuous receive
+    // IRQ mask: only trigger on RX_DONE
+    _sx1262->startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF, RADIOLIB_SX126X_IRQ_RX_DONE, RADIOLIB_SX126X_IRQ_RX_DONE);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->startReceive(RADIOLIB_SX128X_RX_TIMEOUT_INF, RADIOLIB_SX128X_IRQ_RX_DONE, RADIOLIB_SX128X_IRQ_RX_DONE);
+  } else {
+    _sx127x->startReceive(_implicitHeaderMode ? _implicitLength : 0);
+  }
+}
+
+void LoRaClass::channelActivityDetection(void) {
+  if (!_initialized) return;
+
+  // CAD detects LoRa preambles only
+  if (_modulation != MODULATION_LORA) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->startChannelScan();
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->startChannelScan();
+  } else {
+    _sx127x->startChannelScan();
+  }
+}
+
+void LoRaClass::idle() {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->standby();
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->standby();
+  } else {
+    _sx127x->standby();
+  }
+}
+
+void LoRaClass::sleep() {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->sleep();
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->sleep();
+  } else {
+    _sx127x->sleep();
+  }
+}
+
+void LoRaClass::setTxPower(int level, int outputPin) {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setOutputPower(level);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->setOutputPower(level < -18 ? -18 : level > 13 ? 13 : level);
+  } else {
+    _sx127x->setOutputPower(level);
+  }
+}
+
+void LoRaClass::setFrequency(uint32_t frequency) {
+  if (!_initialized) return;
+
+  _frequency = frequency;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setFrequency(frequency / 1000000.0);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->setFrequency(frequency / 1000000.0);
+  } else {
+    _sx127x->setFrequency(frequency / 1000000.0);
+  }
+}
+
+int LoRaClass::setSpreadingFactor(int sf) {
+  if (!_initialized || _modulation != MODULATION_LORA) return 0;
+
+  // the SX1280 goes down to SF5
+  int min = _chipType == CHIP_SX1280 ? 5 : 6;
+  if (sf < min) sf = min;
+  if (sf > 12) sf = 12;
+
+  int state;
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    state = _sx1262->setSpreadingFactor(sf);
+  } else if (_chipType == CHIP_SX1280) {
+    state = _sx1280->setSpreadingFactor(sf);
+  } else {
+    state = _sx127x->setSpreadingFactor(sf);
+  }
+  if (state != RADIOLIB_ERR_NONE) {
+    ESP_LOGE(TAG, "Spreading factor %d not supported (%d)", sf, state);
+    return 0;
+  }
+  _currentSpreadingFactor = sf;
+  return 1;
+}
+
+int LoRaClass::getSpreadingFactor() {
+  return _currentSpreadingFactor;
+}
+
+int LoRaClass::setSignalBandwidth(long sbw) {
+  if (!_initialized || _modulation != MODULATION_LORA) return 0;
+
+  float bw_khz = sbw / 1000.0;
+
+  int state;
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    state = _sx1262->setBandwidth(bw_khz);
+  } else if (_chipType == CHIP_SX1280) {
+    state = _sx1280->setBandwidth(bw_khz);
+  } else {
+    state = _sx127x->setBandwidth(bw_khz);
+  }
+  if (state != RADIOLIB_ERR_NONE) {
+    if (_chipType == CHIP_SX1280) {
+      ESP_LOGE(TAG, "Bandwidth %ld Hz not supported, the SX1280 takes 203125, 406250, 812500 or 1625000", sbw);
+    } else {
+      ESP_LOGE(TAG, "Bandwidth %ld Hz not supported (%d)", sbw, state);
+    }
+    return 0;
+  }
+  _currentBandwidth = sbw;
+  return 1;
+}
+
+long LoRaClass::getSignalBandwidth() {
+  return _currentBandwidth;
+}
+
+int LoRaClass::setBitRate(long bitRate) {
+  if (!_initialized || _modulation == MODULATION_LORA) return 0;
+
+  if (_modulation == MODULATION_GFSK) {
+    if (bitRate < 600 || bitRate > 300000) {
+      ESP_LOGE(TAG, "GFSK bit rate %ld not supported: 600 to 300000", bitRate);
+      return 0;
+    }
+    int state;
+    if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+      state = _sx1262->setBitRate(bitRate / 1000.0);
+    } else {
+      state = _sx127x->setBitRate(bitRate / 1000.0);
+    }
+    if (state != RADIOLIB_ERR_NONE) {
+      ESP_LOGE(TAG, "GFSK bit rate %ld not supported (%d)", bitRate, state);
+      return 0;
+    }
+    _bitRate = bitRate;
+    return setFrequencyDeviation(bitRate / 4);
+  }
+
+  if (_sx1280->setBitRate(bitRate / 1000.0) != RADIOLIB_ERR_NONE) {
+    ESP_LOGE(TAG, "FLRC bit rate %ld not supported: 260000, 325000, 520000, 650000, 1000000 or 1300000", bitRate);
+    return 0;
+  }
+  _bitRate = bitRate;
+  return 1;
+}
+
+int LoRaClass::setFrequencyDeviation(long deviation) {
+  if (!_initialized || _modulation != MODULATION_GFSK) return 0;
+
+  long previous = _deviation;
+  _deviation = deviation;
+  float rxBandwidth = gfskRxBandwidth();
+  int state;
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    state = _sx1262->setFrequencyDeviation(deviation / 1000.0);
+    if (state == RADIOLIB_ERR_NONE) state = _sx1262->setRxBandwidth(rxBandwidth);
+  } else {
+    state = _sx127x->setFrequencyDeviation(deviation / 1000.0);
+    if (state == RADIOLIB_ERR_NONE) state = _sx127x->setRxBandwidth(rxBandwidth);
+  }
+  if (rxBandwidth == 0 || state != RADIOLIB_ERR_NONE) {
+    ESP_LOGE(TAG, "GFSK deviation %ld Hz at %ld bps not supported (%d)", deviation, _bitRate, state);
+    _deviation = previous;
+    return 0;
+  }
+  return 1;
+}
+
+float LoRaClass::gfskRxBandwidth() {
+  // the narrowest receiver bandwidth that holds the signal (Carson's rule), in kHz; the
+  // SX126x filters are set by their full width, the SX127x ones by half of it
+  static const float SX126X[] = {4.8, 5.8, 7.3, 9.7, 11.7, 14.6, 19.5, 23.4, 29.3, 39.0, 46.9,
+                                 58.6, 78.2, 93.8, 117.3, 156.2, 187.2, 234.3, 312.0, 373.6, 467.0};
+  static const float SX127X[] = {2.6, 3.1, 3.9, 5.2, 6.3, 7.8, 10.4, 12.5, 15.6, 20.8, 25.0,
+                                 31.3, 41.7, 50.0, 62.5, 83.3, 100.0, 125.0, 166.7, 200.0, 250.0};
+  float occupied = (_bitRate + 2.0f * _deviation) / 1000.0f;
+  bool sx126x = _chipType == CHIP_SX1262 || _chipType == CHIP_SX1268;
+  const float *table = sx126x ? SX126X : SX127X;
+  float needed = sx126x ? occupied : occupied / 2;
+  for (size_t i = 0; i < sizeof(SX126X) / sizeof(SX126X[0]); i++) {
+    if (table[i] >= needed) return table[i];
+  }
+  return 0;
+}
+
+int LoRaClass::setFlrcCodingRate(int rate) {
+  if (!_initialized || _modulation != MODULATION_FLRC) return 0;
+
+  if (rate < 2 || rate > 4 || _sx1280->setCodingRate(rate) != RADIOLIB_ERR_NONE) {
+    ESP_LOGE(TAG, "FLRC coding rate %d not supported: 2 (1/2), 3 (3/4) or 4 (uncoded)", rate);
+    return 0;
+  }
+  _flrcCodingRate = rate;
+  return 1;
+}
+
+void LoRaClass::setCodingRate4(int denominator) {
+  if (!_initialized || _modulation != MODULATION_LORA) return;
+
+  if (denominator < 5) denominator = 5;
+  if (denominator > 8) denominator = 8;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setCodingRate(denominator);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->setCodingRate(denominator);
+  } else {
+    _sx127x->setCodingRate(denominator);
+  }
+}
+
+void LoRaClass::setPreambleLength(long length) {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setPreambleLength(length);
+  } else if (_chipType == CHIP_SX1280) {
+    // symbols with LoRa, bits with FLRC
+    _sx1280->setPreambleLength(length);
+  } else {
+    _sx127x->setPreambleLength(length);
+  }
+}
+
+void LoRaClass::setSyncWord(int sw) {
+  if (!_initialized) return;
+
+  // FLRC and GFSK packets start with a 4-byte sync word
+  uint8_t syncWord[4] = {(uint8_t)sw, (uint8_t)sw, (uint8_t)sw, (uint8_t)sw};
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    // LoRa on the SX1262 uses a 2-byte sync word; we'll use the same byte twice
+    _sx1262->setSyncWord(syncWord, _modulation == MODULATION_GFSK ? 4 : 2);
+  } else if (_chipType == CHIP_SX1280) {
+    if (_modulation == MODULATION_FLRC) {
+      _sx1280->setSyncWord(syncWord, 4);
+    } else {
+      _sx1280->setSyncWord((uint8_t)sw);
+    }
+  } else if (_modulation == MODULATION_GFSK) {
+    _sx127x->setSyncWord(syncWord, 4);
+  } else {
+    _sx127x->setSyncWord(sw);
+  }
+}
+
+void LoRaClass::enableCrc() {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setCRC(true);
+  } else if (_chipType == CHIP_SX1280) {
+    // the CRC length in bytes, any non-zero length turns it on with LoRa
+    _sx1280->setCRC(2);
+  } else {
+    _sx127x->setCRC(true);
+  }
+}
+
+void LoRaClass::disableCrc() {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setCRC(false);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->setCRC(0);
+  } else {
+    _sx127x->setCRC(false);
+  }
+}
+
+void LoRaClass::enableInvertIQ() {
+  if (!_initialized || _modulation != MODULATION_LORA) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->invertIQ(true);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->invertIQ(true);
+  } else {
+    _sx127x->invertIQ(true);
+  }
+}
+
+void LoRaClass::disableInvertIQ() {
+  if (!_initialized || _modulation != MODULATION_LORA) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->invertIQ(false);
+  } else if (_chipType == CHIP_SX1280) {
+    _sx1280->invertIQ(false);
+  } else {
+    _sx127x->invertIQ(false);
+  }
+}
+
+void LoRaClass::setOCP(uint8_t mA) {
+  if (!_initialized) return;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    _sx1262->setCurrentLimit(mA);
+  } else if (_chipType == CHIP_SX1280) {
+    // no over current protection setting on the SX1280
+  } else {
+    _sx127x->setCurrentLimit(mA);
+  }
+}
+
+void LoRaClass::setGain(uint8_t gain) {
+  // RadioLib handles gain automatically, this is a no-op for compatibility
+}
+
+byte LoRaClass::random() {
+  if (!_initialized) return 0;
+
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    return _sx1262->randomByte();
+  } else if (_chipType == CHIP_SX1280) {
+    // the SX1280 has no random number generator RadioLib can read
+    return esphome::random_uint32();
+  } else {
+    return _sx127x->randomByte();
+  }
+}
+
+void LoRaClass::setPins(int ss, int reset, int dio0, int dio1) {
+  _ss = ss;
+  _reset = reset;
+  _dio0 = dio0;
+  _dio1 = dio1;
+}
+
+void LoRaClass::setSPI(SPIClass& spi) {
+  _spi = &spi;
+}
+
+void LoRaClass::setSPIFrequency(uint32_t frequency) {
+  _spiSettings = SPISettings(frequency, MSBFIRST, SPI_MODE0);
+}
+
+void LoRaClass::dumpRegisters(Stream& out) {
+  // RadioLib doesn't provide direct register access in the same way
+  out.println("Register dump not available with RadioLib");
+}
+
+bool LoRaClass::explicitHeaderMode() {
+  if (!_initialized) return false;
+
+  int state;
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    state = _sx1262->explicitHeader();
+  } else if (_chipType == CHIP_SX1280) {
+    state = _sx1280->explicitHeader();
+  } else {
+    state = _sx127x->explicitHeader();
+  }
+  if (state != RADIOLIB_ERR_NONE) return false;
+  _implicitHeaderMode = 0;
+  _implicitLength = 0;
+  return true;
+}
+
+bool LoRaClass::implicitHeaderMode(size_t length) {
+  if (!_initialized) return false;
+
+  int state;
+  if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+    state = _sx1262->implicitHeader(length);
+  } else if (_chipType == CHIP_SX1280) {
+    state = _sx1280->implicitHeader(length);
+  } else {
+    state = _sx127x->implicitHeader(length);
+  }
+  if (state != RADIOLIB_ERR_NONE) return false;
+  _implicitHeaderMode = 1;
+  _implicitLength = length;
+  return true;
+}
+
+void LoRaClass::handleDio0Rise() {
+  uint32_t irqCycles = esphome::arch_get_cpu_cycle_count();
+  g_lora_irqs.inc();
+
+  if (!_initialized) return;
+  if (_spiBusy) {
+    // isReceiving() has the bus and reads the packet out when it's done
+    _pendingIrqCycles = irqCycles;
+    _dioPending = true;
+    return;
+  }
+  readPacket(irqCycles);
+}
+
+// from the DIO interrupt, or from isReceiving() for an interrupt it held off
+void LoRaClass::readPacket(uint32_t irqCycles) {
+  uint32_t start = micros();
+  int packetLength = parsePacket();
+
+  if (packetLength > 0) {
+    g_lora_packets.inc();
+    _irqCycles = irqCycles;
+    _readoutCycles = esphome::arch_get_cpu_cycle_count();
+    if (_onReceive) {
+      _onReceive(packetLength);
+    }
+  }
+
+  if (_onTxDone) {
+    _onTxDone();
+  }
+
+  // Restart receive mode for continuous reception
+  if (_onReceive) {
+    if (_chipType == CHIP_SX1262 || _chipType == CHIP_SX1268) {
+      // Clear IRQ flags and restart receive with proper IRQ configuration
+      _sx1262->startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF, RADIOLIB_SX126X_IRQ_RX_DONE, RADIOLIB_SX126X_IRQ_RX_DONE);
+    } else if (_chipType == CHIP_SX1280) {
+      _sx1280->startReceive(RADIOLIB_SX128X_RX_TIMEOUT_INF, RADIOLIB_SX128X_IRQ_RX_DONE, RADIOLIB_SX128X_IRQ_RX_DONE);
+    } else {
+      _sx127x->startReceive(_implicitHeaderMode ? _implicitLength : 0);
+    }
+  }
+  g_lora_irq_us.record(micros() - start);
+}
+
+void LoRaClass::handleDio1Rise() {
+  // DIO1 is used for RxTimeout and other events
+}
+
+ISR_PREFIX void LoRaClass::onDio0Rise() {
+  LoRa.handleDio0Rise();
+}
+
+ISR_PREFIX void LoRaClass::onDio1Rise() {
+  LoRa.handleDio1Rise();
+}
+
+LoRaClass LoRa;
@@ -0,0 +1,249 @@
+#ifndef LORA_WRAPPER_H
+#define LORA_WRAPPER_H
+
+#include <Arduino.h>
+#include <SPI.h>
+// isReceiving() reads the chip status, which is part of RadioLib's low level API
+#ifndef RADIOLIB_LOW_LEVEL
+#define RADIOLIB_LOW_LEVEL 1
+#endif
+#include <RadioLib.h>
+#include "esphome/components/metrics/metrics.h"
+
+// Default pin definitions (same as original)
+#define LORA_DEFAULT_SPI           SPI
+#define LORA_DEFAULT_SPI_FREQUENCY 8E6
+#define LORA_DEFAULT_SS_PIN        10
+#define LORA_DEFAULT_RESET_PIN     9
+#define LORA_DEFAULT_DIO0_PIN      2
+#define LORA_DEFAULT_DIO1_PIN      -1
+
+#define PA_OUTPUT_RFO_PIN          0
+#define PA_OUTPUT_PA_BOOST_PIN     1
+
+// Chip type selection
+enum LoRaChipType {
+  CHIP_SX1276,
+  CHIP_SX1277,
+  CHIP_SX1278,
+  CHIP_SX1279,
+  CHIP_SX1262,
+  CHIP_SX1268,
+  CHIP_SX1280
+};
+
+// Modulation. Both trade the range of LoRa for bit rate, with setBitRate() instead of
+// the spreading factor, bandwidth and coding rate:
+// - FLRC needs an SX1280, up to 1.3 Mbps, see setFlrcCodingRate();
+// - GFSK needs an SX126x or SX127x, up to 300 kbps, see setFrequencyDeviation().
+enum LoRaModulation {
+  MODULATION_LORA,
+  MODULATION_FLRC,
+  MODULATION_GFSK
+};
+
+class LoRaClass : public Stream {
+public:
+  LoRaClass();
+
+  // Set the chip type before calling begin()
+  void setChipType(LoRaChipType type);
+  // after setChipType(), before begin()
+  int setModulation(LoRaModulation modulation);
+  LoRaModulation modulation() { return _modulation; }
+
+  // Hz; 2.4 GHz doesn't fit a 32 bit long
+  int begin(uint32_t frequency);
+  void end();
+
+  // Implicit header mode drops the PHY header (length, coding rate, CRC flag) from
+  // every packet, so both ends must be configured alike. Packets then have a fixed
+  // length on air: the driver sends a length byte, the data and zero padding, and
+  // hands only the data to the receiver. length is the size on air, 2..255; 0 goes
+  // back to explicit header mode. Call after setSpreadingFactor(): SF6 needs it.
+  // LoRa modulation only.
+  int setImplicitHeader(size_t length);
+  size_t implicitHeaderLength() { return _implicitHeaderMode ? _implicitLength : 0; }
+  // the most a packet can carry in the current header mode, 127 bytes with FLRC and
+  // 64 with GFSK on an SX127x
+  size_t maxPacketLength();
+
+  // implicitHeader must match the mode set with setImplicitHeader(), 0 otherwise
+  int beginPacket(int implicitHeader = false);
+  int endPacket(bool async = false);
+
+  int parsePacket(int size = 0);
+  // CPU cycle counts at DIO interrupt entry and when the packet had been read out of
+  // the radio, for latency tracing
+  uint32_t packetIrqCycles() { return _irqCycles; }
+  uint32_t packetReadoutCycles() { return _readoutCycles; }
+  int packetRssi();
+  float packetSnr();
+  // carrier offset of the last packet in Hz, positive when the sender was above the
+  // frequency this radio is tuned to; LoRa modulation only, 0 otherwise
+  long packetFrequencyError();
+
+  // airtime of a packet with the current modem settings, in microseconds; the fixed
+  // length in implicit header mode
+  uint32_t timeOnAir(size_t len);
+
+  int rssi();
+
+  // 1 if the chip reports it is in receive mode, 0 if it sits in standby or isn't
+  // initialized, -1 otherwise (transmitting, or an SX127x, which has no status
+  // command). A DIO interrupt during the status read is held off until it is done.
+  int isReceiving();
+
+  // false after end() or a failed begin(), until a begin() succeeds
+  bool isInitialized() { return _initialized; }
+
+  // reads len bytes (up to 255) of the radio's packet buffer over SPI as a packet's
+  // readout does, without a packet, for timing the transfer. Returns the bytes read,
+  // 0 if not initialized or in GFSK mode on an SX127x, whose FIFO reads destructively
+  int readBuffer(uint8_t *buffer, size_t len);
+
+  // from Print
+  virtual size_t write(uint8_t byte);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+
+  // from Stream
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  virtual void flush();
+
+  void onReceive(void(*callback)(int));
+  void onCadDone(void(*callback)(boolean));
+  void onTxDone(void(*callback)());
+
+  void receive(int size = 0);
+  void channelActivityDetection(void);
+
+  void idle();
+  void sleep();
+
+  void setTxPower(int level, int outputPin = PA_OUTPUT_PA_BOOST_PIN);
+  // may leave receive mode: call receive() again to go on listening
+  void setFrequency(uint32_t frequency);
+  // these return 0 if the radio doesn't support the value
+  int setSpreadingFactor(int sf);
+  int setSignalBandwidth(long sbw);
+  // FLRC: 260000, 325000, 520000, 650000, 1000000 or 1300000 bps. GFSK: 600 to
+  // 300000 bps; this sets the deviation to a quarter of it, modulation index 0.5
+  int setBitRate(long bitRate);
+  long bitRate() { return _bitRate; }
+  // GFSK, Hz; the receiver bandwidth follows bit rate and deviation
+  int setFrequencyDeviation(long deviation);
+  // FLRC: 2 = 1/2, 3 = 3/4, 4 = uncoded
+  int setFlrcCodingRate(int rate);
+  void setCodingRate4(int denominator);
+  void setPreambleLength(long length);
+  void setSyncWord(int sw);
+  void enableCrc();
+  void disableCrc();
+  void enableInvertIQ();
+  void disableInvertIQ();
+
+  void setOCP(uint8_t mA);
+  void setGain(uint8_t gain);
+
+  // deprecated
+  void crc() { enableCrc(); }
+  void noCrc() { disableCrc(); }
+
+  byte random();
+
+  void setPins(int ss = LORA_DEFAULT_SS_PIN, int reset = LORA_DEFAULT_RESET_PIN,
+               int dio0 = LORA_DEFAULT_DIO0_PIN, int dio1 = LORA_DEFAULT_DIO1_PIN);
+  void setSPI(SPIClass& spi);
+  void setSPIFrequency(uint32_t frequency);
+
+  void dumpRegisters(Stream& out);
+
+private:
+  void handleDio0Rise();
+  void readPacket(uint32_t irqCycles);
+  void handleDio1Rise();
+  bool isTransmitting();
+
+  int getSpreadingFactor();
+  long getSignalBandwidth();
+  uint32_t flrcTimeOnAir(size_t len);
+  uint32_t gfskTimeOnAir(size_t len);
+  float gfskRxBandwidth();
+
+  static void onDio0Rise();
+  static void onDio1Rise();
+
+  bool explicitHeaderMode();
+  bool implicitHeaderMode(size_t length);
+
+private:
+  SPISettings _spiSettings;
+  SPIClass* _spi;
+  int _ss;
+  int _reset;
+  int _dio0;
+  int _dio1;
+  uint32_t _frequency;
+  int _packetIndex;
+  int _implicitHeaderMode;
+  size_t _implicitLength;
+  void (*_onReceive)(int);
+  void (*_onCadDone)(boolean);
+  void (*_onTxDone)();
+
+  LoRaChipType _chipType;
+  LoRaModulation _modulation;
+
+  // RadioLib module pointers (only one will be used based on chip type)
+  SX1276* _sx127x;
+  SX1262* _sx1262;
+  SX1280* _sx1280;
+
+  // Receive buffer for compatibility with Stream interface
+  static const int RX_BUFFER_SIZE = 256;
+  uint8_t _rxBuffer[RX_BUFFER_SIZE];
+  int _rxBufferLen;
+
+  // Transmission buffer
+  static const int TX_BUFFER_SIZE = 256;
+  uint8_t _txBuffer[TX_BUFFER_SIZE];
+  int _txBufferLen;
+
+  // Last packet info
+  int _lastRssi;
+  float _lastSnr;
+  long _lastFreqError;
+
+  // Current settings (RadioLib doesn't provide getters)
+  int _currentSpreadingFactor;
+  long _currentBandwidth;
+  long _bitRate;
+  int _flrcCodingRate;
+  long _deviation;
+
+  bool _initialized;
+  // RadioLib's radio classes don't own their Module
+  Module* _mod;
+
+  volatile uint32_t _irqCycles;
+  volatile uint32_t _readoutCycles;
+
+  // Set while loop() code has the SPI bus: a DIO interrupt then only notes its packet,
+  // which is read out as soon as the bus is free again
+  volatile bool _spiBusy;
+  volatile bool _dioPending;
+  volatile uint32_t _pendingIrqCycles;
+};
+
+extern LoRaClass LoRa;
+
+// Driver metrics, updated from the DIO interrupt
+extern esphome::metrics::Counter g_lora_irqs;
+extern esphome::metrics::Counter g_lora_packets;
+extern esphome::metrics::Counter g_lora_crc_errors;
+extern esphome::metrics::Counter g_lora_rx_errors;
+extern esphome::metrics::Histogram g_lora_irq_us;
+
+#endif
@@ -0,0 +1,131 @@
+#include "metrics.h"
+#include <cstdio>
+#include <cstring>
+
+namespace esphome
+{
+    namespace metrics
+    {
+        // zero initialised before any constructor runs, so metrics defined as globals in
+        // other translation units can register in any order
+        static Metric *registry[MetricsRegistry::MAX_METRICS];
+        static size_t registry_size;
+
+        Metric::Metric(const char *name, MetricType type) : name_(name), type_(type) { MetricsRegistry::add(this); }
+
+        static void append_key(std::string &out, const char *name)
+        {
+            out += '"';
+            out += name;
+            out += "\":";
+        }
+
+        static void append_number(std::string &out, long long value)
+        {
+            char buf[24];
+            snprintf(buf, sizeof(buf), "%lld", value);
+            out += buf;
+        }
+
+        void Counter::append_json(std::string &out) const
+        {
+            append_key(out, this->name_);
+            append_number(out, this->get());
+        }
+
+        void Gauge::append_json(std::string &out) const
+        {
+            append_key(out, this->name_);
+            append_number(out, this->get());
+        }
+
+        float Histogram::value() const
+        {
+            uint32_t count = this->count();
+            return count == 0 ? 0.0f : (float)this->sum_.load(std::memory_order_relaxed) / count;
+        }
+
+        void Histogram::append_json(std::string &out) const
+        {
+            append_key(out, this->name_);
+            out += "{\"n\":";
+            append_number(out, this->count());
+            out += ",\"sum\":";
+            append_number(out, this->sum_.load(std::memory_order_relaxed));
+            out += ",\"b\":[";
+            for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            {
+                if (i != 0)
+                    out += ',';
+                append_number(out, this->bucket(i));
+            }
+            out += "]}";
+        }
+
+        uint32_t LatencyHistogram::percentile(uint8_t pct) const
+        {
+            uint32_t count = this->count();
+            if (count == 0)
+                return 0;
+            uint32_t target = ((uint64_t)count * pct + 99) / 100;
+            uint32_t seen = 0;
+            for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++)
+            {
+                seen += this->buckets_[i].load(std::memory_order_relaxed);
+                if (seen >= target)
+                    return bucket_edge(i);
+            }
+            // the open ended top bucket
+            return this->max();
+        }
+
+        void LatencyHistogram::append_json(std::string &out) const
+        {
+            append_key(out, this->name_);
+            out += "{\"n\":";
+            append_number(out, this->count());
+            out += ",\"p50\":";
+            append_number(out, this->percentile(50));
+            out += ",\"p95\":";
+            append_number(out, this->percentile(95));
+            out += ",\"p99\":";
+            append_number(out, this->percentile(99));
+            out += ",\"max\":";
+            append_number(out, this->max());
+            out += '}';
+        }
+
+        void MetricsRegistry::add(Metric *metric)
+        {
+            // silently untracked beyond MAX_METRICS; the metric itself still works
+            if (registry_size < MAX_METRICS)
+                registry[registry_size++] = metric;
+        }
+
+        size_t MetricsRegistry::size() { return registry_size; }
+
+        Metric *MetricsRegistry::at(size_t index) { return index < registry_size ? registry[index] : nullptr; }
+
+        Metric *MetricsRegistry::find(const char *name)
+        {
+            for (size_t i = 0; i < registry_size; i++)
+            {
+                if (strcmp(registry[i]->name(), name) == 0)
+                    return registry[i];
+            }
+            return nullptr;
+        }
+
+        void MetricsRegistry::to_json(std::string &out)
+        {
+            out += '{';
+            for (size_t i = 0; i < registry_size; i++)
+            {
+                if (i != 0)
+                    out += ',';
+                registry[i]->append_json(out);
+            }
+            out += '}';
+        }
+    } // namespace metrics
+} // namespace esphome
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace esphome
+{
+    namespace metrics
+    {
+        // Counters, gauges and fixed-bucket histograms that register themselves by name.
+        // Updates are single relaxed atomics, so they can be made from an ISR or the WiFi
+        // task; reads from loop() see each value consistently but not a snapshot of all.
+        // Metrics are meant to be globals or members of objects that live forever.
+        enum MetricType : uint8_t
+        {
+            METRIC_COUNTER,
+            METRIC_GAUGE,
+            METRIC_HISTOGRAM,
+        };
+
+        class Metric
+        {
+        public:
+            const char *name() const { return this->name_; }
+            MetricType type() const { return this->type_; }
+            // counter total, gauge value, histogram mean or latency p95
+            virtual float value() const = 0;
+            // appends "name":value
+            virtual void append_json(std::string &out) const = 0;
+
+        protected:
+            Metric(const char *name, MetricType type);
+            Metric(const Metric &) = delete;
+            Metric &operator=(const Metric &) = delete;
+
+            const char *name_;
+            MetricType type_;
+        };
+
+        class Counter : public Metric
+        {
+        public:
+            explicit Counter(const char *name) : Metric(name, METRIC_COUNTER) {}
+
+            void inc(uint32_t n = 1) { this->count_.fetch_add(n, std::memory_order_relaxed); }
+            uint32_t get() const { return this->count_.load(std::memory_order_relaxed); }
+
+            float value() const override { return this->get(); }
+            void append_json(std::string &out) const override;
+
+        protected:
+            std::atomic<uint32_t> count_{0};
+        };
+
+        class Gauge : public Metric
+        {
+        public:
+            explicit Gauge(const char *name) : Metric(name, METRIC_GAUGE) {}
+
+            void set(int32_t value) { this->value_.store(value, std::memory_order_relaxed); }
+            int32_t get() const { return this->value_.load(std::memory_order_relaxed); }
+
+            float value() const override { return this->get(); }
+            void append_json(std::string &out) const override;
+
+        protected:
+            std::atomic<int32_t> value_{0};
+        };
+
+        // HISTOGRAM_BUCKETS buckets split at the given upper bounds (inclusive), the last
+        // one open ended. Exported as {"n":count,"sum":sum,"b":[bucket counts]}.
+        static const uint8_t HISTOGRAM_BUCKETS = 8;
+
+        class Histogram : public Metric
+        {
+        public:
+            Histogram(const char *name, const uint32_t (&bounds)[HISTOGRAM_BUCKETS - 1]) : Metric(name, METRIC_HISTOGRAM), bounds_(bounds) {}
+
+            void record(uint32_t sample)
+            {
+                uint8_t bucket = 0;
+                while (bucket < HISTOGRAM_BUCKETS - 1 && sample > this->bounds_[bucket])
+                    bucket++;
+                this->buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+                this->sum_.fetch_add(sample, std::memory_order_relaxed);
+                this->count_.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint32_t count() const { return this->count_.load(std::memory_order_relaxed); }
+            uint32_t bucket(uint8_t index) const { return this->buckets_[index].load(std::memory_order_relaxed); }
+            const uint32_t *bounds() const { return this->bounds_; }
+
+            float value() const override;
+            void append_json(std::string &out) const override;
+
+        protected:
+            const uint32_t *bounds_;
+            std::atomic<uint32_t> buckets_[HISTOGRAM_BUCKETS]{};
+            std::atomic<uint32_t> sum_{0};
+            std::atomic<uint32_t> count_{0};
+        };
+
+        // bucket bounds for durations in microseconds
+        static const uint32_t DURATION_US_BOUNDS[HISTOGRAM_BUCKETS - 1] = {50, 100, 250, 500, 1000, 2500, 10000};
+
+        // Half-octave buckets for latencies in microseconds, 1 us up to about a second,
+        // for percentiles rather than a fixed layout. A reported percentile is the upper
+        // edge of its bucket, so it overstates by at most half an octave.
+        // Exported as {"n":count,"p50":..,"p95":..,"p99":..,"max":..}.
+        static const uint8_t LATENCY_BUCKETS = 40;
+
+        class LatencyHistogram : public Metric
+        {
+        public:
+            explicit LatencyHistogram(const char *name) : Metric(name, METRIC_HISTOGRAM) {}
+
+            void record(uint32_t us)
+            {
+                this->buckets_[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+                this->count_.fetch_add(1, std::memory_order_relaxed);
+                uint32_t max = this->max_.load(std::memory_order_relaxed);
+                while (us > max && !this->max_.compare_exchange_weak(max, us, std::memory_order_relaxed))
+                {
+                }
+            }
+            uint32_t count() const { return this->count_.load(std::memory_order_relaxed); }
+            uint32_t max() const { return this->max_.load(std::memory_order_relaxed); }
+            // upper edge of the bucket holding the given percentile, 0 without samples
+            uint32_t percentile(uint8_t pct) const;
+
+            // p95, the figure worth watching on a sensor
+            float value() const override { return this->percentile(95); }
+            void append_json(std::string &out) const override;
+
+            static uint8_t bucket_of(uint32_t us)
+            {
+                if (us < 2)
+                    return 0;
+                uint8_t msb = 31 - __builtin_clz(us);
+                uint8_t bucket = 2 * msb + ((us >> (msb - 1)) & 1);
+                return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+            }
+            static uint32_t bucket_edge(uint8_t bucket)
+            {
+                if (bucket < 2)
+                    return 1;
+                uint8_t msb = bucket / 2;
+                return (1u << msb) + ((uint32_t)(bucket % 2 + 1) << (msb - 1)) - 1;
+            }
+
+        protected:
+            std::atomic<uint32_t> buckets_[LATENCY_BUCKETS]{};
+            std::atomic<uint32_t> count_{0};
+            std::atomic<uint32_t> max_{0};
+        };
+
+        class MetricsRegistry
+        {
+        public:
+            static const size_t MAX_METRICS = 48;
+
+            static size_t size();
+            static Metric *at(size_t index);
+            static Metric *find(const char *name);
+            // {"name":value,...} over every registered metric
+            static void to_json(std::string &out);
+
+        protected:
+            friend class Metric;
+            static void add(Metric *metric);
+        };
+    } // namespace metrics
+} // namespace esphome
@@ -23,7 +23,12 @@ namespace esphome
 {
     namespace now_mqtt
     {
+        using namespace frame_codec;
+
         static const char *const TAG = "now_mqtt.sensor";
+        static const uint8_t BROADCAST_ADDRESS[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+        Now_MQTTComponent *Now_MQTTComponent::instance_ = nullptr;
+
         void Now_MQTTComponent::setup()
         {
 #ifdef USE_ESP32
@@ -57,6 +62,9 @@ namespace esphome
                 ESP_LOGE(TAG, "Failed to add peer");
                 return;
             }
+            instance_ = this;
+            esp_now_register_recv_cb(Now_MQTTComponent::call_on_data_recv_callback);
+            esp_now_register_send_cb(Now_MQTTComponent::call_on_data_sent_callback);
 #endif
 #ifdef USE_ESP8266
             uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -68,7 +76,24 @@ namespace esphome
                 return;
             }
             esp_now_add_peer(broadcastAddress, ESP_NOW_ROLE_COMBO, 1, NULL, 0);
+            instance_ = this;
+            esp_now_register_recv_cb(Now_MQTTComponent::call_on_data_recv_callback);
+            esp_now_register_send_cb(Now_MQTTComponent::call_on_data_sent_callback);
 #endif
+#ifdef USE_ESP32
+            if (!this->encryption_key_.empty())
+            {
+                this->sealer_.set_key(this->key_id_, this->encryption_key_);
+                if (!this->sealer_.begin(fnv1_hash("now_mqtt.seal")))
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "Invalid encryption key, expected 32 hex characters");
+                    return;
+                }
+                ESP_LOGI(TAG, "Encryption enabled: key id %d, counter %lu", this->key_id_, (unsigned long)this->sealer_.counter());
+            }
+#endif
+            this->node_name_ = str_snake_case(App.get_name());
             for (auto *obj : App.get_sensors())
             {
                 obj->add_on_state_callback([this, obj](float state)
@@ -90,49 +115,339 @@ namespace esphome
                                            { this->on_text_sensor_update(obj, state); });
             }
 #endif
+            this->send_probe();
         }
 
-#ifdef USE_BINARY_SENSOR
-        void Now_MQTTComponent::on_binary_sensor_update(binary_sensor::BinarySensor *obj, float state)
+        void Now_MQTTComponent::loop()
         {
-            if (!obj->has_state())
+            uint32_t now = millis();
+
+            // a bridge answered a probe: register it so frames to it get MAC-layer ACKs
+            if (this->bridge_offered_.load(std::memory_order_acquire))
+            {
+                if (!this->bridge_known_ && this->add_peer(this->offered_bridge_))
+                {
+                    memcpy(this->bridge_, this->offered_bridge_, 6);
+                    this->bridge_known_ = true;
+                    this->consecutive_failures_.store(0, std::memory_order_relaxed);
+                    ESP_LOGI(TAG, "Bridge %02x:%02x:%02x:%02x:%02x:%02x found, sending unicast",
+                             this->bridge_[0], this->bridge_[1], this->bridge_[2], this->bridge_[3], this->bridge_[4], this->bridge_[5]);
+                }
+                this->bridge_offered_.store(false, std::memory_order_release);
+            }
+
+            // the bridge stopped acknowledging: fall back to broadcast and look again
+            if (this->bridge_known_ && this->consecutive_failures_.load(std::memory_order_relaxed) >= BRIDGE_LOST_FAILURES)
+            {
+                ESP_LOGW(TAG, "Bridge stopped acknowledging, falling back to broadcast");
+                esp_now_del_peer(this->bridge_);
+                this->bridge_known_ = false;
+                this->send_probe();
+            }
+
+            if (!this->bridge_known_ && now - this->last_probe_ >= PROBE_INTERVAL_MS)
+                this->send_probe();
+
+            this->pump_tx();
+
+            if (now - this->last_stats_ >= STATS_INTERVAL_MS)
+            {
+                this->last_stats_ = now;
+                uint32_t delivered = this->unicast_delivered_.load(std::memory_order_relaxed);
+                uint32_t failed = this->unicast_failed_.load(std::memory_order_relaxed);
+                uint32_t completed = delivered + failed;
+                ESP_LOGD(TAG, "Delivery: unicast sent=%lu delivered=%lu failed=%lu (%lu%%), broadcast sent=%lu, bridge %s",
+                         (unsigned long)this->unicast_sent_, (unsigned long)delivered, (unsigned long)failed,
+                         (unsigned long)(completed == 0 ? 100 : delivered * 100 / completed),
+                         (unsigned long)this->broadcast_sent_, this->bridge_known_ ? "known" : "unknown");
+                ESP_LOGD(TAG, "Send queue: depth=%u, high water=%u/%u, dropped full=%lu, dropped on error=%lu, backpressure=%lu, fragmented lines=%lu",
+                         (unsigned)this->tx_count_, (unsigned)this->tx_high_water_, (unsigned)TX_QUEUE_SIZE,
+                         (unsigned long)this->tx_queue_dropped_, (unsigned long)this->tx_send_dropped_,
+                         (unsigned long)this->tx_backpressure_, (unsigned long)this->fragmented_lines_);
+#ifdef USE_ESP32
+                if (this->sealer_.enabled())
+                    this->sealer_.stats().log(TAG, "Encryption");
+#endif
+            }
+        }
+
+        void Now_MQTTComponent::send_line(const std::string &line)
+        {
+            const uint8_t *data = reinterpret_cast<const uint8_t *>(line.data());
+            size_t len = line.size();
+#ifdef USE_ESP32
+            uint8_t sealed[NOW_MAX_MESSAGE];
+            if (this->sealer_.enabled())
+            {
+                if (len + SEALED_OVERHEAD > sizeof(sealed) || !this->sealer_.seal(data, len, sealed))
+                {
+                    ESP_LOGW(TAG, "Could not seal a %u byte line, dropped", (unsigned)len);
+                    this->tx_send_dropped_++;
+                    return;
+                }
+                data = sealed;
+                len += SEALED_OVERHEAD;
+            }
+#endif
+            if (len <= NOW_MAX_FRAME)
+            {
+                this->send_frame(data, len);
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-            std::string line;
-            const char *state_s = state ? "ON" : "OFF";
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            line += obj->get_device_class().c_str();
-            line += ":";
-            line += "binary_sensor";
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += ":";
-            line += state_s;
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
+            }
+            if (len > NOW_MAX_MESSAGE)
+            {
+                ESP_LOGW(TAG, "Line of %u bytes exceeds %u, dropped", (unsigned)len, (unsigned)NOW_MAX_MESSAGE);
+                this->tx_send_dropped_++;
+                return;
+            }
+
+            // every fragment but the last is full, the bridge places them by index
+            uint8_t count = (len + NOW_FRAGMENT_PAYLOAD - 1) / NOW_FRAGMENT_PAYLOAD;
+            uint8_t msg_id = this->fragment_msg_id_++;
+            uint8_t frame[NOW_MAX_FRAME];
+            for (uint8_t index = 0; index < count; index++)
+            {
+                size_t offset = index * NOW_FRAGMENT_PAYLOAD;
+                size_t chunk = len - offset < NOW_FRAGMENT_PAYLOAD ? len - offset : NOW_FRAGMENT_PAYLOAD;
+                frame[0] = NOW_FRAME_FRAGMENT;
+                frame[1] = msg_id;
+                frame[2] = index;
+                frame[3] = count;
+                memcpy(frame + NOW_FRAGMENT_HEADER, data + offset, chunk);
+                // room for all of them is made with the first, and they go out once all are queued
+                if (!this->queue_frame(frame, NOW_FRAGMENT_HEADER + chunk, false, index == 0 ? count : 0))
+                    return;
+            }
+            this->fragmented_lines_++;
+            this->pump_tx();
+        }
+
+        void Now_MQTTComponent::send_frame(const uint8_t *data, size_t len, bool broadcast)
+        {
+            if (this->queue_frame(data, len, broadcast, 1))
+                this->pump_tx();
+        }
+
+        bool Now_MQTTComponent::queue_frame(const uint8_t *data, size_t len, bool broadcast, uint8_t line_frames)
+        {
+            if (len > NOW_MAX_FRAME)
+            {
+                ESP_LOGW(TAG, "Frame of %u bytes is too long for ESP-NOW, dropped", (unsigned)len);
+                this->tx_send_dropped_++;
+                return false;
+            }
+            if (line_frames != 0 && !this->make_room(line_frames))
+            {
+                ESP_LOGW(TAG, "Line of %u frames can never fit the send queue, dropped", (unsigned)line_frames);
+                this->tx_send_dropped_++;
+                return false;
+            }
+            OutboundFrame &frame = this->tx_queue_[(this->tx_head_ + this->tx_count_) % TX_QUEUE_SIZE];
+            frame.broadcast = broadcast;
+            frame.attempts = 0;
+            frame.len = len;
+            frame.line_frames = line_frames;
+            memcpy(frame.data, data, len);
+            this->tx_count_++;
+            if (this->tx_count_ > this->tx_high_water_)
+                this->tx_high_water_ = this->tx_count_;
+            return true;
+        }
+
+        bool Now_MQTTComponent::make_room(uint8_t frames)
+        {
+            if (frames > TX_QUEUE_SIZE)
+                return false;
+            // full queue: the oldest reading is the most stale, so its line gives way
+            while (TX_QUEUE_SIZE - this->tx_count_ < frames)
+            {
+                uint8_t dropped = this->drop_line();
+                this->tx_queue_dropped_++;
+                ESP_LOGW(TAG, "Send queue full, dropped oldest line of %u frame(s) (%lu lines total)", (unsigned)dropped,
+                         (unsigned long)this->tx_queue_dropped_);
+            }
+            return true;
+        }
+
+        // Drops the frame at the head and the rest of its line. Returns the frames dropped.
+        uint8_t Now_MQTTComponent::drop_line()
+        {
+            uint8_t dropped = 0;
+            do
+            {
+                this->tx_head_ = (this->tx_head_ + 1) % TX_QUEUE_SIZE;
+                this->tx_count_--;
+                dropped++;
+            } while (this->tx_count_ != 0 && this->tx_queue_[this->tx_head_].line_frames == 0);
+            return dropped;
+        }
+
+        void Now_MQTTComponent::pump_tx()
+        {
+            uint32_t now = millis();
+            // a completion that never arrives must not stall the queue for good
+            if (this->in_flight_.load(std::memory_order_acquire) != 0 && now - this->last_submit_ >= COMPLETION_TIMEOUT_MS)
+            {
+                ESP_LOGW(TAG, "No send completion for %lu ms, resetting in-flight count", (unsigned long)(now - this->last_submit_));
+                this->in_flight_.store(0, std::memory_order_release);
+            }
+
+            while (this->tx_count_ != 0 && this->in_flight_.load(std::memory_order_acquire) < MAX_IN_FLIGHT)
+            {
+                OutboundFrame &frame = this->tx_queue_[this->tx_head_];
+                bool unicast = this->bridge_known_ && !frame.broadcast;
+                const uint8_t *address = unicast ? this->bridge_ : BROADCAST_ADDRESS;
+
+                // count before submitting, the completion may run before esp_now_send returns
+                this->in_flight_.fetch_add(1, std::memory_order_acq_rel);
+#ifdef USE_ESP32
+                esp_err_t err = esp_now_send(address, frame.data, frame.len);
+                bool sent = err == ESP_OK;
+                bool busy = err == ESP_ERR_ESPNOW_NO_MEM;
+#endif
+#ifdef USE_ESP8266
+                int err = esp_now_send((uint8_t *)address, frame.data, frame.len);
+                bool sent = err == 0;
+                bool busy = !sent;
+#endif
+                if (sent)
+                {
+                    this->last_submit_ = now;
+                    if (unicast)
+                        this->unicast_sent_++;
+                    else
+                        this->broadcast_sent_++;
+                    this->tx_head_ = (this->tx_head_ + 1) % TX_QUEUE_SIZE;
+                    this->tx_count_--;
+                    continue;
+                }
+                this->in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+
+                // the driver buffer is full: keep the frame and try again on a later completion,
+                // unless nothing is in flight that could ever free it
+                if (busy && this->in_flight_.load(std::memory_order_acquire) != 0)
+                {
+                    this->tx_backpressure_++;
+                    break;
+                }
+                if (++frame.attempts < MAX_SUBMIT_ATTEMPTS)
+                {
+                    this->tx_backpressure_++;
+                    break;
+                }
+                // the line's other fragments are no use without this one
+                uint8_t dropped = this->drop_line();
+                ESP_LOGW(TAG, "esp_now_send failed (%d), dropped its line of %u frame(s)", (int)err, (unsigned)dropped);
+                this->tx_send_dropped_++;
+            }
+        }
+
+        void Now_MQTTComponent::send_probe()
+        {
+            uint8_t frame[NOW_PROBE_FRAME_SIZE] = {NOW_FRAME_PROBE};
+            this->last_probe_ = millis();
+            ESP_LOGD(TAG, "Probing for a bridge");
+            this->send_frame(frame, sizeof(frame), true);
+        }
+
+        bool Now_MQTTComponent::add_peer(const uint8_t *mac)
+        {
+#ifdef USE_ESP32
+            if (esp_now_is_peer_exist(mac))
+                return true;
+            esp_now_peer_info_t peerInfo = {};
+            memcpy(peerInfo.peer_addr, mac, 6);
+            peerInfo.channel = this->wifi_channel_;
+            peerInfo.encrypt = false;
+            if (esp_now_add_peer(&peerInfo) != ESP_OK)
+            {
+                ESP_LOGW(TAG, "Failed to add bridge peer");
+                return false;
+            }
+#endif
+#ifdef USE_ESP8266
+            if (esp_now_add_peer((uint8_t *)mac, ESP_NOW_ROLE_COMBO, this->wifi_channel_, NULL, 0) != 0)
+            {
+                ESP_LOGW(TAG, "Failed to add bridge peer");
+                return false;
+            }
+#endif
+            return true;
+        }
+
+        void Now_MQTTComponent::on_data_recv(const uint8_t *mac, const uint8_t *data, int len)
+        {
+            // WiFi task: just remember the offer, loop() registers the peer
+            if (len < (int)NOW_PROBE_FRAME_SIZE || data[0] != NOW_FRAME_PROBE_REPLY)
+                return;
+            if (this->bridge_known_ || this->bridge_offered_.load(std::memory_order_acquire))
+                return;
+            memcpy(this->offered_bridge_, mac, 6);
+            this->bridge_offered_.store(true, std::memory_order_release);
+        }
+
+        void Now_MQTTComponent::on_data_sent(const uint8_t *mac, bool success)
+        {
+            // frees a driver slot, loop() hands over the next queued frame
+            uint8_t in_flight = this->in_flight_.load(std::memory_order_acquire);
+            while (in_flight != 0 && !this->in_flight_.compare_exchange_weak(in_flight, in_flight - 1, std::memory_order_acq_rel))
+            {
+            }
+
+            // broadcast is never acknowledged, so only unicast says anything about delivery
+            if (memcmp(mac, BROADCAST_ADDRESS, 6) == 0)
+                return;
+            if (success)
+            {
+                this->unicast_delivered_.fetch_add(1, std::memory_order_relaxed);
+                this->consecutive_failures_.store(0, std::memory_order_relaxed);
             }
             else
             {
-                line += ":";
+                this->unicast_failed_.fetch_add(1, std::memory_order_relaxed);
+                uint8_t failures = this->consecutive_failures_.load(std::memory_order_relaxed);
+                if (failures < 255)
+                    this->consecutive_failures_.store(failures + 1, std::memory_order_relaxed);
             }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += "::";
+        }
+
+#ifdef USE_ESP32
+        void Now_MQTTComponent::call_on_data_recv_callback(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+        {
+            if (instance_ != nullptr)
+                instance_->on_data_recv(info->src_addr, data, len);
+        }
+
+        void Now_MQTTComponent::call_on_data_sent_callback(const uint8_t *mac, esp_now_send_status_t status)
+        {
+            if (instance_ != nullptr && mac != nullptr)
+                instance_->on_data_sent(mac, status == ESP_NOW_SEND_SUCCESS);
+        }
+#endif
+#ifdef USE_ESP8266
+        void Now_MQTTComponent::call_on_data_recv_callback(uint8_t *mac, uint8_t *data, uint8_t len)
+        {
+            if (instance_ != nullptr)
+                instance_->on_data_recv(mac, data, len);
+        }
+
+        void Now_MQTTComponent::call_on_data_sent_callback(uint8_t *mac, uint8_t status)
+        {
+            if (instance_ != nullptr && mac != nullptr)
+                instance_->on_data_sent(mac, status == 0);
+        }
+#endif
+
+#ifdef USE_BINARY_SENSOR
+        void Now_MQTTComponent::on_binary_sensor_update(binary_sensor::BinarySensor *obj, float state)
+        {
+            if (!obj->has_state())
+                return;
+            std::string line;
+            NowCodec::encode_binary_sensor(this->node_name_, obj, state, nullptr, line);
 
             ESP_LOGI(TAG, "ESP-Now-MQTT Publish:  %s", line.c_str());
-            #ifdef USE_ESP32
-            ESP_ERROR_CHECK(esp_now_send(serverAddress, reinterpret_cast<const uint8_t *>(&line[0]), line.size()));
-            #endif
-            #ifdef USE_ESP8266
-            esp_now_send(serverAddress, (uint8_t *)&line[0], line.size());
-            #endif
+            this->send_line(line);
             this->callback_.call(state);
         }
 #endif
@@ -142,41 +457,11 @@ namespace esphome
         {
             if (!obj->has_state())
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
             std::string line;
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            // line += obj->get_device_class().c_str();
-            line += ":";
-            // line += "sensor";
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += ":";
-            line += state;
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
-            }
-            else
-            {
-                line += ":";
-            }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += "::";
+            NowCodec::encode_text_sensor(this->node_name_, obj, state, line);
 
             ESP_LOGI(TAG, "ESP-Now-MQTT Publish:  %s", line.c_str());
-            #ifdef USE_ESP32
-            ESP_ERROR_CHECK(esp_now_send(serverAddress, reinterpret_cast<const uint8_t *>(&line[0]), line.size()));
-            #endif
-            #ifdef USE_ESP8266
-            esp_now_send(serverAddress, (uint8_t *)&line[0], line.size());
-            #endif
+            this->send_line(line);
             this->callback_text_.call(state);
         }
 #endif
@@ -185,43 +470,11 @@ namespace esphome
         {
             if (!obj->has_state())
                 return;
-            uint8_t serverAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
             std::string line;
-            int8_t accuracy = obj->get_accuracy_decimals();
-
-            line = str_snake_case(App.get_name());
-            line += ":";
-            line += obj->get_device_class().c_str();
-            line += ":";
-            line += state_class_to_string(obj->get_state_class()).c_str();
-            line += ":";
-            line += str_snake_case(obj->get_name().c_str());
-            line += ":";
-            line += obj->get_unit_of_measurement().c_str();
-            line += ":";
-            line += value_accuracy_to_string(state, accuracy);
-            line += ":";
-            if (obj->get_icon().length() != 0)
-            {
-                line += obj->get_icon();
-            }
-            else
-            {
-                line += ":";
-            }
-            line += ":";
-            line += ESPHOME_VERSION;
-            line += ":";
-            line += ESPHOME_BOARD;
-            line += ":sensor:";
+            NowCodec::encode_sensor(this->node_name_, obj, state, nullptr, line);
 
             ESP_LOGI(TAG, "ESP-Now-MQTT Publish:  %s", line.c_str());
-            #ifdef USE_ESP32
-            ESP_ERROR_CHECK(esp_now_send(serverAddress, reinterpret_cast<const uint8_t *>(&line[0]), line.size()));
-            #endif
-            #ifdef USE_ESP8266
-            esp_now_send(serverAddress, (uint8_t *)&line[0], line.size());
-            #endif
+            this->send_line(line);
             this->callback_.call(state);
         }
     } // namespace now_mqtt
@@ -3,6 +3,13 @@
 #include "esphome/core/component.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/core/automation.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include <atomic>
+
+#ifdef USE_ESP32
+#include <esp_now.h>
+#include "esphome/components/frame_codec/frame_crypto.h"
+#endif
 
 #ifdef USE_BINARY_SENSOR
 #include "esphome/components/binary_sensor/binary_sensor.h"
@@ -20,7 +27,12 @@ namespace esphome
         {
         public:
             void setup() override;
+            void loop() override;
             void set_wifi_channel(uint8_t channel) { this->wifi_channel_ = channel; }
+#ifdef USE_ESP32
+            void set_encryption_key(const std::string &key) { this->encryption_key_ = key; }
+            void set_key_id(int key_id) { this->key_id_ = key_id; }
+#endif
             void add_on_state_callback(std::function<void(float)> &&callback) { this->callback_.add(std::move(callback)); }
 
         protected:
@@ -29,6 +41,81 @@ namespace esphome
         private:
             CallbackManager<void(float)> callback_;
             CallbackManager<void(std::string)> callback_text_;
+
+            // bridge discovery: readings go unicast to a bridge that answered a probe so the
+            // MAC layer acknowledges and retries them, broadcast until one is known
+            static const uint32_t PROBE_INTERVAL_MS = 30000;
+            static const uint8_t BRIDGE_LOST_FAILURES = 5;
+            static const uint32_t STATS_INTERVAL_MS = 60000;
+            static Now_MQTTComponent *instance_;
+
+            // outbound frames wait here and are handed to the driver as send completions
+            // free up room, so a burst of updates queues instead of failing the send
+            static const uint8_t TX_QUEUE_SIZE = 8;
+            static const uint8_t MAX_IN_FLIGHT = 4;
+            static const uint8_t MAX_SUBMIT_ATTEMPTS = 3;
+            static const uint32_t COMPLETION_TIMEOUT_MS = 1000;
+            // A fragmented line is queued and dropped whole: the bridge can't use part of one.
+            struct OutboundFrame
+            {
+                bool broadcast;
+                uint8_t attempts;
+                uint8_t len;
+                uint8_t line_frames; // frames of the line that starts here, 0 for later fragments
+                uint8_t data[frame_codec::NOW_MAX_FRAME];
+            };
+            static_assert(frame_codec::NOW_MAX_FRAGMENTS <= TX_QUEUE_SIZE, "the longest line must fit the send queue");
+            OutboundFrame tx_queue_[TX_QUEUE_SIZE];
+            uint8_t tx_head_{0};
+            uint8_t tx_count_{0};
+            uint8_t tx_high_water_{0};
+            std::atomic<uint8_t> in_flight_{0};
+            uint32_t last_submit_{0};
+            uint32_t tx_queue_dropped_{0}; // lines
+            uint32_t tx_send_dropped_{0};
+            uint32_t tx_backpressure_{0};
+
+            void send_line(const std::string &line);
+            void send_frame(const uint8_t *data, size_t len, bool broadcast = false);
+            bool queue_frame(const uint8_t *data, size_t len, bool broadcast, uint8_t line_frames);
+            bool make_room(uint8_t frames);
+            uint8_t drop_line();
+            std::string node_name_;
+            uint8_t fragment_msg_id_{0};
+            uint32_t fragmented_lines_{0};
+#ifdef USE_ESP32
+            // readings are sealed as a whole before fragmentation, probes stay in the clear
+            std::string encryption_key_;
+            int key_id_{0};
+            frame_codec::FrameSealer sealer_;
+#endif
+            void pump_tx();
+            void send_probe();
+            bool add_peer(const uint8_t *mac);
+            void on_data_recv(const uint8_t *mac, const uint8_t *data, int len);
+            void on_data_sent(const uint8_t *mac, bool success);
+#ifdef USE_ESP32
+            static void call_on_data_recv_callback(const esp_now_recv_info_t *info, const uint8_t *data, int len);
+            static void call_on_data_sent_callback(const uint8_t *mac, esp_now_send_status_t status);
+#endif
+#ifdef USE_ESP8266
+            static void call_on_data_recv_callback(uint8_t *mac, uint8_t *data, uint8_t len);
+            static void call_on_data_sent_callback(uint8_t *mac, uint8_t status);
+#endif
+
+            uint8_t bridge_[6]{};
+            bool bridge_known_{false};
+            uint8_t offered_bridge_[6]{};
+            std::atomic<bool> bridge_offered_{false};
+            uint32_t last_probe_{0};
+
+            // written from the WiFi task in the send callback
+            std::atomic<uint32_t> unicast_delivered_{0};
+            std::atomic<uint32_t> unicast_failed_{0};
+            std::atomic<uint8_t> consecutive_failures_{0};
+            uint32_t unicast_sent_{0};
+            uint32_t broadcast_sent_{0};
+            uint32_t last_stats_{0};
             void on_sensor_update(sensor::Sensor *obj, float state);
             #ifdef USE_BINARY_SENSOR
             void on_binary_sensor_update(binary_sensor::BinarySensor *obj, float state);
@@ -9,186 +9,297 @@ namespace esphome
 {
     namespace now_mqtt_bridge
     {
+        using namespace frame_codec;
+
         static const char *const TAG = "now_mqtt_bridge.sensor";
-        int32_t Now_MQTT_BridgeComponent::last_rssi = 0;
+        Now_MQTT_BridgeComponent *Now_MQTT_BridgeComponent::instance_ = nullptr;
 
-        void Now_MQTT_BridgeComponent::receivecallback(const uint8_t *mac, const uint8_t *data, int len)
+        void Now_MQTT_BridgeComponent::loop()
         {
-            char received_string[251];
-            char config_topic[] = "%s/sensor/%s/%s/config";
-            char sensor_topic[] = "%s/sensor/%s/state";
-            char binary_config_topic[] = "%s/binary_sensor/%s/%s/config";
-            char binary_sensor_topic[] = "%s/binary_sensor/%s/state";
+            // decode and publish outside the WiFi task, a few frames per loop so a burst
+            // doesn't hold up the rest of the application
+            uint8_t depth = (uint8_t)(this->rx_head_.load(std::memory_order_acquire) - this->rx_tail_.load(std::memory_order_relaxed) + RX_QUEUE_SIZE) % RX_QUEUE_SIZE;
+            if (depth > this->rx_high_water_)
+                this->rx_high_water_ = depth;
 
-            char topic[250];
-            char macStr[18];
-            DynamicJsonDocument doc(1024);
-            JsonObject dev;
-            std::string json;
-            std::string message_type;
+            for (uint8_t i = 0; i < RX_FRAMES_PER_LOOP; i++)
+            {
+                uint8_t tail = this->rx_tail_.load(std::memory_order_relaxed);
+                if (tail == this->rx_head_.load(std::memory_order_acquire))
+                    break;
+                const ReceivedFrame &frame = this->rx_queue_[tail];
+                this->receivecallback(frame);
+                this->rx_tail_.store((tail + 1) % RX_QUEUE_SIZE, std::memory_order_release);
+                this->rx_frames_++;
+            }
 
-            // sender mac address
-            const uint8_t *bssid = mac;
-            snprintf(macStr, sizeof(macStr), "%02x%02x%02x%02x%02x%02x", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+            uint32_t dropped = this->rx_dropped_.load(std::memory_order_relaxed);
+            if (dropped != this->rx_dropped_reported_)
+            {
+                ESP_LOGW(TAG, "Receive queue full - dropped %lu frame(s), %lu total",
+                         (unsigned long)(dropped - this->rx_dropped_reported_), (unsigned long)dropped);
+                this->rx_dropped_reported_ = dropped;
+            }
 
-            // received data
-            memset(&received_string, 0, sizeof(received_string));
-            memcpy(&received_string, data, len);
+            uint32_t now = millis();
+            this->expire_reassembly(now);
+            if (now - this->last_stats_ >= STATS_INTERVAL_MS)
+            {
+                this->last_stats_ = now;
+                uint32_t attempts = this->reassembled_ + this->reassembly_failed_;
+                if (attempts != 0)
+                    ESP_LOGD(TAG, "Reassembly: completed=%lu, failed=%lu (%lu%% ok), slots high water=%u/%u, bytes high water=%lu of %u",
+                             (unsigned long)this->reassembled_, (unsigned long)this->reassembly_failed_,
+                             (unsigned long)(this->reassembled_ * 100 / attempts),
+                             (unsigned)this->reassembly_slots_high_water_, (unsigned)REASSEMBLY_SLOTS,
+                             (unsigned long)this->reassembly_bytes_high_water_, (unsigned)sizeof(this->reassembly_));
+                ESP_LOGD(TAG, "Receive queue: frames=%lu, dropped=%lu, high water=%u/%u, probes answered=%lu",
+                         (unsigned long)this->rx_frames_, (unsigned long)dropped,
+                         (unsigned)this->rx_high_water_, (unsigned)(RX_QUEUE_SIZE - 1),
+                         (unsigned long)this->probes_answered_);
+                if (!this->keys_.empty())
+                    this->opener_.stats().log(TAG, "Decryption");
+                this->entities_.log_stats(TAG);
+            }
+            this->opener_.loop(now);
+        }
 
-            // tokenize the received string
-            char *tokens[13];
-            int argc;
-            split(tokens, &argc, received_string, ':', 1);
+        void Now_MQTT_BridgeComponent::answer_probe(const uint8_t *mac)
+        {
+            // the node learns our address from the sender of the reply
+            static const uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+            uint8_t reply[NOW_PROBE_FRAME_SIZE] = {NOW_FRAME_PROBE_REPLY};
+            esp_err_t err = esp_now_send(broadcastAddress, reply, sizeof(reply));
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG, "Probe reply failed: %d", (int)err);
+                return;
+            }
+            this->probes_answered_++;
+            ESP_LOGD(TAG, "Answered probe from %02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        }
 
-            // if we didn't get 11 elements, this wasn't a message from our sensors
-            if (argc != 11)
+        void Now_MQTT_BridgeComponent::enqueue_frame(const uint8_t *mac, const uint8_t *data, int len)
+        {
+            // runs in the WiFi task: copy and return, never block or allocate here
+            if (len <= 0 || len > ESP_NOW_MAX_DATA_LEN)
+                return;
+            uint8_t head = this->rx_head_.load(std::memory_order_relaxed);
+            uint8_t next = (head + 1) % RX_QUEUE_SIZE;
+            if (next == this->rx_tail_.load(std::memory_order_acquire))
             {
+                this->rx_dropped_.fetch_add(1, std::memory_order_relaxed);
                 return;
             }
+            ReceivedFrame &frame = this->rx_queue_[head];
+            memcpy(frame.mac, mac, sizeof(frame.mac));
+            memcpy(frame.data, data, len);
+            frame.len = len;
+            const SenderSignal *signal = this->find_signal(mac);
+            frame.rssi = signal ? signal->rssi : 0;
+            frame.noise_floor = signal ? signal->noise_floor : 0;
+            this->rx_head_.store(next, std::memory_order_release);
+        }
+
+        void Now_MQTT_BridgeComponent::receivecallback(const ReceivedFrame &frame)
+        {
+            if (frame.data[0] == NOW_FRAME_PROBE)
+                this->answer_probe(frame.mac);
+            else if (frame.data[0] == NOW_FRAME_FRAGMENT)
+                this->reassemble(frame);
+            else
+                this->process_line(frame.mac, frame.rssi, frame.noise_floor, frame.data, frame.len);
+        }
 
-            ESP_LOGI(TAG, "line rcv: %s:%s:%s:%s:%s:%s:%s:%s:%s:%s:%s", tokens[0], tokens[1], tokens[2], tokens[3], tokens[4], tokens[5], tokens[6], tokens[7], tokens[8], tokens[9], tokens[10]);
+        void Now_MQTT_BridgeComponent::reassemble(const ReceivedFrame &frame)
+        {
+            if (frame.len <= NOW_FRAGMENT_HEADER)
+                return;
+            uint8_t msg_id = frame.data[1];
+            uint8_t index = frame.data[2];
+            uint8_t count = frame.data[3];
+            size_t chunk = frame.len - NOW_FRAGMENT_HEADER;
+            size_t offset = index * NOW_FRAGMENT_PAYLOAD;
+            if (count == 0 || count > NOW_MAX_FRAGMENTS || index >= count || offset + chunk > NOW_MAX_MESSAGE ||
+                (index + 1 < count && chunk != NOW_FRAGMENT_PAYLOAD))
+                return;
 
-            // check for binary_sensor or sensor
-            message_type = tokens[2];
-            if (message_type.compare("binary_sensor") == 0)
+            // the sender's slot, else a free one, else the one that has waited longest
+            Reassembly *slot = nullptr;
+            Reassembly *oldest = nullptr;
+            for (uint8_t i = 0; i < REASSEMBLY_SLOTS && slot == nullptr; i++)
             {
-                if (strlen(tokens[3]) != 0)
-                {
-                    doc["name"] = tokens[3];
-                }
-                if (strlen(tokens[0]) != 0)
-                {
-                    std::string stat_t = tokens[0];
-                    stat_t += "/binary_sensor/";
-                    stat_t += tokens[3];
-                    stat_t += "/state";
-                    doc["stat_t"] = stat_t;
-                }
-                if (strlen(tokens[0]) != 0)
-                {
-                    std::string uniq_id = macStr;
-                    uniq_id += "_";
-                    uniq_id += tokens[3];
-                    doc["uniq_id"] = uniq_id;
-                }
-                dev = doc["dev"].to<JsonObject>();
-                dev["ids"] = macStr;
-                if (strlen(tokens[0]) != 0)
+                Reassembly &entry = this->reassembly_[i];
+                if (entry.active && memcmp(entry.mac, frame.mac, 6) == 0)
+                    slot = &entry;
+                else if (oldest == nullptr || (oldest->active && (!entry.active || entry.started < oldest->started)))
+                    oldest = &entry;
+            }
+            if (slot != nullptr && (slot->msg_id != msg_id || slot->count != count))
+            {
+                // a node sends one line at a time, a new id means the previous one is lost
+                this->abandon_reassembly(*slot, "superseded");
+            }
+            if (slot == nullptr)
+            {
+                slot = oldest;
+                if (slot->active)
+                    this->abandon_reassembly(*slot, "evicted");
+            }
+            if (!slot->active)
+            {
+                slot->active = true;
+                memcpy(slot->mac, frame.mac, 6);
+                slot->msg_id = msg_id;
+                slot->count = count;
+                slot->received = 0;
+                slot->len = 0;
+                slot->held = 0;
+                slot->started = millis();
+            }
+
+            if (!(slot->received & (1 << index)))
+            {
+                memcpy(slot->data + offset, frame.data + NOW_FRAGMENT_HEADER, chunk);
+                slot->received |= 1 << index;
+                slot->held += chunk;
+                if (index + 1 == count)
+                    slot->len = offset + chunk;
+            }
+
+            uint8_t slots = 0;
+            uint32_t bytes = 0;
+            for (uint8_t i = 0; i < REASSEMBLY_SLOTS; i++)
+            {
+                if (this->reassembly_[i].active)
                 {
-                    dev["name"] = tokens[0];
+                    slots++;
+                    bytes += this->reassembly_[i].held;
                 }
-                dev["sw"] = tokens[8];
-                dev["mdl"] = tokens[9];
-                dev["mf"] = "espressif";
-                serializeJson(doc, json);
+            }
+            if (slots > this->reassembly_slots_high_water_)
+                this->reassembly_slots_high_water_ = slots;
+            if (bytes > this->reassembly_bytes_high_water_)
+                this->reassembly_bytes_high_water_ = bytes;
 
-                // make and send the config topic
-                discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), binary_config_topic, discovery_info.prefix.c_str(), tokens[0], tokens[3]);
-                mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
+            if (slot->received == (uint8_t)((1 << count) - 1))
+            {
+                slot->active = false;
+                this->reassembled_++;
+                this->process_line(slot->mac, frame.rssi, frame.noise_floor, slot->data, slot->len);
+            }
+        }
 
-                // make and send the state topic
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), binary_sensor_topic, tokens[0], tokens[3]);
-                mqtt::global_mqtt_client->publish(topic, tokens[5], strlen(tokens[5]), 2, true);
+        void Now_MQTT_BridgeComponent::expire_reassembly(uint32_t now)
+        {
+            for (uint8_t i = 0; i < REASSEMBLY_SLOTS; i++)
+            {
+                Reassembly &slot = this->reassembly_[i];
+                if (slot.active && now - slot.started >= REASSEMBLY_TIMEOUT_MS)
+                    this->abandon_reassembly(slot, "timed out");
             }
-            else
+        }
+
+        void Now_MQTT_BridgeComponent::abandon_reassembly(Reassembly &slot, const char *reason)
+        {
+            ESP_LOGW(TAG, "Reassembly of message %u from %02x%02x%02x%02x%02x%02x %s with %u/%u fragments",
+                     (unsigned)slot.msg_id, slot.mac[0], slot.mac[1], slot.mac[2], slot.mac[3], slot.mac[4], slot.mac[5],
+                     reason, (unsigned)__builtin_popcount(slot.received), (unsigned)slot.count);
+            slot.active = false;
+            this->reassembly_failed_++;
+        }
+
+        void Now_MQTT_BridgeComponent::process_line(const uint8_t *mac, int8_t rssi, int8_t noise_floor, const uint8_t *data, size_t len)
+        {
+            char received_string[NOW_MAX_MESSAGE + 1];
+            char macStr[18];
+            DynamicJsonDocument doc(1024);
+            std::string json;
+
+            // sender mac address
+            const uint8_t *bssid = mac;
+            snprintf(macStr, sizeof(macStr), "%02x%02x%02x%02x%02x%02x", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+
+            // received data
+            if (len == 0 || len >= sizeof(received_string))
+                return;
+            if (is_sealed(data, len))
             {
-                if (strlen(tokens[1]) != 0)
-                {
-                    doc["dev_cla"] = tokens[1];
-                }
-                if (strlen(tokens[4]) != 0)
-                {
-                    doc["unit_of_meas"] = tokens[4];
-                }
-                if (strlen(tokens[2]) != 0)
-                {
-                    doc["stat_cla"] = tokens[2];
-                }
-                if (strlen(tokens[3]) != 0)
-                {
-                    doc["name"] = tokens[3];
-                }
-                if (strlen(tokens[6]) != 0)
+                if (!this->opener_.open(data, len, reinterpret_cast<uint8_t *>(received_string)))
                 {
-                    std::string icon = tokens[6];
-                    icon += ":";
-                    icon += tokens[7];
-                    doc["icon"] = icon;
+                    ESP_LOGW(TAG, "Sealed line from %s (key %d) failed to open, dropped", macStr, data[0] & SEALED_KEY_MASK);
+                    return;
                 }
-                if (strlen(tokens[0]) != 0)
-                {
-                    std::string stat_t = tokens[0];
-                    stat_t += "/sensor/";
-                    stat_t += tokens[3];
-                    stat_t += "/state";
-                    doc["stat_t"] = stat_t;
-                }
-                if (strlen(tokens[0]) != 0)
-                {
-                    std::string uniq_id = macStr;
-                    uniq_id += "_";
-                    uniq_id += tokens[3];
-                    doc["uniq_id"] = uniq_id;
-                }
-                dev = doc["dev"].to<JsonObject>();
-                dev["ids"] = macStr;
-                if (strlen(tokens[0]) != 0)
-                {
-                    dev["name"] = tokens[0];
-                }
-                dev["sw"] = tokens[8];
-                dev["mdl"] = tokens[9];
-                dev["mf"] = "espressif";
+                len -= SEALED_OVERHEAD;
+            }
+            else if (this->opener_.required())
+            {
+                ESP_LOGW(TAG, "Unsealed line from %s while encryption is required, dropped", macStr);
+                return;
+            }
+            else
+                memcpy(&received_string, data, len);
+            received_string[len] = 0;
+
+            // if it doesn't parse, this wasn't a message from our sensors
+            SensorLine line;
+            if (!NowCodec::decode(received_string, &line))
+            {
+                return;
+            }
+
+            ESP_LOGI(TAG, "line rcv: %s:%s:%s:%s:%s:%s:%s:%s:%s:%s", line.node, line.device_class, line.state_class, line.object_id,
+                     line.unit, line.value, line.icon, line.version, line.board, line.kind);
+
+            uint32_t now = millis();
+
+            // config topic, only when the entity is new or its config changed
+            EntityTable::Entity *entity = this->intern(line.type(), line.node, line.object_id);
+            if (entity == nullptr)
+            {
+                ESP_LOGW(TAG, "Topics for %s/%s are too long, dropped", line.node, line.object_id);
+                return;
+            }
+            if (this->entities_.needs_discovery(entity, NowCodec::discovery_hash(line, macStr, false), now))
+            {
+                NowCodec::build_discovery(line, macStr, false, doc);
                 serializeJson(doc, json);
+                if (!mqtt::global_mqtt_client->publish(this->entities_.config_topic(entity), json.c_str(), json.length(), 2, true))
+                    this->entities_.discovery_failed(entity);
+            }
+
+            // state topic
+            mqtt::global_mqtt_client->publish(this->entities_.state_topic(entity), line.value, strlen(line.value), 2, true);
 
-                // make and send the config topic
-                discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), config_topic, discovery_info.prefix.c_str(), tokens[0], tokens[3]);
-                mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
+            // no promiscuous sample was matched to this sender, nothing to report
+            if (rssi == 0)
+                return;
 
-                // make and send the state topic
-                memset(&topic, 0, sizeof(topic));
-                snprintf(topic, sizeof(topic), sensor_topic, tokens[0], tokens[3]);
-                mqtt::global_mqtt_client->publish(topic, tokens[5], strlen(tokens[5]), 2, true);
+            // rssi config and state topics
+            entity = this->intern("sensor", line.node, "rssi");
+            if (entity == nullptr)
+                return;
+            if (this->entities_.needs_discovery(entity, NowCodec::rssi_discovery_hash(line, macStr), now))
+            {
+                json = "";
+                doc.clear();
+                NowCodec::build_rssi_discovery(line, macStr, doc);
+                serializeJson(doc, json);
+                if (!mqtt::global_mqtt_client->publish(this->entities_.config_topic(entity), json.c_str(), json.length(), 2, true))
+                    this->entities_.discovery_failed(entity);
             }
+            char rssi_str[8];
+            int rssi_len = snprintf(rssi_str, sizeof(rssi_str), "%d", rssi);
+            mqtt::global_mqtt_client->publish(this->entities_.state_topic(entity), rssi_str, rssi_len, 2, true);
+            ESP_LOGD(TAG, "rssi %s: %d dBm, noise floor %d dBm", macStr, rssi, noise_floor);
+        }
 
-            // create RSSI message
-            json = "";
-            doc.clear();
-            doc["name"] = "rssi";
-            doc["dev_cla"] = "SIGNAL_STRENGTH";
-            doc["unit_of_meas"] = "dBm";
-            doc["stat_cla"] = "measurement";
-            doc["icon"] = "mdi:wifi";
-
-            std::string stat_t = tokens[0];
-            stat_t += "/sensor/";
-            stat_t += "rssi";
-            stat_t += "/state";
-            doc["stat_t"] = stat_t;
-
-            std::string uniq_id = macStr;
-            uniq_id += "_";
-            uniq_id += "rssi";
-            doc["uniq_id"] = uniq_id;
-
-            serializeJson(doc, json);
-
-            // make and send the rssi config topic
-            // discovery_info = mqtt::global_mqtt_client->get_discovery_info();
-            // memset(&topic, 0, sizeof(topic));
-            // snprintf(topic, sizeof(topic), config_topic, discovery_info.prefix.c_str(), tokens[0], "rssi");
-            // mqtt::global_mqtt_client->publish(topic, json.c_str(), json.length(), 2, true);
-
-            // // make and send the rssi state topic
-            // memset(&topic, 0, sizeof(topic));
-            // snprintf(topic, sizeof(topic), sensor_topic, tokens[0], "rssi");
-            // std::string last_rssi_str = std::to_string(last_rssi);
-            // mqtt::global_mqtt_client->publish(topic, last_rssi_str.c_str(), last_rssi_str.length(), 2, true);
+        EntityTable::Entity *Now_MQTT_BridgeComponent::intern(const char *type, const char *node, const char *object_id)
+        {
+            EntityTable::Entity *entity = this->entities_.find(type, node, object_id);
+            if (entity != nullptr)
+                return entity;
+            return this->entities_.add(type, node, object_id, mqtt::global_mqtt_client->get_discovery_info().prefix.c_str());
         }
 
         float Now_MQTT_BridgeComponent::get_setup_priority() const { return setup_priority::AFTER_CONNECTION; }
@@ -209,6 +320,18 @@ namespace esphome
             uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
             esp_now_peer_info_t peerInfo = {};
 
+            for (auto &key : this->keys_)
+            {
+                if (!this->opener_.add_key(key.first, key.second))
+                {
+                    this->mark_failed();
+                    ESP_LOGE(TAG, "Invalid encryption key for key id %d, expected 32 hex characters", key.first);
+                    return;
+                }
+            }
+            if (!this->keys_.empty())
+                this->opener_.begin(fnv1_hash("now_mqtt_bridge.replay"));
+
             ESP_LOGD(TAG, "Setting up ESP-Now MQTT Bridge...");
             ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
 
@@ -218,20 +341,34 @@ namespace esphome
                 ESP_LOGE(TAG, "Error initializing ESP-Now MQTT Bridge");
                 return;
             }
+            // probe replies go out as broadcast so answering never fills the peer table
+            memcpy(peerInfo.peer_addr, broadcastAddress, 6);
+            peerInfo.channel = 0;
+            peerInfo.encrypt = false;
+            if (esp_now_add_peer(&peerInfo) != ESP_OK)
+                ESP_LOGW(TAG, "Failed to add broadcast peer, nodes will stay on broadcast");
+
+            instance_ = this;
             esp_now_register_recv_cb(Now_MQTT_BridgeComponent::call_on_data_recv_callback);
-            esp_wifi_set_promiscuous(true);
+            // ESP-NOW rides on vendor action frames, so only management frames need to reach
+            // the promiscuous callback; data and control traffic is filtered in hardware
+            wifi_promiscuous_filter_t filter = {};
+            filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+            esp_wifi_set_promiscuous_filter(&filter);
             esp_wifi_set_promiscuous_rx_cb(Now_MQTT_BridgeComponent::call_prom_callback);
+            esp_wifi_set_promiscuous(true);
         }
 
         void Now_MQTT_BridgeComponent::call_on_data_recv_callback(const esp_now_recv_info_t *info, const uint8_t *incomingData, int len)
         {
-            const uint8_t *mac = info->src_addr;
-            Now_MQTT_BridgeComponent().receivecallback(mac, incomingData, len);
+            if (instance_ != nullptr)
+                instance_->enqueue_frame(info->src_addr, incomingData, len);
         }
 
         void Now_MQTT_BridgeComponent::call_prom_callback(void *buf, wifi_promiscuous_pkt_type_t type)
         {
-            Now_MQTT_BridgeComponent().promcallback(buf, type);
+            if (instance_ != nullptr)
+                instance_->promcallback(buf, type);
         }
 
         void Now_MQTT_BridgeComponent::promcallback(void *buf, wifi_promiscuous_pkt_type_t type)
@@ -244,31 +381,48 @@ namespace esphome
             const wifi_ieee80211_packet_t *ipkt = (wifi_ieee80211_packet_t *)ppkt->payload;
             const wifi_ieee80211_mac_hdr_t *hdr = &ipkt->hdr;
 
+            // action frames only (type 0, subtype 13), before touching the body
+            if ((hdr->frame_ctrl & 0xFC) != 0xD0)
+                return;
+
             static const uint8_t esp_oui[3] = {0x18, 0xfe, 0x34}; // esp32 oui
 
             // Filter vendor specific frame with the esp oui.
             if (((ipkt->category_code) == 127) && (memcmp(ipkt->oui, esp_oui, 3) == 0))
             {
-                last_rssi = ppkt->rx_ctrl.rssi;
+                this->record_signal(hdr->addr2, ppkt->rx_ctrl.rssi, ppkt->rx_ctrl.noise_floor);
             }
         }
-        void Now_MQTT_BridgeComponent::split(char **argv, int *argc, char *string, const char delimiter, int allowempty)
+
+        void Now_MQTT_BridgeComponent::record_signal(const uint8_t *mac, int8_t rssi, int8_t noise_floor)
         {
-            *argc = 0;
-            do
+            // reuse the sender's slot, otherwise evict the least recently heard one
+            SenderSignal *slot = &this->senders_[0];
+            for (uint8_t i = 0; i < SENDER_TABLE_SIZE; i++)
             {
-                if (*string && (*string != delimiter || allowempty))
+                SenderSignal *entry = &this->senders_[i];
+                if (memcmp(entry->mac, mac, 6) == 0)
                 {
-                    argv[(*argc)++] = string;
+                    slot = entry;
+                    break;
                 }
-                while (*string && *string != delimiter)
-                    string++;
-                if (*string)
-                    *string++ = 0;
-                if (!allowempty)
-                    while (*string && *string == delimiter)
-                        string++;
-            } while (*string);
+                if (entry->seen < slot->seen)
+                    slot = entry;
+            }
+            memcpy(slot->mac, mac, 6);
+            slot->rssi = rssi;
+            slot->noise_floor = noise_floor;
+            slot->seen = ++this->sender_clock_;
+        }
+
+        const Now_MQTT_BridgeComponent::SenderSignal *Now_MQTT_BridgeComponent::find_signal(const uint8_t *mac) const
+        {
+            for (uint8_t i = 0; i < SENDER_TABLE_SIZE; i++)
+            {
+                if (this->senders_[i].seen != 0 && memcmp(this->senders_[i].mac, mac, 6) == 0)
+                    return &this->senders_[i];
+            }
+            return nullptr;
         }
     } // namespace now_mqtt_bridge
 } // namespace esphome
@@ -4,6 +4,10 @@
 #include "esphome/components/mqtt/mqtt_client.h"
 #include "esp_wifi.h"
 #include "esp_now.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/frame_crypto.h"
+#include "esphome/components/frame_codec/entity_table.h"
+#include <atomic>
 
 namespace esphome
 {
@@ -29,22 +33,97 @@ namespace esphome
                 uint8_t payload[0];
             } wifi_ieee80211_packet_t;
 
+            // a frame as copied out of the WiFi task, waiting for loop()
+            struct ReceivedFrame
+            {
+                uint8_t mac[6];
+                uint8_t len;
+                int8_t rssi;
+                int8_t noise_floor;
+                uint8_t data[ESP_NOW_MAX_DATA_LEN];
+            };
+
+            // radio metrics of the last vendor action frame seen from each sender; only
+            // touched from the WiFi task, where the promiscuous callback runs just before
+            // the ESP-NOW receive callback for the same frame
+            struct SenderSignal
+            {
+                uint8_t mac[6];
+                int8_t rssi;
+                int8_t noise_floor;
+                uint32_t seen;
+            };
+
         public:
             void setup() override;
+            void loop() override;
             float get_setup_priority() const override;
             void set_wifi_channel(uint8_t channel) { this->wifi_channel_ = channel; }
+            void add_key(int key_id, const std::string &key) { this->keys_.push_back({key_id, key}); }
+            void set_require_encryption(bool required) { this->opener_.set_required(required); }
 
         protected:
             uint8_t wifi_channel_;
 
         private:
-            static int32_t last_rssi;
-            void receivecallback(const uint8_t *mac, const uint8_t *data, int len);
+            static Now_MQTT_BridgeComponent *instance_;
+
+            static const uint8_t SENDER_TABLE_SIZE = 8;
+            SenderSignal senders_[SENDER_TABLE_SIZE]{};
+            uint32_t sender_clock_{0};
+            void record_signal(const uint8_t *mac, int8_t rssi, int8_t noise_floor);
+            const SenderSignal *find_signal(const uint8_t *mac) const;
+
+            // single producer (WiFi task) / single consumer (loop) ring, one slot is kept free
+            static const uint8_t RX_QUEUE_SIZE = 16;
+            static const uint8_t RX_FRAMES_PER_LOOP = 4;
+            static const uint32_t STATS_INTERVAL_MS = 30000;
+            ReceivedFrame rx_queue_[RX_QUEUE_SIZE];
+            std::atomic<uint8_t> rx_head_{0};
+            std::atomic<uint8_t> rx_tail_{0};
+            std::atomic<uint32_t> rx_dropped_{0};
+            uint32_t rx_dropped_reported_{0};
+            uint32_t rx_frames_{0};
+            uint8_t rx_high_water_{0};
+            uint32_t last_stats_{0};
+            void enqueue_frame(const uint8_t *mac, const uint8_t *data, int len);
+
+            // rebuilds fragmented lines, one slot per sender, all in fixed memory
+            static const uint8_t REASSEMBLY_SLOTS = 4;
+            static const uint32_t REASSEMBLY_TIMEOUT_MS = 2000;
+            static_assert(frame_codec::NOW_MAX_FRAGMENTS <= 8, "fragment bitmask is a uint8_t");
+            struct Reassembly
+            {
+                bool active;
+                uint8_t mac[6];
+                uint8_t msg_id;
+                uint8_t count;
+                uint8_t received;
+                uint16_t len;
+                uint16_t held;
+                uint32_t started;
+                uint8_t data[frame_codec::NOW_MAX_MESSAGE];
+            };
+            Reassembly reassembly_[REASSEMBLY_SLOTS]{};
+            uint32_t reassembled_{0};
+            uint32_t reassembly_failed_{0};
+            uint8_t reassembly_slots_high_water_{0};
+            uint32_t reassembly_bytes_high_water_{0};
+            void reassemble(const ReceivedFrame &frame);
+            void expire_reassembly(uint32_t now);
+            void abandon_reassembly(Reassembly &slot, const char *reason);
+
+            void receivecallback(const ReceivedFrame &frame);
+            void process_line(const uint8_t *mac, int8_t rssi, int8_t noise_floor, const uint8_t *data, size_t len);
+            void answer_probe(const uint8_t *mac);
+            std::vector<std::pair<int, std::string>> keys_;
+            frame_codec::FrameOpener opener_;
+            uint32_t probes_answered_{0};
             static void call_on_data_recv_callback(const esp_now_recv_info *info_t, const uint8_t *incomingData, int len);
             void promcallback(void *buf, wifi_promiscuous_pkt_type_t type);
             static void call_prom_callback(void *buf, wifi_promiscuous_pkt_type_t type);
-            void split(char **argv, int *argc, char *string, const char delimiter, int allowempty);
-            mqtt::MQTTDiscoveryInfo discovery_info;
+            frame_codec::EntityTable entities_;
+            frame_codec::EntityTable::Entity *intern(const char *type, const char *node, const char *object_id);
         };
     } // namespace now_mqtt_bridge
 } // namespace esphome
@@ -0,0 +1,484 @@
+// Host benchmark of the frame_codec encoders: the packed series of catch-up uploads
+// (SeriesEncoder, SeriesDecoder) on synthetic sensor histories, whole catch-up frames
+// assembled the way the node does, and the text lines (LineCodec) at each line size.
+// Reports bytes and nanoseconds per sample against the plain varint age + float32
+// samples, and nanoseconds per line. See README.md.
+//
+//   g++ -O2 -std=gnu++17 -I../host -I../.. codec_bench.cpp -o codec_bench
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/frames.h"
+
+namespace lora_host
+{
+    bool verbose = false;
+} // namespace lora_host
+
+namespace codec_bench
+{
+    using namespace esphome::frame_codec;
+    using Clock = std::chrono::steady_clock;
+
+    // as in lora_mqtt.h
+    static const size_t MAX_CATCHUP_FRAME = 255;
+    static const uint8_t MAX_CATCHUP_BLOCKS = 6;
+
+    struct Options
+    {
+        uint32_t samples{10000};
+        uint32_t repeat{200};
+        uint32_t seed{1};
+    };
+
+    struct Sample
+    {
+        int32_t time; // seconds, negative age
+        float value;
+    };
+
+    struct Series
+    {
+        const char *name;
+        const char *object_id;
+        uint8_t accuracy;
+        bool binary;
+        std::vector<Sample> samples;
+    };
+
+    // what the backlog holds for one entity: readings oldest first, ending now
+    static Series make_series(const char *name, const char *object_id, uint8_t accuracy, bool binary, uint32_t count,
+                              uint32_t interval, uint32_t jitter, float step, float start, std::mt19937 &rng)
+    {
+        Series series{name, object_id, accuracy, binary, {}};
+        std::uniform_int_distribution<int32_t> jitter_s(-(int32_t)jitter, (int32_t)jitter);
+        std::normal_distribution<float> walk(0.0f, step);
+        std::exponential_distribution<double> gap(1.0 / interval);
+        int32_t time = 0;
+        float value = start;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (binary)
+            {
+                // events: a door opens and closes at random
+                time += 1 + (int32_t)gap(rng);
+                value = value != 0.0f ? 0.0f : 1.0f;
+            }
+            else
+            {
+                time += interval + jitter_s(rng);
+                value += walk(rng);
+            }
+            series.samples.push_back({time, value});
+        }
+        int32_t now = time;
+        for (auto &sample : series.samples)
+            sample.time -= now;
+        return series;
+    }
+
+    static volatile uint32_t sink;
+
+    template <typename F> static double ns_per(uint32_t repeat, uint32_t count, F &&f)
+    {
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < repeat; i++)
+            f();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        return ns / ((double)repeat * count);
+    }
+
+    static void bench_series(const Series &series, const Options &options)
+    {
+        size_t count = series.samples.size();
+        std::vector<int32_t> quantized(count);
+        for (size_t i = 0; i < count; i++)
+            quantize_value(series.samples[i].value, series.accuracy, &quantized[i]);
+
+        std::vector<uint8_t> packed(count * 10);
+        size_t packed_len = 0;
+        {
+            SeriesEncoder encoder;
+            for (size_t i = 0; i < count; i++)
+                packed_len += encoder.encode(packed.data() + packed_len, series.samples[i].time, quantized[i]);
+        }
+        size_t plain_len = 0;
+        for (auto &sample : series.samples)
+        {
+            uint8_t buf[5];
+            plain_len += put_varint(buf, -sample.time) + sizeof(float);
+        }
+
+        // check the round trip before timing it
+        {
+            SeriesDecoder decoder;
+            size_t pos = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                int32_t time, value;
+                size_t n = decoder.decode(packed.data() + pos, packed_len - pos, &time, &value);
+                if (n == 0 || time != series.samples[i].time || value != quantized[i])
+                {
+                    fprintf(stderr, "%s: sample %zu doesn't decode to what was encoded\n", series.name, i);
+                    exit(1);
+                }
+                pos += n;
+            }
+        }
+
+        double encode_ns = ns_per(options.repeat, count, [&]() {
+            SeriesEncoder encoder;
+            size_t len = 0;
+            for (size_t i = 0; i < count; i++)
+                len += encoder.encode(packed.data() + len, series.samples[i].time, quantized[i]);
+            sink = len;
+        });
+        double decode_ns = ns_per(options.repeat, count, [&]() {
+            SeriesDecoder decoder;
+            size_t pos = 0;
+            int32_t time = 0, value = 0, sum = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                pos += decoder.decode(packed.data() + pos, packed_len - pos, &time, &value);
+                sum += value;
+            }
+            sink = sum;
+        });
+        double quantize_ns = ns_per(options.repeat, count, [&]() {
+            int32_t q = 0, sum = 0;
+            for (auto &sample : series.samples)
+            {
+                quantize_value(sample.value, series.accuracy, &q);
+                sum += q;
+            }
+            sink = sum;
+        });
+
+        printf("%-12s %9.2f %9.2f %7.2f %10.1f %10.1f %12.1f\n", series.name, (double)packed_len / count, (double)plain_len / count,
+               (double)plain_len / packed_len, encode_ns, decode_ns, quantize_ns);
+    }
+
+    struct Reading
+    {
+        uint8_t entity;
+        int32_t time;
+        float value;
+    };
+
+    struct Block
+    {
+        uint8_t entity;
+        uint8_t flags;
+        uint8_t count;
+        uint8_t len;
+        SeriesEncoder encoder;
+        uint8_t data[MAX_CATCHUP_FRAME];
+    };
+
+    // Lora_MQTTComponent::send_catchup(): the oldest readings in order, one block per
+    // entity, until the frame is full. Returns the readings taken.
+    static size_t encode_catchup(const std::vector<Series> &entities, const Reading *readings, size_t available, bool packed,
+                                 uint8_t *frame, size_t *frame_len)
+    {
+        static const char *const NODE = "bench-node";
+        Block blocks[MAX_CATCHUP_BLOCKS];
+        uint8_t used = 0;
+        size_t len = 3 + strlen(NODE);
+        size_t taken = 0;
+        while (taken < available)
+        {
+            const Reading &reading = readings[taken];
+            const Series &entity = entities[reading.entity];
+            Block *block = nullptr;
+            for (uint8_t i = 0; i < used; i++)
+            {
+                if (blocks[i].entity == reading.entity)
+                    block = &blocks[i];
+            }
+            int32_t quantized = 0;
+            if (block == nullptr)
+            {
+                size_t object_len = strlen(entity.object_id);
+                if (used == MAX_CATCHUP_BLOCKS || len + 3 + object_len + 10 > MAX_CATCHUP_FRAME)
+                    break;
+                block = &blocks[used++];
+                block->entity = reading.entity;
+                block->flags = (entity.binary ? ENTITY_BINARY : 0) | entity.accuracy;
+                if (packed && quantize_value(reading.value, entity.accuracy, &quantized))
+                    block->flags |= ENTITY_PACKED;
+                block->count = 0;
+                block->len = 0;
+                block->encoder = SeriesEncoder();
+                len += 3 + object_len;
+            }
+            if (block->count == 255)
+                break;
+            uint8_t sample[10];
+            size_t sample_len;
+            if (block->flags & ENTITY_PACKED)
+            {
+                if (!quantize_value(reading.value, entity.accuracy, &quantized))
+                    break;
+                sample_len = block->encoder.encode(sample, reading.time, quantized);
+            }
+            else
+            {
+                sample_len = put_varint(sample, -reading.time);
+                memcpy(sample + sample_len, &reading.value, sizeof(float));
+                sample_len += sizeof(float);
+            }
+            if (len + sample_len > MAX_CATCHUP_FRAME)
+                break;
+            memcpy(block->data + block->len, sample, sample_len);
+            block->len += sample_len;
+            block->count++;
+            len += sample_len;
+            taken++;
+        }
+
+        size_t pos = 0;
+        frame[pos++] = FRAME_CATCHUP;
+        frame[pos++] = 0;
+        frame[pos++] = strlen(NODE);
+        memcpy(frame + pos, NODE, strlen(NODE));
+        pos += strlen(NODE);
+        for (uint8_t i = 0; i < used; i++)
+        {
+            const char *object_id = entities[blocks[i].entity].object_id;
+            frame[pos++] = blocks[i].flags;
+            frame[pos++] = strlen(object_id);
+            memcpy(frame + pos, object_id, strlen(object_id));
+            pos += strlen(object_id);
+            frame[pos++] = blocks[i].count;
+            memcpy(frame + pos, blocks[i].data, blocks[i].len);
+            pos += blocks[i].len;
+        }
+        *frame_len = pos;
+        return taken;
+    }
+
+    // the bridge's parse of a catch-up frame (process_catchup() without the publishing);
+    // returns the samples, 0 on a malformed frame
+    static uint32_t decode_catchup(const uint8_t *frame, size_t len, float *sum)
+    {
+        size_t pos = 3 + frame[2];
+        uint32_t samples = 0;
+        while (pos < len)
+        {
+            if (pos + 2 > len)
+                return 0;
+            uint8_t flags = frame[pos++];
+            if ((flags & ENTITY_PACKED) && (flags & ENTITY_ACCURACY) > MAX_ACCURACY)
+                return 0;
+            uint8_t object_len = frame[pos++];
+            if (pos + object_len + 1 > len)
+                return 0;
+            pos += object_len;
+            uint8_t count = frame[pos++];
+            SeriesDecoder decoder;
+            for (uint8_t i = 0; i < count; i++)
+            {
+                float value;
+                if (flags & ENTITY_PACKED)
+                {
+                    int32_t time, quantized;
+                    size_t n = decoder.decode(frame + pos, len - pos, &time, &quantized);
+                    if (n == 0 || !valid_sample_time(time))
+                        return 0;
+                    pos += n;
+                    value = dequantize_value(quantized, flags & ENTITY_ACCURACY);
+                }
+                else
+                {
+                    uint32_t age;
+                    size_t n = get_varint(frame + pos, len - pos, &age);
+                    if (n == 0 || pos + n + sizeof(float) > len)
+                        return 0;
+                    pos += n;
+                    memcpy(&value, frame + pos, sizeof(float));
+                    pos += sizeof(float);
+                }
+                *sum += value;
+                samples++;
+            }
+        }
+        return samples;
+    }
+
+    // a backlog of all entities interleaved by time, as the node records it
+    static std::vector<Reading> merge_backlog(const std::vector<Series> &entities)
+    {
+        std::vector<Reading> backlog;
+        std::vector<size_t> next(entities.size(), 0);
+        while (true)
+        {
+            int best = -1;
+            for (size_t e = 0; e < entities.size(); e++)
+            {
+                if (next[e] < entities[e].samples.size() &&
+                    (best < 0 || entities[e].samples[next[e]].time < entities[best].samples[next[best]].time))
+                    best = e;
+            }
+            if (best < 0)
+                return backlog;
+            const Sample &sample = entities[best].samples[next[best]++];
+            backlog.push_back({(uint8_t)best, sample.time, sample.value});
+        }
+    }
+
+    static void bench_catchup(const std::vector<Series> &entities, const Options &options)
+    {
+        std::vector<Reading> backlog = merge_backlog(entities);
+        for (bool packed : {false, true})
+        {
+            uint8_t frame[MAX_CATCHUP_FRAME];
+            size_t frame_len;
+            uint32_t frames = 0;
+            uint64_t bytes = 0;
+            for (size_t pos = 0; pos < backlog.size();)
+            {
+                size_t taken = encode_catchup(entities, backlog.data() + pos, backlog.size() - pos, packed, frame, &frame_len);
+                float sum = 0.0f;
+                if (taken == 0 || decode_catchup(frame, frame_len, &sum) != taken)
+                {
+                    fprintf(stderr, "catch-up frame %u doesn't decode to the %zu readings it took\n", frames, taken);
+                    exit(1);
+                }
+                pos += taken;
+                bytes += frame_len;
+                frames++;
+            }
+
+            // a full frame's worth of the backlog, over and over
+            size_t taken = encode_catchup(entities, backlog.data(), backlog.size(), packed, frame, &frame_len);
+            uint32_t repeat = options.repeat * 50;
+            double encode_ns = ns_per(repeat, taken, [&]() {
+                uint8_t out[MAX_CATCHUP_FRAME];
+                size_t len;
+                sink = encode_catchup(entities, backlog.data(), backlog.size(), packed, out, &len);
+            });
+            double decode_ns = ns_per(repeat, taken, [&]() {
+                float sum = 0.0f;
+                sink = decode_catchup(frame, frame_len, &sum) + (uint32_t)sum;
+            });
+            printf("%-8s %8zu %7u %11.1f %10.2f %10.1f %10.1f\n", packed ? "packed" : "plain", backlog.size(), frames,
+                   (double)backlog.size() / frames, (double)bytes / backlog.size(), encode_ns, decode_ns);
+        }
+    }
+
+    // the line sizes lora_mqtt_benchmark runs on the board
+    static const size_t LINE_SIZES[] = {64, 128, 192, 255};
+
+    // A sensor line padded to the size through its object id, as lora_mqtt_benchmark
+    // pads its sensor's name
+    static void bench_lines(const Options &options)
+    {
+        for (size_t size : LINE_SIZES)
+        {
+            SensorLine line;
+            line.node = "bench-node";
+            line.device_class = "temperature";
+            line.state_class = "measurement";
+            line.unit = "°C";
+            line.value = "21.38";
+            line.icon = "mdi:thermometer";
+            line.kind = "sensor";
+            line.seq = "2a";
+            std::string encoded, object_id = "benchmark";
+            line.object_id = object_id.c_str();
+            LoRaCodec::encode(line, encoded);
+            if (encoded.size() < size)
+                object_id.append(size - encoded.size(), 'x');
+            line.object_id = object_id.c_str();
+            if (!LoRaCodec::encode(line, encoded))
+            {
+                fprintf(stderr, "a %zu byte line doesn't encode\n", size);
+                exit(1);
+            }
+
+            char buf[LoRaTransport::MAX_LINE + 1];
+            SensorLine decoded;
+            uint32_t repeat = options.repeat * 500;
+            double encode_ns = ns_per(repeat, 1, [&]() {
+                std::string out;
+                LoRaCodec::encode(line, out);
+                sink = out.size();
+            });
+            // the bridge copies every packet out of its receive buffer first
+            double decode_ns = ns_per(repeat, 1, [&]() {
+                memcpy(buf, encoded.c_str(), encoded.size() + 1);
+                sink = LoRaCodec::decode(buf, &decoded);
+            });
+            memcpy(buf, encoded.c_str(), encoded.size() + 1);
+            LoRaCodec::decode(buf, &decoded);
+            double hash_ns = ns_per(repeat, 1, [&]() { sink = LoRaCodec::discovery_hash(decoded, decoded.node, false); });
+            printf("%-8zu %10.1f %10.1f %10.1f\n", encoded.size(), encode_ns, decode_ns, hash_ns);
+        }
+    }
+
+    static void usage(const char *argv0)
+    {
+        fprintf(stderr, "usage: %s [--samples N] [--repeat N] [--seed N]\n", argv0);
+        exit(2);
+    }
+
+    static Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+            const char *arg = argv[i];
+            if (i + 1 >= argc)
+                usage(argv[0]);
+            const char *value = argv[++i];
+            if (!strcmp(arg, "--samples"))
+                options.samples = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--repeat"))
+                options.repeat = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--seed"))
+                options.seed = strtoul(value, nullptr, 10);
+            else
+                usage(argv[0]);
+        }
+        if (options.samples == 0 || options.repeat == 0)
+            usage(argv[0]);
+        return options;
+    }
+} // namespace codec_bench
+
+int main(int argc, char **argv)
+{
+    using namespace codec_bench;
+    Options options = parse_options(argc, argv);
+    std::mt19937 rng(options.seed);
+
+    std::vector<Series> entities;
+    entities.push_back(make_series("temperature", "temperature", 1, false, options.samples, 60, 0, 0.05f, 21.0f, rng));
+    entities.push_back(make_series("humidity", "humidity", 0, false, options.samples, 60, 2, 0.4f, 55.0f, rng));
+    entities.push_back(make_series("pressure", "pressure", 2, false, options.samples, 300, 5, 0.08f, 1013.0f, rng));
+    entities.push_back(make_series("voltage", "battery_voltage", 3, false, options.samples, 30, 0, 0.004f, 3.9f, rng));
+    entities.push_back(make_series("door", "door", 0, true, options.samples, 900, 0, 0.0f, 0.0f, rng));
+
+    printf("Series codec, %u samples per entity\n", options.samples);
+    printf("%-12s %9s %9s %7s %10s %10s %12s\n", "entity", "B/packed", "B/plain", "ratio", "enc ns", "dec ns", "quantize ns");
+    for (auto &series : entities)
+        bench_series(series, options);
+
+    // the node sends the backlog of every entity at once
+    printf("\nCatch-up frames of the interleaved backlog (%u byte frames, %u entities a frame)\n", (unsigned)MAX_CATCHUP_FRAME,
+           (unsigned)MAX_CATCHUP_BLOCKS);
+    printf("%-8s %8s %7s %11s %10s %10s %10s\n", "encoding", "readings", "frames", "per frame", "B/sample", "enc ns", "dec ns");
+    bench_catchup(entities, options);
+
+    printf("\nText lines (LoRaCodec)\n");
+    printf("%-8s %10s %10s %10s\n", "bytes", "enc ns", "dec ns", "hash ns");
+    bench_lines(options);
+    return 0;
+}
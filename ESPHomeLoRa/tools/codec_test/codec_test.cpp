@@ -0,0 +1,228 @@
+// Host test of the frame_codec text line codec (LineCodec in frame_codec.h), on both
+// transports: lines round trip through encode() and decode(), the icon comes back in
+// one piece, the optional seq token is only taken where the transport has ACKs, and
+// malformed lines are refused. Exits 1 on the first failure.
+//
+//   g++ -O2 -std=gnu++17 -Wall -Wextra -I../host -I../.. codec_test.cpp -o codec_test && ./codec_test
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "esphome/components/frame_codec/frame_codec.h"
+
+namespace lora_host
+{
+    bool verbose = false;
+} // namespace lora_host
+
+namespace codec_test
+{
+    using namespace esphome::frame_codec;
+
+    static int checks = 0;
+    static const char *current = "";
+
+#define CHECK(cond)                                                                                     \
+    do                                                                                                  \
+    {                                                                                                   \
+        checks++;                                                                                       \
+        if (!(cond))                                                                                    \
+        {                                                                                               \
+            fprintf(stderr, "%s: %s:%d: CHECK(%s) failed\n", current, __FILE__, __LINE__, #cond);       \
+            exit(1);                                                                                    \
+        }                                                                                               \
+    } while (0)
+
+#define CHECK_STR(a, b) CHECK(strcmp((a), (b)) == 0)
+
+    static SensorLine temperature()
+    {
+        SensorLine line;
+        line.node = "greenhouse";
+        line.device_class = "temperature";
+        line.state_class = "measurement";
+        line.object_id = "air_temperature";
+        line.unit = "°C";
+        line.value = "21.38";
+        line.icon = "mdi:thermometer";
+        line.version = "2024.6.0";
+        line.board = "esp32dev";
+        line.kind = "sensor";
+        return line;
+    }
+
+    static void check_same(const SensorLine &a, const SensorLine &b)
+    {
+        CHECK_STR(a.node, b.node);
+        CHECK_STR(a.device_class, b.device_class);
+        CHECK_STR(a.state_class, b.state_class);
+        CHECK_STR(a.object_id, b.object_id);
+        CHECK_STR(a.unit, b.unit);
+        CHECK_STR(a.value, b.value);
+        CHECK_STR(a.icon, b.icon);
+        CHECK_STR(a.version, b.version);
+        CHECK_STR(a.board, b.board);
+        CHECK_STR(a.kind, b.kind);
+    }
+
+    // encodes, decodes the result and checks that every field came back
+    template <typename Codec> static void round_trip(const SensorLine &line, SensorLine *decoded, char *buf, size_t size)
+    {
+        std::string encoded;
+        CHECK(Codec::encode(line, encoded));
+        CHECK(encoded.size() < size);
+        memcpy(buf, encoded.c_str(), encoded.size() + 1);
+        CHECK(Codec::decode(buf, decoded));
+        check_same(line, *decoded);
+    }
+
+    template <typename Codec> static bool decodes(const char *text, SensorLine *line = nullptr)
+    {
+        char buf[2048];
+        snprintf(buf, sizeof(buf), "%s", text);
+        SensorLine scratch;
+        return Codec::decode(buf, line != nullptr ? line : &scratch);
+    }
+
+    static void test_round_trip()
+    {
+        current = "round trip";
+        char buf[LoRaTransport::MAX_LINE + 1];
+        SensorLine decoded;
+        round_trip<LoRaCodec>(temperature(), &decoded, buf, sizeof(buf));
+        CHECK(decoded.stamp == nullptr);
+        CHECK(decoded.seq == nullptr);
+        CHECK(!decoded.is_binary());
+        CHECK_STR(decoded.type(), "sensor");
+
+        SensorLine door;
+        door.node = "shed";
+        door.device_class = "door";
+        door.state_class = "binary_sensor";
+        door.object_id = "shed_door";
+        door.value = "ON";
+        SensorLine decoded_door;
+        round_trip<LoRaCodec>(door, &decoded_door, buf, sizeof(buf));
+        CHECK(decoded_door.is_binary());
+        CHECK_STR(decoded_door.type(), "binary_sensor");
+
+        // a text sensor leaves the classes, the unit and the kind empty
+        SensorLine text;
+        text.node = "shed";
+        text.object_id = "status";
+        text.value = "idle";
+        SensorLine decoded_text;
+        round_trip<LoRaCodec>(text, &decoded_text, buf, sizeof(buf));
+        CHECK_STR(decoded_text.kind, "");
+
+        char now_buf[NowTransport::MAX_LINE + 1];
+        round_trip<NowCodec>(temperature(), &decoded, now_buf, sizeof(now_buf));
+    }
+
+    static void test_icon()
+    {
+        current = "icon";
+        char buf[LoRaTransport::MAX_LINE + 1];
+        SensorLine decoded;
+        round_trip<LoRaCodec>(temperature(), &decoded, buf, sizeof(buf));
+        // split at its own colon on the way in, one token again on the way out
+        CHECK_STR(decoded.icon, "mdi:thermometer");
+        CHECK_STR(decoded.version, "2024.6.0");
+
+        SensorLine line = temperature();
+        line.icon = "";
+        std::string encoded;
+        CHECK(LoRaCodec::encode(line, encoded));
+        // both icon tokens are there, empty
+        CHECK(encoded.find(":21.38:::2024.6.0:") != std::string::npos);
+        round_trip<LoRaCodec>(line, &decoded, buf, sizeof(buf));
+        CHECK_STR(decoded.icon, "");
+
+        // the rejoined icon leaves the fields after it alone
+        CHECK(decodes<LoRaCodec>("n:dc:sc:oid:u:1:mdi:water:v:b:k", &decoded));
+        CHECK_STR(decoded.icon, "mdi:water");
+        CHECK_STR(decoded.version, "v");
+        CHECK_STR(decoded.kind, "k");
+    }
+
+    static void test_seq()
+    {
+        current = "seq";
+        char buf[LoRaTransport::MAX_LINE + 1];
+        SensorLine line = temperature();
+        line.seq = "7f";
+        SensorLine decoded;
+        round_trip<LoRaCodec>(line, &decoded, buf, sizeof(buf));
+        CHECK(decoded.seq != nullptr);
+        CHECK_STR(decoded.seq, "7f");
+
+        // ESP-NOW has no ACKs: seq isn't encoded, and a 12th token isn't a line
+        std::string encoded;
+        CHECK(NowCodec::encode(line, encoded));
+        CHECK(encoded.find("7f") == std::string::npos);
+        CHECK(LoRaCodec::encode(line, encoded));
+        CHECK(!decodes<NowCodec>(encoded.c_str()));
+        CHECK(decodes<LoRaCodec>(encoded.c_str()));
+
+        // the trailing colon without a seq is the 11 token line
+        CHECK(decodes<LoRaCodec>("n:dc:sc:oid:u:1:::v:b:k:", &decoded));
+        CHECK(decoded.seq == nullptr);
+        CHECK_STR(decoded.kind, "k");
+    }
+
+    static void test_stamp()
+    {
+        current = "stamp";
+        char buf[LoRaTransport::MAX_LINE + 1];
+        SensorLine line = temperature();
+        char stamp[3] = {timestamp_char(1), timestamp_char(42), 0};
+        line.stamp = stamp;
+        SensorLine decoded;
+        round_trip<LoRaCodec>(line, &decoded, buf, sizeof(buf));
+        CHECK(decoded.stamp != nullptr);
+        CHECK_STR(decoded.stamp, stamp);
+
+        // ESP-NOW bridges don't take timestamps, so nodes don't send them
+        std::string encoded;
+        CHECK(NowCodec::encode(line, encoded));
+        CHECK(encoded.find(TIMESTAMP_MARK) == std::string::npos);
+    }
+
+    static void test_malformed()
+    {
+        current = "malformed";
+        CHECK(!decodes<LoRaCodec>(""));
+        CHECK(!decodes<LoRaCodec>("hello"));
+        CHECK(!decodes<LoRaCodec>("n:dc:sc:oid:u:1:::v:b"));
+        // 13 tokens: one more than a line with a seq
+        CHECK(!decodes<LoRaCodec>("n:dc:sc:oid:u:1:::v:b:k:01:x"));
+        // far more tokens than a line has room for
+        CHECK(!decodes<LoRaCodec>("a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:p:q:r:s:t"));
+        CHECK(!decodes<NowCodec>("a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:p:q:r:s:t"));
+        // an icon without its colon is a token short
+        CHECK(!decodes<LoRaCodec>("n:dc:sc:oid:u:1:thermometer:v:b:k"));
+
+        // too long for the transport: encoded anyway, but refused
+        SensorLine line = temperature();
+        std::string name(LoRaTransport::MAX_LINE, 'x');
+        line.object_id = name.c_str();
+        std::string encoded;
+        CHECK(!LoRaCodec::encode(line, encoded));
+        CHECK(encoded.size() > LoRaTransport::MAX_LINE);
+        // which ESP-NOW has room for
+        CHECK(NowCodec::encode(line, encoded));
+    }
+} // namespace codec_test
+
+int main()
+{
+    using namespace codec_test;
+    test_round_trip();
+    test_icon();
+    test_seq();
+    test_stamp();
+    test_malformed();
+    printf("codec_test: %d checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Host stand-in for the part of ArduinoJson the discovery builders use: string members
+// on the document and on one nested object. Good enough to size the configs a bridge
+// would publish.
+#include <cstddef>
+#include <string>
+
+class JsonObject;
+
+class JsonDocument
+{
+public:
+    class Member
+    {
+    public:
+        Member(JsonDocument *doc, const char *key, bool nested) : doc_(doc), key_(key), nested_(nested) {}
+        Member &operator=(const char *value)
+        {
+            std::string &out = this->nested_ ? this->doc_->nested_ : this->doc_->members_;
+            if (!out.empty())
+                out += ',';
+            out += '"';
+            out += this->key_;
+            out += "\":\"";
+            out += value;
+            out += '"';
+            return *this;
+        }
+        Member &operator=(const std::string &value) { return *this = value.c_str(); }
+        // only the one nested object is supported, which is all add_device() needs
+        template <typename T> T to()
+        {
+            this->doc_->nested_key_ = this->key_;
+            return T(this->doc_);
+        }
+
+    protected:
+        JsonDocument *doc_;
+        const char *key_;
+        bool nested_;
+    };
+
+    Member operator[](const char *key) { return Member(this, key, false); }
+    void clear()
+    {
+        this->members_.clear();
+        this->nested_.clear();
+        this->nested_key_ = nullptr;
+    }
+
+protected:
+    friend class JsonObject;
+    friend size_t serializeJson(const JsonDocument &doc, std::string &out);
+    std::string members_;
+    std::string nested_;
+    const char *nested_key_{nullptr};
+};
+
+class JsonObject
+{
+public:
+    explicit JsonObject(JsonDocument *doc) : doc_(doc) {}
+    JsonDocument::Member operator[](const char *key) { return JsonDocument::Member(this->doc_, key, true); }
+
+protected:
+    JsonDocument *doc_;
+};
+
+template <size_t N> using StaticJsonDocument = JsonDocument;
+
+inline size_t serializeJson(const JsonDocument &doc, std::string &out)
+{
+    out = '{';
+    out += doc.members_;
+    if (doc.nested_key_ != nullptr)
+    {
+        if (!doc.members_.empty())
+            out += ',';
+        out += '"';
+        out += doc.nested_key_;
+        out += "\":{";
+        out += doc.nested_;
+        out += '}';
+    }
+    out += '}';
+    return out.size();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+// Host stand-in for the Arduino LittleFS API the bridge's journal uses, on a directory
+// of the host filesystem (lora_host::littlefs_root). Paths are taken as they are below
+// it. Timings measure the code around the filesystem, not flash.
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lora_host
+{
+    extern std::string littlefs_root;
+} // namespace lora_host
+
+class File
+{
+public:
+    File() = default;
+    File(FILE *file, const std::string &name) : file_(file), name_(name) {}
+    File(DIR *dir, const std::string &path, const std::string &name) : dir_(dir), path_(path), name_(name) {}
+    File(File &&other) noexcept { *this = std::move(other); }
+    File &operator=(File &&other) noexcept
+    {
+        if (this != &other)
+        {
+            this->close();
+            this->file_ = other.file_;
+            this->dir_ = other.dir_;
+            this->path_ = std::move(other.path_);
+            this->name_ = std::move(other.name_);
+            other.file_ = nullptr;
+            other.dir_ = nullptr;
+        }
+        return *this;
+    }
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+    ~File() { this->close(); }
+
+    explicit operator bool() const { return this->file_ != nullptr || this->dir_ != nullptr; }
+    bool isDirectory() const { return this->dir_ != nullptr; }
+    const char *name() const { return this->name_.c_str(); }
+
+    File openNextFile()
+    {
+        if (this->dir_ == nullptr)
+            return File();
+        while (struct dirent *entry = readdir(this->dir_))
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+            FILE *file = fopen((this->path_ + "/" + entry->d_name).c_str(), "rb");
+            if (file != nullptr)
+                return File(file, entry->d_name);
+        }
+        return File();
+    }
+
+    size_t write(const uint8_t *data, size_t len) { return this->file_ != nullptr ? fwrite(data, 1, len, this->file_) : 0; }
+    size_t read(uint8_t *data, size_t len) { return this->file_ != nullptr ? fread(data, 1, len, this->file_) : 0; }
+    bool seek(uint32_t offset) { return this->file_ != nullptr && fseek(this->file_, offset, SEEK_SET) == 0; }
+    size_t size() const
+    {
+        struct stat st;
+        return this->file_ != nullptr && fstat(fileno(this->file_), &st) == 0 ? st.st_size : 0;
+    }
+
+    void close()
+    {
+        if (this->file_ != nullptr)
+            fclose(this->file_);
+        if (this->dir_ != nullptr)
+            closedir(this->dir_);
+        this->file_ = nullptr;
+        this->dir_ = nullptr;
+    }
+
+private:
+    FILE *file_{nullptr};
+    DIR *dir_{nullptr};
+    std::string path_;
+    std::string name_;
+};
+
+class HostLittleFS
+{
+public:
+    bool begin(bool format_on_fail)
+    {
+        (void)format_on_fail;
+        ::mkdir(lora_host::littlefs_root.c_str(), 0755);
+        struct stat st;
+        return stat(lora_host::littlefs_root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    bool exists(const char *path) const
+    {
+        struct stat st;
+        return stat(host_path(path).c_str(), &st) == 0;
+    }
+    bool mkdir(const char *path) { return ::mkdir(host_path(path).c_str(), 0755) == 0; }
+    bool remove(const char *path) { return ::unlink(host_path(path).c_str()) == 0; }
+
+    // mode "r", "w" or "a"; a directory opens for openNextFile()
+    File open(const char *path, const char *mode = "r")
+    {
+        std::string full = host_path(path);
+        struct stat st;
+        if (stat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            DIR *dir = opendir(full.c_str());
+            return dir != nullptr ? File(dir, full, path) : File();
+        }
+        std::string host_mode = std::string(mode) + "b";
+        FILE *file = fopen(full.c_str(), host_mode.c_str());
+        return file != nullptr ? File(file, path) : File();
+    }
+
+private:
+    static std::string host_path(const char *path) { return lora_host::littlefs_root + path; }
+};
+
+inline HostLittleFS LittleFS;
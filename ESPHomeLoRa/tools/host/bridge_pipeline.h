@@ -0,0 +1,323 @@
+#pragma once
+
+// Host build of the lora_mqtt_bridge receive path, handle_packet() and what it calls,
+// for the tools that feed it frames: lora_sim from its virtual radio, lora_replay from
+// a capture. It takes the component's steps with the same frame_codec code and entity
+// table; the broker and the ACK transmitter are callbacks.
+//
+// Sealed frames need mbedtls to open and are only counted. The bridge captures frames
+// it could open in the clear (CAPTURE_UNSEALED), so a capture replays without the keys.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include "esphome/components/frame_codec/entity_table.h"
+#include "esphome/components/frame_codec/frame_codec.h"
+#include "esphome/components/frame_codec/text_dictionary.h"
+
+namespace lora_host
+{
+    using namespace esphome::frame_codec;
+
+    // FRAME_SEALED and SEALED_OVERHEAD; frame_crypto.h itself needs mbedtls
+    static const uint8_t HOST_FRAME_SEALED = 0xC0;
+    static const size_t HOST_SEALED_OVERHEAD = 8;
+
+    enum PacketResult
+    {
+        PACKET_PUBLISHED,
+        PACKET_DROPPED, // malformed, or topics too long
+        PACKET_SEALED,  // not opened on the host
+    };
+
+    struct PipelineStats
+    {
+        uint32_t lines{0};
+        uint32_t catchups{0};
+        uint32_t texts{0};
+        uint32_t sealed{0};
+        uint32_t dropped{0};
+        uint32_t acks{0};
+        uint32_t publishes{0};
+        uint32_t discovery{0};
+        uint64_t publish_bytes{0};
+    };
+
+    class BridgePipeline
+    {
+    public:
+        // topic and payload are only valid during the call
+        using PublishFn = std::function<void(const char *topic, const char *payload, size_t len)>;
+        using AckFn = std::function<void(const char *node, uint8_t seq)>;
+
+        void on_publish(PublishFn &&publish) { this->publish_ = std::move(publish); }
+        void on_ack(AckFn &&ack) { this->ack_ = std::move(ack); }
+
+        // wall_time is unix time, 0 while the bridge has none; now_ms its millis()
+        PacketResult handle(const uint8_t *frame, size_t len, int rssi, uint32_t wall_time, uint32_t now_ms)
+        {
+            if (len == 0)
+            {
+                this->stats_.dropped++;
+                return PACKET_DROPPED;
+            }
+            if (len > HOST_SEALED_OVERHEAD && (frame[0] & 0xF0) == HOST_FRAME_SEALED)
+            {
+                this->stats_.sealed++;
+                return PACKET_SEALED;
+            }
+            this->wall_time_ = wall_time;
+            this->now_ms_ = now_ms;
+            bool ok;
+            if (frame[0] == FRAME_TEXT)
+            {
+                this->stats_.texts++;
+                ok = this->process_text(frame, len);
+            }
+            else if (frame[0] == FRAME_CATCHUP)
+            {
+                this->stats_.catchups++;
+                ok = this->process_catchup(frame, len, false);
+                if (ok)
+                {
+                    char node[65];
+                    memcpy(node, frame + 3, frame[2]);
+                    node[frame[2]] = 0;
+                    this->send_ack(node, frame[1]);
+                    this->process_catchup(frame, len, true);
+                }
+            }
+            else
+            {
+                this->stats_.lines++;
+                ok = this->process_line(frame, len, rssi);
+            }
+            if (!ok)
+                this->stats_.dropped++;
+            return ok ? PACKET_PUBLISHED : PACKET_DROPPED;
+        }
+
+        const PipelineStats &stats() const { return this->stats_; }
+        const EntityTable &entities() const { return this->entities_; }
+
+    protected:
+        bool process_line(const uint8_t *frame, size_t len, int rssi)
+        {
+            // the bridge decodes from its NUL terminated receive buffer
+            char received_string[257];
+            memcpy(received_string, frame, len);
+            received_string[len] = 0;
+            SensorLine line;
+            if (!LoRaCodec::decode(received_string, &line))
+                return false;
+            if (line.seq != nullptr)
+                this->send_ack(line.node, strtoul(line.seq, nullptr, 16));
+            uint32_t sample_time = line.stamp != nullptr ? this->resolve_timestamp(line.stamp) : 0;
+
+            EntityTable::Entity *entity = this->intern(line.type(), line.node, line.object_id);
+            if (entity == nullptr)
+                return false;
+            if (this->entities_.needs_discovery(entity, LoRaCodec::discovery_hash(line, line.node, sample_time != 0), this->now_ms_))
+            {
+                LoRaCodec::build_discovery(line, line.node, sample_time != 0, this->doc_);
+                this->publish_config(entity);
+            }
+            this->publish(this->entities_.state_topic(entity), line.value, strlen(line.value));
+            if (sample_time != 0)
+            {
+                char topic[250];
+                char payload[64];
+                snprintf(topic, sizeof(topic), "%s/%s/%s/attributes", line.node, line.type(), line.object_id);
+                int payload_len = snprintf(payload, sizeof(payload), "{\"sample_time\":%lu,\"delay\":%ld}", (unsigned long)sample_time,
+                                           (long)(this->wall_time_ - sample_time));
+                this->publish(topic, payload, payload_len);
+            }
+
+            entity = this->intern("sensor", line.node, "rssi");
+            if (entity == nullptr)
+                return true;
+            if (this->entities_.needs_discovery(entity, LoRaCodec::rssi_discovery_hash(line, line.node), this->now_ms_))
+            {
+                LoRaCodec::build_rssi_discovery(line, line.node, this->doc_);
+                this->publish_config(entity);
+            }
+            char rssi_s[8];
+            this->publish(this->entities_.state_topic(entity), rssi_s, snprintf(rssi_s, sizeof(rssi_s), "%d", rssi));
+            return true;
+        }
+
+        bool process_catchup(const uint8_t *frame, size_t len, bool publish)
+        {
+            if (len < 4 || frame[2] == 0 || frame[2] > 64 || 3u + frame[2] > len)
+                return false;
+            char node[65];
+            memcpy(node, frame + 3, frame[2]);
+            node[frame[2]] = 0;
+            size_t pos = 3 + frame[2];
+
+            uint32_t samples = 0;
+            while (pos < len)
+            {
+                if (pos + 2 > len)
+                    return false;
+                uint8_t flags = frame[pos++];
+                if ((flags & ENTITY_PACKED) && (flags & ENTITY_ACCURACY) > MAX_ACCURACY)
+                    return false;
+                uint8_t object_len = frame[pos++];
+                if (object_len == 0 || object_len > 64 || pos + object_len + 1 > len)
+                    return false;
+                char object_id[65];
+                memcpy(object_id, frame + pos, object_len);
+                object_id[object_len] = 0;
+                pos += object_len;
+                uint8_t count = frame[pos++];
+
+                char topic[250];
+                snprintf(topic, sizeof(topic), (flags & ENTITY_BINARY) ? "%s/binary_sensor/%s/history" : "%s/sensor/%s/history", node,
+                         object_id);
+                SeriesDecoder decoder;
+                for (uint8_t i = 0; i < count; i++)
+                {
+                    uint32_t age;
+                    float value;
+                    if (flags & ENTITY_PACKED)
+                    {
+                        int32_t time, quantized;
+                        size_t n = decoder.decode(frame + pos, len - pos, &time, &quantized);
+                        if (n == 0 || !valid_sample_time(time))
+                            return false;
+                        pos += n;
+                        age = -time;
+                        value = dequantize_value(quantized, flags & ENTITY_ACCURACY);
+                    }
+                    else
+                    {
+                        size_t n = get_varint(frame + pos, len - pos, &age);
+                        if (n == 0 || pos + n + sizeof(float) > len)
+                            return false;
+                        pos += n;
+                        memcpy(&value, frame + pos, sizeof(float));
+                        pos += sizeof(float);
+                    }
+                    samples++;
+                    if (!publish)
+                        continue;
+
+                    char value_s[24];
+                    if (flags & ENTITY_BINARY)
+                        strcpy(value_s, value != 0.0f ? "ON" : "OFF");
+                    else
+                        snprintf(value_s, sizeof(value_s), "%.*f", flags & ENTITY_ACCURACY, value);
+                    char payload[96];
+                    int payload_len;
+                    if (this->wall_time_ != 0)
+                        payload_len = snprintf(payload, sizeof(payload), "{\"ts\":%lu,\"value\":\"%s\"}",
+                                               (unsigned long)(this->wall_time_ - age), value_s);
+                    else
+                        payload_len = snprintf(payload, sizeof(payload), "{\"age\":%lu,\"value\":\"%s\"}", (unsigned long)age, value_s);
+                    this->publish(topic, payload, payload_len);
+                }
+            }
+            return samples != 0;
+        }
+
+        bool process_text(const uint8_t *frame, size_t len)
+        {
+            size_t pos = 1;
+            char node[65];
+            char object_id[65];
+            for (char *name : {node, object_id})
+            {
+                if (pos >= len || frame[pos] == 0 || frame[pos] > 64 || pos + 1 + frame[pos] > len)
+                    return false;
+                memcpy(name, frame + pos + 1, frame[pos]);
+                name[frame[pos]] = 0;
+                pos += 1 + frame[pos];
+            }
+
+            std::string key = node;
+            key += '/';
+            key += object_id;
+            std::string value;
+            bool carries_text;
+            if (this->text_dictionaries_.get(key).decode(frame + pos, len - pos, value, &carries_text) == 0)
+                return false;
+
+            SensorLine line;
+            line.node = node;
+            line.object_id = object_id;
+            line.value = value.c_str();
+            line.version = "";
+            line.board = "";
+            EntityTable::Entity *entity = this->intern(line.type(), line.node, line.object_id);
+            if (entity == nullptr)
+                return false;
+            if (this->entities_.needs_discovery(entity, LoRaCodec::discovery_hash(line, line.node, false), this->now_ms_))
+            {
+                LoRaCodec::build_discovery(line, line.node, false, this->doc_);
+                this->publish_config(entity);
+            }
+            this->publish(this->entities_.state_topic(entity), line.value, strlen(line.value));
+            return true;
+        }
+
+        uint32_t resolve_timestamp(const char *stamp) const
+        {
+            int high = timestamp_value(stamp[0]);
+            int low = high < 0 ? -1 : timestamp_value(stamp[1]);
+            uint32_t now = this->wall_time_;
+            if (low < 0 || stamp[2] != 0 || now == 0)
+                return 0;
+            uint32_t stamp_value = (high << 6) | low;
+            uint32_t sample_time = now - now % TIMESTAMP_MODULO + stamp_value;
+            if (sample_time > now + 60)
+                sample_time -= TIMESTAMP_MODULO;
+            return sample_time;
+        }
+
+        EntityTable::Entity *intern(const char *type, const char *node, const char *object_id)
+        {
+            EntityTable::Entity *entity = this->entities_.find(type, node, object_id);
+            if (entity != nullptr)
+                return entity;
+            return this->entities_.add(type, node, object_id, "homeassistant");
+        }
+
+        void publish_config(EntityTable::Entity *entity)
+        {
+            this->json_.clear();
+            serializeJson(this->doc_, this->json_);
+            this->doc_.clear();
+            this->stats_.discovery++;
+            this->publish(this->entities_.config_topic(entity), this->json_.c_str(), this->json_.size());
+        }
+
+        void publish(const char *topic, const char *payload, size_t len)
+        {
+            this->stats_.publishes++;
+            this->stats_.publish_bytes += strlen(topic) + len;
+            if (this->publish_)
+                this->publish_(topic, payload, len);
+        }
+
+        void send_ack(const char *node, uint8_t seq)
+        {
+            this->stats_.acks++;
+            if (this->ack_)
+                this->ack_(node, seq);
+        }
+
+        EntityTable entities_;
+        // per "node/object_id", as on the bridge
+        TextDictionaryTable text_dictionaries_;
+        JsonDocument doc_;
+        std::string json_;
+        PublishFn publish_;
+        AckFn ack_;
+        uint32_t wall_time_{0};
+        uint32_t now_ms_{0};
+        PipelineStats stats_;
+    };
+} // namespace lora_host
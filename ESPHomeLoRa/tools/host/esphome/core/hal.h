@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in: millis() and micros() from the monotonic clock, since the tool started
+#include <chrono>
+#include <cstdint>
+
+namespace esphome
+{
+    inline uint64_t host_elapsed_us()
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    inline uint32_t millis() { return (uint32_t)(host_elapsed_us() / 1000); }
+    inline uint32_t micros() { return (uint32_t)host_elapsed_us(); }
+} // namespace esphome
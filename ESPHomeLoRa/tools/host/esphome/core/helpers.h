@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in: frame_codec only needs the ESPHome helpers when it encodes from
+// sensor objects, which the host tools don't, and parse_hex() for the keys of sealed
+// frames.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace esphome
+{
+    // true if str is exactly length bytes of hex digits
+    inline bool parse_hex(const std::string &str, uint8_t *data, size_t length)
+    {
+        if (str.size() != length * 2)
+            return false;
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            char c = str[i];
+            uint8_t nibble;
+            if (c >= '0' && c <= '9')
+                nibble = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                nibble = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                nibble = c - 'A' + 10;
+            else
+                return false;
+            data[i / 2] = (i % 2 == 0) ? nibble << 4 : (data[i / 2] | nibble);
+        }
+        return true;
+    }
+} // namespace esphome
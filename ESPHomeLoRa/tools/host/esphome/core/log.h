@@ -0,0 +1,29 @@
+#pragma once
+
+// Host stand-in for the ESPHome logger: everything but verbose output is printed when
+// a tool runs with --verbose.
+#include <cstdarg>
+#include <cstdio>
+
+namespace lora_host
+{
+    extern bool verbose;
+
+    inline void log(const char *level, const char *tag, const char *format, ...)
+    {
+        if (!verbose)
+            return;
+        va_list args;
+        va_start(args, format);
+        printf("[%s][%s] ", level, tag);
+        vprintf(format, args);
+        putchar('\n');
+        va_end(args);
+    }
+} // namespace lora_host
+
+#define ESP_LOGE(tag, ...) lora_host::log("E", tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) lora_host::log("W", tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) lora_host::log("I", tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) lora_host::log("D", tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ((void)0)
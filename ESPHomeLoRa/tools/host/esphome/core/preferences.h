@@ -0,0 +1,58 @@
+#pragma once
+
+// Host stand-in: preferences kept in memory for as long as the tool runs
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace esphome
+{
+    class ESPPreferenceObject
+    {
+    public:
+        ESPPreferenceObject() = default;
+        explicit ESPPreferenceObject(std::vector<uint8_t> *data) : data_(data) {}
+
+        template <typename T> bool save(const T *src)
+        {
+            if (this->data_ == nullptr)
+                return false;
+            this->data_->assign((const uint8_t *)src, (const uint8_t *)src + sizeof(T));
+            return true;
+        }
+        template <typename T> bool load(T *dest)
+        {
+            if (this->data_ == nullptr || this->data_->size() != sizeof(T))
+                return false;
+            memcpy((void *)dest, this->data_->data(), sizeof(T));
+            return true;
+        }
+
+    protected:
+        std::vector<uint8_t> *data_{nullptr};
+    };
+
+    class ESPPreferences
+    {
+    public:
+        template <typename T> ESPPreferenceObject make_preference(uint32_t type, bool in_flash = false)
+        {
+            (void)in_flash;
+            return ESPPreferenceObject(&this->store_[type]);
+        }
+        bool sync()
+        {
+            this->syncs_++;
+            return true;
+        }
+        uint32_t syncs() const { return this->syncs_; }
+
+    protected:
+        std::map<uint32_t, std::vector<uint8_t>> store_;
+        uint32_t syncs_{0};
+    };
+
+    inline ESPPreferences host_preferences;
+    inline ESPPreferences *global_preferences = &host_preferences;
+} // namespace esphome
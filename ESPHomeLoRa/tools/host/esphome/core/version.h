@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in with the strings a typical node puts in its lines
+#define ESPHOME_VERSION "2025.10.0"
+#define ESPHOME_BOARD "seeed_xiao_esp32s3"
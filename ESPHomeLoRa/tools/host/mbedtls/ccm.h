@@ -0,0 +1,34 @@
+#pragma once
+
+// Host stand-in for when only the mbedTLS library is installed, not its headers
+// (libmbedcrypto.so.7 without libmbedtls-dev): declares the CCM calls frame_crypto.h
+// makes, as mbedTLS 2.28 and 3.x define them. The context is opaque here and sized
+// well above the real one, since only the library looks inside it.
+#if __has_include_next(<mbedtls/ccm.h>)
+#include_next <mbedtls/ccm.h>
+#else
+#include <cstddef>
+
+extern "C"
+{
+    typedef struct mbedtls_ccm_context
+    {
+        alignas(16) unsigned char opaque[512];
+    } mbedtls_ccm_context;
+
+    typedef enum
+    {
+        MBEDTLS_CIPHER_ID_AES = 2,
+    } mbedtls_cipher_id_t;
+
+    void mbedtls_ccm_init(mbedtls_ccm_context *ctx);
+    int mbedtls_ccm_setkey(mbedtls_ccm_context *ctx, mbedtls_cipher_id_t cipher, const unsigned char *key, unsigned int keybits);
+    void mbedtls_ccm_free(mbedtls_ccm_context *ctx);
+    int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context *ctx, size_t length, const unsigned char *iv, size_t iv_len,
+                                    const unsigned char *ad, size_t ad_len, const unsigned char *input, unsigned char *output,
+                                    unsigned char *tag, size_t tag_len);
+    int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length, const unsigned char *iv, size_t iv_len,
+                                 const unsigned char *ad, size_t ad_len, const unsigned char *input, unsigned char *output,
+                                 const unsigned char *tag, size_t tag_len);
+}
+#endif
@@ -0,0 +1,178 @@
+// Host benchmark of the bridge's uplink journal (UplinkJournal): journals a broker
+// outage worth of state publishes, then replays them in the bridge's batches of 8 and
+// checks every record comes back once and in order. Reports records and KiB per second
+// for both, and the journal's own page write figures. LittleFS is a directory of the
+// host filesystem here (../host/LittleFS.h). See README.md.
+//
+//   g++ -O2 -std=gnu++17 -I../host -I../.. journal_bench.cpp ../../esphome/components/lora_mqtt_bridge/uplink_journal.cpp -o journal_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <LittleFS.h>
+#include "esphome/components/lora_mqtt_bridge/uplink_journal.h"
+
+namespace lora_host
+{
+    bool verbose = false;
+    std::string littlefs_root;
+} // namespace lora_host
+
+namespace journal_bench
+{
+    using esphome::lora_mqtt_bridge::UplinkJournal;
+    using Clock = std::chrono::steady_clock;
+
+    // as in the bridge's loop()
+    static const size_t REPLAY_BATCH = 8;
+
+    struct Options
+    {
+        uint32_t records{2000};
+        uint32_t nodes{50};
+        uint32_t journal_size{131072};
+        const char *dir{nullptr};
+    };
+
+    // what the bridge journals: a node's sensor state, as the decoded line gives it
+    static void make_record(uint32_t i, const Options &options, char *topic, size_t topic_len, char *payload, size_t payload_len)
+    {
+        snprintf(topic, topic_len, "lora_node_%02u/sensor/temperature/state", (unsigned)(i % options.nodes));
+        snprintf(payload, payload_len, "%u.%u", (unsigned)(15 + i % 13), (unsigned)(i % 10));
+    }
+
+    static double seconds_since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    static void usage(const char *argv0)
+    {
+        fprintf(stderr, "usage: %s [--records N] [--nodes N] [--journal-size BYTES] [--dir DIR]\n", argv0);
+        exit(2);
+    }
+
+    static Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+            const char *arg = argv[i];
+            if (i + 1 >= argc)
+                usage(argv[0]);
+            const char *value = argv[++i];
+            if (!strcmp(arg, "--records"))
+                options.records = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--nodes"))
+                options.nodes = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--journal-size"))
+                options.journal_size = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--dir"))
+                options.dir = value;
+            else
+                usage(argv[0]);
+        }
+        if (options.records == 0 || options.nodes == 0)
+            usage(argv[0]);
+        return options;
+    }
+} // namespace journal_bench
+
+int main(int argc, char **argv)
+{
+    using namespace journal_bench;
+    Options options = parse_options(argc, argv);
+
+    char temp_dir[] = "/tmp/journal_bench.XXXXXX";
+    if (options.dir != nullptr)
+        lora_host::littlefs_root = options.dir;
+    else if (mkdtemp(temp_dir) != nullptr)
+        lora_host::littlefs_root = temp_dir;
+    else
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    UplinkJournal journal;
+    if (!journal.begin(options.journal_size))
+    {
+        fprintf(stderr, "Could not start the journal in %s\n", lora_host::littlefs_root.c_str());
+        return 1;
+    }
+    if (!journal.empty())
+    {
+        fprintf(stderr, "%s holds a journal from an earlier run\n", lora_host::littlefs_root.c_str());
+        return 1;
+    }
+
+    char topic[UplinkJournal::MAX_TOPIC + 1];
+    char payload[UplinkJournal::MAX_PAYLOAD + 1];
+    uint64_t bytes = 0;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < options.records; i++)
+    {
+        make_record(i, options, topic, sizeof(topic), payload, sizeof(payload));
+        size_t len = strlen(payload);
+        if (!journal.append(topic, payload, len, false))
+        {
+            fprintf(stderr, "FAIL: record %u was not journaled\n", (unsigned)i);
+            return 1;
+        }
+        bytes += strlen(topic) + len;
+    }
+    journal.flush();
+    double append_s = seconds_since(start);
+
+    // the oldest records are gone if the outage outgrew the journal
+    uint32_t next = journal.dropped();
+    uint32_t replayed = 0;
+    uint64_t replayed_bytes = 0;
+    bool in_order = true;
+    start = Clock::now();
+    while (!journal.empty())
+    {
+        size_t published = journal.replay([&](const char *topic_in, const char *payload_in, size_t len, bool retain)
+                                          {
+                                              make_record(next++, options, topic, sizeof(topic), payload, sizeof(payload));
+                                              if (strcmp(topic_in, topic) != 0 || len != strlen(payload) ||
+                                                  memcmp(payload_in, payload, len) != 0 || retain)
+                                                  in_order = false;
+                                              replayed_bytes += strlen(topic_in) + len;
+                                              return true;
+                                          },
+                                          REPLAY_BATCH);
+        if (published == 0)
+            break;
+        replayed += published;
+    }
+    double replay_s = seconds_since(start);
+
+    printf("Uplink journal, %u records from %u nodes, %u byte budget, in %s\n", (unsigned)options.records,
+           (unsigned)options.nodes, (unsigned)options.journal_size, lora_host::littlefs_root.c_str());
+    printf("%-8s %10s %12s %10s\n", "phase", "records", "records/s", "KiB/s");
+    printf("%-8s %10u %12.0f %10.0f\n", "append", (unsigned)options.records, options.records / append_s, bytes / 1024.0 / append_s);
+    printf("%-8s %10u %12.0f %10.0f\n", "replay", (unsigned)replayed, replayed / replay_s, replayed_bytes / 1024.0 / replay_s);
+    // the page writes alone, as the bridge logs them
+    lora_host::verbose = true;
+    journal.log_stats("journal_bench");
+    lora_host::verbose = false;
+
+    if (options.dir == nullptr)
+    {
+        rmdir((lora_host::littlefs_root + "/journal").c_str());
+        rmdir(lora_host::littlefs_root.c_str());
+    }
+
+    uint32_t expected = options.records - journal.dropped();
+    if (!in_order || replayed != expected || next != options.records)
+    {
+        fprintf(stderr, "FAIL: replayed %u of %u records%s\n", (unsigned)replayed, (unsigned)expected,
+                in_order ? "" : ", not in order");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+// Replays a frame capture from lora_mqtt_bridge (its capture option, see
+// frame_codec/frame_capture.h) through the host build of the bridge's receive path,
+// host/bridge_pipeline.h. Reproduces what a field bridge did with the frames it got and
+// benchmarks the pipeline on real traffic. See README.md.
+//
+//   g++ -O2 -std=gnu++17 -I../host -I../.. lora_replay.cpp ../../esphome/components/metrics/metrics.cpp -o lora_replay
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bridge_pipeline.h"
+#include "esphome/components/frame_codec/frame_capture.h"
+#include "esphome/components/metrics/metrics.h"
+
+namespace lora_host
+{
+    bool verbose = false;
+} // namespace lora_host
+
+namespace lora_replay
+{
+    using namespace esphome::frame_codec;
+    using esphome::metrics::LatencyHistogram;
+    using lora_host::BridgePipeline;
+
+    static LatencyHistogram metric_handle_ns("handle_ns");
+
+    struct Options
+    {
+        const char *path{nullptr};
+        double speed{0.0}; // 0 = as fast as possible
+        uint32_t repeat{1};
+        bool print{false};
+    };
+
+    static int base64_value(char c)
+    {
+        if (c >= 'A' && c <= 'Z')
+            return c - 'A';
+        if (c >= 'a' && c <= 'z')
+            return c - 'a' + 26;
+        if (c >= '0' && c <= '9')
+            return c - '0' + 52;
+        if (c == '+')
+            return 62;
+        if (c == '/')
+            return 63;
+        return -1;
+    }
+
+    // decodes up to the first character that isn't base64; false if nothing was decoded
+    static bool base64_decode(const char *in, std::vector<uint8_t> &out)
+    {
+        uint32_t bits = 0;
+        int count = 0;
+        size_t start = out.size();
+        for (; base64_value(*in) >= 0; in++)
+        {
+            bits = bits << 6 | base64_value(*in);
+            count += 6;
+            if (count >= 8)
+            {
+                count -= 8;
+                out.push_back(bits >> count);
+            }
+        }
+        return out.size() != start;
+    }
+
+    // A binary capture (a file from the bridge or mosquitto_sub -N output) is used as is.
+    // Anything else is taken for a log with "CAP:" lines, whose records get a header of
+    // their own: the log doesn't say which modem settings were used.
+    static bool load(const char *path, std::vector<uint8_t> &capture)
+    {
+        FILE *file = fopen(path, "rb");
+        if (file == nullptr)
+        {
+            perror(path);
+            return false;
+        }
+        std::vector<uint8_t> data;
+        uint8_t buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) != 0)
+            data.insert(data.end(), buf, buf + n);
+        fclose(file);
+
+        if (data.size() >= CAPTURE_HEADER_SIZE && memcmp(data.data(), CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0)
+        {
+            capture.swap(data);
+            return true;
+        }
+        capture.resize(CAPTURE_HEADER_SIZE);
+        capture_put_header(capture.data(), CaptureHeader());
+        data.push_back(0);
+        for (const char *line = (const char *)data.data(); line != nullptr && *line != 0;)
+        {
+            const char *cap = strstr(line, "CAP:");
+            if (cap == nullptr)
+                break;
+            base64_decode(cap + 4, capture);
+            line = strchr(cap, '\n');
+        }
+        if (capture.size() == CAPTURE_HEADER_SIZE)
+        {
+            fprintf(stderr, "%s: neither a capture nor a log with CAP: lines\n", path);
+            return false;
+        }
+        return true;
+    }
+
+    static uint64_t record_us(const CaptureRecord &record) { return (uint64_t)record.time_s * 1000000 + record.time_us; }
+
+    static void usage()
+    {
+        fprintf(stderr, "usage: lora_replay [options] capture\n"
+                        "  --speed X     replay at X times the captured timing, 0 (default) as fast as possible\n"
+                        "  --repeat N    replay the capture N times, default 1\n"
+                        "  --print       print every publish\n"
+                        "  --verbose     log what the bridge code logs\n");
+    }
+
+    static bool parse(int argc, char **argv, Options &o)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--speed" && has_value)
+                o.speed = atof(argv[++i]);
+            else if (arg == "--repeat" && has_value)
+                o.repeat = strtoul(argv[++i], nullptr, 10);
+            else if (arg == "--print")
+                o.print = true;
+            else if (arg == "--verbose")
+                lora_host::verbose = true;
+            else if (arg[0] != '-' && o.path == nullptr)
+                o.path = argv[i];
+            else
+                return false;
+        }
+        return o.path != nullptr && o.speed >= 0 && o.repeat > 0;
+    }
+
+    static int run(const Options &o)
+    {
+        std::vector<uint8_t> capture;
+        if (!load(o.path, capture))
+            return 1;
+
+        BridgePipeline bridge;
+        if (o.print)
+            bridge.on_publish([](const char *topic, const char *payload, size_t len) { printf("%s %.*s\n", topic, (int)len, payload); });
+
+        uint32_t records = 0, captured_sealed = 0, wall_time = 0;
+        uint64_t bytes = 0;
+        uint64_t first_us = 0, last_us = 0;
+        bool truncated = false;
+        CaptureHeader header;
+        double handle_s = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t pass = 0; pass < o.repeat; pass++)
+        {
+            CaptureReader reader(capture.data(), capture.size());
+            CaptureRecord record;
+            auto pass_start = std::chrono::steady_clock::now();
+            uint64_t pass_first_us = 0;
+            bool first = true;
+            while (reader.next(&record))
+            {
+                uint64_t at_us = record_us(record);
+                if (first)
+                {
+                    pass_first_us = at_us;
+                    if (pass == 0)
+                        first_us = at_us;
+                    first = false;
+                }
+                if (pass == 0)
+                {
+                    last_us = at_us;
+                    records++;
+                    bytes += record.len;
+                    captured_sealed += (record.flags & CAPTURE_SEALED) != 0;
+                    wall_time += (record.flags & CAPTURE_WALL_TIME) != 0;
+                }
+                if (o.speed > 0 && at_us > pass_first_us)
+                    std::this_thread::sleep_until(pass_start + std::chrono::microseconds((int64_t)((at_us - pass_first_us) / o.speed)));
+
+                // the bridge's clocks as they were when the frame arrived
+                uint32_t now_wall = (record.flags & CAPTURE_WALL_TIME) ? record.time_s : 0;
+                uint32_t now_ms = (record.flags & CAPTURE_WALL_TIME) ? (uint32_t)((at_us - first_us) / 1000) : (uint32_t)(at_us / 1000);
+                auto t0 = std::chrono::steady_clock::now();
+                bridge.handle(record.frame, record.len, record.rssi, now_wall, now_ms);
+                auto t1 = std::chrono::steady_clock::now();
+                double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+                handle_s += ns / 1e9;
+                metric_handle_ns.record((uint32_t)ns);
+            }
+            truncated |= reader.truncated();
+            header = reader.header();
+        }
+        double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const lora_host::PipelineStats &stats = bridge.stats();
+        uint32_t handled = records * o.repeat;
+        if (header.sf != 0)
+            printf("Capture: SF%u BW%lu CR4/%u\n", header.sf, (unsigned long)header.bandwidth / 1000, header.coding);
+        else if (header.bandwidth != 0 && header.coding == 0)
+            printf("Capture: GFSK %lu kbps\n", (unsigned long)header.bandwidth / 1000);
+        else if (header.bandwidth != 0)
+            printf("Capture: FLRC %lu kbps, coding rate %s\n", (unsigned long)header.bandwidth / 1000,
+                   header.coding == 2 ? "1/2" : header.coding == 3 ? "3/4" : "1");
+        printf("Records: %lu, %llu frame bytes, %.1f s captured, %lu with wall time%s\n", (unsigned long)records,
+               (unsigned long long)bytes, (last_us - first_us) / 1e6, (unsigned long)wall_time, truncated ? ", truncated" : "");
+        printf("Frames: %lu line(s), %lu catch-up, %lu text, %lu sealed, %lu dropped\n", (unsigned long)stats.lines,
+               (unsigned long)stats.catchups, (unsigned long)stats.texts, (unsigned long)stats.sealed, (unsigned long)stats.dropped);
+        if (captured_sealed != 0)
+            printf("%lu sealed frame(s) per pass failed to open on the bridge too\n", (unsigned long)captured_sealed);
+        printf("Bridge: %lu publish(es), %llu bytes, %lu discovery config(s), %lu ACK(s)\n", (unsigned long)stats.publishes,
+               (unsigned long long)stats.publish_bytes, (unsigned long)stats.discovery, (unsigned long)stats.acks);
+        printf("Pipeline: %lu frame(s) in %.3f s (%.0f frames/s), %.3f s wall\n", (unsigned long)handled, handle_s,
+               handle_s > 0 ? handled / handle_s : 0.0, wall_s);
+        printf("Per frame ns: mean %.0f, p50 %lu, p95 %lu, p99 %lu, max %lu\n", handled ? handle_s * 1e9 / handled : 0.0,
+               (unsigned long)metric_handle_ns.percentile(50), (unsigned long)metric_handle_ns.percentile(95),
+               (unsigned long)metric_handle_ns.percentile(99), (unsigned long)metric_handle_ns.max());
+        // the bridge logs these at debug level
+        bool was_verbose = lora_host::verbose;
+        lora_host::verbose = true;
+        bridge.entities().log_stats("lora_replay");
+        lora_host::verbose = was_verbose;
+        return 0;
+    }
+} // namespace lora_replay
+
+int main(int argc, char **argv)
+{
+    lora_replay::Options options;
+    if (!lora_replay::parse(argc, argv, options))
+    {
+        lora_replay::usage();
+        return 2;
+    }
+    return lora_replay::run(options);
+}
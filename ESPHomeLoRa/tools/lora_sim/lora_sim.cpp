@@ -0,0 +1,1378 @@
+// Discrete-event simulator of a LoRa sensor network: many lora_mqtt style nodes and
+// one lora_mqtt_bridge on a shared channel. Frames are built and parsed with the real
+// frame_codec code (lines, catch-up series, the bridge's entity table and discovery
+// configs, see host/bridge_pipeline.h) and counted with the real metrics; the radio is
+// a VirtualRadio on a simulated channel (see radio_model.h). See README.md for the
+// model and options.
+//
+//   g++ -O2 -std=gnu++17 -I../host -I../.. lora_sim.cpp ../../esphome/components/metrics/metrics.cpp -o lora_sim
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bridge_pipeline.h"
+#include "esphome/components/frame_codec/frame_capture.h"
+#include "esphome/components/frame_codec/frequency_tracker.h"
+#include "esphome/components/frame_codec/fountain.h"
+#include "esphome/components/metrics/metrics.h"
+#include "virtual_radio.h"
+
+namespace lora_host
+{
+    bool verbose = false;
+} // namespace lora_host
+
+namespace lora_sim
+{
+    using namespace esphome::frame_codec;
+    using esphome::metrics::Counter;
+    using esphome::metrics::LatencyHistogram;
+    using esphome::metrics::MetricsRegistry;
+    using lora_host::BridgePipeline;
+    using lora_host::PACKET_PUBLISHED;
+    using lora_host::PacketResult;
+    using lora_host::verbose;
+
+    // the bridge's clock at simulated time 0 (2026-01-01, rounded down to a whole
+    // TIMESTAMP_MODULO so the nodes' time stamps line up with it)
+    static const uint32_t SIM_EPOCH_S = 1767223296;
+    static const char *const TAG = "lora_sim";
+
+    static Counter metric_readings("readings");
+    static Counter metric_delivered("delivered");
+    static Counter metric_duplicates("duplicates");
+    static Counter metric_dropped("dropped");
+    static Counter metric_frames("frames");
+    static Counter metric_rx_ok("rx_ok");
+    static Counter metric_rx_weak("rx_weak");
+    static Counter metric_rx_collision("rx_collision");
+    static Counter metric_rx_half_duplex("rx_half_duplex");
+    static Counter metric_rx_other_sf("rx_other_sf");
+    static Counter metric_rx_off_frequency("rx_off_frequency");
+    static Counter metric_rx_overrun("rx_overrun");
+    static Counter metric_bad_frames("bad_frames");
+    static Counter metric_acks("acks");
+    static Counter metric_acks_lost("acks_lost");
+    static Counter metric_ack_timeouts("ack_timeouts");
+    static Counter metric_lbt_deferrals("lbt_deferrals");
+    static Counter metric_duty_waits("duty_waits");
+    static Counter metric_broker_messages("broker_messages");
+    static Counter metric_broker_bytes("broker_bytes");
+    static Counter metric_discovery("discovery");
+    static LatencyHistogram metric_latency("latency_ms");
+
+    // what the bridge does with the carrier offsets it measures, as frequency_correction
+    enum FrequencyCorrection : uint8_t
+    {
+        CORRECTION_OFF,
+        CORRECTION_NODES,
+        CORRECTION_RECEIVER,
+    };
+
+    struct Options
+    {
+        uint32_t nodes{300};
+        double hours{1.0};
+        double radius_m{2000};
+        uint8_t sensors{3};
+        double interval_s{60};
+        double events_per_hour{1};
+        ModemSettings modem;
+        int power_dbm{14};
+        float duty_cycle{1.0f};
+        double capture_db{6};
+        PathLossModel path_loss;
+        bool ack{false};
+        bool lbt{false};
+        uint8_t batch{1};
+        double batch_wait_s{0};
+        bool adr{false};
+        double adr_margin_db{10};
+        bool time_sync{false};
+        double drift_ppm{0};
+        FrequencyCorrection correction{CORRECTION_OFF};
+        uint32_t loop_ms{16};
+        uint64_t seed{1};
+        bool json{false};
+        const char *capture_path{nullptr};
+        bool airtime{false};
+        // multicast firmware update instead of sensor traffic
+        uint32_t fuota_bytes{0};
+        double fuota_loss{10};
+        int fuota_redundancy{40};
+        int fuota_passes{2};
+    };
+
+    // what a node's sensors look like on the wire
+    struct EntityTemplate
+    {
+        const char *object_id;
+        const char *device_class;
+        const char *unit;
+        const char *icon;
+        uint8_t accuracy;
+        float mean;
+        float step;
+    };
+    static const EntityTemplate SENSORS[] = {
+        {"temperature", "temperature", "°C", "", 1, 21.0f, 0.2f},
+        {"humidity", "humidity", "%", "", 0, 55.0f, 1.0f},
+        {"battery", "voltage", "V", "mdi:battery", 2, 3.9f, 0.01f},
+        {"pressure", "pressure", "hPa", "", 1, 1013.0f, 0.3f},
+        {"illuminance", "illuminance", "lx", "", 0, 400.0f, 40.0f},
+        {"soil_moisture", "moisture", "%", "mdi:water-percent", 0, 35.0f, 1.0f},
+    };
+    static const uint8_t MAX_SENSORS = sizeof(SENSORS) / sizeof(SENSORS[0]);
+    static const EntityTemplate DOOR = {"door", "door", "", "", 0, 0.0f, 0.0f};
+
+    // the node's limits, as in lora_mqtt
+    static const uint8_t QUEUE_SIZE = 16;
+    static const uint16_t BACKLOG_SIZE = 256;
+    static const uint8_t CRITICAL_ATTEMPTS = 3;
+    static const uint8_t LINK_DOWN_MISSES = 3;
+    static const int64_t PROBE_INTERVAL_US = 60000000;
+    static const size_t MAX_CATCHUP_FRAME = 255;
+    static const uint8_t MAX_CATCHUP_BLOCKS = 6;
+    static const uint8_t LBT_ATTEMPTS = 5;
+
+    // node crystals: the carrier the ppm apply to, and the daily temperature cycle
+    static const double CARRIER_MHZ = 868.0;
+    static const int64_t DAY_US = 86400000000LL;
+    struct Reading
+    {
+        uint32_t index;
+        uint8_t entity; // < sensors for a sensor, == sensors for the door
+        float value;
+        int64_t taken_us;
+    };
+
+    struct Node
+    {
+        Node(Channel *channel, int site) : radio(channel, site) {}
+
+        VirtualRadio radio;
+        std::string name;
+        uint16_t node_id{0};
+        std::vector<float> values;
+        bool door_open{false};
+        uint32_t taken{0};
+        std::vector<bool> delivered;
+
+        std::deque<Reading> queue;
+        std::deque<Reading> backlog;
+        std::vector<Reading> in_flight;
+        bool in_flight_backlog{false}; // a catch-up upload of the backlog
+        bool transmitting{false};
+        bool ack_pending{false};
+        uint8_t seq{0};
+        uint8_t ack_seq{0};
+        uint32_t ack_generation{0};
+        uint8_t attempts{0};
+        bool link_up{true};
+        uint8_t missed_acks{0};
+        int64_t last_probe_us{0};
+        uint8_t lbt_tries{0};
+        bool service_scheduled{false};
+
+        int64_t airtime_budget_us{0};
+        int64_t airtime_refill_us{0};
+
+        // crystal error, its share that follows the temperature, and the correction the
+        // bridge's ACKs brought
+        double crystal_ppm{0};
+        double temperature_phase{0};
+        double correction_hz{0};
+        uint32_t corrections{0};
+    };
+
+    enum EventType : uint8_t
+    {
+        EVENT_READING, // target node, arg entity
+        EVENT_SERVICE, // target node: try to send
+        EVENT_TX_END,  // arg transmission id
+        EVENT_ACK_TIMEOUT,
+        EVENT_PICKUP, // the bridge loop reads the packet out of the radio
+    };
+
+    struct Event
+    {
+        int64_t at_us;
+        uint64_t order;
+        EventType type;
+        uint32_t target;
+        uint32_t arg;
+
+        bool operator>(const Event &other) const { return this->at_us != other.at_us ? this->at_us > other.at_us : this->order > other.order; }
+    };
+
+    class Simulator
+    {
+    public:
+        explicit Simulator(const Options &options)
+            : options_(options), channel_(options.modem, options.path_loss, options.capture_db, options.seed), rng_(options.seed),
+              bridge_radio_(&channel_, channel_.add_site(0, 0))
+        {
+            this->bridge_radio_.setSpreadingFactor(options.modem.sf);
+            this->bridge_radio_.setTxPower(options.power_dbm);
+            this->bridge_.on_publish([this](const char *topic, const char * /*payload*/, size_t len) { this->publish(topic, len); });
+            this->bridge_.on_ack([this](const char *node, uint8_t seq) { this->send_ack(node, seq); });
+            this->end_us_ = (int64_t)(options.hours * 3600e6);
+            this->batch_wait_us_ = (int64_t)((options.batch_wait_s > 0 ? options.batch_wait_s : options.interval_s) * 1e6);
+            this->ack_timeout_ms_ = 2 * options.modem.time_on_air(ACK_FRAME_SIZE) / 1000 + 1000;
+            this->frequencies_.set_deadband(options.modem.bandwidth / 100);
+
+            std::uniform_real_distribution<double> unit(0.0, 1.0);
+            this->nodes_.reserve(options.nodes);
+            for (uint32_t i = 0; i < options.nodes; i++)
+            {
+                // uniform over the disc around the bridge
+                double r = options.radius_m * std::sqrt(unit(this->rng_));
+                double angle = 2 * M_PI * unit(this->rng_);
+                this->nodes_.emplace_back(&this->channel_, this->channel_.add_site(r * std::cos(angle), r * std::sin(angle)));
+                Node &node = this->nodes_.back();
+                char name[16];
+                snprintf(name, sizeof(name), "node_%04u", (unsigned)i);
+                node.name = name;
+                node.node_id = node_id_hash(fnv1a(name));
+                this->nodes_by_id_[node.node_id].push_back(i);
+                node.radio.setTxPower(options.power_dbm);
+                node.radio.setSpreadingFactor(options.adr ? this->adr_sf(node) : options.modem.sf);
+                this->sf_counts_[node.radio.getSpreadingFactor() - 7]++;
+                node.airtime_budget_us = (int64_t)(3600e6 * options.duty_cycle / 100.0f);
+                node.crystal_ppm = options.drift_ppm * (2 * unit(this->rng_) - 1);
+                node.temperature_phase = 2 * M_PI * unit(this->rng_);
+                this->tune(node);
+                for (uint8_t s = 0; s < options.sensors; s++)
+                {
+                    node.values.push_back(SENSORS[s].mean);
+                    this->schedule((int64_t)(unit(this->rng_) * options.interval_s * 1e6), EVENT_READING, i, s);
+                }
+                if (options.events_per_hour > 0)
+                    this->schedule(this->next_event_us(0), EVENT_READING, i, options.sensors);
+            }
+
+            if (options.capture_path != nullptr)
+            {
+                this->capture_ = fopen(options.capture_path, "wb");
+                if (this->capture_ == nullptr)
+                {
+                    perror(options.capture_path);
+                    exit(1);
+                }
+                CaptureHeader header;
+                header.sf = options.modem.sf;
+                header.coding = options.modem.coding;
+                header.bandwidth = options.modem.bandwidth;
+                uint8_t buf[CAPTURE_HEADER_SIZE];
+                fwrite(buf, 1, capture_put_header(buf, header), this->capture_);
+            }
+        }
+
+        ~Simulator()
+        {
+            if (this->capture_ != nullptr)
+                fclose(this->capture_);
+        }
+
+        void run()
+        {
+            // readings stop at the end, frames in flight get a while to land
+            int64_t drain_us = this->end_us_ + 600e6;
+            while (!this->events_.empty() && this->events_.top().at_us <= drain_us)
+            {
+                Event event = this->events_.top();
+                this->events_.pop();
+                this->channel_.advance(event.at_us);
+                switch (event.type)
+                {
+                case EVENT_READING:
+                    this->on_reading(event.target, event.arg);
+                    break;
+                case EVENT_SERVICE:
+                    this->nodes_[event.target].service_scheduled = false;
+                    this->service(event.target);
+                    break;
+                case EVENT_TX_END:
+                    this->on_tx_end(event.arg);
+                    break;
+                case EVENT_ACK_TIMEOUT:
+                    this->on_ack_timeout(event.target, event.arg);
+                    break;
+                case EVENT_PICKUP:
+                    this->on_pickup(event.arg);
+                    break;
+                }
+            }
+        }
+
+        void report(double wall_s) const;
+
+    protected:
+        void schedule(int64_t at_us, EventType type, uint32_t target, uint32_t arg = 0)
+        {
+            this->events_.push({at_us, this->order_++, type, target, arg});
+        }
+        void schedule_service(uint32_t index, int64_t at_us)
+        {
+            Node &node = this->nodes_[index];
+            if (node.service_scheduled)
+                return;
+            node.service_scheduled = true;
+            this->schedule(at_us, EVENT_SERVICE, index);
+        }
+        int64_t now() const { return this->channel_.now(); }
+
+        int64_t next_event_us(int64_t from_us)
+        {
+            std::exponential_distribution<double> gap(this->options_.events_per_hour / 3600e6);
+            return from_us + (int64_t)gap(this->rng_);
+        }
+
+        // lowest spreading factor that reaches the bridge with the margin to spare
+        int adr_sf(const Node &node) const
+        {
+            double power = this->options_.power_dbm - this->channel_.path_loss(node.radio.site(), this->bridge_radio_.site());
+            for (int sf = 7; sf < 12; sf++)
+            {
+                if (power - sensitivity_dbm(sf, this->options_.modem.bandwidth) >= this->options_.adr_margin_db)
+                    return sf;
+            }
+            return 12;
+        }
+
+        // node side, mirroring lora_mqtt
+
+        void on_reading(uint32_t index, uint8_t entity)
+        {
+            Node &node = this->nodes_[index];
+            int64_t now = this->now();
+            if (now >= this->end_us_)
+                return;
+            Reading reading{node.taken++, entity, 0.0f, now};
+            node.delivered.push_back(false);
+            metric_readings.inc();
+            if (entity < this->options_.sensors)
+            {
+                std::normal_distribution<float> step(0.0f, SENSORS[entity].step);
+                node.values[entity] += step(this->rng_);
+                reading.value = node.values[entity];
+                std::uniform_real_distribution<double> jitter(0.99, 1.01);
+                this->schedule(now + (int64_t)(this->options_.interval_s * 1e6 * jitter(this->rng_)), EVENT_READING, index, entity);
+                if (node.queue.size() >= QUEUE_SIZE)
+                    this->queue_overflow(node);
+                node.queue.push_back(reading);
+            }
+            else
+            {
+                node.door_open = !node.door_open;
+                reading.value = node.door_open;
+                this->schedule(this->next_event_us(now), EVENT_READING, index, entity);
+                if (node.queue.size() >= QUEUE_SIZE)
+                    this->queue_overflow(node);
+                // critical: ahead of everything else
+                node.queue.push_front(reading);
+            }
+            this->service(index);
+        }
+
+        void queue_overflow(Node &node)
+        {
+            if (this->options_.ack)
+            {
+                this->to_backlog(node, node.queue.back());
+            }
+            else
+            {
+                metric_dropped.inc();
+            }
+            node.queue.pop_back();
+        }
+
+        void to_backlog(Node &node, const Reading &reading)
+        {
+            if (node.backlog.size() >= BACKLOG_SIZE)
+            {
+                metric_dropped.inc();
+                node.backlog.pop_front();
+            }
+            node.backlog.push_back(reading);
+        }
+
+        void service(uint32_t index)
+        {
+            Node &node = this->nodes_[index];
+            if (node.transmitting || node.ack_pending)
+                return;
+            int64_t now = this->now();
+
+            // no bridge in reach: readings are parked in the backlog and only a critical
+            // one, or one a minute as a probe, goes out
+            bool probe = false;
+            if (this->options_.ack && !node.link_up)
+            {
+                if (node.queue.empty())
+                    return;
+                bool critical = node.queue.front().entity == this->options_.sensors;
+                if (!critical && now - node.last_probe_us < PROBE_INTERVAL_US)
+                {
+                    for (auto &reading : node.queue)
+                        this->to_backlog(node, reading);
+                    node.queue.clear();
+                    return;
+                }
+                probe = true;
+            }
+
+            std::vector<Reading> readings;
+            bool catchup = false;
+            bool from_backlog = false;
+            if (this->options_.batch > 1 && !node.queue.empty())
+            {
+                // hold sensor readings until a batch is full or the oldest has waited long enough
+                bool critical = node.queue.front().entity == this->options_.sensors;
+                int64_t due = node.queue.back().taken_us;
+                for (auto &reading : node.queue)
+                    due = std::min(due, reading.taken_us);
+                due += this->batch_wait_us_;
+                if (!critical && node.queue.size() < this->options_.batch && now < due && now < this->end_us_)
+                {
+                    this->schedule_service(index, due);
+                    return;
+                }
+                for (size_t i = 0; i < node.queue.size() && i < this->options_.batch; i++)
+                    readings.push_back(node.queue[i]);
+                catchup = true;
+            }
+            else if (!node.queue.empty())
+            {
+                readings.push_back(node.queue.front());
+            }
+            else if (this->options_.ack && !node.backlog.empty())
+            {
+                for (size_t i = 0; i < node.backlog.size() && i < 64; i++)
+                    readings.push_back(node.backlog[i]);
+                catchup = true;
+                from_backlog = true;
+            }
+            else
+            {
+                return;
+            }
+
+            std::string frame;
+            if (catchup)
+                this->build_catchup(node, readings, frame);
+            else
+                this->build_line(node, readings.front(), frame);
+            if (frame.size() > node.radio.maxPacketLength() && !catchup && this->options_.ack)
+            {
+                // too long for the implicit header frame length: the line goes to the backlog
+                // and out in a catch-up frame, as in lora_mqtt
+                this->to_backlog(node, readings.front());
+                node.queue.pop_front();
+                readings.clear();
+                for (size_t i = 0; i < node.backlog.size() && i < 64; i++)
+                    readings.push_back(node.backlog[i]);
+                catchup = true;
+                from_backlog = true;
+                this->build_catchup(node, readings, frame);
+            }
+            if (frame.size() > node.radio.maxPacketLength())
+            {
+                // can't be sent at all
+                metric_dropped.inc();
+                if (from_backlog)
+                    node.backlog.pop_front();
+                else
+                    node.queue.pop_front();
+                this->schedule_service(index, now);
+                return;
+            }
+            uint32_t airtime = node.radio.timeOnAir(frame.size());
+
+            // the duty-cycle budget only applies with acknowledged delivery, like lora_mqtt
+            if (this->options_.ack)
+            {
+                node.airtime_budget_us += (now - node.airtime_refill_us) / 1000 * 10 * this->options_.duty_cycle;
+                node.airtime_refill_us = now;
+                int64_t max = (int64_t)(3600e6 * this->options_.duty_cycle / 100.0f);
+                if (node.airtime_budget_us > max)
+                    node.airtime_budget_us = max;
+                if (node.airtime_budget_us < airtime)
+                {
+                    metric_duty_waits.inc();
+                    int64_t wait_ms = (airtime - node.airtime_budget_us) / (10 * this->options_.duty_cycle) + 1;
+                    this->schedule_service(index, now + wait_ms * 1000);
+                    return;
+                }
+            }
+
+            if (this->options_.lbt && node.lbt_tries < LBT_ATTEMPTS && node.radio.channelActivityDetection())
+            {
+                // busy: back off for up to a few frames' worth, longer each time
+                metric_lbt_deferrals.inc();
+                node.lbt_tries++;
+                std::uniform_int_distribution<int64_t> backoff(this->options_.modem.cad_us(), (int64_t)airtime << node.lbt_tries);
+                this->schedule_service(index, now + backoff(this->rng_));
+                return;
+            }
+            node.lbt_tries = 0;
+            if (probe)
+                node.last_probe_us = now;
+
+            // what went into the frame leaves the queue it came from
+            if (from_backlog)
+                node.backlog.erase(node.backlog.begin(), node.backlog.begin() + readings.size());
+            else
+                node.queue.erase(node.queue.begin(), node.queue.begin() + readings.size());
+            node.in_flight = std::move(readings);
+            node.in_flight_backlog = from_backlog;
+
+            this->tune(node);
+            node.radio.beginPacket();
+            node.radio.write(reinterpret_cast<const uint8_t *>(frame.data()), frame.size());
+            for (auto &reading : node.in_flight)
+                node.radio.tag({index, reading.index, reading.taken_us});
+            node.radio.endPacket(true);
+            if (this->options_.ack)
+                node.airtime_budget_us -= airtime;
+            node.transmitting = true;
+            metric_frames.inc();
+            this->frame_bytes_ += frame.size();
+            this->schedule(node.radio.txEnd(), EVENT_TX_END, index, node.radio.txId());
+        }
+
+        // half the crystal error again comes and goes with the daily temperature cycle
+        void tune(Node &node)
+        {
+            double ppm = node.crystal_ppm + this->options_.drift_ppm / 2 * std::sin(2 * M_PI * this->now() / DAY_US + node.temperature_phase);
+            node.radio.setFrequencyOffset(ppm * CARRIER_MHZ - node.correction_hz);
+        }
+
+        void build_line(Node &node, const Reading &reading, std::string &out)
+        {
+            bool door = reading.entity == this->options_.sensors;
+            const EntityTemplate &entity = door ? DOOR : SENSORS[reading.entity];
+            char value[16];
+            snprintf(value, sizeof(value), "%.*f", entity.accuracy, reading.value);
+            char stamp[3];
+            char seq[3];
+            SensorLine line;
+            line.node = node.name.c_str();
+            line.device_class = entity.device_class;
+            line.state_class = door ? "binary_sensor" : "measurement";
+            line.object_id = entity.object_id;
+            line.unit = entity.unit;
+            line.value = door ? (reading.value != 0.0f ? "ON" : "OFF") : value;
+            line.icon = entity.icon;
+            line.kind = door ? "" : "sensor";
+            if (this->options_.time_sync)
+            {
+                uint32_t time = (uint32_t)(reading.taken_us / 1000000) % TIMESTAMP_MODULO;
+                stamp[0] = timestamp_char(time >> 6);
+                stamp[1] = timestamp_char(time);
+                stamp[2] = 0;
+                line.stamp = stamp;
+            }
+            if (this->options_.ack)
+            {
+                snprintf(seq, sizeof(seq), "%02x", node.seq);
+                line.seq = seq;
+            }
+            LoRaCodec::encode(line, out);
+        }
+
+        // FRAME_CATCHUP seq name_len name, then one packed series block per entity; trims
+        // readings off the end until the frame fits
+        void build_catchup(Node &node, std::vector<Reading> &readings, std::string &out)
+        {
+            int64_t now = this->now();
+            while (true)
+            {
+                out.assign(1, (char)FRAME_CATCHUP);
+                out += (char)node.seq;
+                out += (char)node.name.size();
+                out += node.name;
+                uint8_t entities[MAX_CATCHUP_BLOCKS];
+                uint8_t blocks = 0;
+                size_t usable = 0;
+                for (auto &reading : readings)
+                {
+                    bool known = false;
+                    for (uint8_t i = 0; i < blocks; i++)
+                        known |= entities[i] == reading.entity;
+                    if (!known && blocks == MAX_CATCHUP_BLOCKS)
+                        break;
+                    if (!known)
+                        entities[blocks++] = reading.entity;
+                    usable++;
+                }
+                readings.resize(usable);
+                for (uint8_t i = 0; i < blocks; i++)
+                {
+                    bool door = entities[i] == this->options_.sensors;
+                    const EntityTemplate &entity = door ? DOOR : SENSORS[entities[i]];
+                    out += (char)(ENTITY_PACKED | (door ? ENTITY_BINARY : 0) | entity.accuracy);
+                    out += (char)strlen(entity.object_id);
+                    out += entity.object_id;
+                    size_t count_at = out.size();
+                    out += (char)0;
+                    SeriesEncoder encoder;
+                    uint8_t sample[10];
+                    for (auto &reading : readings)
+                    {
+                        if (reading.entity != entities[i])
+                            continue;
+                        int32_t quantized = 0;
+                        quantize_value(reading.value, entity.accuracy, &quantized);
+                        size_t n = encoder.encode(sample, -(int32_t)((now - reading.taken_us) / 1000000), quantized);
+                        out.append(reinterpret_cast<char *>(sample), n);
+                        out[count_at]++;
+                    }
+                }
+                if (out.size() <= std::min(MAX_CATCHUP_FRAME, node.radio.maxPacketLength()) || readings.size() == 1)
+                    return;
+                readings.pop_back();
+            }
+        }
+
+        void on_node_tx_end(uint32_t index)
+        {
+            Node &node = this->nodes_[index];
+            node.transmitting = false;
+            if (this->options_.ack)
+            {
+                node.ack_pending = true;
+                node.ack_seq = node.seq++;
+                this->schedule(this->now() + this->ack_timeout_ms_ * 1000, EVENT_ACK_TIMEOUT, index, ++node.ack_generation);
+                return;
+            }
+            node.seq++;
+            node.in_flight.clear();
+            this->service(index);
+        }
+
+        void on_ack(uint32_t index)
+        {
+            Node &node = this->nodes_[index];
+            node.ack_pending = false;
+            node.attempts = 0;
+            node.missed_acks = 0;
+            node.link_up = true;
+            node.in_flight.clear();
+            this->service(index);
+        }
+
+        void on_ack_timeout(uint32_t index, uint32_t generation)
+        {
+            Node &node = this->nodes_[index];
+            if (!node.ack_pending || node.ack_generation != generation)
+                return;
+            metric_ack_timeouts.inc();
+            node.ack_pending = false;
+            if (node.in_flight_backlog)
+            {
+                // a catch-up upload only leaves the backlog once it is acknowledged
+                node.backlog.insert(node.backlog.begin(), node.in_flight.begin(), node.in_flight.end());
+                while (node.backlog.size() > BACKLOG_SIZE)
+                {
+                    metric_dropped.inc();
+                    node.backlog.pop_front();
+                }
+            }
+            else if (node.in_flight.size() == 1 && node.in_flight.front().entity == this->options_.sensors &&
+                     ++node.attempts < CRITICAL_ATTEMPTS)
+            {
+                // retry a critical reading straight away
+                node.queue.push_front(node.in_flight.front());
+            }
+            else
+            {
+                node.attempts = 0;
+                for (auto &reading : node.in_flight)
+                    this->to_backlog(node, reading);
+            }
+            node.in_flight.clear();
+            if (node.link_up && ++node.missed_acks >= LINK_DOWN_MISSES)
+            {
+                node.link_up = false;
+                node.last_probe_us = this->now();
+            }
+            this->service(index);
+        }
+
+        // the channel
+
+        void on_tx_end(uint32_t id)
+        {
+            const Transmission *tx = this->channel_.find(id);
+            if (tx == nullptr)
+                return;
+            if (tx->sender == this->bridge_radio_.site())
+            {
+                this->on_downlink_end(*tx);
+                return;
+            }
+            uint32_t index = tx->sender - 1;
+            double rssi, snr;
+            RxResult result = this->channel_.receive(*tx, this->bridge_radio_.site(), this->options_.adr ? 0 : this->options_.modem.sf, &rssi, &snr);
+            this->count_rx(result);
+            const Node &node = this->nodes_[index];
+            int phase = node.corrections != 0 || this->frequencies_.receiver_corrections() != 0 ? 1 : 0;
+            this->decode_frames_[phase]++;
+            if (result == RX_OK)
+            {
+                this->decode_ok_[phase]++;
+                if (this->pickup_pending_)
+                    metric_rx_overrun.inc();
+                // the radio's estimate is good to about a fifth of a percent of the bandwidth
+                std::normal_distribution<double> estimate(this->channel_.frequency_error(*tx, this->bridge_radio_.site()),
+                                                          this->options_.modem.bandwidth / 500.0);
+                this->bridge_radio_.deliver(*tx, rssi, snr, estimate(this->rng_));
+                this->pickup_pending_ = true;
+                std::uniform_int_distribution<int64_t> loop(0, this->options_.loop_ms * 1000);
+                this->schedule(this->now() + loop(this->rng_), EVENT_PICKUP, 0, ++this->pickup_generation_);
+            }
+            this->on_node_tx_end(index);
+        }
+
+        void count_rx(RxResult result)
+        {
+            static Counter *const COUNTERS[RX_RESULTS] = {&metric_rx_ok,       &metric_rx_weak,     &metric_rx_collision,
+                                                          &metric_rx_half_duplex, &metric_rx_other_sf, &metric_rx_off_frequency};
+            COUNTERS[result]->inc();
+        }
+
+        void on_downlink_end(const Transmission &tx)
+        {
+            uint16_t node_id = tx.data[1] | tx.data[2] << 8;
+            auto it = this->nodes_by_id_.find(node_id);
+            if (it == this->nodes_by_id_.end())
+                return;
+            for (uint32_t index : it->second)
+            {
+                Node &node = this->nodes_[index];
+                if (!node.ack_pending || node.ack_seq != tx.data[3] || node.radio.getSpreadingFactor() != tx.sf)
+                    continue;
+                double rssi, snr;
+                if (this->channel_.receive(tx, node.radio.site(), tx.sf, &rssi, &snr) == RX_OK)
+                {
+                    this->on_ack(index);
+                    if (tx.data.size() == ACK_CORRECTION_FRAME_SIZE)
+                    {
+                        node.correction_hz += (int16_t)(tx.data[4] | tx.data[5] << 8);
+                        node.corrections++;
+                        this->tune(node);
+                    }
+                }
+                else
+                    metric_acks_lost.inc();
+            }
+        }
+
+        // bridge side, mirroring lora_mqtt_bridge
+
+        void on_pickup(uint32_t generation)
+        {
+            if (generation != this->pickup_generation_)
+                return;
+            // the bridge sends its ACKs blocking, so the loop only gets here afterwards
+            if (this->bridge_radio_.isTransmitting())
+            {
+                this->schedule(this->bridge_radio_.txEnd(), EVENT_PICKUP, 0, generation);
+                return;
+            }
+            this->pickup_pending_ = false;
+            this->handle_packet();
+        }
+
+        void handle_packet()
+        {
+            uint8_t frame[255];
+            size_t len = 0;
+            while (this->bridge_radio_.available() && len < sizeof(frame))
+                frame[len++] = this->bridge_radio_.read();
+            int64_t now = this->now();
+            if (this->capture_ != nullptr)
+                this->capture(frame, len, now);
+            this->track_frequency();
+            uint32_t discovery = this->bridge_.stats().discovery;
+            PacketResult result =
+                this->bridge_.handle(frame, len, this->bridge_radio_.packetRssi(), SIM_EPOCH_S + now / 1000000, now / 1000);
+            metric_discovery.inc(this->bridge_.stats().discovery - discovery);
+            if (result != PACKET_PUBLISHED)
+            {
+                metric_bad_frames.inc();
+                return;
+            }
+            this->delivered();
+        }
+
+        // what the bridge's capture option records, with network time
+        void capture(const uint8_t *frame, size_t len, int64_t now)
+        {
+            CaptureRecord record;
+            record.time_s = SIM_EPOCH_S + now / 1000000;
+            record.time_us = now % 1000000;
+            record.rssi = this->bridge_radio_.packetRssi();
+            record.snr_quarter_db = (int8_t)std::lround(std::fmax(-128, std::fmin(127, this->bridge_radio_.packetSnr() * 4)));
+            record.flags = CAPTURE_WALL_TIME;
+            record.len = len;
+            record.frame = frame;
+            uint8_t buf[CAPTURE_RECORD_HEADER_SIZE + 255];
+            fwrite(buf, 1, capture_put_record(buf, record), this->capture_);
+        }
+
+        // The bridge tracks the node it decodes the frame from; the simulator knows it
+        // from the tags. Sequence gaps aren't counted here, the channel knows the losses.
+        void track_frequency()
+        {
+            const std::vector<ReadingTag> &tags = this->bridge_radio_.packetTags();
+            if (tags.empty())
+                return;
+            this->frequencies_.add(this->nodes_[tags.front().node].node_id, this->bridge_radio_.packetFrequencyError(), -1);
+            if (this->options_.correction != CORRECTION_RECEIVER)
+                return;
+            int32_t correction = this->frequencies_.take_receiver_correction();
+            if (correction == 0)
+                return;
+            this->receiver_offset_hz_ += correction;
+            this->bridge_radio_.setFrequencyOffset(this->receiver_offset_hz_);
+        }
+
+        void send_ack(const char *node, uint8_t seq)
+        {
+            uint16_t node_id = node_id_hash(fnv1a(node));
+            uint8_t frame[ACK_CORRECTION_FRAME_SIZE] = {FRAME_ACK, (uint8_t)(node_id & 0xFF), (uint8_t)(node_id >> 8), seq};
+            size_t len = ACK_FRAME_SIZE;
+            FrequencyTracker::Node *tracked = this->frequencies_.find(node_id);
+            if (this->options_.correction == CORRECTION_NODES && tracked != nullptr)
+            {
+                int32_t correction = this->frequencies_.take_correction(tracked);
+                if (correction != 0)
+                {
+                    int16_t hz = (int16_t)std::max(-32768, std::min(32767, correction));
+                    frame[4] = (uint8_t)hz;
+                    frame[5] = (uint8_t)((uint16_t)hz >> 8);
+                    len = ACK_CORRECTION_FRAME_SIZE;
+                }
+            }
+            // a multi-SF gateway answers on the SF the frame came in on
+            if (this->options_.adr)
+            {
+                auto it = this->nodes_by_id_.find(node_id);
+                if (it != this->nodes_by_id_.end())
+                    this->bridge_radio_.setSpreadingFactor(this->nodes_[it->second.front()].radio.getSpreadingFactor());
+            }
+            this->bridge_radio_.beginPacket();
+            this->bridge_radio_.write(frame, len);
+            this->bridge_radio_.endPacket(true);
+            metric_acks.inc();
+            this->schedule(this->bridge_radio_.txEnd(), EVENT_TX_END, 0, this->bridge_radio_.txId());
+        }
+
+        void publish(const char *topic, size_t payload_len)
+        {
+            metric_broker_messages.inc();
+            metric_broker_bytes.inc(strlen(topic) + payload_len);
+            int64_t second = this->now() / 1000000;
+            if (second != this->broker_second_)
+            {
+                this->broker_second_ = second;
+                this->broker_in_second_ = 0;
+            }
+            if (++this->broker_in_second_ > this->broker_peak_)
+                this->broker_peak_ = this->broker_in_second_;
+        }
+
+        // every reading in the packet just published reached the broker
+        void delivered()
+        {
+            int64_t now = this->now();
+            for (auto &tag : this->bridge_radio_.packetTags())
+            {
+                std::vector<bool>::reference seen = this->nodes_[tag.node].delivered[tag.index];
+                if (seen)
+                {
+                    metric_duplicates.inc();
+                    continue;
+                }
+                seen = true;
+                metric_delivered.inc();
+                metric_latency.record((now - tag.taken_us) / 1000);
+            }
+        }
+
+        Options options_;
+        Channel channel_;
+        std::mt19937_64 rng_;
+        VirtualRadio bridge_radio_;
+        std::vector<Node> nodes_;
+        std::unordered_map<uint16_t, std::vector<uint32_t>> nodes_by_id_;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+        uint64_t order_{0};
+        int64_t end_us_;
+        int64_t batch_wait_us_;
+        uint32_t ack_timeout_ms_;
+        uint32_t sf_counts_[6]{};
+        uint64_t frame_bytes_{0};
+        // frames from nodes and those the bridge decoded, before and after the first
+        // frequency correction that applied to the sender
+        uint32_t decode_frames_[2]{};
+        uint32_t decode_ok_[2]{};
+
+        BridgePipeline bridge_;
+        FrequencyTracker frequencies_;
+        int32_t receiver_offset_hz_{0};
+        FILE *capture_{nullptr};
+        bool pickup_pending_{false};
+        uint32_t pickup_generation_{0};
+        int64_t broker_second_{-1};
+        uint32_t broker_in_second_{0};
+        uint32_t broker_peak_{0};
+    };
+
+    void Simulator::report(double wall_s) const
+    {
+        const Options &o = this->options_;
+        double sim_s = o.hours * 3600;
+        printf("Simulated %u node(s) for %.2f h in %.2f s (%.0fx real time)\n", (unsigned)o.nodes, o.hours, wall_s, sim_s / wall_s);
+        printf("Setup: SF%d BW%ld CR4/%d, %d dBm, %.0f m radius, %u sensor(s) every %.0f s, %.1f door event(s)/h\n", o.modem.sf,
+               o.modem.bandwidth / 1000, o.modem.coding, o.power_dbm, o.radius_m, (unsigned)o.sensors, o.interval_s, o.events_per_hour);
+        printf("Options: ack=%s lbt=%s batch=%u adr=%s time_sync=%s\n", o.ack ? "on" : "off", o.lbt ? "on" : "off", (unsigned)o.batch,
+               o.adr ? "on" : "off", o.time_sync ? "on" : "off");
+        if (o.modem.implicit_header != 0)
+            printf("Implicit header: %u byte frames\n", (unsigned)o.modem.implicit_header);
+        if (o.adr)
+            printf("ADR: SF7..12 = %u %u %u %u %u %u node(s)\n", this->sf_counts_[0], this->sf_counts_[1], this->sf_counts_[2],
+                   this->sf_counts_[3], this->sf_counts_[4], this->sf_counts_[5]);
+
+        uint32_t readings = metric_readings.get(), delivered = metric_delivered.get();
+        printf("Readings: %lu taken, %lu delivered (%.2f%%), %lu duplicate(s), %lu dropped\n", (unsigned long)readings,
+               (unsigned long)delivered, readings == 0 ? 0.0 : 100.0 * delivered / readings, (unsigned long)metric_duplicates.get(),
+               (unsigned long)metric_dropped.get());
+        uint32_t frames = metric_frames.get();
+        printf("Frames: %lu sent, %.1f bytes avg, offered load %.3f Erlang\n", (unsigned long)frames,
+               frames == 0 ? 0.0 : (double)this->frame_bytes_ / frames, this->channel_.airtime_us() / (sim_s * 1e6));
+        printf("At the bridge: %lu received, lost %lu too weak, %lu collided, %lu while transmitting, %lu other SF, %lu off frequency, "
+               "%lu overrun\n",
+               (unsigned long)metric_rx_ok.get(), (unsigned long)metric_rx_weak.get(), (unsigned long)metric_rx_collision.get(),
+               (unsigned long)metric_rx_half_duplex.get(), (unsigned long)metric_rx_other_sf.get(),
+               (unsigned long)metric_rx_off_frequency.get(), (unsigned long)metric_rx_overrun.get());
+        if (o.drift_ppm > 0 || o.correction != CORRECTION_OFF)
+        {
+            static const char *const MODES[] = {"off", "nodes", "receiver"};
+            printf("Frequency: crystals within %.1f ppm, correction %s, %lu to nodes, %lu to the receiver (%+ld Hz), largest offset %ld Hz\n",
+                   o.drift_ppm, MODES[o.correction], (unsigned long)this->frequencies_.node_corrections(),
+                   (unsigned long)this->frequencies_.receiver_corrections(), (long)this->receiver_offset_hz_,
+                   (long)this->frequencies_.max_offset_hz());
+            printf("Decode success: %.1f%% of %lu frame(s) before correction, %.1f%% of %lu after\n",
+                   FrequencyTracker::success_percent(this->decode_ok_[0], this->decode_frames_[0] - this->decode_ok_[0]),
+                   (unsigned long)this->decode_frames_[0],
+                   FrequencyTracker::success_percent(this->decode_ok_[1], this->decode_frames_[1] - this->decode_ok_[1]),
+                   (unsigned long)this->decode_frames_[1]);
+        }
+        if (o.ack || o.batch > 1)
+            printf("ACKs: %lu sent, %lu lost on the way back, %lu timeout(s), %lu duty-cycle wait(s)\n", (unsigned long)metric_acks.get(),
+                   (unsigned long)metric_acks_lost.get(), (unsigned long)metric_ack_timeouts.get(), (unsigned long)metric_duty_waits.get());
+        if (o.lbt)
+            printf("LBT: %lu deferral(s)\n", (unsigned long)metric_lbt_deferrals.get());
+        printf("Latency ms: p50 %lu, p95 %lu, p99 %lu, max %lu\n", (unsigned long)metric_latency.percentile(50),
+               (unsigned long)metric_latency.percentile(95), (unsigned long)metric_latency.percentile(99),
+               (unsigned long)metric_latency.max());
+        uint32_t messages = metric_broker_messages.get();
+        printf("Broker: %lu message(s), %.1f/s avg, %lu/s peak, %lu bytes, %lu discovery config(s)\n", (unsigned long)messages,
+               messages / sim_s, (unsigned long)this->broker_peak_, (unsigned long)metric_broker_bytes.get(),
+               (unsigned long)metric_discovery.get());
+        // the bridge logs these at debug level
+        bool was_verbose = verbose;
+        verbose = true;
+        this->bridge_.entities().log_stats(TAG);
+        verbose = was_verbose;
+        if (o.json)
+        {
+            std::string json;
+            MetricsRegistry::to_json(json);
+            printf("%s\n", json.c_str());
+        }
+    }
+
+    // time on air of a frame of each size at SF7..12, explicit header against an implicit
+    // header frame of just that size (the length byte included) with the other settings
+    static void print_airtime(const Options &o)
+    {
+        static const size_t SIZES[] = {6, 16, 32, 64, 128};
+        printf("Time on air in ms, BW%ld CR4/%d, explicit / implicit header with the frame length fixed at the size\n",
+               o.modem.bandwidth / 1000, o.modem.coding);
+        printf("frame bytes");
+        for (size_t size : SIZES)
+            printf(" %12u", (unsigned)size);
+        printf("\n");
+        for (int sf = 7; sf <= 12; sf++)
+        {
+            ModemSettings explicit_header = o.modem;
+            explicit_header.sf = sf;
+            explicit_header.implicit_header = 0;
+            ModemSettings implicit_header = explicit_header;
+            printf("SF%-9d", sf);
+            for (size_t size : SIZES)
+            {
+                implicit_header.implicit_header = size + 1;
+                char cell[24];
+                snprintf(cell, sizeof(cell), "%lu / %lu", (unsigned long)explicit_header.time_on_air(size) / 1000,
+                         (unsigned long)implicit_header.time_on_air(size) / 1000);
+                printf(" %12s", cell);
+            }
+            printf("\n");
+        }
+    }
+
+    // LoRa on the SX1262 against its GFSK, and against the SX1280 at 2.4 GHz in LoRa and
+    // in FLRC: time on air per frame and the rate a node can sustain back to back
+    static void print_modulation_airtime()
+    {
+        auto lora = [](int sf, long bandwidth)
+        {
+            ModemSettings modem;
+            modem.sf = sf;
+            modem.bandwidth = bandwidth;
+            return modem;
+        };
+        auto flrc = [](long bit_rate, int coding)
+        {
+            ModemSettings modem;
+            modem.modulation = ModemSettings::FLRC;
+            modem.bit_rate = bit_rate;
+            modem.flrc_coding = coding;
+            return modem;
+        };
+        auto gfsk = [](long bit_rate)
+        {
+            ModemSettings modem;
+            modem.modulation = ModemSettings::GFSK;
+            modem.bit_rate = bit_rate;
+            return modem;
+        };
+        struct Row
+        {
+            const char *name;
+            ModemSettings modem;
+        };
+        const Row rows[] = {
+            {"SX1262 LoRa SF7 BW125", lora(7, 125000)},
+            {"SX1262 LoRa SF10 BW125", lora(10, 125000)},
+            {"SX1262 LoRa SF12 BW125", lora(12, 125000)},
+            {"SX1262 LoRa SF7 BW500", lora(7, 500000)},
+            {"SX1262 GFSK 50k", gfsk(50000)},
+            {"SX1262 GFSK 100k", gfsk(100000)},
+            {"SX1262 GFSK 300k", gfsk(300000)},
+            {"SX1280 LoRa SF7 BW812", lora(7, 812500)},
+            {"SX1280 LoRa SF7 BW1625", lora(7, 1625000)},
+            {"SX1280 FLRC 260k CR3/4", flrc(260000, 3)},
+            {"SX1280 FLRC 650k CR3/4", flrc(650000, 3)},
+            {"SX1280 FLRC 1300k CR3/4", flrc(1300000, 3)},
+            {"SX1280 FLRC 1300k uncoded", flrc(1300000, 4)},
+        };
+
+        static const size_t SIZES[] = {16, 64, 127};
+        printf("\nTime on air in us and sustained throughput at 127 bytes\n");
+        printf("%-26s", "modem");
+        for (size_t size : SIZES)
+            printf(" %9u B", (unsigned)size);
+        printf(" %12s\n", "kbit/s");
+        for (auto &row : rows)
+        {
+            printf("%-26s", row.name);
+            for (size_t size : SIZES)
+                printf(" %11lu", (unsigned long)row.modem.time_on_air(size));
+            printf(" %12.1f\n", 127 * 8 * 1000.0 / row.modem.time_on_air(127));
+        }
+    }
+
+    // The bridge's multicast firmware update (fuota_sender.h) to every node, each
+    // losing frames at its own rate, up to --fuota-loss, and decoding them as
+    // fuota_receiver.h does: a block missed in one pass is filled in by the next.
+    // Only the frame loss is modelled, not the channel.
+    static void run_fuota(const Options &o)
+    {
+        static const uint8_t ANNOUNCE_FRAMES = 3;
+        size_t max_frame = o.modem.max_frame() < 255 ? o.modem.max_frame() : 255;
+        if (max_frame < FUOTA_SESSION_FRAME_SIZE)
+        {
+            fprintf(stderr, "frames of %u bytes are too short for firmware updates\n", (unsigned)max_frame);
+            return;
+        }
+        size_t fragment_size = max_frame - FUOTA_FRAGMENT_HEADER;
+        size_t block_size = FUOTA_BLOCK * fragment_size;
+        uint32_t blocks = (o.fuota_bytes + block_size - 1) / block_size;
+        uint8_t repair = std::min((FUOTA_BLOCK * o.fuota_redundancy + 99) / 100, 255 - FUOTA_BLOCK);
+
+        std::mt19937_64 rng(o.seed);
+        std::vector<uint8_t> image(blocks * block_size, 0);
+        for (uint32_t i = 0; i < o.fuota_bytes; i++)
+            image[i] = rng();
+
+        struct Receiver
+        {
+            double loss;
+            bool joined;
+            std::vector<bool> written;
+            uint32_t remaining;
+            uint32_t missed;
+            int done_pass; // 0 while incomplete
+            bool corrupt;  // a block decoded to something else than was sent
+            FountainDecoder decoder;
+        };
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::vector<Receiver> nodes(o.nodes);
+        for (auto &node : nodes)
+        {
+            node.loss = uniform(rng) * o.fuota_loss / 100.0;
+            node.joined = false;
+            node.written.assign(blocks, false);
+            node.remaining = blocks;
+            node.missed = 0;
+            node.done_pass = 0;
+            node.corrupt = false;
+            node.decoder.begin(fragment_size);
+        }
+
+        std::vector<uint8_t> fragment(fragment_size);
+        uint64_t frames = 0;
+        uint64_t airtime_us = 0;
+        for (int pass = 1; pass <= o.fuota_passes; pass++)
+        {
+            for (uint8_t i = 0; i < ANNOUNCE_FRAMES; i++)
+            {
+                frames++;
+                airtime_us += o.modem.time_on_air(FUOTA_SESSION_FRAME_SIZE);
+                for (auto &node : nodes)
+                {
+                    if (!node.joined && uniform(rng) >= node.loss)
+                    {
+                        node.joined = true;
+                        node.decoder.reset(0);
+                    }
+                }
+            }
+            for (uint32_t block = 0; block < blocks; block++)
+            {
+                const uint8_t *data = image.data() + block * block_size;
+                for (int index = 0; index < FUOTA_BLOCK + repair; index++)
+                {
+                    fountain_encode(data, fragment_size, block, index, fragment.data());
+                    frames++;
+                    airtime_us += o.modem.time_on_air(FUOTA_FRAGMENT_HEADER + fragment_size);
+                    for (auto &node : nodes)
+                    {
+                        if (!node.joined || node.done_pass != 0 || uniform(rng) < node.loss || node.written[block])
+                            continue;
+                        if (block != node.decoder.block())
+                        {
+                            node.missed += node.decoder.rank() != 0 ? 1 : 0;
+                            node.decoder.reset(block);
+                        }
+                        if (!node.decoder.add(index, fragment.data()))
+                            continue;
+                        node.corrupt |= memcmp(node.decoder.data(), data, block_size) != 0;
+                        node.written[block] = true;
+                        node.decoder.reset(block + 1 < blocks ? block + 1 : 0);
+                        if (--node.remaining == 0)
+                            node.done_pass = pass;
+                    }
+                }
+            }
+        }
+
+        uint32_t done[256] = {};
+        uint32_t corrupt = 0, missed = 0;
+        for (auto &node : nodes)
+        {
+            done[node.done_pass]++;
+            missed += node.missed;
+            corrupt += node.corrupt ? 1 : 0;
+        }
+        uint32_t per_pass = ANNOUNCE_FRAMES + blocks * (FUOTA_BLOCK + repair);
+        double airtime_s = airtime_us / 1e6;
+        printf("Firmware update: %lu bytes, %lu blocks of %u+%u fragments of %u bytes\n", (unsigned long)o.fuota_bytes,
+               (unsigned long)blocks, (unsigned)FUOTA_BLOCK, (unsigned)repair, (unsigned)fragment_size);
+        printf("  frames:   %lu per pass, %lu in %d pass(es)\n", (unsigned long)per_pass, (unsigned long)frames, o.fuota_passes);
+        printf("  airtime:  %.0f s per pass (%.1f h at %.1f%% duty cycle), %.0f s in total\n", airtime_s / o.fuota_passes,
+               airtime_s / o.fuota_passes / 36.0 / o.duty_cycle, o.duty_cycle, airtime_s);
+        printf("  nodes:    %u, frame loss 0..%.0f%%\n", (unsigned)o.nodes, o.fuota_loss);
+        for (int pass = 1; pass <= o.fuota_passes; pass++)
+            printf("  complete after pass %d: %u\n", pass, done[pass]);
+        printf("  incomplete: %u, blocks left for a later pass: %lu, corrupt images: %u\n", done[0], (unsigned long)missed, corrupt);
+    }
+
+    static void usage()
+    {
+        fprintf(stderr,
+                "usage: lora_sim [options]\n"
+                "  --nodes N            nodes around the bridge (300)\n"
+                "  --hours H            simulated time (1)\n"
+                "  --radius M           nodes spread uniformly over this disc (2000)\n"
+                "  --sensors N          sensors per node, 1..6 (3)\n"
+                "  --interval S         sensor update interval (60)\n"
+                "  --events N           door events per node and hour, critical (1)\n"
+                "  --sf N --bw HZ --cr N --power DBM   modem settings (7, 125000, 5, 14)\n"
+                "  --implicit-header N  fixed frame length N (7..255) without the LoRa header\n"
+                "  --airtime            print time on air with and without the header, and of the\n"
+                "                       GFSK and SX1280 modes against LoRa, and exit\n"
+                "  --duty PCT           node duty cycle with --ack (1)\n"
+                "  --capture DB         same-SF capture threshold (6)\n"
+                "  --shadowing DB       log-normal shadowing per link (0)\n"
+                "  --path-loss DB M N   path loss at distance M and exponent N (31.2 1 3)\n"
+                "  --ack                acknowledged delivery with backlog and catch-up\n"
+                "  --lbt                listen before talk (CAD) with random backoff\n"
+                "  --batch N            send readings N at a time as catch-up frames\n"
+                "  --batch-wait S       longest a reading waits for its batch (interval)\n"
+                "  --adr                per-node SF by link margin, multi-SF gateway\n"
+                "  --adr-margin DB      link margin ADR keeps (10)\n"
+                "  --time-sync          stamp readings with network time\n"
+                "  --drift PPM          node crystals off by up to PPM, half that again daily (0)\n"
+                "  --frequency-correction nodes|receiver   correct carrier offsets at the bridge\n"
+                "  --loop-ms MS         bridge loop period (16)\n"
+                "  --seed N             random seed (1)\n"
+                "  --json               also print every metric as JSON\n"
+                "  --write-capture FILE write what the bridge receives for lora_replay\n"
+                "  --fuota BYTES        multicast a firmware image of BYTES to the nodes instead\n"
+                "  --fuota-loss PCT     nodes lose up to PCT of the update's frames (10)\n"
+                "  --fuota-redundancy PCT   repair fragments per block (40)\n"
+                "  --fuota-passes N     passes over the image (2)\n"
+                "  --verbose            log what the codec logs\n");
+    }
+
+    static bool parse(int argc, char **argv, Options &o)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            auto value = [&]() { return atof(argv[++i]); };
+            if (arg == "--ack")
+                o.ack = true;
+            else if (arg == "--lbt")
+                o.lbt = true;
+            else if (arg == "--adr")
+                o.adr = true;
+            else if (arg == "--time-sync")
+                o.time_sync = true;
+            else if (arg == "--json")
+                o.json = true;
+            else if (arg == "--airtime")
+                o.airtime = true;
+            else if (arg == "--verbose")
+                verbose = true;
+            else if (!has_value)
+                return false;
+            else if (arg == "--nodes")
+                o.nodes = value();
+            else if (arg == "--hours")
+                o.hours = value();
+            else if (arg == "--radius")
+                o.radius_m = value();
+            else if (arg == "--sensors")
+                o.sensors = value();
+            else if (arg == "--interval")
+                o.interval_s = value();
+            else if (arg == "--events")
+                o.events_per_hour = value();
+            else if (arg == "--sf")
+                o.modem.sf = value();
+            else if (arg == "--bw")
+                o.modem.bandwidth = value();
+            else if (arg == "--cr")
+                o.modem.coding = value();
+            else if (arg == "--implicit-header")
+                o.modem.implicit_header = value();
+            else if (arg == "--power")
+                o.power_dbm = value();
+            else if (arg == "--duty")
+                o.duty_cycle = value();
+            else if (arg == "--capture")
+                o.capture_db = value();
+            else if (arg == "--shadowing")
+                o.path_loss.shadowing_db = value();
+            else if (arg == "--path-loss" && i + 3 < argc)
+            {
+                o.path_loss.reference_db = value();
+                o.path_loss.reference_m = value();
+                o.path_loss.exponent = value();
+            }
+            else if (arg == "--batch")
+                o.batch = value();
+            else if (arg == "--batch-wait")
+                o.batch_wait_s = value();
+            else if (arg == "--adr-margin")
+                o.adr_margin_db = value();
+            else if (arg == "--loop-ms")
+                o.loop_ms = value();
+            else if (arg == "--seed")
+                o.seed = value();
+            else if (arg == "--write-capture")
+                o.capture_path = argv[++i];
+            else if (arg == "--drift")
+                o.drift_ppm = value();
+            else if (arg == "--fuota")
+                o.fuota_bytes = value();
+            else if (arg == "--fuota-loss")
+                o.fuota_loss = value();
+            else if (arg == "--fuota-redundancy")
+                o.fuota_redundancy = value();
+            else if (arg == "--fuota-passes")
+                o.fuota_passes = value();
+            else if (arg == "--frequency-correction")
+            {
+                std::string mode = argv[++i];
+                if (mode == "nodes")
+                    o.correction = CORRECTION_NODES;
+                else if (mode == "receiver")
+                    o.correction = CORRECTION_RECEIVER;
+                else
+                    return false;
+            }
+            else
+                return false;
+        }
+        return o.nodes > 0 && o.sensors >= 1 && o.sensors <= MAX_SENSORS && o.modem.sf >= 7 && o.modem.sf <= 12 &&
+               o.modem.coding >= 5 && o.modem.coding <= 8 && o.batch >= 1 && o.interval_s > 0 && o.duty_cycle > 0 &&
+               (o.modem.implicit_header == 0 || (o.modem.implicit_header >= MIN_IMPLICIT_HEADER && o.modem.implicit_header <= 255)) &&
+               o.fuota_passes >= 1 && o.fuota_passes <= 255 && o.fuota_redundancy >= 0 && o.fuota_loss >= 0 && o.fuota_loss <= 100;
+    }
+} // namespace lora_sim
+
+int main(int argc, char **argv)
+{
+    lora_sim::Options options;
+    if (!lora_sim::parse(argc, argv, options))
+    {
+        lora_sim::usage();
+        return 2;
+    }
+    if (options.airtime)
+    {
+        lora_sim::print_airtime(options);
+        lora_sim::print_modulation_airtime();
+        return 0;
+    }
+    if (options.fuota_bytes != 0)
+    {
+        lora_sim::run_fuota(options);
+        return 0;
+    }
+    auto start = std::chrono::steady_clock::now();
+    lora_sim::Simulator simulator(options);
+    simulator.run();
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    simulator.report(wall_s);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace lora_sim
+{
+    // Physical layer of the simulated channel: time on air, receiver sensitivity,
+    // path loss and what survives an overlap. Figures are for the SX127x/SX126x at
+    // 125 kHz and scale with the bandwidth.
+    struct ModemSettings
+    {
+        int sf{7};
+        long bandwidth{125000};
+        int coding{5}; // 4/coding
+        int preamble{8};
+        bool crc{true};
+        // fixed frame length on air in implicit header mode, 0 for explicit; frames carry
+        // a length byte and padding, as LoRaClass sends them
+        size_t implicit_header{0};
+        // FLRC (SX1280) and GFSK (SX126x/SX127x) run at bit_rate, in bits per second;
+        // only their time on air is modelled
+        enum Modulation
+        {
+            LORA,
+            FLRC,
+            GFSK,
+        } modulation{LORA};
+        long bit_rate{0};
+        int flrc_coding{3}; // 2 (1/2), 3 (3/4) or 4 (uncoded)
+
+        double symbol_us() const { return (double)(1L << this->sf) * 1e6 / this->bandwidth; }
+        bool low_data_rate() const { return this->symbol_us() > 16000.0; }
+        size_t max_frame() const
+        {
+            if (this->modulation == FLRC)
+                return 127;
+            return this->implicit_header != 0 ? this->implicit_header - 1 : 255;
+        }
+
+        // Semtech AN1200.13, the same formula RadioLib's getTimeOnAir() uses
+        uint32_t time_on_air(size_t len) const
+        {
+            // as LoRaClass counts them
+            if (this->modulation == FLRC)
+            {
+                // SX1280 packet format: 16 bits of preamble and 32 of sync word, then
+                // header, payload, CRC and tail at the coding rate
+                static const double RATES[] = {0.5, 0.75, 1.0};
+                double coded = (16 + 8.0 * len + 16 + 6) / RATES[this->flrc_coding - 2];
+                return (uint32_t)((16 + 32 + std::ceil(coded)) * 1e6 / this->bit_rate);
+            }
+            if (this->modulation == GFSK)
+            {
+                // preamble, sync word, length byte, payload, CRC
+                return (uint32_t)((16 + 32 + 8.0 * (1 + len + 2)) * 1e6 / this->bit_rate);
+            }
+            if (this->implicit_header != 0)
+                len = this->implicit_header;
+            double symbol = this->symbol_us();
+            int de = this->low_data_rate() ? 1 : 0;
+            double numerator = 8.0 * len - 4.0 * this->sf + 28 + (this->crc ? 16 : 0) - (this->implicit_header != 0 ? 20 : 0);
+            double payload_symbols = 8 + std::fmax(std::ceil(numerator / (4.0 * (this->sf - 2 * de))) * this->coding, 0.0);
+            return (uint32_t)((this->preamble + 4.25 + payload_symbols) * symbol);
+        }
+
+        // a receiver has locked on once all but the last few preamble symbols are in
+        uint32_t lock_us() const { return (uint32_t)((this->preamble - 5) * this->symbol_us()); }
+
+        // channel activity detection listens for about two symbols
+        uint32_t cad_us() const { return (uint32_t)(2 * this->symbol_us()); }
+    };
+
+    inline double sensitivity_dbm(int sf, long bandwidth)
+    {
+        static const double AT_125K[] = {-123.0, -126.0, -129.0, -132.0, -134.5, -137.0};
+        return AT_125K[sf - 7] + 10.0 * std::log10(bandwidth / 125000.0);
+    }
+
+    // Largest carrier offset between sender and receiver the demodulator still locks on
+    // to. The SX127x/SX126x take a quarter of the bandwidth; from SF11 at 125 kHz the
+    // symbols are long enough that the offset turns into timing drift as well. The halving
+    // per SF from SF11 is an assumption of this model, not a datasheet figure.
+    inline double frequency_tolerance_hz(int sf, long bandwidth)
+    {
+        double tolerance = bandwidth / 4.0;
+        for (int s = 11; s <= sf; s++)
+            tolerance /= 2;
+        return tolerance;
+    }
+
+    // thermal noise plus a 6 dB receiver noise figure, for the reported SNR
+    inline double noise_floor_dbm(long bandwidth) { return -174.0 + 10.0 * std::log10((double)bandwidth) + 6.0; }
+
+    // Minimum signal to interference ratio (dB) for a wanted packet at sf to survive an
+    // interferer at interferer_sf, from Croce et al., "Impact of LoRa Imperfect
+    // Orthogonality" (2018). Same-SF capture is a parameter instead, see capture_db.
+    inline double sir_threshold_db(int sf, int interferer_sf)
+    {
+        static const double MATRIX[6][6] = {
+            {0, -8, -9, -9, -9, -9},
+            {-11, 0, -11, -12, -13, -13},
+            {-15, -13, 0, -13, -14, -15},
+            {-19, -18, -17, 0, -17, -18},
+            {-22, -22, -21, -20, 0, -20},
+            {-25, -25, -25, -24, -23, 0},
+        };
+        return MATRIX[sf - 7][interferer_sf - 7];
+    }
+
+    // Log-distance path loss from free space at 1 m (868 MHz). The default exponent of
+    // 3 is a suburban link to a gateway on a roof, about 130 dB at 2 km. Bor et al., "Do
+    // LoRa Low-Power Wide-Area Networks Scale?" (2016) measured a far lossier site:
+    // 127.41 dB at 40 m with an exponent of 2.08.
+    struct PathLossModel
+    {
+        double reference_db{31.2};
+        double reference_m{1.0};
+        double exponent{3.0};
+        double shadowing_db{0.0}; // standard deviation, fixed per link
+
+        double loss_db(double distance_m, double shadowing) const
+        {
+            if (distance_m < 1.0)
+                distance_m = 1.0;
+            return this->reference_db + 10.0 * this->exponent * std::log10(distance_m / this->reference_m) +
+                   shadowing * this->shadowing_db;
+        }
+    };
+} // namespace lora_sim
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <utility>
+#include <vector>
+#include "radio_model.h"
+
+namespace lora_sim
+{
+    // Simulator bookkeeping that rides along with a frame but is not part of it: which
+    // node's reading it carries and when that reading was taken.
+    struct ReadingTag
+    {
+        uint32_t node;
+        uint32_t index;
+        int64_t taken_us;
+    };
+
+    struct Transmission
+    {
+        uint32_t id;
+        int sender;
+        int sf;
+        double power_dbm;
+        double offset_hz; // the sender's carrier from nominal
+        int64_t start_us;
+        int64_t lock_us; // from here on an overlap can corrupt it
+        int64_t end_us;
+        std::vector<uint8_t> data;
+        std::vector<ReadingTag> readings;
+    };
+
+    enum RxResult : uint8_t
+    {
+        RX_OK,
+        RX_WEAK,          // below the receiver's sensitivity
+        RX_COLLISION,     // an overlapping frame was too strong
+        RX_HALF_DUPLEX,   // the receiver was transmitting itself
+        RX_OTHER_SF,      // the receiver wasn't listening on that spreading factor
+        RX_OFF_FREQUENCY, // sender and receiver carriers too far apart
+        RX_RESULTS,
+    };
+
+    // The shared medium. Every site (nodes and the bridge) has a position; frames are
+    // kept while they can still overlap one that is being received.
+    class Channel
+    {
+    public:
+        Channel(const ModemSettings &modem, const PathLossModel &loss, double capture_db, uint64_t seed)
+            : modem_(modem), loss_(loss), capture_db_(capture_db), seed_(seed) {}
+
+        int add_site(double x, double y)
+        {
+            this->sites_.push_back({x, y, 0.0});
+            return this->sites_.size() - 1;
+        }
+        // where the site's radio is tuned, from nominal: crystal error and any correction
+        void set_offset(int site, double offset_hz) { this->sites_[site].offset_hz = offset_hz; }
+        // the frequency error a receiver measures on the frame, positive when the
+        // sender is above it
+        double frequency_error(const Transmission &tx, int receiver) const { return tx.offset_hz - this->sites_[receiver].offset_hz; }
+        double distance(int a, int b) const { return std::hypot(this->sites_[a].x - this->sites_[b].x, this->sites_[a].y - this->sites_[b].y); }
+        double path_loss(int a, int b) const { return this->loss_.loss_db(this->distance(a, b), this->shadowing_(a, b)); }
+
+        int64_t now() const { return this->now_us_; }
+        void advance(int64_t now_us)
+        {
+            this->now_us_ = now_us;
+            // nothing on air longer than the longest frame so far can still overlap
+            while (!this->air_.empty() && this->air_.front().end_us + 2 * this->longest_us_ < now_us)
+                this->air_.pop_front();
+        }
+
+        const Transmission &start(int sender, int sf, double power_dbm, const uint8_t *data, size_t len, std::vector<ReadingTag> &&readings)
+        {
+            ModemSettings modem = this->modem_;
+            modem.sf = sf;
+            Transmission tx;
+            tx.id = ++this->last_id_;
+            tx.sender = sender;
+            tx.sf = sf;
+            tx.power_dbm = power_dbm;
+            tx.offset_hz = this->sites_[sender].offset_hz;
+            tx.start_us = this->now_us_;
+            tx.lock_us = tx.start_us + modem.lock_us();
+            tx.end_us = tx.start_us + modem.time_on_air(len);
+            tx.data.assign(data, data + len);
+            tx.readings = std::move(readings);
+            if (tx.end_us - tx.start_us > this->longest_us_)
+                this->longest_us_ = tx.end_us - tx.start_us;
+            this->airtime_us_ += tx.end_us - tx.start_us;
+            this->air_.push_back(std::move(tx));
+            return this->air_.back();
+        }
+
+        const Transmission *find(uint32_t id) const
+        {
+            for (auto &tx : this->air_)
+            {
+                if (tx.id == id)
+                    return &tx;
+            }
+            return nullptr;
+        }
+
+        // Called once the frame has ended. A receiver listening on one spreading factor
+        // passes it; a multi-SF gateway passes 0.
+        RxResult receive(const Transmission &tx, int receiver, int receiver_sf, double *rssi, double *snr) const
+        {
+            if (receiver_sf != 0 && receiver_sf != tx.sf)
+                return RX_OTHER_SF;
+            double power = tx.power_dbm - this->path_loss(tx.sender, receiver);
+            if (power < sensitivity_dbm(tx.sf, this->modem_.bandwidth))
+                return RX_WEAK;
+            if (std::fabs(this->frequency_error(tx, receiver)) > frequency_tolerance_hz(tx.sf, this->modem_.bandwidth))
+                return RX_OFF_FREQUENCY;
+            for (auto &other : this->air_)
+            {
+                if (other.id == tx.id || other.end_us <= tx.start_us || other.start_us >= tx.end_us)
+                    continue;
+                if (other.sender == receiver)
+                    return RX_HALF_DUPLEX;
+                // once locked, a frame that is over before the lock point doesn't matter
+                if (other.end_us <= tx.lock_us)
+                    continue;
+                double interference = other.power_dbm - this->path_loss(other.sender, receiver);
+                double threshold = other.sf == tx.sf ? this->capture_db_ : sir_threshold_db(tx.sf, other.sf);
+                if (power - interference < threshold)
+                    return RX_COLLISION;
+            }
+            *rssi = power;
+            *snr = power - noise_floor_dbm(this->modem_.bandwidth);
+            return RX_OK;
+        }
+
+        // channel activity detection: a preamble or payload at sf the listener can hear
+        bool busy(int listener, int sf) const
+        {
+            for (auto &other : this->air_)
+            {
+                if (other.sf != sf || other.sender == listener || other.start_us > this->now_us_ || other.end_us <= this->now_us_)
+                    continue;
+                if (other.power_dbm - this->path_loss(other.sender, listener) >= sensitivity_dbm(sf, this->modem_.bandwidth))
+                    return true;
+            }
+            return false;
+        }
+
+        const ModemSettings &modem() const { return this->modem_; }
+        int64_t airtime_us() const { return this->airtime_us_; }
+
+    protected:
+        struct Site
+        {
+            double x;
+            double y;
+            double offset_hz;
+        };
+
+        // fixed per link and the same both ways, standard normal
+        double shadowing_(int a, int b) const
+        {
+            if (this->loss_.shadowing_db == 0.0)
+                return 0.0;
+            if (a > b)
+                std::swap(a, b);
+            uint64_t state = this->seed_ ^ ((uint64_t)a << 32 | (uint32_t)b);
+            // Box-Muller over two splitmix64 draws
+            double u1 = ((splitmix64(state) >> 11) + 0.5) / 9007199254740992.0;
+            double u2 = (splitmix64(state) >> 11) / 9007199254740992.0;
+            return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+        }
+        static uint64_t splitmix64(uint64_t &state)
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        ModemSettings modem_;
+        PathLossModel loss_;
+        double capture_db_;
+        uint64_t seed_;
+        std::vector<Site> sites_;
+        std::list<Transmission> air_;
+        int64_t now_us_{0};
+        int64_t longest_us_{0};
+        int64_t airtime_us_{0};
+        uint32_t last_id_{0};
+    };
+
+    // The slice of LoRaClass the node and bridge code uses, backed by the channel.
+    // Frames go on air at the channel's current time; reception is decided by the
+    // simulator when a frame ends and handed over with deliver().
+    class VirtualRadio
+    {
+    public:
+        VirtualRadio(Channel *channel, int site) : channel_(channel), site_(site) {}
+
+        void setSpreadingFactor(int sf) { this->sf_ = sf; }
+        void setTxPower(int level) { this->power_dbm_ = level; }
+        // simulator only: the carrier offset from nominal, where LoRaClass::setFrequency()
+        // would tune to the nominal frequency plus the correction
+        void setFrequencyOffset(double offset_hz) { this->channel_->set_offset(this->site_, offset_hz); }
+        int getSpreadingFactor() const { return this->sf_; }
+        int site() const { return this->site_; }
+
+        uint32_t timeOnAir(size_t len) const
+        {
+            ModemSettings modem = this->channel_->modem();
+            modem.sf = this->sf_;
+            return modem.time_on_air(len);
+        }
+
+        size_t maxPacketLength() const { return this->channel_->modem().max_frame(); }
+
+        int beginPacket(int /*implicitHeader*/ = false)
+        {
+            this->tx_len_ = 0;
+            this->tags_.clear();
+            return 1;
+        }
+        size_t write(uint8_t byte) { return this->write(&byte, 1); }
+        size_t write(const uint8_t *buffer, size_t size)
+        {
+            if (this->tx_len_ + size > this->maxPacketLength())
+                size = this->maxPacketLength() - this->tx_len_;
+            memcpy(this->tx_buffer_ + this->tx_len_, buffer, size);
+            this->tx_len_ += size;
+            return size;
+        }
+        // simulator only: the readings the packet being built carries
+        void tag(const ReadingTag &reading) { this->tags_.push_back(reading); }
+        // always async: the frame is on air until txEnd()
+        int endPacket(bool /*async*/ = true)
+        {
+            const Transmission &tx = this->channel_->start(this->site_, this->sf_, this->power_dbm_, this->tx_buffer_, this->tx_len_, std::move(this->tags_));
+            this->tags_.clear();
+            this->tx_id_ = tx.id;
+            this->tx_end_us_ = tx.end_us;
+            return 1;
+        }
+        uint32_t txId() const { return this->tx_id_; }
+        int64_t txEnd() const { return this->tx_end_us_; }
+        bool isTransmitting() const { return this->tx_end_us_ > this->channel_->now(); }
+
+        bool channelActivityDetection() const { return this->channel_->busy(this->site_, this->sf_); }
+
+        // copied like the driver copies the FIFO, the frame may be pruned before it is read
+        void deliver(const Transmission &tx, double rssi, double snr, double frequency_error)
+        {
+            this->frequency_error_ = frequency_error;
+            this->rx_.assign(tx.data.begin(), tx.data.end());
+            this->rx_tags_ = tx.readings;
+            this->rx_index_ = 0;
+            this->rssi_ = rssi;
+            this->snr_ = snr;
+        }
+        int parsePacket() const { return this->rx_.size(); }
+        int available() const { return this->rx_.size() - this->rx_index_; }
+        int read() { return this->available() ? this->rx_[this->rx_index_++] : -1; }
+        // simulator only: the readings the last received packet carried
+        const std::vector<ReadingTag> &packetTags() const { return this->rx_tags_; }
+        int packetRssi() const { return (int)std::lround(this->rssi_); }
+        float packetSnr() const { return this->snr_; }
+        long packetFrequencyError() const { return std::lround(this->frequency_error_); }
+
+    protected:
+        Channel *channel_;
+        int site_;
+        int sf_{7};
+        double power_dbm_{14};
+        uint8_t tx_buffer_[256];
+        size_t tx_len_{0};
+        std::vector<ReadingTag> tags_;
+        uint32_t tx_id_{0};
+        int64_t tx_end_us_{0};
+        std::vector<uint8_t> rx_;
+        std::vector<ReadingTag> rx_tags_;
+        size_t rx_index_{0};
+        double rssi_{0};
+        double snr_{0};
+        double frequency_error_{0};
+    };
+} // namespace lora_sim